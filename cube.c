@@ -53,6 +53,23 @@
 #if !defined(WIN32)
 #include <GL/glx.h>
 
+#if defined(VK_USE_PLATFORM_DISPLAY_KHR)
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <dirent.h>
+#include <drm_fourcc.h>
+
+#ifndef DRM_FORMAT_ABGR16161616F
+#define DRM_FORMAT_ABGR16161616F fourcc_code('A', 'B', '4', 'H')
+#endif
+
+// From GL_OES_EGL_image and GL_EXT_EGL_image_storage, which our GLEW doesn't know:
+typedef void (*PFNGLEGLIMAGETARGETTEXTURE2DOESPROC) (GLenum target, void *image);
+typedef void (*PFNGLEGLIMAGETARGETTEXSTORAGEEXTPROC) (GLenum target, void *image, const GLint* attrib_list);
+#endif
+
 #if defined(VK_USE_PLATFORM_XLIB_KHR) || defined(VK_USE_PLATFORM_XCB_KHR) || defined(VK_USE_PLATFORM_XLIB_XRANDR_EXT)
 typedef Bool ( * PFNGLXGETSYNCVALUESOMLPROC) (Display* dpy, GLXDrawable drawable, int64_t* ust, int64_t* msc, int64_t* sbc);
 PFNGLXGETSYNCVALUESOMLPROC glXGetSyncValuesOML = NULL;
@@ -88,6 +105,10 @@ PFNGLXGETSYNCVALUESOMLPROC glXGetSyncValuesOML = NULL;
 #include "linmath.h"
 
 #include "gettime.h"
+#include "hdrtransfer.h"
+#include "edid.h"
+#include "ppm.h"
+#include "ktx.h"
 #include "inttypes.h"
 #define MILLION 1000000L
 #define BILLION 1000000000L
@@ -99,6 +120,46 @@ PFNGLXGETSYNCVALUESOMLPROC glXGetSyncValuesOML = NULL;
 // Allow a maximum of two outstanding presentation operations.
 #define FRAME_LAG 1
 
+// Number of stimulus images the threaded OpenGL client can queue up for Vulkan.
+#define GL_SLOT_COUNT 3
+
+// Maximum number of slots of the upload ring, ie. of texture uploads in flight, or
+// movie frames decoded ahead, and number of movie reader threads, each decoding
+// every MOVIE_THREAD_COUNT'th frame:
+#define UPLOAD_SLOT_COUNT 6
+#define MOVIE_THREAD_COUNT 3
+
+// Encoding of linear nits into PQ or HLG in the OpenGL HDR post-processing shader:
+#define HDR_ENCODE_EXACT 0      // Evaluate the transfer function per pixel.
+#define HDR_ENCODE_LUT   1      // Linearly filtered 1D LUT texture.
+#define HDR_ENCODE_POLY  2      // Piecewise cubic polynomial.
+#define HDR_LUT_SIZE 4096       // LUT entries, log spaced over the input range.
+#define HDR_LUT_KNEE 0.0001     // Nits below which the log spacing turns linear, so 0 nits is included.
+#define HDR_POLY_SEGMENTS 64    // Number of cubic segments, uniformly spaced in the same log domain.
+#define HDR_ENCODE_NONE  3      // Leave linear nits, for encoding by the Vulkan side pass.
+
+// Gamut mapping of BT.2020 content to the display's native primaries in the same pass:
+#define HDR_GAMUT_OFF    0      // Send BT.2020 unchanged.
+#define HDR_GAMUT_CLIP   1      // 3x3 matrix, out of gamut components clipped to zero.
+#define HDR_GAMUT_SOFT   2      // 3x3 matrix, saturation softly compressed into the gamut.
+#define HDR_GAMUT_KNEE   0.8    // Relative saturation above which HDR_GAMUT_SOFT starts to compress.
+
+// Spatiotemporal blue noise dither of the encoded output, before quantization to 8 or 10 bits:
+#define HDR_DITHER_SIZE   64    // Width and height of the tiled blue noise texture.
+#define HDR_DITHER_FRAMES 64    // Period of the per frame noise offsets.
+
+// Output transfer function of the Vulkan side pass, one prebuilt pipeline each, see cube.frag:
+#define OUTPUT_TF_NONE   0      // Pass-through, OpenGL already encoded.
+#define OUTPUT_TF_PQ     1      // ST-2084 PQ.
+#define OUTPUT_TF_HLG    2      // HLG.
+#define OUTPUT_TF_LINEAR 3      // Linear, 1.0 = 80 nits, e.g., scRGB.
+#define OUTPUT_TF_SRGB   4      // sRGB.
+#define OUTPUT_TF_COUNT  5
+
+// Per frame MaxCLL / MaxFALL measurement by compute shader, see cube-lightlevel.comp:
+#define LIGHTLEVEL_TILE 16          // Workgroup width and height, each workgroup yields one partial result.
+#define LIGHTLEVEL_THRESHOLD 0.05   // Relative change of MaxCLL or MaxFALL which triggers new HDR metadata.
+
 #define ARRAY_SIZE(a) (sizeof(a) / sizeof(a[0]))
 
 #if defined(NDEBUG) && defined(__GNUC__)
@@ -183,6 +244,56 @@ static PFN_vkGetDeviceProcAddr g_gdpa = NULL;
         }                                                                                                        \
     }
 
+// MK: Device memory sub-allocator. All resources which are not exported to OpenGL share a few
+// large blocks of device memory, instead of one vkAllocateMemory() each, which is slow, and
+// limited to maxMemoryAllocationCount allocations. Requests larger than half a block get a
+// block of their own, which is freed with them. Other blocks stay for reuse, e.g., after
+// a resize, until demo_cleanup():
+#define MEMORY_BLOCK_SIZE (32 * 1024 * 1024)
+#define MEMORY_BLOCK_COUNT 64
+#define MEMORY_RANGE_COUNT 64
+
+// With a bufferImageGranularity > 1, linear resources (buffers, linear images) and optimal tiled
+// images must not share a page, so each block only holds one of both kinds:
+enum { MEMORY_TILING_ANY = 0, MEMORY_TILING_LINEAR = 1, MEMORY_TILING_OPTIMAL = 2 };
+
+struct memory_range {
+    VkDeviceSize offset;
+    VkDeviceSize size;
+};
+
+// One sub-allocation, to bind with vkBind*Memory(mem, offset):
+struct memory_alloc {
+    VkDeviceMemory mem;  // Of its block, VK_NULL_HANDLE if not allocated.
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    void *data;          // Host pointer between demo_memory_map() and demo_memory_unmap().
+    uint32_t block;
+};
+
+struct memory_block {
+    VkDeviceMemory mem;  // VK_NULL_HANDLE if unused.
+    VkDeviceSize size;
+    uint32_t type;       // Memory type index.
+    int tiling;          // MEMORY_TILING_* of its resources.
+    bool single;         // Own block of a large request, freed with it.
+    uint8_t *data;       // Mapped while map_count > 0.
+    uint32_t map_count;  // Mapped sub-allocations, as a VkDeviceMemory can only be mapped once.
+    uint32_t alloc_count;
+
+    // Free ranges, sorted by offset and coalesced. If they run out, the smallest
+    // gaps are lost until the block is empty again:
+    uint32_t range_count;
+    struct memory_range ranges[MEMORY_RANGE_COUNT];
+};
+
+struct memory_allocator {
+    struct memory_block blocks[MEMORY_BLOCK_COUNT];
+    uint32_t alloc_count;    // Live sub-allocations.
+    uint32_t alloc_total;    // Sub-allocations made so far.
+    uint32_t vk_allocs;      // vkAllocateMemory() calls made so far.
+};
+
 /*
  * structure to track all objects related to a texture.
  */
@@ -193,115 +304,18 @@ struct texture_object {
     VkImageLayout imageLayout;
 
     VkMemoryAllocateInfo mem_alloc;
-    VkDeviceMemory mem;
+    VkDeviceMemory mem;          // Own allocation if exported to OpenGL.
+    struct memory_alloc alloc;   // Otherwise a sub-allocation.
     VkImageView view;
     int32_t tex_width, tex_height;
+    VkFormat format;
+    uint32_t mip_levels;
 };
 
 static char *tex_files[] = {"jesse.ppm"};
 
 static int validation_error = 0;
 
-struct vktexcube_vs_uniform {
-    // Must start with MVP
-    float mvp[4][4];
-    float position[12 * 3][4];
-    float attr[12 * 3][4];
-};
-
-//--------------------------------------------------------------------------------------
-// Mesh and VertexFormat Data
-//--------------------------------------------------------------------------------------
-// clang-format off
-static const float g_vertex_buffer_data[] = {
-    -1.0f, 1.0f, 0.0f,  // +Z side
-    -1.0f,-1.0f, 0.0f,
-     1.0f, 1.0f, 0.0f,
-    -1.0f,-1.0f, 0.0f,
-     1.0f,-1.0f, 0.0f,
-     1.0f, 1.0f, 0.0f,
-
-    -1.0f,-1.0f,-1.0f,  // -X side
-    -1.0f,-1.0f, 1.0f,
-    -1.0f, 1.0f, 1.0f,
-    -1.0f, 1.0f, 1.0f,
-    -1.0f, 1.0f,-1.0f,
-    -1.0f,-1.0f,-1.0f,
-
-    -1.0f,-1.0f,-1.0f,  // -Z side
-     1.0f, 1.0f,-1.0f,
-     1.0f,-1.0f,-1.0f,
-    -1.0f,-1.0f,-1.0f,
-    -1.0f, 1.0f,-1.0f,
-     1.0f, 1.0f,-1.0f,
-
-    -1.0f,-1.0f,-1.0f,  // -Y side
-     1.0f,-1.0f,-1.0f,
-     1.0f,-1.0f, 1.0f,
-    -1.0f,-1.0f,-1.0f,
-     1.0f,-1.0f, 1.0f,
-    -1.0f,-1.0f, 1.0f,
-
-    -1.0f, 1.0f,-1.0f,  // +Y side
-    -1.0f, 1.0f, 1.0f,
-     1.0f, 1.0f, 1.0f,
-    -1.0f, 1.0f,-1.0f,
-     1.0f, 1.0f, 1.0f,
-     1.0f, 1.0f,-1.0f,
-
-     1.0f, 1.0f,-1.0f,  // +X side
-     1.0f, 1.0f, 1.0f,
-     1.0f,-1.0f, 1.0f,
-     1.0f,-1.0f, 1.0f,
-     1.0f,-1.0f,-1.0f,
-     1.0f, 1.0f,-1.0f,
-};
-
-static const float g_uv_buffer_data[] = {
-    0.0f, 0.0f,  // +Z side
-    0.0f, 1.0f,
-    1.0f, 0.0f,
-    0.0f, 1.0f,
-    1.0f, 1.0f,
-    1.0f, 0.0f,
-
-    0.0f, 1.0f,  // -X side
-    1.0f, 1.0f,
-    1.0f, 0.0f,
-    1.0f, 0.0f,
-    0.0f, 0.0f,
-    0.0f, 1.0f,
-
-    1.0f, 1.0f,  // -Z side
-    0.0f, 0.0f,
-    0.0f, 1.0f,
-    1.0f, 1.0f,
-    1.0f, 0.0f,
-    0.0f, 0.0f,
-
-    1.0f, 0.0f,  // -Y side
-    1.0f, 1.0f,
-    0.0f, 1.0f,
-    1.0f, 0.0f,
-    0.0f, 1.0f,
-    0.0f, 0.0f,
-
-    1.0f, 0.0f,  // +Y side
-    0.0f, 0.0f,
-    0.0f, 1.0f,
-    1.0f, 0.0f,
-    0.0f, 1.0f,
-    1.0f, 1.0f,
-
-    1.0f, 0.0f,  // +X side
-    0.0f, 0.0f,
-    0.0f, 1.0f,
-    0.0f, 1.0f,
-    1.0f, 1.0f,
-    1.0f, 0.0f,
-};
-// clang-format on
-
 void dumpMatrix(const char *note, mat4x4 MVP) {
     int i;
 
@@ -337,10 +351,14 @@ typedef struct {
     VkCommandBuffer cmd;
     VkCommandBuffer graphics_to_present_cmd;
     VkImageView view;
-    VkBuffer uniform_buffer;
-    VkDeviceMemory uniform_memory;
     VkFramebuffer framebuffer;
-    VkDescriptorSet descriptor_set;
+    VkDescriptorSet convert_descriptor_set;
+    VkDescriptorSet lightlevel_descriptor_set;
+    VkBuffer lightlevel_buffer;        // Per workgroup max and sum of max(R, G, B) in nits.
+    struct memory_alloc lightlevel_alloc;
+    float *lightlevel_data;            // Persistently mapped lightlevel_alloc.
+    bool lightlevel_pending;           // Results of a submitted frame are waiting for readback.
+    VkFence lightlevel_fence;          // Signals when the frame that wrote lightlevel_buffer completed.
 } SwapchainImageResources;
 
 #if defined(VK_USE_PLATFORM_WIN32_KHR)
@@ -357,6 +375,59 @@ typedef struct _ShareHandles {
 } ShareHandles;
 #endif
 
+#if defined(VK_USE_PLATFORM_DISPLAY_KHR)
+enum { GLSLOT_FREE = 0, GLSLOT_READY = 1 };
+
+// MK: One stimulus image of the threaded OpenGL client. Ownership moves between
+// client thread and Vulkan thread via 'state', GPU side ordering via 'fence',
+// which is always created by the side that last used 'texture'. Content light
+// levels the client set for this image travel along with it:
+struct gl_slot {
+    GLuint texture;     // RGBA16F stimulus image, shared between both contexts.
+    GLuint fbo;         // Client thread fbo for texture, as fbo's are not shared.
+    GLsync fence;
+    atomic_int state;   // GLSLOT_FREE = Owned by client thread, GLSLOT_READY = Owned by Vulkan thread.
+    bool hdr_update;    // setHdrMetadata() was called for this image with maxL and avgL.
+    float maxL;
+    float avgL;
+};
+#endif
+
+enum { UPLOADSLOT_FREE = 0, UPLOADSLOT_READY = 1, UPLOADSLOT_UPLOADING = 2 };
+
+// MK: One slot of the upload ring, holding the pixels of one texture upload until
+// vkCmdCopyBufferToImage() is done with them, ie. until 'fence' signals. During movie
+// playback, frame n always goes to slot n % UPLOAD_SLOT_COUNT, reader threads own FREE
+// slots, the Vulkan thread READY slots, hence 'state' is atomic there:
+struct upload_slot {
+    VkDeviceSize offset; // Of the slot in the ring buffer.
+    void *data;          // Mapped for the lifetime of the ring.
+    VkCommandBuffer cmd;
+    VkFence fence;
+    int32_t width;       // Size of the image in the slot, 0 if it failed to decode.
+    int32_t height;
+    int64_t frame;       // Movie frame index, its scheduled onset is movie_t0 + frame * movie_period.
+    uint64_t decode_ns;  // Time to read and decode the movie frame.
+#if defined(VK_USE_PLATFORM_DISPLAY_KHR)
+    atomic_int state;
+#else
+    int state;
+#endif
+};
+
+// One persistently mapped, host coherent buffer, divided into equal slots, which all
+// texture uploads go through, at startup and at runtime:
+struct upload_ring {
+    VkBuffer buffer;
+    struct memory_alloc alloc;
+    uint8_t *data;
+    VkDeviceSize slot_size;
+    uint32_t slot_count;
+    uint32_t next;       // Next slot for demo_upload_acquire().
+    VkCommandPool cmd_pool;
+    struct upload_slot slots[UPLOAD_SLOT_COUNT];
+};
+
 struct demo {
 #if defined(VK_USE_PLATFORM_WIN32_KHR)
 #define APP_NAME_STR_LEN 80
@@ -379,6 +450,52 @@ struct demo {
     GLXDrawable drawable;
     xcb_intern_atom_reply_t *atom_wm_delete_window;
     bool leasedAlready;
+#if defined(VK_USE_PLATFORM_DISPLAY_KHR)
+    bool use_egl;             // Use a windowless EGL context for OpenGL instead of GLX.
+    EGLDisplay egl_display;
+    EGLContext egl_context;
+    EGLSurface egl_surface;   // Dummy 1x1 pbuffer if EGL_KHR_surfaceless_context is unsupported.
+    EGLConfig egl_config;
+
+    // Threaded OpenGL client rendering:
+    bool use_glthread;
+    pthread_t glthread;
+    atomic_bool glthread_quit;
+    bool glthread_running;    // Set before the client thread starts, so setHdrMetadata() defers to its slot.
+    pthread_mutex_t glthread_mutex;
+    pthread_cond_t glthread_cond; // Signalled when a slot becomes free, or on quit.
+    GLXContext glthread_context;
+    EGLContext glthread_egl_context;
+    EGLSurface glthread_egl_surface;
+    struct gl_slot glslots[GL_SLOT_COUNT];
+    uint32_t glslot_read;     // Only touched by the Vulkan thread.
+    uint32_t glslot_write;    // Only touched by the client thread.
+    int32_t glthread_frame;   // Only touched by the client thread.
+    bool glthread_hdr_update; // Only touched by the client thread, setHdrMetadata() for the current slot.
+    float glthread_maxL;
+    float glthread_avgL;
+
+    // Movie playback of an image sequence, decoded ahead by reader threads:
+    char movie_path[256];     // Directory of PPM frames, or a file of concatenated PPM frames.
+    double movie_fps;         // Target frame rate, 0 = one frame per flip.
+    pthread_t moviethreads[MOVIE_THREAD_COUNT];
+    int moviethread_count;
+    atomic_bool moviethread_quit;
+    atomic_int moviethread_next;
+    char **movie_files;       // Sorted frame files of a directory, or NULL.
+    struct ppm_image movie_container;
+    bool movie_container_open;      // movie_container needs a ppm_close().
+    struct ppm_image *movie_frames; // Headers of all frames in movie_container, or NULL.
+    int movie_frame_count;
+    int64_t movie_next;       // Next frame to show, in slot movie_next % UPLOAD_SLOT_COUNT.
+    int64_t movie_pending;    // Frame presented last, whose onset isn't known yet, or -1.
+    uint64_t movie_t0;        // Scheduled onset of frame 0, 0 = not started yet.
+    uint64_t movie_period;    // Nanoseconds between frame onsets.
+    uint64_t movie_ifi;       // Estimated flip interval.
+    uint64_t movie_decode_max;
+    int movie_flips;
+    int movie_shown, movie_late, movie_dropped, movie_starved;
+#endif
 #elif defined(VK_USE_PLATFORM_WAYLAND_KHR)
     struct wl_display *display;
     struct wl_registry *registry;
@@ -396,6 +513,7 @@ struct demo {
     VkSurfaceKHR surface;
 //    VkKmsDisplayInfoKEITHP display_info;
     bool prepared;
+    bool recreate_swapchain;           // demo_resize() for a new colorspace, also in direct display mode.
     bool use_staging_buffer;
     bool separate_present_queue;
 
@@ -454,17 +572,63 @@ struct demo {
 #endif
     // MK OpenGL -> Vulkan interop stuff:
     PFN_vkGetMemoryFdKHR fpGetMemoryFdKHR;
+    PFN_vkGetImageMemoryRequirements2KHR fpGetImageMemoryRequirements2KHR;
+    PFN_vkGetSemaphoreFdKHR fpGetSemaphoreFdKHR;
+    VkSemaphore interop_gl_complete; // Signalled by OpenGL when the interop image is ready for Vulkan.
+    VkSemaphore interop_gl_ready;    // Signalled by Vulkan when it is done with the interop image.
+    VkBool32 interop_semaphores;     // Semaphores imported, so OpenGL and Vulkan sync via them.
+    VkBool32 interop_gl_signalled;   // OpenGL signalled interop_gl_complete for the next submit.
+    VkBool32 interop_vk_signalled;   // Vulkan signalled interop_gl_ready, OpenGL must wait for it.
+    VkBool32 dedicatedallocationExtFound;
+    VkBool32 interop_dedicated;
+    VkBool32 reuse_textures; // Keep the same-sized interop image across demo_resize().
+    VkBool32 reuse_pipelines; // Keep all pipelines across demo_resize().
+
+    // MK DMA-BUF interop with DRM format modifiers:
+    VkBool32 use_dmabuf;
+    uint64_t dmabuf_modifier;        // DRM format modifier the driver chose for the interop image.
+    uint32_t dmabuf_plane_count;     // Number of memory planes, e.g., 2 for compression metadata.
+    VkSubresourceLayout dmabuf_planes[4];
+    PFN_vkGetPhysicalDeviceFormatProperties2KHR fpGetPhysicalDeviceFormatProperties2KHR;
+    PFN_vkGetPhysicalDeviceImageFormatProperties2KHR fpGetPhysicalDeviceImageFormatProperties2KHR;
+    PFN_vkGetImageDrmFormatModifierPropertiesEXT fpGetImageDrmFormatModifierPropertiesEXT;
     VkFormat interop_tex_format;
     VkBool32 interop_tiled_texture;
     VkBool32 interop_enabled;
     VkBool32 timestamping_enabled;
     VkBool32 use_blit;
 
+    // MK Compute shader format conversion for interop -> swapchain transfer:
+    VkBool32 use_compute_convert;
+    VkBool32 storage_write_without_format; // Device supports shaderStorageImageWriteWithoutFormat.
+    uint32_t convert_tile[2];              // Workgroup size override from --convert-tile, 0 = per format default.
+    VkDescriptorSetLayout convert_desc_layout;
+    VkPipelineLayout convert_pipeline_layout;
+    VkPipeline convert_pipeline;
+    VkDescriptorPool convert_desc_pool;
+    bool use_lightlevel;               // Measure MaxCLL and MaxFALL per frame on the gpu, --no-lightlevel disables.
+    VkDescriptorSetLayout lightlevel_desc_layout;
+    VkPipelineLayout lightlevel_pipeline_layout;
+    VkPipeline lightlevel_pipeline;
+    VkDescriptorPool lightlevel_desc_pool;
+    uint32_t lightlevel_groups[2];     // Workgroups in x and y.
+    float maxcll, maxfall;             // Last values sent via vkSetHdrMetadataEXT.
+
     // MK HDR stuff:
     VkBool32 hdr_enabled;
     VkBool32 local_dimming_enabled;
     VkBool32 amddisplaynativehdrExtFound;
     VkHdrMetadataEXT nativeDisplayHdrMetadata;
+    float hdr_maxL, hdr_avgL;          // Last demo_send_hdr_metadata() arguments, for a new swapchain.
+    struct edid_info edid;             // Parsed EDID of the display, valid if edid_len > 0.
+    uint8_t edid_data[EDID_MAX_SIZE];
+    size_t edid_len;
+    char edid_path[256];               // EDID file from --edid, instead of sysfs or RandR.
+    char image_path[256];              // HDR stimulus image for test pattern 7, from --image.
+    char texture_path[256];            // Texture instead of jesse.ppm, from --texture.
+    bool use_ktx;                      // texture_path is a KTX2 file with block compressed mip levels.
+    bool use_movie;                    // Play an image sequence instead of OpenGL client rendering.
+    bool edid_test;
     PFN_vkSetHdrMetadataEXT fpSetHdrMetadataEXT;
     PFN_vkSetLocalDimmingAMD fpSetLocalDimmingAMD;
 
@@ -476,9 +640,28 @@ struct demo {
     GLuint dstfbo; // Destination fbo to which Vulkan backing memory is attached.
     GLuint srcfbo; // Source fbo into which our simulated renderer renders.
     GLuint hdr_shader; // HDR post-processing shader for EOTF application etc.
+    int hdr_encode;    // HDR_ENCODE_EXACT, HDR_ENCODE_LUT, HDR_ENCODE_POLY or HDR_ENCODE_NONE.
+    bool hdr_encode_accuracy; // Report max code value error of all encodings at startup.
+    bool verify;              // Headless golden image test of all test patterns, see demo_verify().
+    bool verify_allow_skip;   // demo_verify() passes without a Vulkan device, instead of failing.
+    GLuint hdr_lut;    // 1D LUT texture for HDR_ENCODE_LUT.
+    float hdr_poly[HDR_POLY_SEGMENTS][4]; // Cubic coefficients per segment for HDR_ENCODE_POLY.
+    int gamut_map;           // HDR_GAMUT_xxx, -1 = HDR_GAMUT_SOFT on display native colorspace, off otherwise.
+    float gamut_matrix[9];   // BT.2020 to native RGB, column major for glUniformMatrix3fv().
+    float gamut_luma[3];     // Luminance weights of the native primaries.
+    bool use_tonemap;        // Tone map content above panel peak with the BT.2390 EETF during PQ encoding.
+    bool eetf_dirty;         // eetf[] changed, upload before next use of hdr_shader.
+    float eetf[4];           // EETF parameters in PQ: Source peak, knee start, target peak and black, see demo_update_eetf().
+    bool use_dither;         // Blue noise dither the encoded output to the bit depth of the output.
+    int dither_levels;       // Highest code value of the dithered output, 0 = no dithering.
+    GLuint dither_noise;     // HDR_DITHER_SIZE^2 blue noise texture.
+    GLint dither_frame_loc;  // Location of the DitherFrame uniform.
     GLuint vao;
     GLuint program;
     GLuint mem;
+#if defined(VK_USE_PLATFORM_DISPLAY_KHR)
+    EGLImageKHR egl_image; // EGLImage for the DMA-BUF interop image.
+#endif
 
     // MK stuff for test patterns and colors:
     int testpattern;    // Id of test pattern to show.
@@ -509,24 +692,18 @@ struct demo {
     VkCommandPool cmd_pool;
     VkCommandPool present_cmd_pool;
 
-    struct {
-        VkFormat format;
-
-        VkImage image;
-        VkMemoryAllocateInfo mem_alloc;
-        VkDeviceMemory mem;
-        VkImageView view;
-    } depth;
-
     struct texture_object textures[DEMO_TEXTURE_COUNT];
-    struct texture_object staging_texture;
+    struct upload_ring upload;
+    struct memory_allocator memory;
 
     VkCommandBuffer cmd;  // Buffer for initialization commands
     VkPipelineLayout pipeline_layout;
     VkDescriptorSetLayout desc_layout;
     VkPipelineCache pipelineCache;
     VkRenderPass render_pass;
-    VkPipeline pipeline;
+    VkPipeline pipeline;  // Currently used one of tf_pipelines[].
+    VkPipeline tf_pipelines[OUTPUT_TF_COUNT];
+    int output_tf;        // OUTPUT_TF_xxx of the Vulkan side pass, -1 = auto select by colorspace.
 
     mat4x4 projection_matrix;
     mat4x4 view_matrix;
@@ -540,9 +717,11 @@ struct demo {
     VkShaderModule frag_shader_module;
 
     VkDescriptorPool desc_pool;
+    VkDescriptorSet descriptor_set;
 
     bool quit;
     int32_t curFrame;
+    int32_t clientFrame;  // Frame counter for the animations of the OpenGL client.
     int32_t frameCount;
     bool validate;
     bool validate_checks_disabled;
@@ -668,8 +847,10 @@ bool CanPresentEarlier(uint64_t earliest,
     return false;
 }
 
-// Forward declaration:
+// Forward declarations:
 static void demo_resize(struct demo *demo);
+static void demo_create_device(struct demo *demo);
+static void demo_send_hdr_metadata(struct demo *demo, float maxL, float avgL);
 
 static bool memory_type_from_properties(struct demo *demo, uint32_t typeBits,
                                         VkFlags requirements_mask,
@@ -690,6 +871,266 @@ static bool memory_type_from_properties(struct demo *demo, uint32_t typeBits,
     return false;
 }
 
+// Take 'size' bytes at 'start' out of free range 'r' of 'block':
+static void demo_memory_take(struct memory_block *block, uint32_t r, VkDeviceSize start, VkDeviceSize size) {
+    struct memory_range *range = &block->ranges[r];
+    const VkDeviceSize pad = start - range->offset;
+    const VkDeviceSize rest = range->offset + range->size - (start + size);
+
+    if (pad && rest && block->range_count < MEMORY_RANGE_COUNT) {
+        // Split in two, keeping the alignment padding in front:
+        memmove(range + 2, range + 1, (block->range_count - r - 1) * sizeof(*range));
+        range->size = pad;
+        range[1].offset = start + size;
+        range[1].size = rest;
+        block->range_count++;
+    }
+    else if (rest) {
+        range->offset = start + size;
+        range->size = rest;
+    }
+    else if (pad) {
+        range->size = pad;
+    }
+    else {
+        memmove(range, range + 1, (block->range_count - r - 1) * sizeof(*range));
+        block->range_count--;
+    }
+}
+
+// First fit in a block of memory type 'type', or -1:
+static int demo_memory_fit(struct demo *demo, const VkMemoryRequirements *reqs, uint32_t type, int tiling,
+                           struct memory_alloc *alloc) {
+    uint32_t b, r;
+
+    for (b = 0; b < MEMORY_BLOCK_COUNT; b++) {
+        struct memory_block *block = &demo->memory.blocks[b];
+
+        if (!block->mem || block->type != type || (block->alloc_count > 0 && block->tiling != tiling))
+            continue;
+
+        for (r = 0; r < block->range_count; r++) {
+            const struct memory_range *range = &block->ranges[r];
+            const VkDeviceSize start = (range->offset + reqs->alignment - 1) / reqs->alignment * reqs->alignment;
+
+            if (start + reqs->size > range->offset + range->size)
+                continue;
+
+            demo_memory_take(block, r, start, reqs->size);
+            block->tiling = tiling;
+            block->alloc_count++;
+
+            alloc->mem = block->mem;
+            alloc->offset = start;
+            alloc->size = reqs->size;
+            alloc->block = b;
+            return (int) b;
+        }
+    }
+
+    return -1;
+}
+
+// Add a block of at least 'size' bytes of memory type 'type':
+static bool demo_memory_add_block(struct demo *demo, uint32_t type, VkDeviceSize size) {
+    struct memory_block *block = NULL;
+    VkResult err;
+    uint32_t b;
+
+    for (b = 0; b < MEMORY_BLOCK_COUNT && !block; b++) {
+        if (!demo->memory.blocks[b].mem)
+            block = &demo->memory.blocks[b];
+    }
+
+    if (!block)
+        return false;
+
+    memset(block, 0, sizeof(*block));
+    block->single = (size > MEMORY_BLOCK_SIZE / 2);
+    block->size = (block->single) ? size : MEMORY_BLOCK_SIZE;
+    block->type = type;
+
+    VkMemoryAllocateInfo mem_alloc = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .pNext = NULL,
+        .allocationSize = block->size,
+        .memoryTypeIndex = type,
+    };
+
+    err = vkAllocateMemory(demo->device, &mem_alloc, NULL, &block->mem);
+    if (err && !block->single) {
+        // Small heap? Try just what is needed:
+        block->single = true;
+        block->size = mem_alloc.allocationSize = size;
+        err = vkAllocateMemory(demo->device, &mem_alloc, NULL, &block->mem);
+    }
+
+    if (err) {
+        block->mem = VK_NULL_HANDLE;
+        return false;
+    }
+
+    demo->memory.vk_allocs++;
+
+    block->range_count = 1;
+    block->ranges[0].offset = 0;
+    block->ranges[0].size = block->size;
+
+    return true;
+}
+
+// MK: Sub-allocate memory with properties 'props' for a resource with requirements 'reqs', an optimal
+// tiled image if 'optimal', else a buffer or linear image. Returns false if no memory type has 'props':
+static bool demo_memory_alloc(struct demo *demo, const VkMemoryRequirements *reqs, VkFlags props, bool optimal,
+                              struct memory_alloc *alloc) {
+    const int tiling = (demo->gpu_props.limits.bufferImageGranularity <= 1) ? MEMORY_TILING_ANY :
+                       (optimal) ? MEMORY_TILING_OPTIMAL : MEMORY_TILING_LINEAR;
+    uint32_t type;
+
+    memset(alloc, 0, sizeof(*alloc));
+
+    if (!memory_type_from_properties(demo, reqs->memoryTypeBits, props, &type))
+        return false;
+
+    if (demo_memory_fit(demo, reqs, type, tiling, alloc) < 0 &&
+        (!demo_memory_add_block(demo, type, reqs->size) || demo_memory_fit(demo, reqs, type, tiling, alloc) < 0)) {
+        ERR_EXIT("Out of device memory, or of sub-allocator blocks", "vkAllocateMemory Failure");
+    }
+
+    demo->memory.alloc_count++;
+    demo->memory.alloc_total++;
+
+    return true;
+}
+
+// Map a host visible sub-allocation. Its block is mapped as a whole by the first
+// mapped sub-allocation and unmapped with the last one:
+static void *demo_memory_map(struct demo *demo, struct memory_alloc *alloc) {
+    struct memory_block *block = &demo->memory.blocks[alloc->block];
+    VkResult U_ASSERT_ONLY err;
+
+    if (alloc->data)
+        return alloc->data;
+
+    if (block->map_count++ == 0) {
+        err = vkMapMemory(demo->device, block->mem, 0, VK_WHOLE_SIZE, 0, (void **) &block->data);
+        assert(!err);
+    }
+
+    alloc->data = block->data + alloc->offset;
+    return alloc->data;
+}
+
+static void demo_memory_unmap(struct demo *demo, struct memory_alloc *alloc) {
+    struct memory_block *block = &demo->memory.blocks[alloc->block];
+
+    if (!alloc->data)
+        return;
+
+    alloc->data = NULL;
+    if (--block->map_count == 0) {
+        vkUnmapMemory(demo->device, block->mem);
+        block->data = NULL;
+    }
+}
+
+static void demo_memory_free(struct demo *demo, struct memory_alloc *alloc) {
+    struct memory_block *block;
+    struct memory_range *ranges;
+    uint32_t r;
+
+    if (!alloc->mem)
+        return;
+
+    demo_memory_unmap(demo, alloc);
+
+    block = &demo->memory.blocks[alloc->block];
+    ranges = block->ranges;
+    demo->memory.alloc_count--;
+
+    if (--block->alloc_count == 0) {
+        if (block->single) {
+            vkFreeMemory(demo->device, block->mem, NULL);
+            memset(block, 0, sizeof(*block));
+        }
+        else {
+            block->range_count = 1;
+            ranges[0].offset = 0;
+            ranges[0].size = block->size;
+        }
+
+        memset(alloc, 0, sizeof(*alloc));
+        return;
+    }
+
+    // Insert sorted, and merge with the free neighbours:
+    for (r = 0; r < block->range_count && ranges[r].offset < alloc->offset; r++);
+
+    if (r > 0 && ranges[r - 1].offset + ranges[r - 1].size == alloc->offset) {
+        ranges[r - 1].size += alloc->size;
+        if (r < block->range_count && ranges[r - 1].offset + ranges[r - 1].size == ranges[r].offset) {
+            ranges[r - 1].size += ranges[r].size;
+            memmove(&ranges[r], &ranges[r + 1], (block->range_count - r - 1) * sizeof(*ranges));
+            block->range_count--;
+        }
+    }
+    else if (r < block->range_count && alloc->offset + alloc->size == ranges[r].offset) {
+        ranges[r].offset = alloc->offset;
+        ranges[r].size += alloc->size;
+    }
+    else if (block->range_count < MEMORY_RANGE_COUNT) {
+        memmove(&ranges[r + 1], &ranges[r], (block->range_count - r) * sizeof(*ranges));
+        ranges[r].offset = alloc->offset;
+        ranges[r].size = alloc->size;
+        block->range_count++;
+    }
+
+    memset(alloc, 0, sizeof(*alloc));
+}
+
+// MK: Print blocks, sizes and usage per memory type:
+static void demo_memory_report(struct demo *demo) {
+    uint32_t type, b, r;
+
+    printf("Device memory: %i sub-allocations live, %i made so far, with %i vkAllocateMemory() calls, %i allowed.\n",
+           demo->memory.alloc_count, demo->memory.alloc_total, demo->memory.vk_allocs,
+           demo->gpu_props.limits.maxMemoryAllocationCount);
+
+    for (type = 0; type < demo->memory_properties.memoryTypeCount; type++) {
+        VkDeviceSize size = 0, used = 0;
+        uint32_t blocks = 0, allocs = 0;
+
+        for (b = 0; b < MEMORY_BLOCK_COUNT; b++) {
+            const struct memory_block *block = &demo->memory.blocks[b];
+
+            if (!block->mem || block->type != type)
+                continue;
+
+            blocks++;
+            allocs += block->alloc_count;
+            size += block->size;
+            used += block->size;
+            for (r = 0; r < block->range_count; r++)
+                used -= block->ranges[r].size;
+        }
+
+        if (blocks > 0)
+            printf("  Memory type %i, flags 0x%x: %i blocks with %.1f MB, %.1f MB used by %i sub-allocations.\n", type,
+                   demo->memory_properties.memoryTypes[type].propertyFlags, blocks, size / 1048576.0, used / 1048576.0, allocs);
+    }
+}
+
+static void demo_memory_destroy(struct demo *demo) {
+    uint32_t b;
+
+    for (b = 0; b < MEMORY_BLOCK_COUNT; b++) {
+        if (demo->memory.blocks[b].mem)
+            vkFreeMemory(demo->device, demo->memory.blocks[b].mem, NULL);
+    }
+
+    memset(&demo->memory, 0, sizeof(demo->memory));
+}
+
 static void demo_flush_init_cmd(struct demo *demo) {
     VkResult U_ASSERT_ONLY err;
 
@@ -782,6 +1223,11 @@ static void demo_set_image_layout(struct demo *demo, VkImage image,
         image_memory_barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
         break;
 
+    case VK_IMAGE_LAYOUT_GENERAL:
+        // Compute shader format conversion reads and writes images in general layout:
+        image_memory_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        break;
+
     default:
         image_memory_barrier.dstAccessMask = 0;
         break;
@@ -794,3364 +1240,8165 @@ static void demo_set_image_layout(struct demo *demo, VkImage image,
                          NULL, 1, pmemory_barrier);
 }
 
-static void demo_draw_build_cmd(struct demo *demo, VkCommandBuffer cmd_buf) {
-    if (demo->use_blit) {
-        VkResult U_ASSERT_ONLY err;
+// MK: Bytes per pixel of the formats used for interop textures and swapchains:
+static uint32_t demo_format_size(VkFormat format) {
+    switch (format) {
+    case VK_FORMAT_R16G16B16A16_SFLOAT:
+        return 8;
 
-        const VkCommandBufferBeginInfo cmd_buf_info = {
-            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-            .pNext = NULL,
-            .flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT,
-            .pInheritanceInfo = NULL,
-        };
+    default:
+        // RGBA8, BGRA8, RGB10A2 and BGR10A2 in all their variants:
+        return 4;
+    }
+}
 
-        err = vkBeginCommandBuffer(cmd_buf, &cmd_buf_info);
-        assert(!err);
+// MK: Highest code value of a unorm format, 0 for float formats:
+static int demo_format_levels(VkFormat format) {
+    switch (format) {
+    case VK_FORMAT_R16G16B16A16_SFLOAT:
+        return 0;
 
-        demo_set_image_layout(demo, demo->textures[0].image,
-                              VK_IMAGE_ASPECT_COLOR_BIT,
-                              demo->textures[0].imageLayout,
-                              VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                              VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-                              VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-                              VK_PIPELINE_STAGE_TRANSFER_BIT,
-                              cmd_buf);
+    case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+    case VK_FORMAT_A2R10G10B10_UNORM_PACK32:
+        return 1023;
 
-        demo_set_image_layout(demo, demo->swapchain_image_resources[demo->current_buffer].image,
-                              VK_IMAGE_ASPECT_COLOR_BIT,
-                              VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-                              VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                              VK_ACCESS_MEMORY_READ_BIT,
-                              VK_PIPELINE_STAGE_TRANSFER_BIT,
-                              VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-                              cmd_buf);
+    default:
+        return 255;
+    }
+}
 
-        // Do pixel format of interop texture and swapchain image match?
-        if (demo->interop_tex_format != demo->format) {
-            // No: Need pixel color format conversion -> blit image:
-            VkImageBlit blit_region = {
-                .srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
-                .srcOffsets = {{0, 0, 0}, {demo->width, demo->height, 1}},
-                .dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
-                .dstOffsets = {{0, 0, 0}, {demo->width, demo->height, 1}}
-            };
+static void demo_destroy_upload_ring(struct demo *demo) {
+    struct upload_ring *ring = &demo->upload;
+    uint32_t i;
 
-            vkCmdBlitImage(
-                cmd_buf, demo->textures[0].image,
-                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, demo->swapchain_image_resources[demo->current_buffer].image,
-                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit_region, VK_FILTER_NEAREST);
+    if (!ring->buffer)
+        return;
 
-            printf("Swapchainbuffer %d: Using vkCmdBlitImage() blit for interop -> swapchain transfer.\n", demo->current_buffer);
-        }
-        else {
-            // Yes: Can do a memcpy() style copy image:
-            VkImageCopy copy_region = {
-                .srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
-                .srcOffset = {0, 0, 0},
-                .dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
-                .dstOffset = {0, 0, 0},
-                .extent = {demo->width, demo->height, 1},
-            };
+    // Uploads may still be in flight:
+    vkDeviceWaitIdle(demo->device);
 
-            vkCmdCopyImage(
-                cmd_buf, demo->textures[0].image,
-                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, demo->swapchain_image_resources[demo->current_buffer].image,
-                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy_region);
+    for (i = 0; i < ring->slot_count; i++)
+        vkDestroyFence(demo->device, ring->slots[i].fence, NULL);
+    vkDestroyCommandPool(demo->device, ring->cmd_pool, NULL);
+    vkDestroyBuffer(demo->device, ring->buffer, NULL);
+    demo_memory_free(demo, &ring->alloc);
+    memset(ring, 0, sizeof(*ring));
+}
 
-            printf("Swapchainbuffer %d: Using vkCmdCopyImage() copy for interop -> swapchain transfer.\n", demo->current_buffer);
-        }
+// MK: Make sure the upload ring has at least 'slot_count' slots of at least 'slot_size'
+// bytes each. The ring is only recreated if it is too small, so all users share one
+// buffer, mapped once, and no upload needs an allocation of its own:
+static void demo_prepare_upload_ring(struct demo *demo, VkDeviceSize slot_size, uint32_t slot_count) {
+    struct upload_ring *ring = &demo->upload;
+    VkDeviceSize align = demo->gpu_props.limits.optimalBufferCopyOffsetAlignment;
+    VkMemoryRequirements mem_reqs;
+    VkResult U_ASSERT_ONLY err;
+    bool U_ASSERT_ONLY pass;
+    uint32_t i;
 
-        demo_set_image_layout(demo, demo->textures[0].image,
-                              VK_IMAGE_ASPECT_COLOR_BIT,
-                              VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                              demo->textures[0].imageLayout,
-                              VK_ACCESS_TRANSFER_READ_BIT,
-                              VK_PIPELINE_STAGE_TRANSFER_BIT,
-                              VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-                              cmd_buf);
+    assert(slot_count <= UPLOAD_SLOT_COUNT);
 
-        demo_set_image_layout(demo, demo->swapchain_image_resources[demo->current_buffer].image,
-                              VK_IMAGE_ASPECT_COLOR_BIT,
-                              VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                              VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-                              VK_ACCESS_TRANSFER_WRITE_BIT,
-                              VK_PIPELINE_STAGE_TRANSFER_BIT,
-                              VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-                              cmd_buf);
+    if (ring->buffer && ring->slot_size >= slot_size && ring->slot_count >= slot_count)
+        return;
 
-        err = vkEndCommandBuffer(cmd_buf);
-        assert(!err);
+    // Grow, never shrink, as the old users may come back:
+    if (ring->buffer) {
+        if (ring->slot_size > slot_size)
+            slot_size = ring->slot_size;
+        if (ring->slot_count > slot_count)
+            slot_count = ring->slot_count;
+        demo_destroy_upload_ring(demo);
     }
-    else {
-        const VkCommandBufferBeginInfo cmd_buf_info = {
-            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-            .pNext = NULL,
-            .flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT,
-            .pInheritanceInfo = NULL,
-        };
-        const VkClearValue clear_values[2] = {
-                //[0] = {.color.float32 = {0.05f, 0.05f, 0.05f, 0.0f}},
-                [0] = {.color.float32 = {0.0f, 0.0f, 0.0f, 0.0f}},
-                [1] = {.depthStencil = {1.0f, 0}},
-        };
-        const VkRenderPassBeginInfo rp_begin = {
-            .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
-            .pNext = NULL,
-            .renderPass = demo->render_pass,
-            .framebuffer = demo->swapchain_image_resources[demo->current_buffer].framebuffer,
-            .renderArea.offset.x = 0,
-            .renderArea.offset.y = 0,
-            .renderArea.extent.width = demo->width,
-            .renderArea.extent.height = demo->height,
-            .clearValueCount = 2,
-            .pClearValues = clear_values,
-        };
-        VkResult U_ASSERT_ONLY err;
 
-        err = vkBeginCommandBuffer(cmd_buf, &cmd_buf_info);
+    // Slot offsets must be a multiple of the texel size, 16 covers all our formats:
+    if (align < 16)
+        align = 16;
+    slot_size = (slot_size + align - 1) / align * align;
+
+    const VkBufferCreateInfo buf_info = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .pNext = NULL,
+        .size = slot_size * slot_count,
+        .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+    };
+
+    err = vkCreateBuffer(demo->device, &buf_info, NULL, &ring->buffer);
+    assert(!err);
+
+    vkGetBufferMemoryRequirements(demo->device, ring->buffer, &mem_reqs);
+
+    // Prefer cached memory, the image decoders write it in small pieces:
+    pass = demo_memory_alloc(demo, &mem_reqs,
+                             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT |
+                             VK_MEMORY_PROPERTY_HOST_CACHED_BIT, false, &ring->alloc) ||
+           demo_memory_alloc(demo, &mem_reqs,
+                             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                             false, &ring->alloc);
+    assert(pass);
+
+    err = vkBindBufferMemory(demo->device, ring->buffer, ring->alloc.mem, ring->alloc.offset);
+    assert(!err);
+
+    ring->data = demo_memory_map(demo, &ring->alloc);
+
+    // Command buffers are re-recorded for each upload through their slot:
+    const VkCommandPoolCreateInfo cmd_pool_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .pNext = NULL,
+        .queueFamilyIndex = demo->graphics_queue_family_index,
+        .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+    };
+
+    err = vkCreateCommandPool(demo->device, &cmd_pool_info, NULL, &ring->cmd_pool);
+    assert(!err);
+
+    const VkCommandBufferAllocateInfo cmd_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .pNext = NULL,
+        .commandPool = ring->cmd_pool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1,
+    };
+
+    const VkFenceCreateInfo fence_info = {
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+    };
+
+    for (i = 0; i < slot_count; i++) {
+        struct upload_slot *slot = &ring->slots[i];
+
+        slot->offset = i * slot_size;
+        slot->data = ring->data + slot->offset;
+
+        err = vkAllocateCommandBuffers(demo->device, &cmd_info, &slot->cmd);
         assert(!err);
-        vkCmdBeginRenderPass(cmd_buf, &rp_begin, VK_SUBPASS_CONTENTS_INLINE);
-        vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, demo->pipeline);
-        vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                                demo->pipeline_layout, 0, 1,
-                                &demo->swapchain_image_resources[demo->current_buffer].descriptor_set,
-                                0, NULL);
-        VkViewport viewport;
-        memset(&viewport, 0, sizeof(viewport));
-        viewport.height = (float)demo->height;
-        viewport.width = (float)demo->width;
-        viewport.minDepth = (float)0.0f;
-        viewport.maxDepth = (float)1.0f;
-        vkCmdSetViewport(cmd_buf, 0, 1, &viewport);
 
-        VkRect2D scissor;
-        memset(&scissor, 0, sizeof(scissor));
-        scissor.extent.width = demo->width;
-        scissor.extent.height = demo->height;
-        scissor.offset.x = 0;
-        scissor.offset.y = 0;
-        vkCmdSetScissor(cmd_buf, 0, 1, &scissor);
-        vkCmdDraw(cmd_buf, 2 * 3, 1, 0, 0);
-        // Note that ending the renderpass changes the image's layout from
-        // COLOR_ATTACHMENT_OPTIMAL to PRESENT_SRC_KHR
-        vkCmdEndRenderPass(cmd_buf);
+        err = vkCreateFence(demo->device, &fence_info, NULL, &slot->fence);
+        assert(!err);
 
-        if (demo->separate_present_queue) {
-            printf("Swapchainbuffer %d: Need separate_present_queue!!!\n", demo->current_buffer);
+        slot->state = UPLOADSLOT_FREE;
+    }
 
-            // We have to transfer ownership from the graphics queue family to the
-            // present queue family to be able to present.  Note that we don't have
-            // to transfer from present queue family back to graphics queue family at
-            // the start of the next frame because we don't care about the image's
-            // contents at that point.
-            VkImageMemoryBarrier image_ownership_barrier = {
-                .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-                .pNext = NULL,
-                .srcAccessMask = 0,
-                .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-                .oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-                .newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-                .srcQueueFamilyIndex = demo->graphics_queue_family_index,
-                .dstQueueFamilyIndex = demo->present_queue_family_index,
-                .image = demo->swapchain_image_resources[demo->current_buffer].image,
-                .subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1}};
+    ring->slot_size = slot_size;
+    ring->slot_count = slot_count;
+    ring->next = 0;
 
-            vkCmdPipelineBarrier(cmd_buf,
-                                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-                                VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
-                                0, NULL, 0, NULL, 1, &image_ownership_barrier);
+    printf("Upload ring with %i slots of %i KB.\n", slot_count, (int) (slot_size / 1024));
+}
+
+// Hand slots whose upload completed back to their producer, without waiting:
+static void demo_upload_reclaim(struct demo *demo) {
+    uint32_t i;
+
+    for (i = 0; i < demo->upload.slot_count; i++) {
+        struct upload_slot *slot = &demo->upload.slots[i];
+
+        if (slot->state == UPLOADSLOT_UPLOADING && vkGetFenceStatus(demo->device, slot->fence) == VK_SUCCESS) {
+            vkResetFences(demo->device, 1, &slot->fence);
+            slot->state = UPLOADSLOT_FREE;
         }
-        err = vkEndCommandBuffer(cmd_buf);
-        assert(!err);
+    }
+}
 
-        printf("Swapchainbuffer %d: Using 3D quad rendering + passthrough shader for interop -> swapchain transfer.\n", demo->current_buffer);
+// Next slot in ring order for an upload from this thread, waiting for its previous upload if needed:
+static struct upload_slot *demo_upload_acquire(struct demo *demo) {
+    struct upload_slot *slot = &demo->upload.slots[demo->upload.next];
+
+    demo->upload.next = (demo->upload.next + 1) % demo->upload.slot_count;
+
+    if (slot->state == UPLOADSLOT_UPLOADING) {
+        vkWaitForFences(demo->device, 1, &slot->fence, VK_TRUE, UINT64_MAX);
+        vkResetFences(demo->device, 1, &slot->fence);
+        slot->state = UPLOADSLOT_FREE;
     }
+
+    return slot;
 }
 
-void demo_build_image_ownership_cmd(struct demo *demo, int i) {
+// Wait for all uploads, and hand all slots back to this thread:
+static void demo_upload_drain(struct demo *demo) {
+    uint32_t i;
+
+    for (i = 0; i < demo->upload.slot_count; i++) {
+        struct upload_slot *slot = &demo->upload.slots[i];
+
+        if (slot->state == UPLOADSLOT_UPLOADING) {
+            vkWaitForFences(demo->device, 1, &slot->fence, VK_TRUE, UINT64_MAX);
+            vkResetFences(demo->device, 1, &slot->fence);
+        }
+        slot->state = UPLOADSLOT_FREE;
+    }
+    demo->upload.next = 0;
+}
+
+// Record the copy of 'region_count' regions of 'slot' into 'tex', which can be block compressed
+// and have several mip levels. If 'clear', clear all of it to black first. 'tex' is left in its
+// imageLayout, visible to all later commands:
+static void demo_upload_record_regions(struct demo *demo, struct upload_slot *slot, struct texture_object *tex,
+                                       const VkBufferImageCopy *regions, uint32_t region_count, bool clear) {
+    const VkImageSubresourceRange range = {VK_IMAGE_ASPECT_COLOR_BIT, 0, VK_REMAINING_MIP_LEVELS, 0, 1};
     VkResult U_ASSERT_ONLY err;
 
-    const VkCommandBufferBeginInfo cmd_buf_info = {
+    const VkCommandBufferBeginInfo begin_info = {
         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
         .pNext = NULL,
-        .flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
         .pInheritanceInfo = NULL,
     };
-    err = vkBeginCommandBuffer(demo->swapchain_image_resources[i].graphics_to_present_cmd,
-                               &cmd_buf_info);
+
+    err = vkBeginCommandBuffer(slot->cmd, &begin_info);
     assert(!err);
 
-    VkImageMemoryBarrier image_ownership_barrier = {
+    // Wait for all reads of the previous content, which only matters for the borders,
+    // and those get cleared anyway:
+    VkImageMemoryBarrier barrier = {
         .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
         .pNext = NULL,
         .srcAccessMask = 0,
-        .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-        .oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-        .newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-        .srcQueueFamilyIndex = demo->graphics_queue_family_index,
-        .dstQueueFamilyIndex = demo->present_queue_family_index,
-        .image = demo->swapchain_image_resources[i].image,
-        .subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1}};
+        .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = tex->image,
+        .subresourceRange = range,
+    };
 
-    vkCmdPipelineBarrier(demo->swapchain_image_resources[i].graphics_to_present_cmd,
-                         VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-                         VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0, 0,
-                         NULL, 0, NULL, 1, &image_ownership_barrier);
-    err = vkEndCommandBuffer(demo->swapchain_image_resources[i].graphics_to_present_cmd);
+    vkCmdPipelineBarrier(slot->cmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         0, 0, NULL, 0, NULL, 1, &barrier);
+
+    if (clear) {
+        const VkClearColorValue black = { .float32 = {0, 0, 0, 1} };
+
+        vkCmdClearColorImage(slot->cmd, tex->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &black, 1, &range);
+
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        vkCmdPipelineBarrier(slot->cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             0, 0, NULL, 0, NULL, 1, &barrier);
+    }
+
+    vkCmdCopyBufferToImage(slot->cmd, demo->upload.buffer, tex->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                           region_count, regions);
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = tex->imageLayout;
+    vkCmdPipelineBarrier(slot->cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                         0, 0, NULL, 0, NULL, 1, &barrier);
+
+    err = vkEndCommandBuffer(slot->cmd);
     assert(!err);
 }
 
-void demo_update_data_buffer(struct demo *demo) {
-    mat4x4 MVP, Model, VP;
-    int matrixSize = sizeof(MVP);
-    uint8_t *pData;
+// Record the upload of the width x height pixels in 'slot', tightly packed in the format
+// of 'tex', into 'tex', centered and with black borders if smaller:
+static void demo_upload_record(struct demo *demo, struct upload_slot *slot, struct texture_object *tex) {
+    const bool covered = (slot->width == tex->tex_width && slot->height == tex->tex_height);
+
+    const VkBufferImageCopy region = {
+        .bufferOffset = slot->offset,
+        .bufferRowLength = 0,
+        .bufferImageHeight = 0,
+        .imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+        .imageOffset = {(tex->tex_width - slot->width) / 2, (tex->tex_height - slot->height) / 2, 0},
+        .imageExtent = {slot->width, slot->height, 1},
+    };
+
+    demo_upload_record_regions(demo, slot, tex, &region, 1, !covered);
+}
+
+// Submit the recorded upload of 'slot' on the graphics queue, so it is ordered before
+// all later submits reading the image. The slot is reused once its fence signals:
+static void demo_upload_submit(struct demo *demo, struct upload_slot *slot) {
     VkResult U_ASSERT_ONLY err;
-    float spin_angle;
 
-    mat4x4_mul(VP, demo->projection_matrix, demo->view_matrix);
+    const VkSubmitInfo submit_info = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = NULL,
+        .waitSemaphoreCount = 0,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &slot->cmd,
+        .signalSemaphoreCount = 0,
+    };
 
-/*
-    // Rotate around the Y axis
-    mat4x4_dup(Model, demo->model_matrix);
+    err = vkQueueSubmit(demo->graphics_queue, 1, &submit_info, slot->fence);
+    assert(!err);
 
-    spin_angle = demo->spin_angle;
+    slot->state = UPLOADSLOT_UPLOADING;
+}
 
-    // Make the cube spin at a constant rate
-    if (demo->VK_GOOGLE_display_timing_enabled)
-        spin_angle *= (float) demo->target_IPD / (1.0f / 30.0f * 1e9);
+// MK: Workgroup size for the compute shader format conversion. Each row of a
+// workgroup should cover 128 bytes of the widest of source and destination, so
+// each row touches whole cache lines / memory channel interleaves, and a workgroup
+// should have 256 threads, e.g., 32 x 8 for 4 byte formats, 16 x 16 for RGBA16F.
+// Clamped to the device limits, which only guarantee 128 threads per workgroup:
+static void demo_convert_tile(struct demo *demo, uint32_t *w, uint32_t *h) {
+    const VkPhysicalDeviceLimits *limits = &demo->gpu_props.limits;
+    uint32_t bpp = demo_format_size(demo->interop_tex_format);
 
-    mat4x4_rotate(demo->model_matrix, Model, 0.0f, 1.0f, 0.0f,
-                  (float)degreesToRadians(spin_angle));
-    mat4x4_mul(MVP, VP, demo->model_matrix);
-*/
+    if (demo_format_size(demo->format) > bpp)
+        bpp = demo_format_size(demo->format);
 
-    err = vkMapMemory(demo->device,
-                      demo->swapchain_image_resources[demo->current_buffer].uniform_memory, 0,
-                      VK_WHOLE_SIZE, 0, (void **)&pData);
-    assert(!err);
+    *w = 128 / bpp;
+    *h = 256 / *w;
+
+    // User override for tuning:
+    if (demo->convert_tile[0] && demo->convert_tile[1]) {
+        *w = demo->convert_tile[0];
+        *h = demo->convert_tile[1];
+    }
+
+    if (*w > limits->maxComputeWorkGroupSize[0])
+        *w = limits->maxComputeWorkGroupSize[0];
+
+    if (*h > limits->maxComputeWorkGroupSize[1])
+        *h = limits->maxComputeWorkGroupSize[1];
 
-    //memcpy(pData, (const void *)&MVP[0][0], matrixSize);
-    memcpy(pData, (const void *)&VP[0][0], matrixSize);
+    // Keep rows whole, give up height first:
+    if (*w > limits->maxComputeWorkGroupInvocations)
+        *w = limits->maxComputeWorkGroupInvocations;
 
-    vkUnmapMemory(demo->device, demo->swapchain_image_resources[demo->current_buffer].uniform_memory);
+    if (*w * *h > limits->maxComputeWorkGroupInvocations)
+        *h = limits->maxComputeWorkGroupInvocations / *w;
 }
 
-static uint64_t
-DemoRefreshDuration(struct demo *demo) {
-   VkRefreshCycleDurationGOOGLE rc_dur;
-   VkResult err;
-   err = demo->fpGetRefreshCycleDurationGOOGLE(demo->device,
-                           demo->swapchain,
-                           &rc_dur);
-   assert(!err);
-   return rc_dur.refreshDuration;
+static const char *demo_output_tf_names[OUTPUT_TF_COUNT] = { "None (OpenGL encodes)", "PQ", "HLG", "Linear", "sRGB" };
+
+// MK: Output transfer function which the swapchain colorspace expects from us:
+static int demo_output_tf_for_colorspace(VkColorSpaceKHR color_space)
+{
+    switch (color_space) {
+        case VK_COLOR_SPACE_HDR10_ST2084_EXT:
+            return OUTPUT_TF_PQ;
+
+        case VK_COLOR_SPACE_HDR10_HLG_EXT:
+            return OUTPUT_TF_HLG;
+
+        case VK_COLOR_SPACE_EXTENDED_SRGB_LINEAR_EXT:
+        case VK_COLOR_SPACE_BT2020_LINEAR_EXT:
+        case VK_COLOR_SPACE_BT709_LINEAR_EXT:
+            return OUTPUT_TF_LINEAR;
+
+        case VK_COLOR_SPACE_SRGB_NONLINEAR_KHR:
+            return OUTPUT_TF_SRGB;
+
+        default:
+            return OUTPUT_TF_NONE;
+    }
 }
 
-void DemoUpdateTargetIPD(struct demo *demo) {
-    // Look at what happened to previous presents, and make appropriate
-    // adjustments in timing:
-    VkResult U_ASSERT_ONLY err;
-    VkPastPresentationTimingGOOGLE* past = NULL;
-    uint32_t count = 0;
+// MK: Pipeline for an output transfer function. *_SRGB swapchain formats already
+// encode on write, so the shader must not apply the sRGB OETF a second time:
+static VkPipeline demo_tf_pipeline(struct demo *demo, int output_tf)
+{
+    if (output_tf == OUTPUT_TF_SRGB &&
+        (demo->format == VK_FORMAT_B8G8R8A8_SRGB || demo->format == VK_FORMAT_R8G8B8A8_SRGB ||
+         demo->format == VK_FORMAT_A8B8G8R8_SRGB_PACK32))
+        output_tf = OUTPUT_TF_LINEAR;
 
-    err = demo->fpGetPastPresentationTimingGOOGLE(demo->device,
-                                                  demo->swapchain,
-                                                  &count,
-                                                  NULL);
-    assert(!err);
-    if (count) {
-        past = (VkPastPresentationTimingGOOGLE*) malloc(sizeof(VkPastPresentationTimingGOOGLE) * count);
-        assert(past);
-        err = demo->fpGetPastPresentationTimingGOOGLE(demo->device,
-                                                      demo->swapchain,
-                                                      &count,
-                                                      past);
-        assert(!err);
+    return demo->tf_pipelines[output_tf];
+}
 
-    uint64_t refresh_duration = DemoRefreshDuration(demo);
+// MK: OpenGL accesses the DMA-BUF interop image as a foreign queue family. So each
+// frame acquires it from there before any use, and releases it back at the end, ahead
+// of signalling OpenGL. The interop semaphores order these against OpenGL's accesses.
+// Movie playback never hands the image to OpenGL, so it keeps it:
+static void demo_interop_ownership_barrier(struct demo *demo, VkCommandBuffer cmd_buf, bool acquire) {
+#if defined(VK_USE_PLATFORM_DISPLAY_KHR)
+    if (!demo->use_dmabuf || !demo->interop_enabled || demo->use_movie)
+        return;
 
-        bool early = false;
-        bool late = false;
-        bool calibrate_next = false;
-        for (uint32_t i = 0 ; i < count ; i++) {
+    const VkImageMemoryBarrier barrier = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .pNext = NULL,
+        .srcAccessMask = 0,
+        .dstAccessMask = (acquire) ? (VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT) : 0,
+        .oldLayout = demo->textures[0].imageLayout,
+        .newLayout = demo->textures[0].imageLayout,
+        .srcQueueFamilyIndex = (acquire) ? VK_QUEUE_FAMILY_FOREIGN_EXT : demo->graphics_queue_family_index,
+        .dstQueueFamilyIndex = (acquire) ? demo->graphics_queue_family_index : VK_QUEUE_FAMILY_FOREIGN_EXT,
+        .image = demo->textures[0].image,
+        .subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1}};
 
-            printf("%d: desired %f actual %f earliest %f gap %f\n",
-                   i,
-                   past[i].desiredPresentTime / 1e9,
-                   past[i].actualPresentTime / 1e9,
-                   past[i].earliestPresentTime / 1e9,
-                   past[i].actualPresentTime / 1e9 - past[i].earliestPresentTime / 1e9);
+    vkCmdPipelineBarrier(cmd_buf,
+                         (acquire) ? VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT : VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                         (acquire) ? VK_PIPELINE_STAGE_ALL_COMMANDS_BIT : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+                         0, NULL, 0, NULL, 1, &barrier);
+#endif
+}
 
+// MK: Record the MaxCLL / MaxFALL reduction over the interop image into the
+// result buffer of the current swapchain image, and make it visible to the host:
+static void demo_draw_build_lightlevel_cmd(struct demo *demo, VkCommandBuffer cmd_buf) {
+    SwapchainImageResources *res = &demo->swapchain_image_resources[demo->current_buffer];
 
-            if (!demo->syncd_with_actual_presents) {
-                // This is the first time that we've received an
-                // actualPresentTime for this swapchain.  In order to not
-                // perceive these early frames as "late", we need to sync-up
-                // our future desiredPresentTime's with the
-                // actualPresentTime(s) that we're receiving now.
-                calibrate_next = true;
+    if (!demo->lightlevel_pipeline)
+        return;
 
-                // So that we don't suspect any pending presents as late,
-                // record them all as suspected-late presents:
-                demo->last_late_id = demo->next_present_id - 1;
-                demo->last_early_id = 0;
-                demo->syncd_with_actual_presents = true;
-                break;
-            } else if (CanPresentEarlier(past[i].earliestPresentTime,
-                                         past[i].actualPresentTime,
-                                         past[i].presentMargin,
-                                         refresh_duration)) {
-                // This image could have been presented earlier.  We don't want
-                // to decrease the target_IPD until we've seen early presents
-                // for at least two seconds.
-                if (demo->last_early_id == past[i].presentID) {
-                    // We've now seen two seconds worth of early presents.
-                    // Flag it as such, and reset the counter:
-                    early = true;
-                    demo->last_early_id = 0;
-                } else if (demo->last_early_id == 0) {
-                    // This is the first early present we've seen.
-                    // Calculate the presentID for two seconds from now.
-                    uint64_t lastEarlyTime =
-                        past[i].actualPresentTime + (2 * BILLION);
-                    uint32_t howManyPresents =
-                        (uint32_t)((lastEarlyTime - past[i].actualPresentTime) / demo->target_IPD);
-                    demo->last_early_id = past[i].presentID + howManyPresents;
-                } else {
-                    // We are in the midst of a set of early images,
-                    // and so we won't do anything.
-                }
-                late = false;
-                demo->last_late_id = 0;
-            } else if (ActualTimeLate(past[i].desiredPresentTime,
-                                      past[i].actualPresentTime,
-                                      refresh_duration)) {
-                // This image was presented after its desired time.  Since
-                // there's a delay between calling vkQueuePresentKHR and when
-                // we get the timing data, several presents may have been late.
-                // Thus, we need to threat all of the outstanding presents as
-                // being likely late, so that we only increase the target_IPD
-                // once for all of those presents.
-                if ((demo->last_late_id == 0) ||
-                    (demo->last_late_id < past[i].presentID)) {
-                    late = true;
-                    // Record the last suspected-late present:
-                    demo->last_late_id = demo->next_present_id - 1;
-                } else {
-                    // We are in the midst of a set of likely-late images,
-                    // and so we won't do anything.
-                }
-                early = false;
-                demo->last_early_id = 0;
-            } else {
-                // Since this image was not presented early or late, reset
-                // any sets of early or late presentIDs:
-                early = false;
-                late = false;
-                calibrate_next = true;
-                demo->last_early_id = 0;
-                demo->last_late_id = 0;
-            }
+    // OpenGL's writes are covered by the interop semaphore wait, movie frames
+    // and uploads were written by transfer:
+    demo_set_image_layout(demo, demo->textures[0].image,
+                          VK_IMAGE_ASPECT_COLOR_BIT,
+                          demo->textures[0].imageLayout,
+                          VK_IMAGE_LAYOUT_GENERAL,
+                          VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+                          VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                          VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                          cmd_buf);
+
+    vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_COMPUTE, demo->lightlevel_pipeline);
+    vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_COMPUTE,
+                            demo->lightlevel_pipeline_layout, 0, 1,
+                            &res->lightlevel_descriptor_set, 0, NULL);
+    vkCmdDispatch(cmd_buf, demo->lightlevel_groups[0], demo->lightlevel_groups[1], 1);
+
+    const VkBufferMemoryBarrier buffer_barrier = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .pNext = NULL,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = res->lightlevel_buffer,
+        .offset = 0,
+        .size = VK_WHOLE_SIZE,
+    };
+
+    vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+                         0, NULL, 1, &buffer_barrier, 0, NULL);
+
+    demo_set_image_layout(demo, demo->textures[0].image,
+                          VK_IMAGE_ASPECT_COLOR_BIT,
+                          VK_IMAGE_LAYOUT_GENERAL,
+                          demo->textures[0].imageLayout,
+                          VK_ACCESS_SHADER_READ_BIT,
+                          VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                          VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                          cmd_buf);
+}
+
+static void demo_draw_build_cmd(struct demo *demo, VkCommandBuffer cmd_buf) {
+    if (demo->use_blit) {
+        VkResult U_ASSERT_ONLY err;
+
+        // Format conversion by compute shader instead of vkCmdBlitImage(), if possible:
+        const bool convert = (demo->interop_tex_format != demo->format) && demo->use_compute_convert;
+        const VkImageLayout src_layout = (convert) ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        const VkImageLayout dst_layout = (convert) ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        const VkPipelineStageFlags stage = (convert) ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT : VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+        const VkCommandBufferBeginInfo cmd_buf_info = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .pNext = NULL,
+            .flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT,
+            .pInheritanceInfo = NULL,
+        };
+
+        err = vkBeginCommandBuffer(cmd_buf, &cmd_buf_info);
+        assert(!err);
+
+        demo_interop_ownership_barrier(demo, cmd_buf, true);
+        demo_draw_build_lightlevel_cmd(demo, cmd_buf);
+
+        // Compute also orders the layout change after the light level reduction:
+        demo_set_image_layout(demo, demo->textures[0].image,
+                              VK_IMAGE_ASPECT_COLOR_BIT,
+                              demo->textures[0].imageLayout,
+                              src_layout,
+                              VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+                              VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT |
+                              VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                              stage,
+                              cmd_buf);
+
+        demo_set_image_layout(demo, demo->swapchain_image_resources[demo->current_buffer].image,
+                              VK_IMAGE_ASPECT_COLOR_BIT,
+                              VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                              dst_layout,
+                              VK_ACCESS_MEMORY_READ_BIT,
+                              stage,
+                              VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                              cmd_buf);
+
+        // Do pixel format of interop texture and swapchain image match?
+        if (convert) {
+            // No: Pixel color format conversion by compute shader, reading the interop
+            // image and writing the swapchain image through a storage image:
+            uint32_t tile_w, tile_h;
+
+            demo_convert_tile(demo, &tile_w, &tile_h);
+            vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_COMPUTE, demo->convert_pipeline);
+            vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_COMPUTE,
+                                    demo->convert_pipeline_layout, 0, 1,
+                                    &demo->swapchain_image_resources[demo->current_buffer].convert_descriptor_set,
+                                    0, NULL);
+            vkCmdDispatch(cmd_buf, (demo->width + tile_w - 1) / tile_w, (demo->height + tile_h - 1) / tile_h, 1);
+
+            printf("Swapchainbuffer %d: Using %i x %i compute shader conversion for interop -> swapchain transfer.\n",
+                   demo->current_buffer, tile_w, tile_h);
         }
+        else if (demo->interop_tex_format != demo->format) {
+            // No: Need pixel color format conversion -> blit image:
+            VkImageBlit blit_region = {
+                .srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+                .srcOffsets = {{0, 0, 0}, {demo->width, demo->height, 1}},
+                .dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+                .dstOffsets = {{0, 0, 0}, {demo->width, demo->height, 1}}
+            };
 
-        if (early) {
-            // Since we've seen at least two-seconds worth of presnts that
-            // could have occured earlier than desired, let's decrease the
-            // target_IPD (i.e. increase the frame rate):
-            //
-            // TODO(ianelliott): Try to calculate a better target_IPD based
-            // on the most recently-seen present (this is overly-simplistic).
-            demo->refresh_duration_multiplier--;
-            if (demo->refresh_duration_multiplier == 0) {
-                // This should never happen, but in case it does, don't
-                // try to go faster.
-                demo->refresh_duration_multiplier = 1;
-            }
+            vkCmdBlitImage(
+                cmd_buf, demo->textures[0].image,
+                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, demo->swapchain_image_resources[demo->current_buffer].image,
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit_region, VK_FILTER_NEAREST);
+
+            printf("Swapchainbuffer %d: Using vkCmdBlitImage() blit for interop -> swapchain transfer.\n", demo->current_buffer);
         }
-        if (late) {
-            // Since we found a new instance of a late present, we want to
-            // increase the target_IPD (i.e. decrease the frame rate):
-            //
-            // TODO(ianelliott): Try to calculate a better target_IPD based
-            // on the most recently-seen present (this is overly-simplistic).
-            demo->refresh_duration_multiplier++;
+        else {
+            // Yes: Can do a memcpy() style copy image:
+            VkImageCopy copy_region = {
+                .srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+                .srcOffset = {0, 0, 0},
+                .dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+                .dstOffset = {0, 0, 0},
+                .extent = {demo->width, demo->height, 1},
+            };
+
+            vkCmdCopyImage(
+                cmd_buf, demo->textures[0].image,
+                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, demo->swapchain_image_resources[demo->current_buffer].image,
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy_region);
+
+            printf("Swapchainbuffer %d: Using vkCmdCopyImage() copy for interop -> swapchain transfer.\n", demo->current_buffer);
         }
-        demo->target_IPD =
-        refresh_duration * demo->refresh_duration_multiplier;
 
-        if (calibrate_next) {
-            int64_t multiple = demo->next_present_id - past[count-1].presentID - 1;
-            demo->prev_desired_present_time =
-                (past[count-1].actualPresentTime +
-                 (multiple * demo->target_IPD));
+        demo_set_image_layout(demo, demo->textures[0].image,
+                              VK_IMAGE_ASPECT_COLOR_BIT,
+                              src_layout,
+                              demo->textures[0].imageLayout,
+                              (convert) ? VK_ACCESS_SHADER_READ_BIT : VK_ACCESS_TRANSFER_READ_BIT,
+                              stage,
+                              VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                              cmd_buf);
+
+        demo_set_image_layout(demo, demo->swapchain_image_resources[demo->current_buffer].image,
+                              VK_IMAGE_ASPECT_COLOR_BIT,
+                              dst_layout,
+                              VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                              (convert) ? VK_ACCESS_SHADER_WRITE_BIT : VK_ACCESS_TRANSFER_WRITE_BIT,
+                              stage,
+                              VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                              cmd_buf);
+
+        demo_interop_ownership_barrier(demo, cmd_buf, false);
+
+        err = vkEndCommandBuffer(cmd_buf);
+        assert(!err);
+    }
+    else {
+        const VkCommandBufferBeginInfo cmd_buf_info = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .pNext = NULL,
+            .flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT,
+            .pInheritanceInfo = NULL,
+        };
+        const VkClearValue clear_values[1] = {
+                //[0] = {.color.float32 = {0.05f, 0.05f, 0.05f, 0.0f}},
+                [0] = {.color.float32 = {0.0f, 0.0f, 0.0f, 0.0f}},
+        };
+        const VkRenderPassBeginInfo rp_begin = {
+            .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+            .pNext = NULL,
+            .renderPass = demo->render_pass,
+            .framebuffer = demo->swapchain_image_resources[demo->current_buffer].framebuffer,
+            .renderArea.offset.x = 0,
+            .renderArea.offset.y = 0,
+            .renderArea.extent.width = demo->width,
+            .renderArea.extent.height = demo->height,
+            .clearValueCount = 1,
+            .pClearValues = clear_values,
+        };
+        VkResult U_ASSERT_ONLY err;
+
+        err = vkBeginCommandBuffer(cmd_buf, &cmd_buf_info);
+        assert(!err);
+        demo_interop_ownership_barrier(demo, cmd_buf, true);
+        demo_draw_build_lightlevel_cmd(demo, cmd_buf);
+        vkCmdBeginRenderPass(cmd_buf, &rp_begin, VK_SUBPASS_CONTENTS_INLINE);
+        vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, demo->pipeline);
+        vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                demo->pipeline_layout, 0, 1, &demo->descriptor_set,
+                                0, NULL);
+
+        // Transform of the fullscreen triangle is static, so it is recorded once as
+        // push constant, instead of being streamed through a uniform buffer per frame:
+        mat4x4 MVP, VP;
+        mat4x4_mul(VP, demo->projection_matrix, demo->view_matrix);
+        mat4x4_mul(MVP, VP, demo->model_matrix);
+        vkCmdPushConstants(cmd_buf, demo->pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT,
+                           0, sizeof(MVP), (const void *) &MVP[0][0]);
+
+        VkViewport viewport;
+        memset(&viewport, 0, sizeof(viewport));
+        viewport.height = (float)demo->height;
+        viewport.width = (float)demo->width;
+        viewport.minDepth = (float)0.0f;
+        viewport.maxDepth = (float)1.0f;
+        vkCmdSetViewport(cmd_buf, 0, 1, &viewport);
+
+        VkRect2D scissor;
+        memset(&scissor, 0, sizeof(scissor));
+        scissor.extent.width = demo->width;
+        scissor.extent.height = demo->height;
+        scissor.offset.x = 0;
+        scissor.offset.y = 0;
+        vkCmdSetScissor(cmd_buf, 0, 1, &scissor);
+        // One triangle covering the whole viewport, generated by the vertex shader:
+        vkCmdDraw(cmd_buf, 3, 1, 0, 0);
+        // Note that ending the renderpass changes the image's layout from
+        // COLOR_ATTACHMENT_OPTIMAL to PRESENT_SRC_KHR
+        vkCmdEndRenderPass(cmd_buf);
+        demo_interop_ownership_barrier(demo, cmd_buf, false);
+
+        if (demo->separate_present_queue) {
+            printf("Swapchainbuffer %d: Need separate_present_queue!!!\n", demo->current_buffer);
+
+            // We have to transfer ownership from the graphics queue family to the
+            // present queue family to be able to present.  Note that we don't have
+            // to transfer from present queue family back to graphics queue family at
+            // the start of the next frame because we don't care about the image's
+            // contents at that point.
+            VkImageMemoryBarrier image_ownership_barrier = {
+                .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                .pNext = NULL,
+                .srcAccessMask = 0,
+                .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                .oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                .newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                .srcQueueFamilyIndex = demo->graphics_queue_family_index,
+                .dstQueueFamilyIndex = demo->present_queue_family_index,
+                .image = demo->swapchain_image_resources[demo->current_buffer].image,
+                .subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1}};
+
+            vkCmdPipelineBarrier(cmd_buf,
+                                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                                VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+                                0, NULL, 0, NULL, 1, &image_ownership_barrier);
+        }
+        err = vkEndCommandBuffer(cmd_buf);
+        assert(!err);
+
+        printf("Swapchainbuffer %d: Using 3D quad rendering + passthrough shader for interop -> swapchain transfer.\n", demo->current_buffer);
+    }
+}
+
+// MK: Swapchain colorspace of the current swapchain format which expects 'output_tf', the
+// current one if it does. Returns false if the surface offers none:
+static bool demo_colorspace_for_output_tf(struct demo *demo, int output_tf, VkColorSpaceKHR *color_space)
+{
+    VkSurfaceFormatKHR *formats;
+    uint32_t count = 0, i;
+    bool found = false;
+    VkResult U_ASSERT_ONLY err;
+
+    if (demo_output_tf_for_colorspace(demo->color_space) == output_tf) {
+        *color_space = demo->color_space;
+        return true;
+    }
+
+    err = demo->fpGetPhysicalDeviceSurfaceFormatsKHR(demo->gpu, demo->surface, &count, NULL);
+    assert(!err);
+    formats = (VkSurfaceFormatKHR *) malloc(count * sizeof(VkSurfaceFormatKHR));
+    err = demo->fpGetPhysicalDeviceSurfaceFormatsKHR(demo->gpu, demo->surface, &count, formats);
+    assert(!err);
+
+    for (i = 0; i < count && !found; i++) {
+        if (formats[i].format == demo->format && demo_output_tf_for_colorspace(formats[i].colorSpace) == output_tf) {
+            *color_space = formats[i].colorSpace;
+            found = true;
+        }
+    }
+
+    free(formats);
+    return found;
+}
+
+// MK: Switch the Vulkan side pass to another of the prebuilt output transfer function
+// pipelines, and the swapchain to the colorspace which expects that encoding, so the
+// display interprets the output correctly. Same colorspace only needs new command
+// buffers, otherwise the swapchain is recreated. demo_resize() keeps all pipelines
+// then, so no shader is ever compiled:
+static bool demo_set_output_tf(struct demo *demo, int output_tf)
+{
+    uint32_t current_buffer = demo->current_buffer;
+    VkColorSpaceKHR color_space;
+
+    // Only possible if OpenGL leaves encoding to us:
+    if (demo->output_tf == OUTPUT_TF_NONE || output_tf == OUTPUT_TF_NONE || !demo->prepared)
+        return false;
+
+    if (!demo_colorspace_for_output_tf(demo, output_tf, &color_space)) {
+        printf("No swapchain colorspace for output transfer function %s. Skipped.\n", demo_output_tf_names[output_tf]);
+        return false;
+    }
+
+    vkDeviceWaitIdle(demo->device);
+
+    demo->output_tf = output_tf;
+
+    if (color_space != demo->color_space) {
+        printf("Switching swapchain colorspace from 0x%x to 0x%x for output transfer function %s.\n",
+               demo->color_space, color_space, demo_output_tf_names[output_tf]);
+
+        // Rebuilds the swapchain, framebuffers and command buffers with tf_pipelines[output_tf]:
+        demo->color_space = color_space;
+        demo->recreate_swapchain = true;
+        demo_resize(demo);
+        demo->recreate_swapchain = false;
+
+        // HDR metadata is per swapchain, so the new one needs it again:
+        demo_send_hdr_metadata(demo, demo->hdr_maxL, demo->hdr_avgL);
+        return true;
+    }
+
+    demo->pipeline = demo_tf_pipeline(demo, output_tf);
+
+    // The command pool doesn't allow resets of individual command buffers, so replace them:
+    const VkCommandBufferAllocateInfo cmd = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .pNext = NULL,
+        .commandPool = demo->cmd_pool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1,
+    };
+
+    for (uint32_t i = 0; i < demo->swapchainImageCount; i++) {
+        VkResult U_ASSERT_ONLY err;
+
+        vkFreeCommandBuffers(demo->device, demo->cmd_pool, 1, &demo->swapchain_image_resources[i].cmd);
+        err = vkAllocateCommandBuffers(demo->device, &cmd, &demo->swapchain_image_resources[i].cmd);
+        assert(!err);
+
+        demo->current_buffer = i;
+        demo_draw_build_cmd(demo, demo->swapchain_image_resources[i].cmd);
+    }
+    demo->current_buffer = current_buffer;
+
+    printf("Vulkan side output transfer function: %s\n", demo_output_tf_names[output_tf]);
+    return true;
+}
+
+// 't' key: Next output transfer function, in PQ, HLG, Linear, sRGB order, which the
+// surface offers a colorspace for:
+static void demo_cycle_output_tf(struct demo *demo)
+{
+    for (int n = 1; n < OUTPUT_TF_COUNT - 1; n++) {
+        if (demo_set_output_tf(demo, (demo->output_tf + n - 1) % (OUTPUT_TF_COUNT - 1) + 1))
+            break;
+    }
+}
+
+void demo_build_image_ownership_cmd(struct demo *demo, int i) {
+    VkResult U_ASSERT_ONLY err;
+
+    const VkCommandBufferBeginInfo cmd_buf_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .pNext = NULL,
+        .flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT,
+        .pInheritanceInfo = NULL,
+    };
+    err = vkBeginCommandBuffer(demo->swapchain_image_resources[i].graphics_to_present_cmd,
+                               &cmd_buf_info);
+    assert(!err);
+
+    VkImageMemoryBarrier image_ownership_barrier = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .pNext = NULL,
+        .srcAccessMask = 0,
+        .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+        .oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+        .newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+        .srcQueueFamilyIndex = demo->graphics_queue_family_index,
+        .dstQueueFamilyIndex = demo->present_queue_family_index,
+        .image = demo->swapchain_image_resources[i].image,
+        .subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1}};
+
+    vkCmdPipelineBarrier(demo->swapchain_image_resources[i].graphics_to_present_cmd,
+                         VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                         VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0, 0,
+                         NULL, 0, NULL, 1, &image_ownership_barrier);
+    err = vkEndCommandBuffer(demo->swapchain_image_resources[i].graphics_to_present_cmd);
+    assert(!err);
+}
+
+static uint64_t
+DemoRefreshDuration(struct demo *demo) {
+   VkRefreshCycleDurationGOOGLE rc_dur;
+   VkResult err;
+   err = demo->fpGetRefreshCycleDurationGOOGLE(demo->device,
+                           demo->swapchain,
+                           &rc_dur);
+   assert(!err);
+   return rc_dur.refreshDuration;
+}
+
+void DemoUpdateTargetIPD(struct demo *demo) {
+    // Look at what happened to previous presents, and make appropriate
+    // adjustments in timing:
+    VkResult U_ASSERT_ONLY err;
+    VkPastPresentationTimingGOOGLE* past = NULL;
+    uint32_t count = 0;
+
+    err = demo->fpGetPastPresentationTimingGOOGLE(demo->device,
+                                                  demo->swapchain,
+                                                  &count,
+                                                  NULL);
+    assert(!err);
+    if (count) {
+        past = (VkPastPresentationTimingGOOGLE*) malloc(sizeof(VkPastPresentationTimingGOOGLE) * count);
+        assert(past);
+        err = demo->fpGetPastPresentationTimingGOOGLE(demo->device,
+                                                      demo->swapchain,
+                                                      &count,
+                                                      past);
+        assert(!err);
+
+    uint64_t refresh_duration = DemoRefreshDuration(demo);
+
+        bool early = false;
+        bool late = false;
+        bool calibrate_next = false;
+        for (uint32_t i = 0 ; i < count ; i++) {
+
+            printf("%d: desired %f actual %f earliest %f gap %f\n",
+                   i,
+                   past[i].desiredPresentTime / 1e9,
+                   past[i].actualPresentTime / 1e9,
+                   past[i].earliestPresentTime / 1e9,
+                   past[i].actualPresentTime / 1e9 - past[i].earliestPresentTime / 1e9);
+
+
+            if (!demo->syncd_with_actual_presents) {
+                // This is the first time that we've received an
+                // actualPresentTime for this swapchain.  In order to not
+                // perceive these early frames as "late", we need to sync-up
+                // our future desiredPresentTime's with the
+                // actualPresentTime(s) that we're receiving now.
+                calibrate_next = true;
+
+                // So that we don't suspect any pending presents as late,
+                // record them all as suspected-late presents:
+                demo->last_late_id = demo->next_present_id - 1;
+                demo->last_early_id = 0;
+                demo->syncd_with_actual_presents = true;
+                break;
+            } else if (CanPresentEarlier(past[i].earliestPresentTime,
+                                         past[i].actualPresentTime,
+                                         past[i].presentMargin,
+                                         refresh_duration)) {
+                // This image could have been presented earlier.  We don't want
+                // to decrease the target_IPD until we've seen early presents
+                // for at least two seconds.
+                if (demo->last_early_id == past[i].presentID) {
+                    // We've now seen two seconds worth of early presents.
+                    // Flag it as such, and reset the counter:
+                    early = true;
+                    demo->last_early_id = 0;
+                } else if (demo->last_early_id == 0) {
+                    // This is the first early present we've seen.
+                    // Calculate the presentID for two seconds from now.
+                    uint64_t lastEarlyTime =
+                        past[i].actualPresentTime + (2 * BILLION);
+                    uint32_t howManyPresents =
+                        (uint32_t)((lastEarlyTime - past[i].actualPresentTime) / demo->target_IPD);
+                    demo->last_early_id = past[i].presentID + howManyPresents;
+                } else {
+                    // We are in the midst of a set of early images,
+                    // and so we won't do anything.
+                }
+                late = false;
+                demo->last_late_id = 0;
+            } else if (ActualTimeLate(past[i].desiredPresentTime,
+                                      past[i].actualPresentTime,
+                                      refresh_duration)) {
+                // This image was presented after its desired time.  Since
+                // there's a delay between calling vkQueuePresentKHR and when
+                // we get the timing data, several presents may have been late.
+                // Thus, we need to threat all of the outstanding presents as
+                // being likely late, so that we only increase the target_IPD
+                // once for all of those presents.
+                if ((demo->last_late_id == 0) ||
+                    (demo->last_late_id < past[i].presentID)) {
+                    late = true;
+                    // Record the last suspected-late present:
+                    demo->last_late_id = demo->next_present_id - 1;
+                } else {
+                    // We are in the midst of a set of likely-late images,
+                    // and so we won't do anything.
+                }
+                early = false;
+                demo->last_early_id = 0;
+            } else {
+                // Since this image was not presented early or late, reset
+                // any sets of early or late presentIDs:
+                early = false;
+                late = false;
+                calibrate_next = true;
+                demo->last_early_id = 0;
+                demo->last_late_id = 0;
+            }
+        }
+
+        if (early) {
+            // Since we've seen at least two-seconds worth of presnts that
+            // could have occured earlier than desired, let's decrease the
+            // target_IPD (i.e. increase the frame rate):
+            //
+            // TODO(ianelliott): Try to calculate a better target_IPD based
+            // on the most recently-seen present (this is overly-simplistic).
+            demo->refresh_duration_multiplier--;
+            if (demo->refresh_duration_multiplier == 0) {
+                // This should never happen, but in case it does, don't
+                // try to go faster.
+                demo->refresh_duration_multiplier = 1;
+            }
+        }
+        if (late) {
+            // Since we found a new instance of a late present, we want to
+            // increase the target_IPD (i.e. decrease the frame rate):
+            //
+            // TODO(ianelliott): Try to calculate a better target_IPD based
+            // on the most recently-seen present (this is overly-simplistic).
+            demo->refresh_duration_multiplier++;
+        }
+        demo->target_IPD =
+        refresh_duration * demo->refresh_duration_multiplier;
+
+        if (calibrate_next) {
+            int64_t multiple = demo->next_present_id - past[count-1].presentID - 1;
+            demo->prev_desired_present_time =
+                (past[count-1].actualPresentTime +
+                 (multiple * demo->target_IPD));
+        }
+    }
+}
+
+// MK: Peak luminance of the panel, for tone mapping:
+static float demo_panel_peak(struct demo *demo) {
+    return (demo->nativeDisplayHdrMetadata.maxLuminance > 0.0) ? demo->nativeDisplayHdrMetadata.maxLuminance : 600;
+}
+
+// MK: BT.2390 EETF parameters for mapping content up to source_peak nits into the
+// panel's luminance range. Identity if the content fits. Only marks the parameters
+// for upload if they actually changed:
+static void demo_update_eetf(struct demo *demo, float source_peak) {
+    const float target_peak = demo_panel_peak(demo);
+    float eetf[4];
+
+    if (source_peak > target_peak) {
+        eetf[0] = tf_pq_encode_ref(source_peak);
+        eetf[2] = tf_pq_encode_ref(target_peak) / eetf[0];
+        eetf[1] = 1.5f * eetf[2] - 0.5f;
+        if (eetf[1] < 0)
+            eetf[1] = 0;
+        eetf[3] = tf_pq_encode_ref(demo->nativeDisplayHdrMetadata.minLuminance) / eetf[0];
+    }
+    else {
+        // Knee start beyond the end of the normalized range:
+        eetf[0] = 1;
+        eetf[1] = 2;
+        eetf[2] = 1;
+        eetf[3] = 0;
+    }
+
+    if (memcmp(eetf, demo->eetf, sizeof(eetf))) {
+        memcpy(demo->eetf, eetf, sizeof(eetf));
+        demo->eetf_dirty = true;
+
+        if (source_peak > target_peak)
+            printf("Tone mapping %f nits content peak to %f nits panel peak.\n", source_peak, target_peak);
+        else
+            printf("No tone mapping, content fits into %f nits panel peak.\n", target_peak);
+    }
+}
+
+static void demo_send_hdr_metadata(struct demo *demo, float maxL, float avgL) {
+    VkHdrMetadataEXT hdr_metadata;
+
+    if (!demo->hdr_enabled)
+        return;
+
+    demo->hdr_maxL = maxL;
+    demo->hdr_avgL = avgL;
+
+    memset(&hdr_metadata, 0, sizeof(hdr_metadata));
+
+    hdr_metadata.sType = VK_STRUCTURE_TYPE_HDR_METADATA_EXT;
+    hdr_metadata.pNext = NULL;
+
+    // Note: These are the mastering display properties of
+    // my Samsung CH27HG70 FreeSync2 HDR monitor.
+    VkXYColorEXT pr = { 0.6767, 0.3164 };
+    VkXYColorEXT pg = { 0.2753, 0.6611 };
+    VkXYColorEXT pb = { 0.1523, 0.0615 };
+    VkXYColorEXT wp = { 0.3134, 0.3291 };
+
+    // BT 2020 color space selected as output color space?
+    if (false &&
+        (demo->color_space == VK_COLOR_SPACE_HDR10_ST2084_EXT ||
+        demo->color_space == VK_COLOR_SPACE_HDR10_HLG_EXT ||
+        demo->color_space == VK_COLOR_SPACE_BT2020_LINEAR_EXT)) {
+        printf("HDR metadata for BT2020 colorspace assigned.\n");
+        // Override to its gamut:
+        pr.x = 0.708;
+        pr.y = 0.292;
+        pg.x = 0.170;
+        pg.y = 0.797;
+        pb.x = 0.131;
+        pb.y = 0.046;
+
+        // D65 white point:
+        wp.x = 0.3127;
+        wp.y = 0.3290;
+    }
+
+    if (true) {
+        // Use  display native color gamut and properties:
+        printf("HDR metadata for display native gamut and luminance levels assigned.\n");
+        memcpy(&hdr_metadata, &demo->nativeDisplayHdrMetadata, sizeof(hdr_metadata));
+
+        // Hack for AMD Vulkan driver on Windows-10: Does set bogus/wrong maxLuminance,
+        // specifically it wrongly sets maxLuminance = maxFrameAverageLightLevel, and
+        // maxFrameAverageLightLevel == 0. The EDID's HDR static metadata corrects this
+        // in demo_apply_edid(). Without one, override with known values from Samsung
+        // CH27HG70 as a last resort:
+        if (!demo->edid.has_hdr && hdr_metadata.maxLuminance < 400) {
+            printf("Driver bug: maxLuminance wrong -- Setting to hard-coded 603.666 nits.\n");
+            hdr_metadata.maxLuminance = 603.666;
+        }
+
+        // If maxCLL is undefined, set it to max mastering display luminance:
+        if (hdr_metadata.maxContentLightLevel == 0)
+            hdr_metadata.maxContentLightLevel = hdr_metadata.maxLuminance;
+
+        // If maxFall is missing, set it to half maxCLL as a reasonable setting:
+        if (hdr_metadata.maxFrameAverageLightLevel == 0) {
+            printf("Driver bug? maxFrameAverageLightLevel missing -- Setting to half maxContentLightLevel.\n");
+            hdr_metadata.maxFrameAverageLightLevel = hdr_metadata.maxContentLightLevel / 2;
+        }
+    }
+
+    // Use maxL for maximum light levels, if provided:
+    if (maxL > 0) {
+        hdr_metadata.maxLuminance = maxL;
+        hdr_metadata.maxContentLightLevel = maxL;
+    }
+
+    // Use avgL for maxFALL, if provided:
+    if (avgL > 0) {
+        hdr_metadata.maxFrameAverageLightLevel = avgL;
+    }
+
+    // Minimum luminance is zero:
+    hdr_metadata.minLuminance = 0.0;
+
+    // Tone mapping content above panel peak ourselves? Then output stays within the panel's range:
+    if (demo->use_tonemap) {
+        const float peak = demo_panel_peak(demo);
+
+        if (hdr_metadata.maxLuminance > peak)
+            hdr_metadata.maxLuminance = peak;
+        if (hdr_metadata.maxContentLightLevel > peak)
+            hdr_metadata.maxContentLightLevel = peak;
+        if (hdr_metadata.maxFrameAverageLightLevel > peak)
+            hdr_metadata.maxFrameAverageLightLevel = peak;
+    }
+
+    printf("Set HDR DATA to:\n");
+    printf("Display Gamut  R: [%f, %f]\n", hdr_metadata.displayPrimaryRed.x, hdr_metadata.displayPrimaryRed.y);
+    printf("Display Gamut  G: [%f, %f]\n", hdr_metadata.displayPrimaryGreen.x, hdr_metadata.displayPrimaryGreen.y);
+    printf("Display Gamut  B: [%f, %f]\n", hdr_metadata.displayPrimaryBlue.x, hdr_metadata.displayPrimaryBlue.y);
+    printf("Display Gamut WP: [%f, %f]\n", hdr_metadata.whitePoint.x, hdr_metadata.whitePoint.y);
+    printf("Display minLuminance: %f nits\n", hdr_metadata.minLuminance);
+    printf("Display maxLuminance: %f nits\n", hdr_metadata.maxLuminance);
+    printf("Content maxFrameAverageLightLevel: %f nits\n", hdr_metadata.maxFrameAverageLightLevel);
+    printf("Content maxContentLightLevel: %f nits\n", hdr_metadata.maxContentLightLevel);
+
+    demo->fpSetHdrMetadataEXT(demo->device, 1, &demo->swapchain, &hdr_metadata);
+}
+
+// Content light levels as estimated by the test patterns. The content peak drives
+// tone mapping. HDR metadata is sent from them, unless measured per frame:
+static void demo_apply_content_light_levels(struct demo *demo, float maxL, float avgL) {
+    if (demo->use_tonemap)
+        demo_update_eetf(demo, maxL);
+
+    if (!demo->lightlevel_pipeline)
+        demo_send_hdr_metadata(demo, maxL, avgL);
+}
+
+void setHdrMetadata(struct demo *demo, float maxL, float avgL) {
+#if defined(VK_USE_PLATFORM_DISPLAY_KHR)
+    // MK: The OpenGL client thread must not touch the swapchain or the tone mapping
+    // state of the Vulkan thread. It only notes the levels for the image it renders,
+    // and the Vulkan thread applies them when it takes that image, see draw_opengl():
+    if (demo->glthread_running) {
+        demo->glthread_hdr_update = true;
+        demo->glthread_maxL = maxL;
+        demo->glthread_avgL = avgL;
+        return;
+    }
+#endif
+
+    demo_apply_content_light_levels(demo, maxL, avgL);
+}
+
+// MK: Finish the MaxCLL / MaxFALL reduction of the last frame rendered into the
+// current swapchain image. Called once that image was acquired again, so its
+// previous rendering is usually complete and waiting for its fence rarely
+// stalls. Acquire alone doesn't guarantee that though. Only sends new HDR
+// metadata if the light levels changed noticeably, as each update may cause
+// the display to resync:
+static void demo_update_lightlevel(struct demo *demo) {
+    SwapchainImageResources *res = &demo->swapchain_image_resources[demo->current_buffer];
+    const uint32_t count = demo->lightlevel_groups[0] * demo->lightlevel_groups[1];
+    float maxcll = 0, maxfall;
+    double sum = 0;
+    uint32_t i;
+
+    if (!demo->lightlevel_pipeline || !res->lightlevel_pending)
+        return;
+
+    res->lightlevel_pending = false;
+
+    VkResult U_ASSERT_ONLY err;
+    err = vkWaitForFences(demo->device, 1, &res->lightlevel_fence, VK_TRUE, UINT64_MAX);
+    assert(!err);
+    err = vkResetFences(demo->device, 1, &res->lightlevel_fence);
+    assert(!err);
+
+    for (i = 0; i < count; i++) {
+        if (res->lightlevel_data[2 * i] > maxcll)
+            maxcll = res->lightlevel_data[2 * i];
+        sum += res->lightlevel_data[2 * i + 1];
+    }
+
+    maxfall = (float) (sum / ((double) demo->width * demo->height));
+
+    // Zero would mean "use display defaults" to demo_send_hdr_metadata(), so at least 1 nit:
+    maxcll = (maxcll > 1) ? maxcll : 1;
+    maxfall = (maxfall > 1) ? maxfall : 1;
+
+    if (fabsf(maxcll - demo->maxcll) > LIGHTLEVEL_THRESHOLD * demo->maxcll ||
+        fabsf(maxfall - demo->maxfall) > LIGHTLEVEL_THRESHOLD * demo->maxfall) {
+        printf("Measured MaxCLL %f nits, MaxFALL %f nits.\n", maxcll, maxfall);
+        demo->maxcll = maxcll;
+        demo->maxfall = maxfall;
+        demo_send_hdr_metadata(demo, maxcll, maxfall);
+    }
+}
+
+// Forward define:
+void draw_opengl(struct demo *demo);
+#if defined(VK_USE_PLATFORM_DISPLAY_KHR)
+static struct upload_slot *demo_movie_update(struct demo *demo, uint64_t tSwapComplete, uint64_t ifi);
+#endif
+
+static void demo_draw(struct demo *demo) {
+    static uint64_t tStartTime = 0;
+    static uint64_t tlastSwapComplete = 0;
+    static uint64_t tPostSwapRequested = 0;
+    static bool firsttime = true;
+    uint64_t tSwapComplete;
+    VkResult U_ASSERT_ONLY err;
+
+    if (tlastSwapComplete == 0) {
+        tlastSwapComplete = getTimeInNanoseconds();
+        tStartTime = tlastSwapComplete;
+    }
+
+    if (false) {
+        // Ensure no more than FRAME_LAG renderings are outstanding
+        vkWaitForFences(demo->device, 1, &demo->fences[demo->frame_index], VK_TRUE, UINT64_MAX);
+        vkResetFences(demo->device, 1, &demo->fences[demo->frame_index]);
+    }
+
+    // Get the index of the next available swapchain image:
+    // Both image_acquired_semaphores[demo->frame_index] and the flipcompletefence
+    // will signal when the display engine is done with scanning out the acquired
+    // image, ergo, when it was replaced as old frontbuffer by a new frontbuffer,
+    // which was our old backbuffer, iow. when the previously scheduled swap/present
+    // actually completed due to kms-pageflip completion:
+    err = demo->fpAcquireNextImageKHR(demo->device, demo->swapchain, UINT64_MAX,
+                                      demo->image_acquired_semaphores[demo->frame_index],
+                                      demo->flipcompletefence, &demo->current_buffer);
+
+    if (err == VK_ERROR_OUT_OF_DATE_KHR) {
+        // demo->swapchain is out of date (e.g. the window was resized) and
+        // must be recreated:
+        demo->frame_index += 1;
+        demo->frame_index %= FRAME_LAG;
+
+        demo_resize(demo);
+        demo_draw(demo);
+        return;
+    } else if (err == VK_SUBOPTIMAL_KHR) {
+        // demo->swapchain is not as optimal as it could be, but the platform's
+        // presentation engine will still present the image correctly.
+    } else {
+        assert(!err);
+    }
+
+    // Wait for flipcompletefence to signal, iow. for confirmed flip completion aka
+    // visual stimulus onset. Then reset the fence and timestamp the moment:
+    vkWaitForFences(demo->device, 1, &demo->flipcompletefence, VK_TRUE, UINT64_MAX);
+    vkResetFences(demo->device, 1, &demo->flipcompletefence);
+    tSwapComplete = getTimeInNanoseconds();
+
+    demo_update_lightlevel(demo);
+
+#if defined(VK_USE_PLATFORM_XLIB_XRANDR_EXT)
+    // Use the precise timestamping, based on high-precision vblank timestamps iff we present synchronized
+    // to vblank for tear-free presentation:
+    if (demo->presentMode == VK_PRESENT_MODE_FIFO_KHR || demo->presentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
+        // Under Linux + X11 we can (ab)use our X11 window on the same output that is
+        // leased out to Vulkan to use the glXGetSyncValuesOML() call on the Mesa FOSS
+        // based drivers to get a precise start of scanout timestamp at end of most
+        // recent vblank. Ideally this will be almost identical to tSwapComplete, ie.
+        // tSwapComplete is a noisy approximation of the proper queried ust here.
+        // Indeed, this works on AMD:
+        uint64_t ust, msc, sbc;
+        double serror;
+
+        if ((NULL != glXGetSyncValuesOML) && glXGetSyncValuesOML(demo->display, demo->drawable, &ust, &msc, &sbc)) {
+            // Timestamp disagreement of less than 1 msec is considered correct:
+            serror = ((double) tSwapComplete / 1000.0) - (double) ust;
+            if (demo->timestamping_enabled) {
+                if (serror < 1000)
+                    printf("OK: ");
+
+                printf("msc %li, tSwapComplete %li - ust %li = %f usecs stimonset error: ", msc, tSwapComplete, ust * 1000, serror);
+            }
+
+            // Override with accurate value:
+            tSwapComplete = ust * 1000;
+        }
+    }
+#endif
+
+    if (demo->timestamping_enabled)
+        printf("ifi = %f msecs. tSwapComplete - tPostSwapRequested = %f msecs.\n",
+               (double)(tSwapComplete - tlastSwapComplete) / 1000000.0,
+               (double)(tSwapComplete - tPostSwapRequested) / 1000000.0);
+
+#if defined(VK_USE_PLATFORM_DISPLAY_KHR)
+    struct upload_slot *movie_slot = NULL;
+    if (demo->use_movie)
+        movie_slot = demo_movie_update(demo, tSwapComplete, tSwapComplete - tlastSwapComplete);
+#endif
+
+    // Update last swap complete for next cycle:
+    tlastSwapComplete = tSwapComplete;
+
+    if (demo->VK_GOOGLE_display_timing_enabled) {
+        // Look at what happened to previous presents, and make appropriate
+        // adjustments in timing:
+        DemoUpdateTargetIPD(demo);
+
+        // Note: a real application would position its geometry to that it's in
+        // the correct locatoin for when the next image is presented.  It might
+        // also wait, so that there's less latency between any input and when
+        // the next image is rendered/presented.  This demo program is so
+        // simple that it doesn't do either of those.
+    }
+
+    #if defined(VK_USE_PLATFORM_DISPLAY_KHR) || defined(VK_USE_PLATFORM_WIN32_KHR)
+        // Movie frames are uploaded into the interop image by Vulkan instead:
+        if (!demo->use_movie)
+            draw_opengl(demo);
+    #endif
+
+    // Wait for the image acquired semaphore to be signaled to ensure
+    // that the image won't be rendered to until the presentation
+    // engine has fully released ownership to the application, and it is
+    // okay to render to the image.
+    VkPipelineStageFlags pipe_stage_flags[2];
+    VkSemaphore wait_semaphores[2] = { demo->image_acquired_semaphores[demo->frame_index], demo->interop_gl_complete };
+    VkSemaphore signal_semaphores[2] = { demo->draw_complete_semaphores[demo->frame_index], demo->interop_gl_ready };
+    VkSubmitInfo submit_info;
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.pNext = NULL;
+    submit_info.pWaitDstStageMask = pipe_stage_flags;
+    pipe_stage_flags[0] = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    pipe_stage_flags[1] = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT; // Makes OpenGL's writes visible to the first barrier.
+    submit_info.waitSemaphoreCount = 1;
+    submit_info.pWaitSemaphores = wait_semaphores;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &demo->swapchain_image_resources[demo->current_buffer].cmd;
+    submit_info.signalSemaphoreCount = 1;
+    submit_info.pSignalSemaphores = signal_semaphores;
+
+    // MK: If OpenGL handed us a new interop image via semaphore, wait for it, and
+    // tell OpenGL when we are done reading it:
+    if (demo->interop_gl_signalled) {
+        submit_info.waitSemaphoreCount = 2;
+        submit_info.signalSemaphoreCount = 2;
+        demo->interop_gl_signalled = false;
+        demo->interop_vk_signalled = true;
+    }
+
+#if defined(VK_USE_PLATFORM_DISPLAY_KHR)
+    // MK: Upload a new movie frame ahead of the draw commands, which wait for it
+    // by the barrier at the end of the upload:
+    if (movie_slot)
+        demo_upload_submit(demo, movie_slot);
+#endif
+
+    err = vkQueueSubmit(demo->graphics_queue, 1, &submit_info,
+                        demo->fences[demo->frame_index]);
+    assert(!err);
+
+    // MK: An empty submission signals its fence once all prior work on the
+    // queue, including the frame that wrote the light level results, is done:
+    if (demo->lightlevel_pipeline) {
+        err = vkQueueSubmit(demo->graphics_queue, 0, NULL,
+                            demo->swapchain_image_resources[demo->current_buffer].lightlevel_fence);
+        assert(!err);
+        demo->swapchain_image_resources[demo->current_buffer].lightlevel_pending = true;
+    }
+
+    if (demo->separate_present_queue) {
+        // If we are using separate queues, change image ownership to the
+        // present queue before presenting, waiting for the draw complete
+        // semaphore and signalling the ownership released semaphore when finished
+        VkFence nullFence = VK_NULL_HANDLE;
+        pipe_stage_flags[0] = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        submit_info.waitSemaphoreCount = 1;
+        submit_info.pWaitSemaphores = &demo->draw_complete_semaphores[demo->frame_index];
+        submit_info.commandBufferCount = 1;
+        submit_info.pCommandBuffers =
+            &demo->swapchain_image_resources[demo->current_buffer].graphics_to_present_cmd;
+        submit_info.signalSemaphoreCount = 1;
+        submit_info.pSignalSemaphores = &demo->image_ownership_semaphores[demo->frame_index];
+        err = vkQueueSubmit(demo->present_queue, 1, &submit_info, nullFence);
+        assert(!err);
+    }
+
+    // If we are using separate queues we have to wait for image ownership,
+    // otherwise wait for draw complete
+    VkPresentInfoKHR present = {
+        .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+        .pNext = NULL,
+        .waitSemaphoreCount = 1,
+        .pWaitSemaphores = (demo->separate_present_queue)
+                               ? &demo->image_ownership_semaphores[demo->frame_index]
+                               : &demo->draw_complete_semaphores[demo->frame_index],
+        .swapchainCount = 1,
+        .pSwapchains = &demo->swapchain,
+        .pImageIndices = &demo->current_buffer,
+    };
+
+    if (demo->VK_KHR_incremental_present_enabled) {
+        // If using VK_KHR_incremental_present, we provide a hint of the region
+        // that contains changed content relative to the previously-presented
+        // image.  The implementation can use this hint in order to save
+        // work/power (by only copying the region in the hint).  The
+        // implementation is free to ignore the hint though, and so we must
+        // ensure that the entire image has the correctly-drawn content.
+        uint32_t eighthOfWidth = demo->width / 8;
+        uint32_t eighthOfHeight = demo->height / 8;
+        VkRectLayerKHR rect = {
+            .offset.x = eighthOfWidth,
+            .offset.y = eighthOfHeight,
+            .extent.width = eighthOfWidth * 6,
+            .extent.height = eighthOfHeight * 6,
+            .layer = 0,
+        };
+        VkPresentRegionKHR region = {
+            .rectangleCount = 1,
+            .pRectangles = &rect,
+        };
+        VkPresentRegionsKHR regions = {
+            .sType = VK_STRUCTURE_TYPE_PRESENT_REGIONS_KHR,
+            .pNext = present.pNext,
+            .swapchainCount = present.swapchainCount,
+            .pRegions = &region,
+        };
+        present.pNext = &regions;
+    }
+
+    if (demo->VK_GOOGLE_display_timing_enabled) {
+        VkPresentTimeGOOGLE ptime;
+        if (demo->prev_desired_present_time == 0) {
+            // This must be the first present for this swapchain.
+            //
+            // We don't know where we are relative to the presentation engine's
+            // display's refresh cycle.  We also don't know how long rendering
+            // takes.  Let's make a grossly-simplified assumption that the
+            // desiredPresentTime should be half way between now and
+            // now+target_IPD.  We will adjust over time.
+            uint64_t curtime = getTimeInNanoseconds();
+            if (curtime == 0) {
+                // Since we didn't find out the current time, don't give a
+                // desiredPresentTime:
+                ptime.desiredPresentTime = 0;
+            } else {
+                ptime.desiredPresentTime = curtime + (demo->target_IPD >> 1);
+            }
+        } else {
+            ptime.desiredPresentTime = (demo->prev_desired_present_time +
+                                        demo->target_IPD);
+        }
+
+        printf("\tdesired present time %f delta %f\n",
+               ptime.desiredPresentTime / 1e9,
+               ptime.desiredPresentTime / 1e9 - demo->prev_desired_present_time / 1e9);
+
+        ptime.presentID = demo->next_present_id++;
+        demo->prev_desired_present_time = ptime.desiredPresentTime;
+
+        VkPresentTimesInfoGOOGLE present_time = {
+            .sType = VK_STRUCTURE_TYPE_PRESENT_TIMES_INFO_GOOGLE,
+            .pNext = present.pNext,
+            .swapchainCount = present.swapchainCount,
+            .pTimes = &ptime,
+        };
+        if (demo->VK_GOOGLE_display_timing_enabled) {
+            present.pNext = &present_time;
+        }
+    }
+
+#ifndef WIN32
+    if (demo->waitMsecs >= 0) {
+        usleep(demo->waitMsecs * 1000);
+    }
+    else {
+        // Randomized wait time:
+        usleep(-1000 * demo->waitMsecs * ((double) random() / (double) RAND_MAX));
+    }
+#else
+    Sleep(demo->waitMsecs);
+#endif
+
+    uint64_t tPreSwapRequested = getTimeInNanoseconds();
+    err = demo->fpQueuePresentKHR(demo->present_queue, &present);
+    tPostSwapRequested = getTimeInNanoseconds();
+
+    demo->frame_index += 1;
+    demo->frame_index %= FRAME_LAG;
+
+#if 0
+    if (demo->fpGetSwapchainCounterEXT) {
+    uint64_t counter;
+
+    demo->fpGetSwapchainCounterEXT(demo->device,
+                       demo->swapchain,
+                       0,
+                       &counter);
+    }
+#endif
+
+    if (err == VK_ERROR_OUT_OF_DATE_KHR) {
+        // demo->swapchain is out of date (e.g. the window was resized) and
+        // must be recreated:
+        demo_resize(demo);
+    } else if (err == VK_SUBOPTIMAL_KHR) {
+        // demo->swapchain is not as optimal as it could be, but the platform's
+        // presentation engine will still present the image correctly.
+    } else {
+        assert(!err);
+    }
+
+    if (false)
+        printf("tPostSwapRequested - tPreSwapRequested = %f msecs. tPostSwapRequested - tSwapComplete = %f msecs.\n",
+            (double)(tPostSwapRequested - tPreSwapRequested) / 1000000.0,
+            (double)(tPostSwapRequested - tSwapComplete) / 1000000.0);
+}
+
+static void demo_prepare_buffers(struct demo *demo) {
+    VkResult U_ASSERT_ONLY err;
+    VkSwapchainKHR oldSwapchain = demo->swapchain;
+
+    // Check the surface capabilities and formats
+    VkSurfaceCapabilitiesKHR surfCapabilities;
+    err = demo->fpGetPhysicalDeviceSurfaceCapabilitiesKHR(
+        demo->gpu, demo->surface, &surfCapabilities);
+    assert(!err);
+
+    uint32_t presentModeCount;
+    err = demo->fpGetPhysicalDeviceSurfacePresentModesKHR(
+        demo->gpu, demo->surface, &presentModeCount, NULL);
+    assert(!err);
+    VkPresentModeKHR *presentModes =
+        (VkPresentModeKHR *)malloc(presentModeCount * sizeof(VkPresentModeKHR));
+    assert(presentModes);
+    err = demo->fpGetPhysicalDeviceSurfacePresentModesKHR(
+        demo->gpu, demo->surface, &presentModeCount, presentModes);
+    assert(!err);
+    printf("%d present modes [0] = %d\n", presentModeCount, presentModes[0]);
+
+    VkExtent2D swapchainExtent;
+    // width and height are either both 0xFFFFFFFF, or both not 0xFFFFFFFF.
+    if (surfCapabilities.currentExtent.width == 0xFFFFFFFF) {
+        // If the surface size is undefined, the size is set to the size
+        // of the images requested, which must fit within the minimum and
+        // maximum values.
+        swapchainExtent.width = demo->width;
+        swapchainExtent.height = demo->height;
+
+        if (swapchainExtent.width < surfCapabilities.minImageExtent.width) {
+            swapchainExtent.width = surfCapabilities.minImageExtent.width;
+        } else if (swapchainExtent.width > surfCapabilities.maxImageExtent.width) {
+            swapchainExtent.width = surfCapabilities.maxImageExtent.width;
+        }
+
+        if (swapchainExtent.height < surfCapabilities.minImageExtent.height) {
+            swapchainExtent.height = surfCapabilities.minImageExtent.height;
+        } else if (swapchainExtent.height > surfCapabilities.maxImageExtent.height) {
+            swapchainExtent.height = surfCapabilities.maxImageExtent.height;
+        }
+    } else {
+        // If the surface size is defined, the swap chain size must match
+        swapchainExtent = surfCapabilities.currentExtent;
+        demo->width = surfCapabilities.currentExtent.width;
+        demo->height = surfCapabilities.currentExtent.height;
+        printf("Swapchain size: %i x %i\n", demo->width, demo->height);
+    }
+
+    // The FIFO present mode is guaranteed by the spec to be supported
+    // and to have no tearing.  It's a great default present mode to use.
+    VkPresentModeKHR swapchainPresentMode = VK_PRESENT_MODE_FIFO_KHR;
+
+    //  There are times when you may wish to use another present mode.  The
+    //  following code shows how to select them, and the comments provide some
+    //  reasons you may wish to use them.
+    //
+    // It should be noted that Vulkan 1.0 doesn't provide a method for
+    // synchronizing rendering with the presentation engine's display.  There
+    // is a method provided for throttling rendering with the display, but
+    // there are some presentation engines for which this method will not work.
+    // If an application doesn't throttle its rendering, and if it renders much
+    // faster than the refresh rate of the display, this can waste power on
+    // mobile devices.  That is because power is being spent rendering images
+    // that may never be seen.
+
+    // VK_PRESENT_MODE_IMMEDIATE_KHR is for applications that don't care about
+    // tearing, or have some way of synchronizing their rendering with the
+    // display.
+    // VK_PRESENT_MODE_MAILBOX_KHR may be useful for applications that
+    // generally render a new presentable image every refresh cycle, but are
+    // occasionally early.  In this case, the application wants the new image
+    // to be displayed instead of the previously-queued-for-presentation image
+    // that has not yet been displayed.
+    // VK_PRESENT_MODE_FIFO_RELAXED_KHR is for applications that generally
+    // render a new presentable image every refresh cycle, but are occasionally
+    // late.  In this case (perhaps because of stuttering/latency concerns),
+    // the application wants the late image to be immediately displayed, even
+    // though that may mean some tearing.
+
+    if (demo->presentMode !=  swapchainPresentMode) {
+
+        for (size_t i = 0; i < presentModeCount; ++i) {
+            if (presentModes[i] == demo->presentMode) {
+                swapchainPresentMode = demo->presentMode;
+                break;
+            }
+        }
+    }
+    if (swapchainPresentMode != demo->presentMode) {
+        ERR_EXIT("Present mode specified is not supported\n", "Present mode unsupported");
+    }
+
+    // Determine the number of VkImages to use in the swap chain.
+    // Application desires to acquire 2 images at a time for double
+    // buffering: MK Changed to 2 for timestamping hack.
+    uint32_t desiredNumOfSwapchainImages = 2;
+    if (desiredNumOfSwapchainImages < surfCapabilities.minImageCount) {
+        desiredNumOfSwapchainImages = surfCapabilities.minImageCount;
+    }
+    // If maxImageCount is 0, we can ask for as many images as we want;
+    // otherwise we're limited to maxImageCount
+    if ((surfCapabilities.maxImageCount > 0) &&
+        (desiredNumOfSwapchainImages > surfCapabilities.maxImageCount)) {
+        // Application must settle for fewer images than desired:
+        desiredNumOfSwapchainImages = surfCapabilities.maxImageCount;
+    }
+
+    VkSurfaceTransformFlagsKHR preTransform;
+    if (surfCapabilities.supportedTransforms &
+        VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR) {
+        preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
+    } else {
+        preTransform = surfCapabilities.currentTransform;
+    }
+
+    // Find a supported composite alpha mode - one of these is guaranteed to be set
+    VkCompositeAlphaFlagBitsKHR compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+    VkCompositeAlphaFlagBitsKHR compositeAlphaFlags[4] = {
+        VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
+        VK_COMPOSITE_ALPHA_PRE_MULTIPLIED_BIT_KHR,
+        VK_COMPOSITE_ALPHA_POST_MULTIPLIED_BIT_KHR,
+        VK_COMPOSITE_ALPHA_INHERIT_BIT_KHR,
+    };
+    for (uint32_t i = 0; i < sizeof(compositeAlphaFlags); i++) {
+        if (surfCapabilities.supportedCompositeAlpha & compositeAlphaFlags[i]) {
+            compositeAlpha = compositeAlphaFlags[i];
+            break;
+        }
+    }
+
+#if defined(WIN32)
+    VkSurfaceFullScreenExclusiveWin32InfoEXT fullscreen_exclusive_info_win32 = {
+        .sType = VK_STRUCTURE_TYPE_SURFACE_FULL_SCREEN_EXCLUSIVE_WIN32_INFO_EXT,
+        .pNext = NULL,
+        .hmonitor = MonitorFromWindow(demo->window, MONITOR_DEFAULTTOPRIMARY),
+    };
+
+    VkSurfaceFullScreenExclusiveInfoEXT fullscreen_exclusive_info = {
+        .sType = VK_STRUCTURE_TYPE_SURFACE_FULL_SCREEN_EXCLUSIVE_INFO_EXT,
+        .pNext = &fullscreen_exclusive_info_win32,
+        .fullScreenExclusive = VK_FULL_SCREEN_EXCLUSIVE_APPLICATION_CONTROLLED_EXT,
+    };
+#endif
+
+    // Compute shader format conversion needs to write the swapchain images as storage images:
+    if (demo->use_compute_convert && (demo->interop_tex_format != demo->format)) {
+        VkFormatProperties format_props;
+
+        vkGetPhysicalDeviceFormatProperties(demo->gpu, demo->format, &format_props);
+        if (!(surfCapabilities.supportedUsageFlags & VK_IMAGE_USAGE_STORAGE_BIT) ||
+            !(format_props.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT) ||
+            !demo->storage_write_without_format) {
+            printf("Swapchain can't be written by compute shader. Using vkCmdBlitImage() for format conversion.\n");
+            demo->use_compute_convert = false;
+        }
+    }
+
+    VkSwapchainCreateInfoKHR swapchain_ci = {
+        .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
+#if defined(WIN32)
+        .pNext = &fullscreen_exclusive_info,
+#else
+        .pNext = NULL,
+#endif
+        .surface = demo->surface,
+        .minImageCount = desiredNumOfSwapchainImages,
+        .imageFormat = demo->format,
+        .imageColorSpace = demo->color_space,
+        .imageExtent =
+            {
+             .width = swapchainExtent.width, .height = swapchainExtent.height,
+            },
+        .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+                      ((demo->use_compute_convert) ? VK_IMAGE_USAGE_STORAGE_BIT : 0),
+        .preTransform = preTransform,
+        .compositeAlpha = compositeAlpha,
+        .imageArrayLayers = 1,
+        .imageSharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount = 0,
+        .pQueueFamilyIndices = NULL,
+        .presentMode = swapchainPresentMode,
+        .oldSwapchain = oldSwapchain,
+        .clipped = true,
+    };
+    uint32_t i;
+    err = demo->fpCreateSwapchainKHR(demo->device, &swapchain_ci, NULL,
+                                     &demo->swapchain);
+    assert(!err);
+
+    // If we just re-created an existing swapchain, we should destroy the old
+    // swapchain at this point.
+    // Note: destroying the swapchain also cleans up all its associated
+    // presentable images once the platform is done with them.
+    if (oldSwapchain != VK_NULL_HANDLE) {
+        // AMD driver times out waiting on fences used in AcquireNextImage on
+        // a swapchain that is subsequently destroyed before the wait.
+        vkWaitForFences(demo->device, FRAME_LAG, demo->fences, VK_TRUE, UINT64_MAX);
+//        vkResetFences(demo->device, FRAME_LAG, demo->fences);
+        demo->fpDestroySwapchainKHR(demo->device, oldSwapchain, NULL);
+    }
+
+    err = demo->fpGetSwapchainImagesKHR(demo->device, demo->swapchain,
+                                        &demo->swapchainImageCount, NULL);
+    assert(!err);
+
+    // MK Important for timestamping hack:
+    if (demo->swapchainImageCount > desiredNumOfSwapchainImages) {
+        printf("Got %i swapchain images, more than the desired %i ones. Clamping.\n",
+               demo->swapchainImageCount, desiredNumOfSwapchainImages);
+        demo->swapchainImageCount = desiredNumOfSwapchainImages;
+    }
+
+    VkImage *swapchainImages =
+        (VkImage *)malloc(demo->swapchainImageCount * sizeof(VkImage));
+    assert(swapchainImages);
+    err = demo->fpGetSwapchainImagesKHR(demo->device, demo->swapchain,
+                                        &demo->swapchainImageCount,
+                                        swapchainImages);
+    assert(err == VK_INCOMPLETE || err == VK_SUCCESS);
+
+    demo->swapchain_image_resources = (SwapchainImageResources *)malloc(sizeof(SwapchainImageResources) *
+                                               demo->swapchainImageCount);
+    assert(demo->swapchain_image_resources);
+
+    for (i = 0; i < demo->swapchainImageCount; i++) {
+        VkImageViewCreateInfo color_image_view = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+            .pNext = NULL,
+            .format = demo->format,
+            .components =
+                {
+                 .r = VK_COMPONENT_SWIZZLE_R,
+                 .g = VK_COMPONENT_SWIZZLE_G,
+                 .b = VK_COMPONENT_SWIZZLE_B,
+                 .a = VK_COMPONENT_SWIZZLE_A,
+                },
+            .subresourceRange = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                                 .baseMipLevel = 0,
+                                 .levelCount = 1,
+                                 .baseArrayLayer = 0,
+                                 .layerCount = 1},
+            .viewType = VK_IMAGE_VIEW_TYPE_2D,
+            .flags = 0,
+        };
+
+        demo->swapchain_image_resources[i].image = swapchainImages[i];
+
+        color_image_view.image = demo->swapchain_image_resources[i].image;
+
+        err = vkCreateImageView(demo->device, &color_image_view, NULL,
+                                &demo->swapchain_image_resources[i].view);
+        assert(!err);
+    }
+
+    if (demo->VK_GOOGLE_display_timing_enabled) {
+        VkRefreshCycleDurationGOOGLE rc_dur;
+        err = demo->fpGetRefreshCycleDurationGOOGLE(demo->device,
+                                                    demo->swapchain,
+                                                    &rc_dur);
+        assert(!err);
+
+        demo->syncd_with_actual_presents = false;
+        // Initially target 1X the refresh duration:
+        demo->refresh_duration_multiplier = 1;
+        demo->target_IPD = DemoRefreshDuration(demo) * demo->refresh_duration_multiplier;
+
+        demo->prev_desired_present_time = 0;
+        demo->next_present_id = 1;
+    }
+
+    if (NULL != presentModes) {
+        free(presentModes);
+    }
+
+#if defined(WIN32)
+    err = demo->fpAcquireFullScreenExclusiveModeEXT(demo->device, demo->swapchain);
+    switch (err) {
+        case VK_SUCCESS:
+            printf("Switched to fullscreen exclusive mode.\n");
+            break;
+
+        case VK_ERROR_INITIALIZATION_FAILED:
+            printf("Could not switch to fullscreen exclusive mode.\n");
+            break;
+
+        default:
+            printf("Error during switch to fullscreen exclusive mode.\n");
+            break;
+    }
+#endif
+
+    if (demo->hdr_enabled) {
+        if (demo->fpSetLocalDimmingAMD)
+            demo->fpSetLocalDimmingAMD(demo->device, demo->swapchain, demo->local_dimming_enabled);
+    }
+}
+
+// MK: The image cache is not thread safe, but the OpenGL client thread uploads
+// from it and may flush it while the main thread reloads textures on resize.
+// Views must only be used while holding the lock:
+#if defined(VK_USE_PLATFORM_DISPLAY_KHR)
+static pthread_mutex_t demo_image_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void demo_lock_image_cache(void)
+{
+#if defined(VK_USE_PLATFORM_DISPLAY_KHR)
+    pthread_mutex_lock(&demo_image_cache_mutex);
+#endif
+}
+
+static void demo_unlock_image_cache(void)
+{
+#if defined(VK_USE_PLATFORM_DISPLAY_KHR)
+    pthread_mutex_unlock(&demo_image_cache_mutex);
+#endif
+}
+
+/* Load a ppm file into memory */
+bool loadTexture(const char *filename, uint8_t *rgba_data,
+                 VkSubresourceLayout *layout, int32_t *width, int32_t *height) {
+
+#if (defined(VK_USE_PLATFORM_IOS_MVK) || defined(VK_USE_PLATFORM_MACOS_MVK))
+    filename =[[[NSBundle mainBundle] resourcePath] stringByAppendingPathComponent: @(filename)].UTF8String;
+#endif
+
+#ifdef __ANDROID__
+#include <lunarg.ppm.h>
+    char *cPtr;
+    cPtr = (char*)lunarg_ppm;
+    if ((unsigned char*)cPtr >= (lunarg_ppm + lunarg_ppm_len) || strncmp(cPtr, "P6\n", 3)) {
+        return false;
+    }
+    while(strncmp(cPtr++, "\n", 1));
+    sscanf(cPtr, "%u %u", width, height);
+    if (rgba_data == NULL) {
+        return true;
+    }
+    while(strncmp(cPtr++, "\n", 1));
+    if ((unsigned char*)cPtr >= (lunarg_ppm + lunarg_ppm_len) || strncmp(cPtr, "255\n", 4)) {
+        return false;
+    }
+    while(strncmp(cPtr++, "\n", 1));
+
+    for (int y = 0; y < *height; y++) {
+        uint8_t *rowPtr = rgba_data;
+        for (int x = 0; x < *width; x++) {
+            memcpy(rowPtr, cPtr, 3);
+            rowPtr[3] = 255; /* Alpha of 1 */
+            rowPtr += 4;
+            cPtr += 3;
+        }
+        rgba_data += layout->rowPitch;
+    }
+
+    return true;
+#else
+    // MK: Each file is only decoded once, into the image cache shared with the OpenGL
+    // uploads, and copied from there to the destination at its row pitch:
+    struct ppm_view view;
+
+    demo_lock_image_cache();
+
+    if (!ppm_cache_get(filename, &view)) {
+        demo_unlock_image_cache();
+        return false;
+    }
+
+    *width = view.width;
+    *height = view.height;
+
+    if (rgba_data)
+        ppm_view_copy(&view, rgba_data, layout->rowPitch);
+
+    demo_unlock_image_cache();
+    return true;
+#endif
+}
+
+// MK: Free the decoded images once all uploads which share them are done, so they
+// don't stay resident for the whole session. Later loads decode again:
+static void demo_flush_image_cache(void)
+{
+    demo_lock_image_cache();
+    printf("Image cache: %i decodes, %i hits, flushed.\n", ppm_cache.decodes, ppm_cache.hits);
+    ppm_cache_flush();
+    demo_unlock_image_cache();
+}
+
+// MK: Close exported interop handles which are still owned by us, ie. which
+// were not (successfully) imported by OpenGL. A successful fd import transfers
+// ownership to the GL, Win32 handle imports never do:
+static void demo_release_interop_handles(struct demo *demo) {
+#ifdef WIN32
+    if (demo->interophandles.memory)
+        CloseHandle(demo->interophandles.memory);
+    if (demo->interophandles.glReady)
+        CloseHandle(demo->interophandles.glReady);
+    if (demo->interophandles.glComplete)
+        CloseHandle(demo->interophandles.glComplete);
+
+    memset(&demo->interophandles, 0, sizeof(demo->interophandles));
+#else
+    if (demo->interophandles.memory >= 0)
+        close(demo->interophandles.memory);
+    if (demo->interophandles.glReady >= 0)
+        close(demo->interophandles.glReady);
+    if (demo->interophandles.glComplete >= 0)
+        close(demo->interophandles.glComplete);
+
+    // 0 is a valid fd, so -1 means no handle:
+    demo->interophandles.memory = demo->interophandles.glReady = demo->interophandles.glComplete = -1;
+#endif
+}
+
+#if !defined(WIN32)
+// MK: Export fd's for the interop semaphores, if any, for import by OpenGL:
+static void demo_export_interop_semaphores(struct demo *demo) {
+    VkResult U_ASSERT_ONLY err;
+
+    if (!demo->interop_gl_complete)
+        return;
+
+    VkSemaphoreGetFdInfoKHR semaphoregetfdinfo = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_GET_FD_INFO_KHR,
+        .pNext = NULL,
+        .semaphore = demo->interop_gl_ready,
+        .handleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_OPAQUE_FD_BIT,
+    };
+
+    err = demo->fpGetSemaphoreFdKHR(demo->device, &semaphoregetfdinfo, &demo->interophandles.glReady);
+    assert(!err);
+
+    semaphoregetfdinfo.semaphore = demo->interop_gl_complete;
+    err = demo->fpGetSemaphoreFdKHR(demo->device, &semaphoregetfdinfo, &demo->interophandles.glComplete);
+    assert(!err);
+
+    printf("GOT semaphore fds %i and %i\n", demo->interophandles.glReady, demo->interophandles.glComplete);
+}
+#endif
+
+#if defined(VK_USE_PLATFORM_DISPLAY_KHR)
+// MK: DRM fourcc corresponding to the Vulkan interop format:
+static uint32_t demo_drm_fourcc(VkFormat format) {
+    switch (format) {
+    case VK_FORMAT_R8G8B8A8_UNORM:
+        return DRM_FORMAT_ABGR8888;
+
+    case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+        return DRM_FORMAT_ABGR2101010;
+
+    case VK_FORMAT_R16G16B16A16_SFLOAT:
+        return DRM_FORMAT_ABGR16161616F;
+
+    default:
+        return DRM_FORMAT_INVALID;
+    }
+}
+
+// MK: Find the DRM format modifiers which both sides can use for the interop
+// image: Vulkan must be able to create and export the image with the given usage,
+// and EGL must be able to import it for rendering, not just as external texture.
+// Returns the number of modifiers stored in 'modifiers'. Vulkan then picks the
+// best one from that list for the image, typically a tiled or compressed one:
+static uint32_t demo_dmabuf_modifiers(struct demo *demo, VkImageUsageFlags usage,
+                                      uint64_t *modifiers, uint32_t max) {
+    PFNEGLQUERYDMABUFMODIFIERSEXTPROC eglQueryDmaBufModifiersEXT;
+    VkDrmFormatModifierPropertiesEXT *vk_props;
+    EGLuint64KHR *egl_mods;
+    EGLBoolean *egl_external_only;
+    EGLint egl_count = 0;
+    uint32_t count = 0;
+    uint32_t i, j;
+    VkResult err;
+
+    VkDrmFormatModifierPropertiesListEXT modifier_list = {
+        .sType = VK_STRUCTURE_TYPE_DRM_FORMAT_MODIFIER_PROPERTIES_LIST_EXT,
+        .pNext = NULL,
+        .drmFormatModifierCount = 0,
+        .pDrmFormatModifierProperties = NULL,
+    };
+
+    VkFormatProperties2 format_props = {
+        .sType = VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_2,
+        .pNext = &modifier_list,
+    };
+
+    eglQueryDmaBufModifiersEXT = (PFNEGLQUERYDMABUFMODIFIERSEXTPROC) eglGetProcAddress("eglQueryDmaBufModifiersEXT");
+    if (!demo->egl_display || !eglQueryDmaBufModifiersEXT ||
+        !eglQueryDmaBufModifiersEXT(demo->egl_display, demo_drm_fourcc(demo->interop_tex_format), 0, NULL, NULL, &egl_count) ||
+        (egl_count == 0)) {
+        printf("EGL does not support DMA-BUF import with modifiers for the interop format.\n");
+        return 0;
+    }
+
+    egl_mods = calloc(egl_count, sizeof(EGLuint64KHR));
+    egl_external_only = calloc(egl_count, sizeof(EGLBoolean));
+    eglQueryDmaBufModifiersEXT(demo->egl_display, demo_drm_fourcc(demo->interop_tex_format), egl_count,
+                               egl_mods, egl_external_only, &egl_count);
+
+    // Two-call idiom for the Vulkan modifiers and their properties:
+    demo->fpGetPhysicalDeviceFormatProperties2KHR(demo->gpu, demo->interop_tex_format, &format_props);
+    vk_props = calloc(modifier_list.drmFormatModifierCount, sizeof(VkDrmFormatModifierPropertiesEXT));
+    modifier_list.pDrmFormatModifierProperties = vk_props;
+    demo->fpGetPhysicalDeviceFormatProperties2KHR(demo->gpu, demo->interop_tex_format, &format_props);
+
+    for (i = 0; i < modifier_list.drmFormatModifierCount && count < max; i++) {
+        const uint64_t modifier = vk_props[i].drmFormatModifier;
+        bool egl_ok = false;
+
+        if (vk_props[i].drmFormatModifierPlaneCount > 4)
+            continue;
+
+        for (j = 0; j < (uint32_t) egl_count; j++) {
+            if (egl_mods[j] == modifier && !egl_external_only[j])
+                egl_ok = true;
+        }
+
+        if (!egl_ok)
+            continue;
+
+        // Can Vulkan create an exportable image with this modifier and our usage?
+        VkPhysicalDeviceImageDrmFormatModifierInfoEXT modifier_info = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_IMAGE_DRM_FORMAT_MODIFIER_INFO_EXT,
+            .pNext = NULL,
+            .drmFormatModifier = modifier,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+            .queueFamilyIndexCount = 0,
+            .pQueueFamilyIndices = NULL,
+        };
+
+        VkPhysicalDeviceExternalImageFormatInfo external_info = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_IMAGE_FORMAT_INFO,
+            .pNext = &modifier_info,
+            .handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT,
+        };
+
+        VkPhysicalDeviceImageFormatInfo2 image_info = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_IMAGE_FORMAT_INFO_2,
+            .pNext = &external_info,
+            .format = demo->interop_tex_format,
+            .type = VK_IMAGE_TYPE_2D,
+            .tiling = VK_IMAGE_TILING_DRM_FORMAT_MODIFIER_EXT,
+            .usage = usage,
+            .flags = 0,
+        };
+
+        VkExternalImageFormatProperties external_props = {
+            .sType = VK_STRUCTURE_TYPE_EXTERNAL_IMAGE_FORMAT_PROPERTIES,
+            .pNext = NULL,
+        };
+
+        VkImageFormatProperties2 image_props = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_FORMAT_PROPERTIES_2,
+            .pNext = &external_props,
+        };
+
+        err = demo->fpGetPhysicalDeviceImageFormatProperties2KHR(demo->gpu, &image_info, &image_props);
+        if (err || !(external_props.externalMemoryProperties.externalMemoryFeatures & VK_EXTERNAL_MEMORY_FEATURE_EXPORTABLE_BIT))
+            continue;
+
+        if ((image_props.imageFormatProperties.maxExtent.width < (uint32_t) demo->width) ||
+            (image_props.imageFormatProperties.maxExtent.height < (uint32_t) demo->height))
+            continue;
+
+        printf("DMA-BUF modifier candidate 0x%" PRIx64 " with %i planes.\n", modifier, vk_props[i].drmFormatModifierPlaneCount);
+        modifiers[count++] = modifier;
+    }
+
+    free(vk_props);
+    free(egl_mods);
+    free(egl_external_only);
+
+    return count;
+}
+#endif
+
+static void demo_prepare_texture_image(struct demo *demo, const char *filename,
+                                       struct texture_object *tex_obj,
+                                       VkImageTiling tiling,
+                                       VkImageUsageFlags usage,
+                                       VkFlags required_props) {
+    const VkFormat tex_format = demo->interop_tex_format;
+    int32_t tex_width;
+    int32_t tex_height;
+    VkResult U_ASSERT_ONLY err;
+    bool U_ASSERT_ONLY pass;
+
+    // No OpenGL interop?
+    if (!demo->interop_enabled) {
+        // Get needed texture size for image:
+        if (!loadTexture(filename, NULL, NULL, &tex_width, &tex_height)) {
+            ERR_EXIT("Failed to load textures", "Load Texture Failure");
+        }
+    }
+    else {
+        // OpenGL interop: Allocate interop texture the size of the true
+        // framebuffer:
+        tex_width = demo->width;
+        tex_height = demo->height;
+    }
+
+    tex_obj->tex_width = tex_width;
+    tex_obj->tex_height = tex_height;
+    tex_obj->format = tex_format;
+    tex_obj->mip_levels = 1;
+
+    // Only the interop image, which OpenGL renders into, is exported:
+    const bool exported = demo->interop_enabled && (usage & VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT);
+
+    // DMA-BUF interop: Let the driver choose the best DRM format modifier for
+    // the interop image, among the ones OpenGL can import as well:
+    bool dmabuf = false;
+    uint64_t modifiers[64];
+    uint32_t modifier_count = 0;
+
+#if defined(VK_USE_PLATFORM_DISPLAY_KHR)
+    if (exported && demo->use_dmabuf) {
+        modifier_count = demo_dmabuf_modifiers(demo, usage, modifiers, ARRAY_SIZE(modifiers));
+        if (modifier_count > 0) {
+            dmabuf = true;
+            tiling = VK_IMAGE_TILING_DRM_FORMAT_MODIFIER_EXT;
+        }
+        else {
+            // No common ground, fall back to opaque fd interop:
+            demo->use_dmabuf = false;
+            printf("WARNING: No DRM format modifier usable by both Vulkan and OpenGL. Using opaque fd interop instead.\n");
+        }
+    }
+#endif
+
+    VkImageDrmFormatModifierListCreateInfoEXT modifier_list_info = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_DRM_FORMAT_MODIFIER_LIST_CREATE_INFO_EXT,
+        .pNext = NULL,
+        .drmFormatModifierCount = modifier_count,
+        .pDrmFormatModifiers = modifiers,
+    };
+
+    VkExternalMemoryImageCreateInfo external_image_info = {
+        .sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_IMAGE_CREATE_INFO,
+        .pNext = &modifier_list_info,
+        .handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT,
+    };
+
+    const VkImageCreateInfo image_create_info = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .pNext = (dmabuf) ? &external_image_info : NULL,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = tex_format,
+        .extent = {tex_width, tex_height, 1},
+        .mipLevels = 1,
+        .arrayLayers = 1,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .tiling = tiling,
+        .usage = usage,
+        .flags = 0,
+        .initialLayout = VK_IMAGE_LAYOUT_PREINITIALIZED,
+    };
+
+    VkMemoryRequirements mem_reqs;
+    bool dedicated = false;
+
+    err = vkCreateImage(demo->device, &image_create_info, NULL, &tex_obj->image);
+    assert(!err);
+
+#if defined(VK_USE_PLATFORM_DISPLAY_KHR)
+    if (dmabuf) {
+        // Which modifier did the driver choose, and what are its memory planes?
+        VkImageDrmFormatModifierPropertiesEXT modifier_props = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_DRM_FORMAT_MODIFIER_PROPERTIES_EXT,
+            .pNext = NULL,
+        };
+
+        err = demo->fpGetImageDrmFormatModifierPropertiesEXT(demo->device, tex_obj->image, &modifier_props);
+        assert(!err);
+        demo->dmabuf_modifier = modifier_props.drmFormatModifier;
+
+        VkDrmFormatModifierPropertiesListEXT props_list = {
+            .sType = VK_STRUCTURE_TYPE_DRM_FORMAT_MODIFIER_PROPERTIES_LIST_EXT,
+            .pNext = NULL,
+        };
+
+        VkFormatProperties2 format_props = {
+            .sType = VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_2,
+            .pNext = &props_list,
+        };
+
+        demo->fpGetPhysicalDeviceFormatProperties2KHR(demo->gpu, tex_format, &format_props);
+        VkDrmFormatModifierPropertiesEXT *props = calloc(props_list.drmFormatModifierCount, sizeof(*props));
+        props_list.pDrmFormatModifierProperties = props;
+        demo->fpGetPhysicalDeviceFormatProperties2KHR(demo->gpu, tex_format, &format_props);
+
+        demo->dmabuf_plane_count = 1;
+        for (uint32_t i = 0; i < props_list.drmFormatModifierCount; i++) {
+            if (props[i].drmFormatModifier == demo->dmabuf_modifier)
+                demo->dmabuf_plane_count = props[i].drmFormatModifierPlaneCount;
+        }
+        free(props);
+
+        printf("DMA-BUF interop image uses modifier 0x%" PRIx64 " with %i memory planes.\n",
+               demo->dmabuf_modifier, demo->dmabuf_plane_count);
+    }
+#endif
+
+    if (exported && demo->dedicatedallocationExtFound) {
+        // MK: Ask the driver if it wants the interop image in its own memory
+        // allocation. Drivers which do (e.g., for framebuffer compression
+        // metadata or special tiling layouts) can then keep the optimal
+        // layout for the shared image, instead of falling back to a generic one:
+        VkMemoryDedicatedRequirements dedicated_reqs = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS,
+            .pNext = NULL,
+        };
+
+        VkMemoryRequirements2 mem_reqs2 = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2,
+            .pNext = &dedicated_reqs,
+        };
+
+        const VkImageMemoryRequirementsInfo2 mem_reqs_info = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2,
+            .pNext = NULL,
+            .image = tex_obj->image,
+        };
+
+        demo->fpGetImageMemoryRequirements2KHR(demo->device, &mem_reqs_info, &mem_reqs2);
+        mem_reqs = mem_reqs2.memoryRequirements;
+
+        dedicated = dedicated_reqs.prefersDedicatedAllocation || dedicated_reqs.requiresDedicatedAllocation;
+        printf("Interop image dedicated allocation: prefers %i, requires %i.\n",
+               dedicated_reqs.prefersDedicatedAllocation, dedicated_reqs.requiresDedicatedAllocation);
+    }
+    else {
+        vkGetImageMemoryRequirements(demo->device, tex_obj->image, &mem_reqs);
+    }
+
+    VkMemoryDedicatedAllocateInfo dedicatedAllocInfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO,
+        .pNext = NULL,
+        .image = tex_obj->image,
+        .buffer = VK_NULL_HANDLE,
+    };
+
+    VkExportMemoryAllocateInfo exportAllocInfo = {
+        .sType = VK_STRUCTURE_TYPE_EXPORT_MEMORY_ALLOCATE_INFO,
+        .pNext = (dedicated) ? &dedicatedAllocInfo : NULL,
+#if defined(WIN32)
+        .handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_WIN32_BIT,
+#else
+        .handleTypes = (dmabuf) ? VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT : VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT,
+#endif
+    };
+
+    if (!exported) {
+        // MK: Not exported to OpenGL, so it can share a block of the sub-allocator:
+        pass = demo_memory_alloc(demo, &mem_reqs, required_props, tiling != VK_IMAGE_TILING_LINEAR, &tex_obj->alloc);
+        assert(pass);
+
+        err = vkBindImageMemory(demo->device, tex_obj->image, tex_obj->alloc.mem, tex_obj->alloc.offset);
+        assert(!err);
+    }
+    else {
+        tex_obj->mem_alloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        tex_obj->mem_alloc.pNext = &exportAllocInfo;
+        tex_obj->mem_alloc.allocationSize = mem_reqs.size;
+        tex_obj->mem_alloc.memoryTypeIndex = 0;
+
+        pass = memory_type_from_properties(demo, mem_reqs.memoryTypeBits,
+                                           required_props,
+                                           &tex_obj->mem_alloc.memoryTypeIndex);
+        assert(pass);
+
+        /* allocate memory */
+        err = vkAllocateMemory(demo->device, &tex_obj->mem_alloc, NULL,
+                               &(tex_obj->mem));
+        assert(!err);
+
+        /* bind memory */
+        err = vkBindImageMemory(demo->device, tex_obj->image, tex_obj->mem, 0);
+        assert(!err);
+    }
+
+    if (exported) {
+        // Don't leak a previously exported, but never imported, memory fd:
+        demo_release_interop_handles(demo);
+
+        // OpenGL must import the memory with the same dedicated state as Vulkan allocated it:
+        demo->interop_dedicated = dedicated;
+
+#ifdef WIN32
+        // Get handle for shared memory with OpenGL:
+        VkMemoryGetWin32HandleInfoKHR memorygetwinhandleinfo = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_GET_WIN32_HANDLE_INFO_KHR,
+            .pNext = NULL,
+            .memory = tex_obj->mem,
+            .handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_WIN32_BIT,
+        };
+
+        //printf("PRE memory handle %p\n", demo->interophandles.memory);
+        err = demo->fpGetMemoryWin32HandleKHR(demo->device, &memorygetwinhandleinfo, &demo->interophandles.memory);
+        assert(!err);
+        printf("GOT memory handle %p\n", demo->interophandles.memory);
+#else
+        // Get fd for shared memory with OpenGL:
+        VkMemoryGetFdInfoKHR memorygetfdinfo = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_GET_FD_INFO_KHR,
+            .pNext = NULL,
+            .memory = tex_obj->mem,
+            .handleType = (dmabuf) ? VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT : VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT,
+        };
+
+        //printf("PRE memory fd %i\n", demo->interophandles.memory);
+        err = demo->fpGetMemoryFdKHR(demo->device, &memorygetfdinfo, &demo->interophandles.memory);
+        assert(!err);
+        printf("GOT memory fd %i\n", demo->interophandles.memory);
+
+        // EGL needs offset and pitch of each memory plane for import:
+        for (uint32_t i = 0; dmabuf && i < demo->dmabuf_plane_count; i++) {
+            const VkImageSubresource plane = {
+                .aspectMask = VK_IMAGE_ASPECT_MEMORY_PLANE_0_BIT_EXT << i,
+                .mipLevel = 0,
+                .arrayLayer = 0,
+            };
+
+            vkGetImageSubresourceLayout(demo->device, tex_obj->image, &plane, &demo->dmabuf_planes[i]);
+            printf("DMA-BUF plane %i: offset %i, pitch %i\n", i,
+                   (int) demo->dmabuf_planes[i].offset, (int) demo->dmabuf_planes[i].rowPitch);
+        }
+#endif
+    }
+
+    // MK tex_obj->imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    tex_obj->imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+}
+
+// MK: Upload image file 'filename' into 'tex_obj', which is at least as large, through the upload ring:
+static void demo_upload_texture_file(struct demo *demo, const char *filename, struct texture_object *tex_obj) {
+    const uint32_t texel_size = demo_format_size(demo->interop_tex_format);
+    struct upload_slot *slot;
+    VkSubresourceLayout layout;
+    int32_t tex_width, tex_height;
+
+    if (!loadTexture(filename, NULL, NULL, &tex_width, &tex_height)) {
+        ERR_EXIT("Failed to load textures", "Load Texture Failure");
+    }
+
+    demo_prepare_upload_ring(demo, (VkDeviceSize) tex_width * tex_height * texel_size, 2);
+    slot = demo_upload_acquire(demo);
+
+    // Tightly packed rows:
+    memset(&layout, 0, sizeof(layout));
+    layout.rowPitch = (VkDeviceSize) tex_width * texel_size;
+
+    if (!loadTexture(filename, slot->data, &layout, &tex_width, &tex_height)) {
+        fprintf(stderr, "Error loading texture: %s\n", filename);
+    }
+
+    slot->width = tex_width;
+    slot->height = tex_height;
+    demo_upload_record(demo, slot, tex_obj);
+    demo_upload_submit(demo, slot);
+}
+
+// MK: Create 'tex_obj' from KTX2 file 'filename', with all its mip levels, for sampling in the shader
+// path. Block compressed formats the gpu can sample are copied as is from the file into the upload
+// ring, which saves 4 - 8x the memory and bandwidth. Others are decoded on the cpu, BC7 to RGBA8 and
+// BC6H to RGBA16F:
+static void demo_prepare_ktx_texture(struct demo *demo, const char *filename, struct texture_object *tex_obj) {
+    VkBufferImageCopy regions[KTX_MAX_LEVELS];
+    struct ktx_texture ktx;
+    struct upload_slot *slot;
+    VkFormatProperties props;
+    VkMemoryRequirements mem_reqs;
+    VkDeviceSize size = 0;
+    size_t texel_size = 0;
+    VkResult U_ASSERT_ONLY err;
+    bool U_ASSERT_ONLY pass;
+    uint32_t i;
+
+    if (!ktx_open(filename, &ktx)) {
+        ERR_EXIT("Failed to load KTX2 texture", "Load Texture Failure");
+    }
+
+    tex_obj->format = (VkFormat) ktx.vk_format;
+    vkGetPhysicalDeviceFormatProperties(demo->gpu, tex_obj->format, &props);
+
+    if (props.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) {
+        printf("KTX2 texture %s: %u x %u, %u mip levels, uploading format %i as is.\n",
+               filename, ktx.width, ktx.height, ktx.level_count, tex_obj->format);
+    }
+    else {
+        texel_size = ktx_decoded_texel_size(&ktx);
+        if (!texel_size) {
+            ERR_EXIT("KTX2 texture format not supported by gpu, and no cpu decoder for it", "Load Texture Failure");
+        }
+
+        tex_obj->format = ktx_is_hdr(&ktx) ? VK_FORMAT_R16G16B16A16_SFLOAT :
+                          ktx_is_srgb(&ktx) ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+        printf("KTX2 texture %s: %u x %u, %u mip levels, format %i not supported by gpu, decoding to format %i.\n",
+               filename, ktx.width, ktx.height, ktx.level_count, (int) ktx.vk_format, tex_obj->format);
+    }
+
+    // All levels back to back in one slot, each at a multiple of the 16 byte block size:
+    for (i = 0; i < ktx.level_count; i++) {
+        const struct ktx_level *level = &ktx.levels[i];
+
+        regions[i].bufferOffset = size;
+        regions[i].bufferRowLength = 0;
+        regions[i].bufferImageHeight = 0;
+        regions[i].imageSubresource = (VkImageSubresourceLayers) {VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1};
+        regions[i].imageOffset = (VkOffset3D) {0, 0, 0};
+        regions[i].imageExtent = (VkExtent3D) {level->width, level->height, 1};
+
+        size += ((texel_size ? (VkDeviceSize) level->width * level->height * texel_size : level->size) + 15) & ~15;
+    }
+
+    const VkImageCreateInfo image_create_info = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .pNext = NULL,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = tex_obj->format,
+        .extent = {ktx.width, ktx.height, 1},
+        .mipLevels = ktx.level_count,
+        .arrayLayers = 1,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+        .flags = 0,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+    };
+
+    err = vkCreateImage(demo->device, &image_create_info, NULL, &tex_obj->image);
+    assert(!err);
+
+    vkGetImageMemoryRequirements(demo->device, tex_obj->image, &mem_reqs);
+
+    pass = demo_memory_alloc(demo, &mem_reqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, true, &tex_obj->alloc);
+    assert(pass);
+
+    err = vkBindImageMemory(demo->device, tex_obj->image, tex_obj->alloc.mem, tex_obj->alloc.offset);
+    assert(!err);
+
+    tex_obj->tex_width = ktx.width;
+    tex_obj->tex_height = ktx.height;
+    tex_obj->mip_levels = ktx.level_count;
+    tex_obj->imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    demo_prepare_upload_ring(demo, size, 2);
+    slot = demo_upload_acquire(demo);
+
+    for (i = 0; i < ktx.level_count; i++) {
+        uint8_t *dst = (uint8_t *) slot->data + regions[i].bufferOffset;
+
+        if (texel_size)
+            ktx_decode_level(&ktx, i, dst, (size_t) ktx.levels[i].width * texel_size);
+        else
+            memcpy(dst, ktx.levels[i].data, ktx.levels[i].size);
+
+        regions[i].bufferOffset += slot->offset;
+    }
+
+    ktx_close(&ktx);
+
+    slot->width = tex_obj->tex_width;
+    slot->height = tex_obj->tex_height;
+    demo_upload_record_regions(demo, slot, tex_obj, regions, tex_obj->mip_levels, false);
+    demo_upload_submit(demo, slot);
+}
+
+static void demo_prepare_textures(struct demo *demo) {
+    const VkFormat tex_format = demo->interop_tex_format;
+    VkFormatProperties props;
+    uint32_t i;
+
+    vkGetPhysicalDeviceFormatProperties(demo->gpu, tex_format, &props);
+
+    for (i = 0; i < DEMO_TEXTURE_COUNT; i++) {
+        VkResult U_ASSERT_ONLY err;
+
+        // MK: Need linear tiling for OpenGL interop on AMD. Without interop, textures are
+        // always optimal tiled, as linear ones are slow to sample:
+        if (i == 0 && demo->use_ktx) {
+            // Only without interop, so no need to render into it:
+            demo_prepare_ktx_texture(demo, demo->texture_path, &demo->textures[i]);
+        } else if (((props.linearTilingFeatures &
+            (VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT)) == (VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT)) &&
+            demo->interop_enabled &&
+            !demo->use_staging_buffer &&
+            !demo->interop_tiled_texture) {
+            demo->interop_tiled_texture = false;
+            printf("Will use linear textures for OpenGL->Vulkan interop via render-to-texture to texture %i\n", i);
+            demo_prepare_texture_image(
+                demo, tex_files[i], &demo->textures[i], VK_IMAGE_TILING_LINEAR,
+                VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+                ((i == 0) ? VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT : 0) |
+                ((i == 0 && demo->use_movie) ? VK_IMAGE_USAGE_TRANSFER_DST_BIT : 0),
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT); // MK Require device local bit.
+
+            // Nothing in the pipeline needs to be complete to start, and don't allow fragment
+            // shader to run until layout transition completes. OpenGL renders the content:
+            demo_set_image_layout(demo, demo->textures[i].image, VK_IMAGE_ASPECT_COLOR_BIT,
+                                  VK_IMAGE_LAYOUT_PREINITIALIZED, demo->textures[i].imageLayout,
+                                  0, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                                  VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, NULL);
+        } else if ((props.optimalTilingFeatures &
+                (VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT)) == (VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT)) {
+            demo->interop_tiled_texture = true;
+            printf("Will use optimal tiled textures for OpenGL->Vulkan interop via render-to-texture to texture %i\n", i);
+            demo_prepare_texture_image(
+                demo, tex_files[i], &demo->textures[i], VK_IMAGE_TILING_OPTIMAL,
+                (VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT |
+                ((i == 0) ? VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT : 0)),
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);  // MK Require device local bit.
+
+            if (demo->use_movie) {
+                // The movie fills the image, and its reader threads own the upload ring:
+                demo_set_image_layout(demo, demo->textures[i].image, VK_IMAGE_ASPECT_COLOR_BIT,
+                                      VK_IMAGE_LAYOUT_PREINITIALIZED, demo->textures[i].imageLayout,
+                                      0, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                                      VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, NULL);
+            }
+            else {
+                // Initial content, until OpenGL renders into it, if at all. The upload is
+                // submitted right away, ahead of the init commands:
+                demo_upload_texture_file(demo, tex_files[i], &demo->textures[i]);
+            }
+        } else {
+            /* Can't support VK_FORMAT_R8G8B8A8_UNORM !? */
+            assert(!"No support for R8G8B8A8_UNORM as texture image format");
+        }
+
+        const VkSamplerCreateInfo sampler = {
+            .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+            .pNext = NULL,
+            .magFilter = VK_FILTER_NEAREST,
+            .minFilter = VK_FILTER_NEAREST,
+            .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+            .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+            .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+            .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+            .mipLodBias = 0.0f,
+            .anisotropyEnable = VK_FALSE,
+            .maxAnisotropy = 1,
+            .compareOp = VK_COMPARE_OP_NEVER,
+            .minLod = 0.0f,
+            .maxLod = (float) (demo->textures[i].mip_levels - 1),
+            .borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE,
+            .unnormalizedCoordinates = VK_FALSE,
+        };
+
+        VkImageViewCreateInfo view = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+            .pNext = NULL,
+            .image = VK_NULL_HANDLE,
+            .viewType = VK_IMAGE_VIEW_TYPE_2D,
+            .format = demo->textures[i].format,
+            .components =
+                {
+                 VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G,
+                 VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A,
+                },
+            .subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, demo->textures[i].mip_levels, 0, 1},
+            .flags = 0,
+        };
+
+        /* create sampler */
+        err = vkCreateSampler(demo->device, &sampler, NULL,
+                              &demo->textures[i].sampler);
+        assert(!err);
+
+        /* create image view */
+        view.image = demo->textures[i].image;
+        err = vkCreateImageView(demo->device, &view, NULL,
+                                &demo->textures[i].view);
+        assert(!err);
+    }
+}
+
+static void demo_prepare_descriptor_layout(struct demo *demo) {
+    // Only the textures, at the binding cube.frag expects them. The transform
+    // is a vertex shader push constant:
+    const VkDescriptorSetLayoutBinding layout_bindings[1] = {
+            [0] =
+                {
+                 .binding = 1,
+                 .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                 .descriptorCount = DEMO_TEXTURE_COUNT,
+                 .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+                 .pImmutableSamplers = NULL,
+                },
+    };
+    const VkPushConstantRange push_range = {
+        .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+        .offset = 0,
+        .size = sizeof(mat4x4),
+    };
+    const VkDescriptorSetLayoutCreateInfo descriptor_layout = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .pNext = NULL,
+        .bindingCount = 1,
+        .pBindings = layout_bindings,
+    };
+    VkResult U_ASSERT_ONLY err;
+
+    err = vkCreateDescriptorSetLayout(demo->device, &descriptor_layout, NULL,
+                                      &demo->desc_layout);
+    assert(!err);
+
+    const VkPipelineLayoutCreateInfo pPipelineLayoutCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .pNext = NULL,
+        .setLayoutCount = 1,
+        .pSetLayouts = &demo->desc_layout,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &push_range,
+    };
+
+    err = vkCreatePipelineLayout(demo->device, &pPipelineLayoutCreateInfo, NULL,
+                                 &demo->pipeline_layout);
+    assert(!err);
+}
+
+static void demo_prepare_render_pass(struct demo *demo) {
+    // The initial layout for the color attachment will be LAYOUT_UNDEFINED
+    // because at the start of the renderpass, we don't care about its contents.
+    // At the start of the subpass, the color attachment's layout will be transitioned
+    // to LAYOUT_COLOR_ATTACHMENT_OPTIMAL.  At the end of the renderpass, it will be
+    // transitioned to LAYOUT_PRESENT_SRC_KHR to be ready to present.  This is all done
+    // as part of the renderpass, no barriers are necessary. Neither the blit path, nor
+    // the fullscreen triangle of the shader path need a depth test, so there is no
+    // depth attachment:
+    const VkAttachmentDescription attachments[1] = {
+            [0] =
+                {
+                 .format = demo->format,
+                 .flags = 0,
+                 .samples = VK_SAMPLE_COUNT_1_BIT,
+                 .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+                 .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+                 .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+                 .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+                 .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                 .finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                },
+    };
+    const VkAttachmentReference color_reference = {
+        .attachment = 0, .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+    };
+    const VkSubpassDescription subpass = {
+        .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+        .flags = 0,
+        .inputAttachmentCount = 0,
+        .pInputAttachments = NULL,
+        .colorAttachmentCount = 1,
+        .pColorAttachments = &color_reference,
+        .pResolveAttachments = NULL,
+        .pDepthStencilAttachment = NULL,
+        .preserveAttachmentCount = 0,
+        .pPreserveAttachments = NULL,
+    };
+    const VkRenderPassCreateInfo rp_info = {
+        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .attachmentCount = 1,
+        .pAttachments = attachments,
+        .subpassCount = 1,
+        .pSubpasses = &subpass,
+        .dependencyCount = 0,
+        .pDependencies = NULL,
+    };
+    VkResult U_ASSERT_ONLY err;
+
+    err = vkCreateRenderPass(demo->device, &rp_info, NULL, &demo->render_pass);
+    assert(!err);
+}
+
+//TODO: Merge shader reading
+#ifndef __ANDROID__
+static VkShaderModule
+demo_prepare_shader_module(struct demo *demo, const void *code, size_t size) {
+    VkShaderModule module;
+    VkShaderModuleCreateInfo moduleCreateInfo;
+    VkResult U_ASSERT_ONLY err;
+
+    moduleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    moduleCreateInfo.pNext = NULL;
+
+    moduleCreateInfo.codeSize = size;
+    moduleCreateInfo.pCode = code;
+    moduleCreateInfo.flags = 0;
+    err = vkCreateShaderModule(demo->device, &moduleCreateInfo, NULL, &module);
+    assert(!err);
+
+    return module;
+}
+
+char *demo_read_spv(const char *filename, size_t *psize) {
+    long int size;
+    size_t U_ASSERT_ONLY retval;
+    void *shader_code;
+
+#if (defined(VK_USE_PLATFORM_IOS_MVK) || defined(VK_USE_PLATFORM_MACOS_MVK))
+    filename =[[[NSBundle mainBundle] resourcePath] stringByAppendingPathComponent: @(filename)].UTF8String;
+#endif
+
+    FILE *fp = fopen(filename, "rb");
+    if (!fp)
+        return NULL;
+
+    fseek(fp, 0L, SEEK_END);
+    size = ftell(fp);
+
+    fseek(fp, 0L, SEEK_SET);
+
+    shader_code = malloc(size);
+    retval = fread(shader_code, size, 1, fp);
+    assert(retval == 1);
+
+    *psize = size;
+
+    fclose(fp);
+    return shader_code;
+}
+#endif
+
+static VkShaderModule demo_prepare_vs(struct demo *demo) {
+#ifdef __ANDROID__
+    VkShaderModuleCreateInfo sh_info = {};
+    sh_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+
+#include "cube.vert.h"
+    sh_info.codeSize = sizeof(cube_vert);
+    sh_info.pCode = cube_vert;
+    VkResult U_ASSERT_ONLY err = vkCreateShaderModule(demo->device, &sh_info, NULL, &demo->vert_shader_module);
+    assert(!err);
+#else
+    void *vertShaderCode;
+    size_t size;
+
+    vertShaderCode = demo_read_spv("cube-vert.spv", &size);
+    if (!vertShaderCode) {
+        ERR_EXIT("Failed to load cube-vert.spv", "Load Shader Failure");
+    }
+
+    demo->vert_shader_module =
+        demo_prepare_shader_module(demo, vertShaderCode, size);
+
+    free(vertShaderCode);
+#endif
+
+    return demo->vert_shader_module;
+}
+
+static VkShaderModule demo_prepare_fs(struct demo *demo) {
+#ifdef __ANDROID__
+    VkShaderModuleCreateInfo sh_info = {};
+    sh_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+
+#include "cube.frag.h"
+    sh_info.codeSize = sizeof(cube_frag);
+    sh_info.pCode = cube_frag;
+    VkResult U_ASSERT_ONLY err = vkCreateShaderModule(demo->device, &sh_info, NULL, &demo->frag_shader_module);
+    assert(!err);
+#else
+    void *fragShaderCode;
+    size_t size;
+
+    fragShaderCode = demo_read_spv("cube-frag.spv", &size);
+    if (!fragShaderCode) {
+        ERR_EXIT("Failed to load cube-frag.spv", "Load Shader Failure");
+    }
+
+    demo->frag_shader_module =
+        demo_prepare_shader_module(demo, fragShaderCode, size);
+
+    free(fragShaderCode);
+#endif
+
+    return demo->frag_shader_module;
+}
+
+static void demo_prepare_pipeline(struct demo *demo) {
+    VkGraphicsPipelineCreateInfo pipeline;
+    VkPipelineCacheCreateInfo pipelineCache;
+    VkPipelineVertexInputStateCreateInfo vi;
+    VkPipelineInputAssemblyStateCreateInfo ia;
+    VkPipelineRasterizationStateCreateInfo rs;
+    VkPipelineColorBlendStateCreateInfo cb;
+    VkPipelineViewportStateCreateInfo vp;
+    VkPipelineMultisampleStateCreateInfo ms;
+    VkDynamicState dynamicStateEnables[VK_DYNAMIC_STATE_RANGE_SIZE];
+    VkPipelineDynamicStateCreateInfo dynamicState;
+    VkResult U_ASSERT_ONLY err;
+
+    memset(dynamicStateEnables, 0, sizeof dynamicStateEnables);
+    memset(&dynamicState, 0, sizeof dynamicState);
+    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicState.pDynamicStates = dynamicStateEnables;
+
+    memset(&pipeline, 0, sizeof(pipeline));
+    pipeline.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipeline.layout = demo->pipeline_layout;
+
+    memset(&vi, 0, sizeof(vi));
+    vi.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+    memset(&ia, 0, sizeof(ia));
+    ia.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    ia.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+    memset(&rs, 0, sizeof(rs));
+    rs.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rs.polygonMode = VK_POLYGON_MODE_FILL;
+    rs.cullMode = VK_CULL_MODE_BACK_BIT;
+    rs.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    rs.depthClampEnable = VK_FALSE;
+    rs.rasterizerDiscardEnable = VK_FALSE;
+    rs.depthBiasEnable = VK_FALSE;
+    rs.lineWidth = 1.0f;
+
+    memset(&cb, 0, sizeof(cb));
+    cb.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    VkPipelineColorBlendAttachmentState att_state[1];
+    memset(att_state, 0, sizeof(att_state));
+    att_state[0].colorWriteMask = 0xf;
+    att_state[0].blendEnable = VK_FALSE;
+    cb.attachmentCount = 1;
+    cb.pAttachments = att_state;
+
+    memset(&vp, 0, sizeof(vp));
+    vp.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    vp.viewportCount = 1;
+    dynamicStateEnables[dynamicState.dynamicStateCount++] =
+        VK_DYNAMIC_STATE_VIEWPORT;
+    vp.scissorCount = 1;
+    dynamicStateEnables[dynamicState.dynamicStateCount++] =
+        VK_DYNAMIC_STATE_SCISSOR;
+
+    memset(&ms, 0, sizeof(ms));
+    ms.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    ms.pSampleMask = NULL;
+    ms.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    // Two stages: vs and fs
+    pipeline.stageCount = 2;
+    VkPipelineShaderStageCreateInfo shaderStages[2];
+    memset(&shaderStages, 0, 2 * sizeof(VkPipelineShaderStageCreateInfo));
+
+    shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+    shaderStages[0].module = demo_prepare_vs(demo);
+    shaderStages[0].pName = "main";
+
+    shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    shaderStages[1].module = demo_prepare_fs(demo);
+    shaderStages[1].pName = "main";
+
+    memset(&pipelineCache, 0, sizeof(pipelineCache));
+    pipelineCache.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+
+    err = vkCreatePipelineCache(demo->device, &pipelineCache, NULL,
+                                &demo->pipelineCache);
+    assert(!err);
+
+    pipeline.pVertexInputState = &vi;
+    pipeline.pInputAssemblyState = &ia;
+    pipeline.pRasterizationState = &rs;
+    pipeline.pColorBlendState = &cb;
+    pipeline.pMultisampleState = &ms;
+    pipeline.pViewportState = &vp;
+    pipeline.pDepthStencilState = NULL;
+    pipeline.pStages = shaderStages;
+    pipeline.renderPass = demo->render_pass;
+    pipeline.pDynamicState = &dynamicState;
+
+    pipeline.renderPass = demo->render_pass;
+
+    // MK: One pipeline per output transfer function, all compiled up front, so switching
+    // between them is only a matter of binding another pipeline. The fragment shader
+    // selects the transfer function by specialization constant, so no branches remain:
+    const VkSpecializationMapEntry spec_entries[3] = {
+        { .constantID = 0, .offset = 0, .size = sizeof(int32_t) },
+        { .constantID = 1, .offset = sizeof(int32_t), .size = sizeof(float) },
+        { .constantID = 2, .offset = sizeof(int32_t) + sizeof(float), .size = sizeof(float) },
+    };
+    struct {
+        int32_t output_tf;
+        float sdr_white;
+        float hlg_lmax;
+    } spec_data[OUTPUT_TF_COUNT];
+    VkSpecializationInfo spec_info[OUTPUT_TF_COUNT];
+    VkPipelineShaderStageCreateInfo tf_stages[OUTPUT_TF_COUNT][2];
+    VkGraphicsPipelineCreateInfo tf_pipeline[OUTPUT_TF_COUNT];
+
+    for (int tf = 0; tf < OUTPUT_TF_COUNT; tf++) {
+        spec_data[tf].output_tf = tf;
+        spec_data[tf].sdr_white = 80.0f;
+        spec_data[tf].hlg_lmax = 1000.0f;
+
+        spec_info[tf].mapEntryCount = 3;
+        spec_info[tf].pMapEntries = spec_entries;
+        spec_info[tf].dataSize = sizeof(spec_data[tf]);
+        spec_info[tf].pData = &spec_data[tf];
+
+        tf_stages[tf][0] = shaderStages[0];
+        tf_stages[tf][1] = shaderStages[1];
+        tf_stages[tf][1].pSpecializationInfo = &spec_info[tf];
+
+        tf_pipeline[tf] = pipeline;
+        tf_pipeline[tf].pStages = tf_stages[tf];
+    }
+
+    err = vkCreateGraphicsPipelines(demo->device, demo->pipelineCache, OUTPUT_TF_COUNT,
+                                    tf_pipeline, NULL, demo->tf_pipelines);
+    assert(!err);
+
+    demo->pipeline = demo_tf_pipeline(demo, demo->output_tf);
+
+    vkDestroyShaderModule(demo->device, demo->frag_shader_module, NULL);
+    vkDestroyShaderModule(demo->device, demo->vert_shader_module, NULL);
+}
+
+static void demo_prepare_descriptor_pool(struct demo *demo) {
+    const VkDescriptorPoolSize type_counts[1] = {
+            [0] =
+                {
+                 .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                 .descriptorCount = DEMO_TEXTURE_COUNT,
+                },
+    };
+    const VkDescriptorPoolCreateInfo descriptor_pool = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .pNext = NULL,
+        .maxSets = 1,
+        .poolSizeCount = 1,
+        .pPoolSizes = type_counts,
+    };
+    VkResult U_ASSERT_ONLY err;
+
+    err = vkCreateDescriptorPool(demo->device, &descriptor_pool, NULL,
+                                 &demo->desc_pool);
+    assert(!err);
+}
+
+static void demo_prepare_descriptor_set(struct demo *demo) {
+    VkDescriptorImageInfo tex_descs[DEMO_TEXTURE_COUNT];
+    VkWriteDescriptorSet writes[1];
+    VkResult U_ASSERT_ONLY err;
+
+    VkDescriptorSetAllocateInfo alloc_info = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .pNext = NULL,
+        .descriptorPool = demo->desc_pool,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &demo->desc_layout};
+
+    memset(&tex_descs, 0, sizeof(tex_descs));
+    for (unsigned int i = 0; i < DEMO_TEXTURE_COUNT; i++) {
+        tex_descs[i].sampler = demo->textures[i].sampler;
+        tex_descs[i].imageView = demo->textures[i].view;
+        // Uploaded KTX2 textures stay in their read only layout:
+        tex_descs[i].imageLayout = (demo->textures[i].imageLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) ?
+                                   VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+    }
+
+    memset(&writes, 0, sizeof(writes));
+
+    writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[0].dstBinding = 1;
+    writes[0].descriptorCount = DEMO_TEXTURE_COUNT;
+    writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    writes[0].pImageInfo = tex_descs;
+
+    err = vkAllocateDescriptorSets(demo->device, &alloc_info, &demo->descriptor_set);
+    assert(!err);
+    writes[0].dstSet = demo->descriptor_set;
+    vkUpdateDescriptorSets(demo->device, 1, writes, 0, NULL);
+}
+
+static void demo_prepare_framebuffers(struct demo *demo) {
+    VkImageView attachments[1];
+
+    const VkFramebufferCreateInfo fb_info = {
+        .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+        .pNext = NULL,
+        .renderPass = demo->render_pass,
+        .attachmentCount = 1,
+        .pAttachments = attachments,
+        .width = demo->width,
+        .height = demo->height,
+        .layers = 1,
+    };
+    VkResult U_ASSERT_ONLY err;
+    uint32_t i;
+
+    for (i = 0; i < demo->swapchainImageCount; i++) {
+        attachments[0] = demo->swapchain_image_resources[i].view;
+        err = vkCreateFramebuffer(demo->device, &fb_info, NULL,
+                                  &demo->swapchain_image_resources[i].framebuffer);
+        assert(!err);
+    }
+}
+
+static VkShaderModule demo_prepare_cs(struct demo *demo, const char *filename) {
+    VkShaderModule module = VK_NULL_HANDLE;
+    void *compShaderCode;
+    size_t size;
+
+    compShaderCode = demo_read_spv(filename, &size);
+    if (compShaderCode) {
+        module = demo_prepare_shader_module(demo, compShaderCode, size);
+        free(compShaderCode);
+    }
+
+    return module;
+}
+
+// MK: Compute pipeline and descriptor sets for the format conversion of the
+// interop image into the swapchain images. One descriptor set per swapchain image:
+static void demo_prepare_convert_pipeline(struct demo *demo) {
+    VkResult U_ASSERT_ONLY err;
+    uint32_t tile[2];
+
+    if (!demo->use_compute_convert || (demo->interop_tex_format == demo->format))
+        return;
+
+    // Swapchain images are already created for compute writes, so no quiet fallback:
+    VkShaderModule module = demo_prepare_cs(demo, "cube-convert-comp.spv");
+    if (!module)
+        ERR_EXIT("Failed to load cube-convert-comp.spv. Build the shaders, or use --blitconvert.\n",
+                 "Load Shader Failure");
+
+    const VkDescriptorSetLayoutBinding layout_bindings[2] = {
+            [0] =
+                {
+                 .binding = 0,
+                 .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                 .descriptorCount = 1,
+                 .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                 .pImmutableSamplers = NULL,
+                },
+            [1] =
+                {
+                 .binding = 1,
+                 .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                 .descriptorCount = 1,
+                 .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                 .pImmutableSamplers = NULL,
+                },
+    };
+    const VkDescriptorSetLayoutCreateInfo descriptor_layout = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .pNext = NULL,
+        .bindingCount = 2,
+        .pBindings = layout_bindings,
+    };
+
+    err = vkCreateDescriptorSetLayout(demo->device, &descriptor_layout, NULL, &demo->convert_desc_layout);
+    assert(!err);
+
+    const VkPipelineLayoutCreateInfo pipeline_layout_info = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .pNext = NULL,
+        .setLayoutCount = 1,
+        .pSetLayouts = &demo->convert_desc_layout,
+    };
+
+    err = vkCreatePipelineLayout(demo->device, &pipeline_layout_info, NULL, &demo->convert_pipeline_layout);
+    assert(!err);
+
+    // Workgroup size is tuned per format pair:
+    demo_convert_tile(demo, &tile[0], &tile[1]);
+    if (demo->convert_tile[0] && demo->convert_tile[1] &&
+        (tile[0] != demo->convert_tile[0] || tile[1] != demo->convert_tile[1])) {
+        printf("Compute conversion workgroup size %u x %u exceeds device limits of %u x %u, %u threads. Using %u x %u.\n",
+               demo->convert_tile[0], demo->convert_tile[1], demo->gpu_props.limits.maxComputeWorkGroupSize[0],
+               demo->gpu_props.limits.maxComputeWorkGroupSize[1], demo->gpu_props.limits.maxComputeWorkGroupInvocations,
+               tile[0], tile[1]);
+    }
+
+    const VkSpecializationMapEntry spec_entries[2] = {
+        [0] = {.constantID = 0, .offset = 0, .size = sizeof(uint32_t)},
+        [1] = {.constantID = 1, .offset = sizeof(uint32_t), .size = sizeof(uint32_t)},
+    };
+    const VkSpecializationInfo spec_info = {
+        .mapEntryCount = 2,
+        .pMapEntries = spec_entries,
+        .dataSize = sizeof(tile),
+        .pData = tile,
+    };
+    const VkComputePipelineCreateInfo pipeline_info = {
+        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        .pNext = NULL,
+        .stage =
+            {
+             .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+             .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+             .module = module,
+             .pName = "main",
+             .pSpecializationInfo = &spec_info,
+            },
+        .layout = demo->convert_pipeline_layout,
+    };
+
+    err = vkCreateComputePipelines(demo->device, VK_NULL_HANDLE, 1, &pipeline_info, NULL, &demo->convert_pipeline);
+    assert(!err);
+
+    vkDestroyShaderModule(demo->device, module, NULL);
+}
+
+// Descriptor sets of the conversion, one per swapchain image, as the destination:
+static void demo_prepare_convert_descriptors(struct demo *demo) {
+    VkResult U_ASSERT_ONLY err;
+    uint32_t i;
+
+    if (!demo->convert_pipeline)
+        return;
+
+    const VkDescriptorPoolSize type_counts[2] = {
+            [0] =
+                {
+                 .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                 .descriptorCount = demo->swapchainImageCount,
+                },
+            [1] =
+                {
+                 .type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                 .descriptorCount = demo->swapchainImageCount,
+                },
+    };
+    const VkDescriptorPoolCreateInfo descriptor_pool = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .pNext = NULL,
+        .maxSets = demo->swapchainImageCount,
+        .poolSizeCount = 2,
+        .pPoolSizes = type_counts,
+    };
+
+    err = vkCreateDescriptorPool(demo->device, &descriptor_pool, NULL, &demo->convert_desc_pool);
+    assert(!err);
+
+    VkDescriptorSetAllocateInfo alloc_info = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .pNext = NULL,
+        .descriptorPool = demo->convert_desc_pool,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &demo->convert_desc_layout};
+
+    VkDescriptorImageInfo src_desc = {
+        .sampler = demo->textures[0].sampler,
+        .imageView = demo->textures[0].view,
+        .imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+    };
+    VkDescriptorImageInfo dst_desc = {
+        .sampler = VK_NULL_HANDLE,
+        .imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+    };
+    VkWriteDescriptorSet writes[2];
+
+    memset(&writes, 0, sizeof(writes));
+
+    writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[0].dstBinding = 0;
+    writes[0].descriptorCount = 1;
+    writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    writes[0].pImageInfo = &src_desc;
+
+    writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[1].dstBinding = 1;
+    writes[1].descriptorCount = 1;
+    writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    writes[1].pImageInfo = &dst_desc;
+
+    for (i = 0; i < demo->swapchainImageCount; i++) {
+        err = vkAllocateDescriptorSets(demo->device, &alloc_info, &demo->swapchain_image_resources[i].convert_descriptor_set);
+        assert(!err);
+        dst_desc.imageView = demo->swapchain_image_resources[i].view;
+        writes[0].dstSet = demo->swapchain_image_resources[i].convert_descriptor_set;
+        writes[1].dstSet = demo->swapchain_image_resources[i].convert_descriptor_set;
+        vkUpdateDescriptorSets(demo->device, 2, writes, 0, NULL);
+    }
+}
+
+// Only the per swapchain image descriptors, unless all:
+static void demo_destroy_convert_pipeline(struct demo *demo, bool all) {
+    if (!demo->convert_pipeline)
+        return;
+
+    vkDestroyDescriptorPool(demo->device, demo->convert_desc_pool, NULL);
+    demo->convert_desc_pool = VK_NULL_HANDLE;
+    if (!all)
+        return;
+
+    vkDestroyPipeline(demo->device, demo->convert_pipeline, NULL);
+    vkDestroyPipelineLayout(demo->device, demo->convert_pipeline_layout, NULL);
+    vkDestroyDescriptorSetLayout(demo->device, demo->convert_desc_layout, NULL);
+    demo->convert_pipeline = VK_NULL_HANDLE;
+    demo->convert_pipeline_layout = VK_NULL_HANDLE;
+    demo->convert_desc_layout = VK_NULL_HANDLE;
+}
+
+// MK: Compute pipeline for the measurement of MaxCLL and MaxFALL of each frame:
+static void demo_prepare_lightlevel_pipeline(struct demo *demo) {
+    VkResult U_ASSERT_ONLY err;
+
+    if (!demo->use_lightlevel || !demo->hdr_enabled || !demo->interop_enabled || !demo->fpSetHdrMetadataEXT)
+        return;
+
+    VkShaderModule module = demo_prepare_cs(demo, "cube-lightlevel-comp.spv");
+    if (!module) {
+        printf("WARNING: Failed to load cube-lightlevel-comp.spv. Per frame MaxCLL / MaxFALL measurement is OFF,\n"
+               "WARNING: HDR metadata keeps the display defaults. Build the shaders, or use --no-lightlevel.\n");
+        demo->use_lightlevel = false;
+        return;
+    }
+
+    const VkDescriptorSetLayoutBinding layout_bindings[2] = {
+            [0] =
+                {
+                 .binding = 0,
+                 .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                 .descriptorCount = 1,
+                 .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                 .pImmutableSamplers = NULL,
+                },
+            [1] =
+                {
+                 .binding = 1,
+                 .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                 .descriptorCount = 1,
+                 .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                 .pImmutableSamplers = NULL,
+                },
+    };
+    const VkDescriptorSetLayoutCreateInfo descriptor_layout = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .pNext = NULL,
+        .bindingCount = 2,
+        .pBindings = layout_bindings,
+    };
+
+    err = vkCreateDescriptorSetLayout(demo->device, &descriptor_layout, NULL, &demo->lightlevel_desc_layout);
+    assert(!err);
+
+    const VkPipelineLayoutCreateInfo pipeline_layout_info = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .pNext = NULL,
+        .setLayoutCount = 1,
+        .pSetLayouts = &demo->lightlevel_desc_layout,
+    };
+
+    err = vkCreatePipelineLayout(demo->device, &pipeline_layout_info, NULL, &demo->lightlevel_pipeline_layout);
+    assert(!err);
+
+    // Interop image holds PQ if OpenGL encoded, linear nits if the Vulkan side pass encodes:
+    const int32_t input_pq = (demo->output_tf == OUTPUT_TF_NONE) ? 1 : 0;
+    const VkSpecializationMapEntry spec_entry = {.constantID = 0, .offset = 0, .size = sizeof(int32_t)};
+    const VkSpecializationInfo spec_info = {
+        .mapEntryCount = 1,
+        .pMapEntries = &spec_entry,
+        .dataSize = sizeof(input_pq),
+        .pData = &input_pq,
+    };
+    const VkComputePipelineCreateInfo pipeline_info = {
+        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        .pNext = NULL,
+        .stage =
+            {
+             .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+             .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+             .module = module,
+             .pName = "main",
+             .pSpecializationInfo = &spec_info,
+            },
+        .layout = demo->lightlevel_pipeline_layout,
+    };
+
+    err = vkCreateComputePipelines(demo->device, VK_NULL_HANDLE, 1, &pipeline_info, NULL, &demo->lightlevel_pipeline);
+    assert(!err);
+
+    vkDestroyShaderModule(demo->device, module, NULL);
+}
+
+// MK: Result buffers and descriptor sets for the light level measurement. One result
+// buffer per swapchain image, so results can be read back whenever that swapchain
+// image comes around again:
+static void demo_prepare_lightlevel_buffers(struct demo *demo) {
+    VkResult U_ASSERT_ONLY err;
+    VkMemoryRequirements mem_reqs;
+    VkDeviceSize size;
+    bool U_ASSERT_ONLY pass;
+    uint32_t i;
+
+    if (!demo->lightlevel_pipeline)
+        return;
+
+    demo->lightlevel_groups[0] = (demo->width + LIGHTLEVEL_TILE - 1) / LIGHTLEVEL_TILE;
+    demo->lightlevel_groups[1] = (demo->height + LIGHTLEVEL_TILE - 1) / LIGHTLEVEL_TILE;
+    size = demo->lightlevel_groups[0] * demo->lightlevel_groups[1] * 2 * sizeof(float);
+
+    const VkDescriptorPoolSize type_counts[2] = {
+            [0] =
+                {
+                 .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                 .descriptorCount = demo->swapchainImageCount,
+                },
+            [1] =
+                {
+                 .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                 .descriptorCount = demo->swapchainImageCount,
+                },
+    };
+    const VkDescriptorPoolCreateInfo descriptor_pool = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .pNext = NULL,
+        .maxSets = demo->swapchainImageCount,
+        .poolSizeCount = 2,
+        .pPoolSizes = type_counts,
+    };
+
+    err = vkCreateDescriptorPool(demo->device, &descriptor_pool, NULL, &demo->lightlevel_desc_pool);
+    assert(!err);
+
+    VkDescriptorSetAllocateInfo alloc_info = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .pNext = NULL,
+        .descriptorPool = demo->lightlevel_desc_pool,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &demo->lightlevel_desc_layout};
+
+    const VkBufferCreateInfo buf_info = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .pNext = NULL,
+        .size = size,
+        .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+    };
+
+    VkDescriptorImageInfo src_desc = {
+        .sampler = demo->textures[0].sampler,
+        .imageView = demo->textures[0].view,
+        .imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+    };
+    VkDescriptorBufferInfo dst_desc = {
+        .offset = 0,
+        .range = size,
+    };
+    VkWriteDescriptorSet writes[2];
+
+    memset(&writes, 0, sizeof(writes));
+
+    writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[0].dstBinding = 0;
+    writes[0].descriptorCount = 1;
+    writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    writes[0].pImageInfo = &src_desc;
+
+    writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[1].dstBinding = 1;
+    writes[1].descriptorCount = 1;
+    writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    writes[1].pBufferInfo = &dst_desc;
+
+    for (i = 0; i < demo->swapchainImageCount; i++) {
+        SwapchainImageResources *res = &demo->swapchain_image_resources[i];
+
+        err = vkCreateBuffer(demo->device, &buf_info, NULL, &res->lightlevel_buffer);
+        assert(!err);
+
+        vkGetBufferMemoryRequirements(demo->device, res->lightlevel_buffer, &mem_reqs);
+
+        // Host cached if possible, as the cpu reads all of it every frame:
+        pass = demo_memory_alloc(demo, &mem_reqs,
+                                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT |
+                                 VK_MEMORY_PROPERTY_HOST_CACHED_BIT, false, &res->lightlevel_alloc) ||
+               demo_memory_alloc(demo, &mem_reqs,
+                                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                 false, &res->lightlevel_alloc);
+        assert(pass);
+
+        err = vkBindBufferMemory(demo->device, res->lightlevel_buffer, res->lightlevel_alloc.mem, res->lightlevel_alloc.offset);
+        assert(!err);
+
+        res->lightlevel_data = demo_memory_map(demo, &res->lightlevel_alloc);
+
+        res->lightlevel_pending = false;
+
+        const VkFenceCreateInfo fence_ci = {
+            .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+            .pNext = NULL,
+            .flags = 0
+        };
+        err = vkCreateFence(demo->device, &fence_ci, NULL, &res->lightlevel_fence);
+        assert(!err);
+
+        err = vkAllocateDescriptorSets(demo->device, &alloc_info, &res->lightlevel_descriptor_set);
+        assert(!err);
+        dst_desc.buffer = res->lightlevel_buffer;
+        writes[0].dstSet = res->lightlevel_descriptor_set;
+        writes[1].dstSet = res->lightlevel_descriptor_set;
+        vkUpdateDescriptorSets(demo->device, 2, writes, 0, NULL);
+    }
+
+    printf("Measuring MaxCLL and MaxFALL per frame with %i x %i workgroups.\n",
+           demo->lightlevel_groups[0], demo->lightlevel_groups[1]);
+}
+
+// Only the per swapchain image buffers, unless all:
+static void demo_destroy_lightlevel_pipeline(struct demo *demo, bool all) {
+    uint32_t i;
+
+    if (!demo->lightlevel_pipeline)
+        return;
+
+    for (i = 0; i < demo->swapchainImageCount; i++) {
+        if (demo->swapchain_image_resources[i].lightlevel_pending)
+            vkWaitForFences(demo->device, 1, &demo->swapchain_image_resources[i].lightlevel_fence, VK_TRUE, UINT64_MAX);
+        vkDestroyFence(demo->device, demo->swapchain_image_resources[i].lightlevel_fence, NULL);
+        vkDestroyBuffer(demo->device, demo->swapchain_image_resources[i].lightlevel_buffer, NULL);
+        demo_memory_free(demo, &demo->swapchain_image_resources[i].lightlevel_alloc);
+        demo->swapchain_image_resources[i].lightlevel_data = NULL;
+        demo->swapchain_image_resources[i].lightlevel_pending = false;
+    }
+
+    vkDestroyDescriptorPool(demo->device, demo->lightlevel_desc_pool, NULL);
+    demo->lightlevel_desc_pool = VK_NULL_HANDLE;
+    if (!all)
+        return;
+
+    vkDestroyPipeline(demo->device, demo->lightlevel_pipeline, NULL);
+    vkDestroyPipelineLayout(demo->device, demo->lightlevel_pipeline_layout, NULL);
+    vkDestroyDescriptorSetLayout(demo->device, demo->lightlevel_desc_layout, NULL);
+    demo->lightlevel_pipeline = VK_NULL_HANDLE;
+    demo->lightlevel_pipeline_layout = VK_NULL_HANDLE;
+    demo->lightlevel_desc_layout = VK_NULL_HANDLE;
+}
+
+static void demo_prepare(struct demo *demo) {
+    VkResult U_ASSERT_ONLY err;
+
+    const VkCommandPoolCreateInfo cmd_pool_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .pNext = NULL,
+        .queueFamilyIndex = demo->graphics_queue_family_index,
+        .flags = 0,
+    };
+    err = vkCreateCommandPool(demo->device, &cmd_pool_info, NULL,
+                              &demo->cmd_pool);
+    assert(!err);
+
+    const VkCommandBufferAllocateInfo cmd = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .pNext = NULL,
+        .commandPool = demo->cmd_pool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1,
+    };
+    err = vkAllocateCommandBuffers(demo->device, &cmd, &demo->cmd);
+    assert(!err);
+    VkCommandBufferBeginInfo cmd_buf_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .pInheritanceInfo = NULL,
+    };
+    err = vkBeginCommandBuffer(demo->cmd, &cmd_buf_info);
+    assert(!err);
+
+    demo_prepare_buffers(demo);
+
+    // Same-sized textures survive a demo_resize(), so the OpenGL side can keep its imports.
+    // A new interop image goes to OpenGL first, reused ones were released by the last frame:
+    if (!demo->reuse_textures) {
+        demo_prepare_textures(demo);
+        demo_interop_ownership_barrier(demo, demo->cmd, false);
+    }
+
+    // Neither swapchain size nor colorspace matter to the pipelines, so demo_resize() keeps them:
+    if (!demo->reuse_pipelines) {
+        demo_prepare_descriptor_layout(demo);
+        demo_prepare_render_pass(demo);
+        demo_prepare_pipeline(demo);
+        demo_prepare_convert_pipeline(demo);
+        demo_prepare_lightlevel_pipeline(demo);
+    }
+
+    for (uint32_t i = 0; i < demo->swapchainImageCount; i++) {
+        err =
+            vkAllocateCommandBuffers(demo->device, &cmd, &demo->swapchain_image_resources[i].cmd);
+        assert(!err);
+    }
+
+    if (demo->separate_present_queue) {
+        const VkCommandPoolCreateInfo present_cmd_pool_info = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+            .pNext = NULL,
+            .queueFamilyIndex = demo->present_queue_family_index,
+            .flags = 0,
+        };
+        err = vkCreateCommandPool(demo->device, &present_cmd_pool_info, NULL,
+                                  &demo->present_cmd_pool);
+        assert(!err);
+        const VkCommandBufferAllocateInfo present_cmd_info = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .pNext = NULL,
+            .commandPool = demo->present_cmd_pool,
+            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            .commandBufferCount = 1,
+        };
+        for (uint32_t i = 0; i < demo->swapchainImageCount; i++) {
+            err = vkAllocateCommandBuffers(
+                demo->device, &present_cmd_info, &demo->swapchain_image_resources[i].graphics_to_present_cmd);
+            assert(!err);
+            demo_build_image_ownership_cmd(demo, i);
+        }
+    }
+
+    demo_prepare_descriptor_pool(demo);
+    demo_prepare_descriptor_set(demo);
+    demo_prepare_convert_descriptors(demo);
+    demo_prepare_lightlevel_buffers(demo);
+
+    demo_prepare_framebuffers(demo);
+
+    for (uint32_t i = 0; i < demo->swapchainImageCount; i++) {
+        demo->current_buffer = i;
+        demo_draw_build_cmd(demo, demo->swapchain_image_resources[i].cmd);
+    }
+
+    /*
+     * Prepare functions above may generate pipeline commands
+     * that need to be flushed before beginning the render loop.
+     */
+    demo_flush_init_cmd(demo);
+    demo_memory_report(demo);
+
+    demo->current_buffer = 0;
+    demo->prepared = true;
+}
+
+// Forward define:
+static void demo_destroy_opengl_interop(struct demo* demo, bool all);
+#if defined(VK_USE_PLATFORM_DISPLAY_KHR)
+static void demo_destroy_egl_opengl(struct demo *demo);
+static void demo_stop_glthread(struct demo *demo);
+static void demo_stop_movie(struct demo *demo);
+#endif
+
+static void demo_cleanup(struct demo *demo) {
+    uint32_t i;
+
+    demo->prepared = false;
+    vkDeviceWaitIdle(demo->device);
+
+    // Wait for fences from present operations
+    for (i = 0; i < FRAME_LAG; i++) {
+        vkWaitForFences(demo->device, 1, &demo->fences[i], VK_TRUE, UINT64_MAX);
+        vkDestroyFence(demo->device, demo->fences[i], NULL);
+        vkDestroySemaphore(demo->device, demo->image_acquired_semaphores[i], NULL);
+        vkDestroySemaphore(demo->device, demo->draw_complete_semaphores[i], NULL);
+        if (demo->separate_present_queue) {
+            vkDestroySemaphore(demo->device, demo->image_ownership_semaphores[i], NULL);
+        }
+    }
+
+    for (i = 0; i < demo->swapchainImageCount; i++) {
+        vkDestroyFramebuffer(demo->device, demo->swapchain_image_resources[i].framebuffer, NULL);
+    }
+    vkDestroyDescriptorPool(demo->device, demo->desc_pool, NULL);
+
+    for (i = 0; i < OUTPUT_TF_COUNT; i++)
+        vkDestroyPipeline(demo->device, demo->tf_pipelines[i], NULL);
+    vkDestroyPipelineCache(demo->device, demo->pipelineCache, NULL);
+    vkDestroyRenderPass(demo->device, demo->render_pass, NULL);
+    vkDestroyPipelineLayout(demo->device, demo->pipeline_layout, NULL);
+    vkDestroyDescriptorSetLayout(demo->device, demo->desc_layout, NULL);
+    demo_destroy_convert_pipeline(demo, true);
+    demo_destroy_lightlevel_pipeline(demo, true);
+
+#if defined(VK_USE_PLATFORM_DISPLAY_KHR)
+    demo_stop_glthread(demo);
+    demo_stop_movie(demo);
+#endif
+    demo_destroy_upload_ring(demo);
+
+    // OpenGL must let go of the shared memory before Vulkan frees it:
+    demo_destroy_opengl_interop(demo, true);
+    demo_release_interop_handles(demo);
+
+    if (demo->interop_gl_complete) {
+        vkDestroySemaphore(demo->device, demo->interop_gl_complete, NULL);
+        vkDestroySemaphore(demo->device, demo->interop_gl_ready, NULL);
+    }
+
+    for (i = 0; i < DEMO_TEXTURE_COUNT; i++) {
+        vkDestroyImageView(demo->device, demo->textures[i].view, NULL);
+        vkDestroyImage(demo->device, demo->textures[i].image, NULL);
+        vkFreeMemory(demo->device, demo->textures[i].mem, NULL);
+        demo_memory_free(demo, &demo->textures[i].alloc);
+        vkDestroySampler(demo->device, demo->textures[i].sampler, NULL);
+    }
+    demo->fpDestroySwapchainKHR(demo->device, demo->swapchain, NULL);
+
+    for (i = 0; i < demo->swapchainImageCount; i++) {
+        vkDestroyImageView(demo->device, demo->swapchain_image_resources[i].view, NULL);
+        vkFreeCommandBuffers(demo->device, demo->cmd_pool, 1,
+                             &demo->swapchain_image_resources[i].cmd);
+    }
+    free(demo->swapchain_image_resources);
+    free(demo->queue_props);
+    vkDestroyCommandPool(demo->device, demo->cmd_pool, NULL);
+
+    demo_flush_image_cache();
+
+    demo_memory_report(demo);
+    demo_memory_destroy(demo);
+
+    if (demo->separate_present_queue) {
+        vkDestroyCommandPool(demo->device, demo->present_cmd_pool, NULL);
+    }
+    vkDeviceWaitIdle(demo->device);
+
+    // Release display from direct display mode under Linux:
+    PFN_vkReleaseDisplayEXT m_pvkReleaseDisplayEXT = (PFN_vkReleaseDisplayEXT) vkGetInstanceProcAddr(demo->inst, "vkReleaseDisplayEXT" );
+    if (m_pvkReleaseDisplayEXT)
+        m_pvkReleaseDisplayEXT(demo->gpu, demo->vkdisplay);
+
+    vkDestroyDevice(demo->device, NULL);
+    if (demo->validate) {
+        demo->DestroyDebugReportCallback(demo->inst, demo->msg_callback, NULL);
+    }
+    vkDestroySurfaceKHR(demo->inst, demo->surface, NULL);
+    vkDestroyInstance(demo->inst, NULL);
+
+#if defined(VK_USE_PLATFORM_XLIB_KHR)
+    XDestroyWindow(demo->display, demo->xlib_window);
+    XCloseDisplay(demo->display);
+#elif defined(VK_USE_PLATFORM_XCB_KHR) || defined(VK_USE_PLATFORM_DISPLAY_KHR)
+#if defined(VK_USE_PLATFORM_DISPLAY_KHR)
+    demo_destroy_egl_opengl(demo);
+#endif
+    printf("Bye bye!\n");
+    xcb_disconnect(demo->connection);
+    free(demo->atom_wm_delete_window);
+#elif defined(VK_USE_PLATFORM_WAYLAND_KHR)
+    wl_shell_surface_destroy(demo->shell_surface);
+    wl_surface_destroy(demo->window);
+    wl_shell_destroy(demo->shell);
+    wl_compositor_destroy(demo->compositor);
+    wl_registry_destroy(demo->registry);
+    wl_display_disconnect(demo->display);
+#elif defined(VK_USE_PLATFORM_MIR_KHR)
+#endif
+}
+
+// Forward define:
+static void demo_create_opengl_interop(struct demo* demo);
+
+static void demo_resize(struct demo *demo) {
+    uint32_t i;
+
+#if defined(VK_USE_PLATFORM_DISPLAY_KHR)
+    // MK: Not needed for direct display mode, unless the colorspace changes:
+    if (!demo->recreate_swapchain)
+        return;
+#endif
+
+    // Don't react to resize until after first initialization.
+    if (!demo->prepared) {
+        return;
+    }
+    // In order to properly resize the window, we must re-create the swapchain
+    // AND redo the command buffers, etc.
+    //
+    // First, perform part of the demo_cleanup() function:
+    demo->prepared = false;
+    vkDeviceWaitIdle(demo->device);
+
+    for (i = 0; i < demo->swapchainImageCount; i++) {
+        vkDestroyFramebuffer(demo->device, demo->swapchain_image_resources[i].framebuffer, NULL);
+    }
+    vkDestroyDescriptorPool(demo->device, demo->desc_pool, NULL);
+
+    // Pipelines, their layouts and the render pass only depend on the swapchain
+    // format, which stays the same. Only per swapchain image objects go:
+    demo_destroy_convert_pipeline(demo, false);
+    demo_destroy_lightlevel_pipeline(demo, false);
+    demo->reuse_pipelines = true;
+
+    // The interop image only depends on the framebuffer size. If that did not
+    // change, keep it and all OpenGL objects which reference it. Otherwise OpenGL
+    // must release all size dependent objects before Vulkan frees the memory:
+    demo->reuse_textures = demo->textures[0].image &&
+                           (!demo->interop_enabled ||
+                            (demo->textures[0].tex_width == demo->width &&
+                             demo->textures[0].tex_height == demo->height));
+
+    if (!demo->reuse_textures) {
+        demo_destroy_opengl_interop(demo, false);
+
+        for (i = 0; i < DEMO_TEXTURE_COUNT; i++) {
+            vkDestroyImageView(demo->device, demo->textures[i].view, NULL);
+            vkDestroyImage(demo->device, demo->textures[i].image, NULL);
+            vkFreeMemory(demo->device, demo->textures[i].mem, NULL);
+            demo_memory_free(demo, &demo->textures[i].alloc);
+            vkDestroySampler(demo->device, demo->textures[i].sampler, NULL);
         }
     }
+    else {
+        printf("Reusing %i x %i interop texture after resize.\n",
+               demo->textures[0].tex_width, demo->textures[0].tex_height);
+    }
+
+    for (i = 0; i < demo->swapchainImageCount; i++) {
+        vkDestroyImageView(demo->device, demo->swapchain_image_resources[i].view, NULL);
+        vkFreeCommandBuffers(demo->device, demo->cmd_pool, 1,
+                             &demo->swapchain_image_resources[i].cmd);
+    }
+    vkDestroyCommandPool(demo->device, demo->cmd_pool, NULL);
+    if (demo->separate_present_queue) {
+        vkDestroyCommandPool(demo->device, demo->present_cmd_pool, NULL);
+    }
+    free(demo->swapchain_image_resources);
+
+    // Second, re-perform the demo_prepare() function, which will re-create the
+    // swapchain:
+    demo_prepare(demo);
+
+    // Renitialize size dependent OpenGL side of OpenGL->Vulkan interop, if needed:
+    if (!demo->reuse_textures)
+        demo_create_opengl_interop(demo);
+
+    demo->reuse_textures = false;
+    demo->reuse_pipelines = false;
 }
 
-void setHdrMetadata(struct demo *demo, float maxL, float avgL) {
-    VkHdrMetadataEXT hdr_metadata;
+// Simulated OpenGL rendering code -- would correspond to PTB user drawing code:
+void draw_jesse(struct demo* demo)
+{
+    // Draw Jesse the cat - i assume?
+    static bool firsttime = true;
 
-    if (!demo->hdr_enabled)
-        return;
+    float maxL = (demo->nativeDisplayHdrMetadata.maxLuminance > 0.0) ? demo->nativeDisplayHdrMetadata.maxLuminance : 600;
 
-    memset(&hdr_metadata, 0, sizeof(hdr_metadata));
+    if (firsttime) {
+        firsttime = false;
 
-    hdr_metadata.sType = VK_STRUCTURE_TYPE_HDR_METADATA_EXT;
-    hdr_metadata.pNext = NULL;
+        // Default background color to maxFALL:
+        if (demo->rgb[0] == -1 && demo->nativeDisplayHdrMetadata.maxFrameAverageLightLevel > 0.0)
+            demo->rgb[0] = demo->nativeDisplayHdrMetadata.maxFrameAverageLightLevel;
 
-    // Note: These are the mastering display properties of
-    // my Samsung CH27HG70 FreeSync2 HDR monitor.
-    VkXYColorEXT pr = { 0.6767, 0.3164 };
-    VkXYColorEXT pg = { 0.2753, 0.6611 };
-    VkXYColorEXT pb = { 0.1523, 0.0615 };
-    VkXYColorEXT wp = { 0.3134, 0.3291 };
+        if (demo->rgb[1] == -1 && demo->nativeDisplayHdrMetadata.maxFrameAverageLightLevel > 0.0)
+            demo->rgb[1] = demo->nativeDisplayHdrMetadata.maxFrameAverageLightLevel;
 
-    // BT 2020 color space selected as output color space?
-    if (false &&
-        (demo->color_space == VK_COLOR_SPACE_HDR10_ST2084_EXT ||
-        demo->color_space == VK_COLOR_SPACE_HDR10_HLG_EXT ||
-        demo->color_space == VK_COLOR_SPACE_BT2020_LINEAR_EXT)) {
-        printf("HDR metadata for BT2020 colorspace assigned.\n");
-        // Override to its gamut:
-        pr.x = 0.708;
-        pr.y = 0.292;
-        pg.x = 0.170;
-        pg.y = 0.797;
-        pb.x = 0.131;
-        pb.y = 0.046;
+        if (demo->rgb[2] == -1 && demo->nativeDisplayHdrMetadata.maxFrameAverageLightLevel > 0.0)
+            demo->rgb[2] = demo->nativeDisplayHdrMetadata.maxFrameAverageLightLevel;
 
-        // D65 white point:
-        wp.x = 0.3127;
-        wp.y = 0.3290;
+        // Set maxL to, well, maxL. Set maxFALL to a weighted average of input rgb, because most of
+        // the content is background color, and the 10% of Jesse are a bit "who cares?":
+        setHdrMetadata(demo, maxL, 0.2126 * demo->rgb[0] + 0.7152 * demo->rgb[1] + 0.0722 * demo->rgb[2]);
     }
 
-    if (true) {
-        // Use  display native color gamut and properties:
-        printf("HDR metadata for display native gamut and luminance levels assigned.\n");
-        memcpy(&hdr_metadata, &demo->nativeDisplayHdrMetadata, sizeof(hdr_metadata));
+    // Background in user-specified R, G, B:
+    glClearColor(demo->rgb[0], demo->rgb[1], demo->rgb[2], 1.0);
+    glClear(GL_COLOR_BUFFER_BIT);
 
-        // Hack for AMD Vulkan driver on Windows-10: Does set bogus/wrong maxLuminance,
-        // specifically it wrongly sets maxLuminance = maxFrameAverageLightLevel, and
-        // maxFrameAverageLightLevel == 0. If we detect this, override with known values
-        // from Samsung CH27HG70 for the moment:
-        if (hdr_metadata.maxLuminance < 400) {
-            printf("Driver bug: maxLuminance wrong -- Setting to hard-coded 603.666 nits.\n");
-            hdr_metadata.maxLuminance = 603.666;
-        }
+    // Map max intensity r, g, b in the cat picture to maxL nits:
+    glColor3f(maxL, maxL, maxL);
 
-        // If maxCLL is undefined, set it to max mastering display luminance:
-        if (hdr_metadata.maxContentLightLevel == 0)
-            hdr_metadata.maxContentLightLevel = hdr_metadata.maxLuminance;
+    // Draw some rotating square into the center, textured with the cat pic:
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
 
-        // If maxFall is missing, set it to half maxCLL as a reasonable setting:
-        if (hdr_metadata.maxFrameAverageLightLevel == 0) {
-            printf("Driver bug? maxFrameAverageLightLevel missing -- Setting to half maxContentLightLevel.\n");
-            hdr_metadata.maxFrameAverageLightLevel = hdr_metadata.maxContentLightLevel / 2;
-        }
-    }
+    glTranslatef(demo->tx, demo->ty, 0.0);
+    glRotatef((float)(demo->clientFrame % 360), 0, 0, 1);
+    glScalef(0.15, 0.15, 1);
 
-    // Use maxL for maximum light levels, if provided:
-    if (maxL > 0) {
-        hdr_metadata.maxLuminance = maxL;
-        hdr_metadata.maxContentLightLevel = maxL;
+    glEnable(GL_TEXTURE_2D);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glBegin(GL_QUADS);
+    glTexCoord2f(0.0, 0.0);
+    glVertex2f(-1.0, -1.0);
+    glTexCoord2f(1.0, 0.0);
+    glVertex2f(1.0, -1.0);
+    glTexCoord2f(1.0, 1.0);
+    glVertex2f(1.0, 1.0);
+    glTexCoord2f(0.0, 1.0);
+    glVertex2f(-1.0, 1.0);
+    glEnd();
+
+    glDisable(GL_TEXTURE_2D);
+}
+
+void draw_centerpatch(struct demo* demo, bool flash, bool move)
+{
+    // Draw a RGB patch filling the center 10% of the display:
+    static bool firsttime = true;
+
+    float maxL = (demo->nativeDisplayHdrMetadata.maxLuminance > 0.0) ? demo->nativeDisplayHdrMetadata.maxLuminance : 600;
+
+    if (firsttime) {
+        firsttime = false;
+
+        // Default color to maxLuminance:
+        if (demo->rgb[0] == -1)
+            demo->rgb[0] = maxL;
+        else
+            if (demo->rgb[0] > maxL)
+                maxL = demo->rgb[0];
+
+        if (demo->rgb[1] == -1)
+            demo->rgb[1] = maxL;
+        else
+            if (demo->rgb[1] > maxL)
+                maxL = demo->rgb[1];
+
+        if (demo->rgb[2] == -1)
+            demo->rgb[2] = maxL;
+        else
+            if (demo->rgb[2] > maxL)
+                maxL = demo->rgb[2];
+
+        // Set maxL to, well, maxL. Set maxFALL to a weighted average of input rgb * 0.1, because only 10% are non-black:
+        setHdrMetadata(demo, maxL, (0.2126 * demo->rgb[0] + 0.7152 * demo->rgb[1] + 0.0722 * demo->rgb[2]) * 0.1);
     }
 
-    // Use avgL for maxFALL, if provided:
-    if (avgL > 0) {
-        hdr_metadata.maxFrameAverageLightLevel = avgL;
+    // Background in black:
+    glClearColor(0, 0, 0, 1.0);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    // User defined RGB values in nits:
+    if (!flash || ((demo->clientFrame % 600) < 200))
+        glColor3f(demo->rgb[0], demo->rgb[1], demo->rgb[2]);
+    else
+        glColor3f(0, 0, 0);
+
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+
+    if (move) {
+        float v = ((float)(demo->clientFrame % 2000) / 1000.0) - 1.0;
+        glTranslatef(sin(v * 3.1415) * 1.5, sin(v * 3.1415) * 1.5, 0.0);
+    } else {
+        glTranslatef(demo->tx, demo->ty, 0.0);
     }
 
-    // Minimum luminance is zero:
-    hdr_metadata.minLuminance = 0.0;
+    // Scale square to cover the center 10% of the display area:
+    glScalef(0.31623, 0.31623, 1);
 
-    printf("Set HDR DATA to:\n");
-    printf("Display Gamut  R: [%f, %f]\n", hdr_metadata.displayPrimaryRed.x, hdr_metadata.displayPrimaryRed.y);
-    printf("Display Gamut  G: [%f, %f]\n", hdr_metadata.displayPrimaryGreen.x, hdr_metadata.displayPrimaryGreen.y);
-    printf("Display Gamut  B: [%f, %f]\n", hdr_metadata.displayPrimaryBlue.x, hdr_metadata.displayPrimaryBlue.y);
-    printf("Display Gamut WP: [%f, %f]\n", hdr_metadata.whitePoint.x, hdr_metadata.whitePoint.y);
-    printf("Display minLuminance: %f nits\n", hdr_metadata.minLuminance);
-    printf("Display maxLuminance: %f nits\n", hdr_metadata.maxLuminance);
-    printf("Content maxFrameAverageLightLevel: %f nits\n", hdr_metadata.maxFrameAverageLightLevel);
-    printf("Content maxContentLightLevel: %f nits\n", hdr_metadata.maxContentLightLevel);
+    glBegin(GL_QUADS);
+    glVertex2f(-1.0, -1.0);
+    glVertex2f(1.0, -1.0);
+    glVertex2f(1.0, 1.0);
+    glVertex2f(-1.0, 1.0);
+    glEnd();
+}
 
-    demo->fpSetHdrMetadataEXT(demo->device, 1, &demo->swapchain, &hdr_metadata);
+void draw_fullscreen(struct demo* demo, bool flash)
+{
+    // Draw a RGB color filling the whole display:
+    static bool firsttime = true;
+
+    float maxFALL = (demo->nativeDisplayHdrMetadata.maxFrameAverageLightLevel > 0.0) ? demo->nativeDisplayHdrMetadata.maxFrameAverageLightLevel : demo->nativeDisplayHdrMetadata.maxLuminance;
+    if (maxFALL == 0)
+        maxFALL = 600.0;
+
+    if (firsttime) {
+        firsttime = false;
+
+        // Default background color to maxFALL:
+        if (demo->rgb[0] == -1)
+            demo->rgb[0] = maxFALL;
+
+        if (demo->rgb[1] == -1)
+            demo->rgb[1] = maxFALL;
+
+        if (demo->rgb[2] == -1)
+            demo->rgb[2] = maxFALL;
+
+        maxFALL = (0.2126 * demo->rgb[0] + 0.7152 * demo->rgb[1] + 0.0722 * demo->rgb[2]);
+
+        // Set maxL and maxFALL to a weighted average of input rgb:
+        setHdrMetadata(demo, maxFALL, maxFALL);
+    }
+
+    if (!flash || ((demo->clientFrame % 600) < 200)) {
+        // Background in user specified color:
+        glClearColor(demo->rgb[0], demo->rgb[1], demo->rgb[2], 1.0);
+    }
+    else {
+        // Background black:
+        glClearColor(0, 0, 0, 1);
+    }
+
+    glClear(GL_COLOR_BUFFER_BIT);
 }
 
-// Forward define:
-void draw_opengl(struct demo *demo);
+void draw_pqramp(struct demo* demo)
+{
+    // Draw a ramp of uniform PQ code value steps from 0 to maxL nits across the display, in four
+    // horizontal bands for gray, red, green and blue. The stimulus is generated on the cpu:
+    static GLuint ramptex = 0;
+    const int steps = 1024;
+
+    if (!ramptex) {
+        struct tf_kernels k = tf_get_kernels();
+        float maxL = (demo->nativeDisplayHdrMetadata.maxLuminance > 0.0) ? demo->nativeDisplayHdrMetadata.maxLuminance : 600;
+        float *code = malloc(steps * sizeof(float));
+        float *nits = malloc(steps * sizeof(float));
+        float *rgba = malloc(steps * 4 * 4 * sizeof(float));
+        uint16_t *half = malloc(steps * 4 * 4 * sizeof(uint16_t));
+        double sum = 0;
+        int i, band;
+
+        // Uniform steps in PQ code space, decoded into nits:
+        for (i = 0; i < steps; i++)
+            code[i] = tf_pq_encode_ref(maxL) * (float) i / (float) (steps - 1);
+        k.pq_decode(code, nits, steps);
+
+        for (band = 0; band < 4; band++) {
+            for (i = 0; i < steps; i++) {
+                float *p = &rgba[(band * steps + i) * 4];
+                p[0] = (band == 0 || band == 1) ? nits[i] : 0;
+                p[1] = (band == 0 || band == 2) ? nits[i] : 0;
+                p[2] = (band == 0 || band == 3) ? nits[i] : 0;
+                p[3] = 1;
+            }
+        }
+
+        for (i = 0; i < steps; i++)
+            sum += nits[i];
+
+        // Half of the four bands luminance is the mean of gray, the color bands add up to another gray:
+        setHdrMetadata(demo, maxL, sum / steps / 2);
+
+        k.float_to_half(rgba, half, steps * 4 * 4);
 
-static void demo_draw(struct demo *demo) {
-    static uint64_t tStartTime = 0;
-    static uint64_t tlastSwapComplete = 0;
-    static uint64_t tPostSwapRequested = 0;
-    static bool firsttime = true;
-    uint64_t tSwapComplete;
-    VkResult U_ASSERT_ONLY err;
+        glGenTextures(1, &ramptex);
+        glBindTexture(GL_TEXTURE_2D, ramptex);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, steps, 4, 0, GL_RGBA, GL_HALF_FLOAT, half);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 
-    if (tlastSwapComplete == 0) {
-        tlastSwapComplete = getTimeInNanoseconds();
-        tStartTime = tlastSwapComplete;
+        free(half);
+        free(rgba);
+        free(nits);
+        free(code);
     }
 
-    if (false) {
-        // Ensure no more than FRAME_LAG renderings are outstanding
-        vkWaitForFences(demo->device, 1, &demo->fences[demo->frame_index], VK_TRUE, UINT64_MAX);
-        vkResetFences(demo->device, 1, &demo->fences[demo->frame_index]);
-    }
+    glClearColor(0, 0, 0, 1.0);
+    glClear(GL_COLOR_BUFFER_BIT);
 
-    // Get the index of the next available swapchain image:
-    // Both image_acquired_semaphores[demo->frame_index] and the flipcompletefence
-    // will signal when the display engine is done with scanning out the acquired
-    // image, ergo, when it was replaced as old frontbuffer by a new frontbuffer,
-    // which was our old backbuffer, iow. when the previously scheduled swap/present
-    // actually completed due to kms-pageflip completion:
-    err = demo->fpAcquireNextImageKHR(demo->device, demo->swapchain, UINT64_MAX,
-                                      demo->image_acquired_semaphores[demo->frame_index],
-                                      demo->flipcompletefence, &demo->current_buffer);
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
 
-    if (err == VK_ERROR_OUT_OF_DATE_KHR) {
-        // demo->swapchain is out of date (e.g. the window was resized) and
-        // must be recreated:
-        demo->frame_index += 1;
-        demo->frame_index %= FRAME_LAG;
+    glBindTexture(GL_TEXTURE_2D, ramptex);
+    glEnable(GL_TEXTURE_2D);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
 
-        demo_resize(demo);
-        demo_draw(demo);
-        return;
-    } else if (err == VK_SUBOPTIMAL_KHR) {
-        // demo->swapchain is not as optimal as it could be, but the platform's
-        // presentation engine will still present the image correctly.
-    } else {
-        assert(!err);
-    }
+    glBegin(GL_QUADS);
+    glTexCoord2f(0.0, 0.0);
+    glVertex2f(-1.0, -1.0);
+    glTexCoord2f(1.0, 0.0);
+    glVertex2f(1.0, -1.0);
+    glTexCoord2f(1.0, 1.0);
+    glVertex2f(1.0, 1.0);
+    glTexCoord2f(0.0, 1.0);
+    glVertex2f(-1.0, 1.0);
+    glEnd();
 
-    // Wait for flipcompletefence to signal, iow. for confirmed flip completion aka
-    // visual stimulus onset. Then reset the fence and timestamp the moment:
-    vkWaitForFences(demo->device, 1, &demo->flipcompletefence, VK_TRUE, UINT64_MAX);
-    vkResetFences(demo->device, 1, &demo->flipcompletefence);
-    tSwapComplete = getTimeInNanoseconds();
+    glDisable(GL_TEXTURE_2D);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+}
 
-#if defined(VK_USE_PLATFORM_XLIB_XRANDR_EXT)
-    // Use the precise timestamping, based on high-precision vblank timestamps iff we present synchronized
-    // to vblank for tear-free presentation:
-    if (demo->presentMode == VK_PRESENT_MODE_FIFO_KHR || demo->presentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
-        // Under Linux + X11 we can (ab)use our X11 window on the same output that is
-        // leased out to Vulkan to use the glXGetSyncValuesOML() call on the Mesa FOSS
-        // based drivers to get a precise start of scanout timestamp at end of most
-        // recent vblank. Ideally this will be almost identical to tSwapComplete, ie.
-        // tSwapComplete is a noisy approximation of the proper queried ust here.
-        // Indeed, this works on AMD:
-        uint64_t ust, msc, sbc;
-        double serror;
+void draw_image(struct demo* demo)
+{
+    // Draw the HDR stimulus image from --image, as large as it fits on the display with its aspect
+    // ratio, centered. 8 and 16 bit PPM's map full scale to maxL, like Jesse, PFM and half float
+    // images are in nits. The file is decoded straight into a pixel buffer object as RGBA16F:
+    static GLuint imagetex = 0;
+    static float scale, sx, sy;
+    static const char *formats[] = { "8 bit PPM", "16 bit PPM", "PFM", "half float" };
+
+    if (!imagetex) {
+        float maxL = (demo->nativeDisplayHdrMetadata.maxLuminance > 0.0) ? demo->nativeDisplayHdrMetadata.maxLuminance : 600;
+        float aspect = (float) demo->textures[0].tex_width / (float) demo->textures[0].tex_height;
+        float maxrgb = 0, avgrgb = 0;
+        uint64_t t = getTimeInNanoseconds();
+        struct ppm_image img;
+        GLuint pbo;
+        void *data;
 
-        if ((NULL != glXGetSyncValuesOML) && glXGetSyncValuesOML(demo->display, demo->drawable, &ust, &msc, &sbc)) {
-            // Timestamp disagreement of less than 1 msec is considered correct:
-            serror = ((double) tSwapComplete / 1000.0) - (double) ust;
-            if (demo->timestamping_enabled) {
-                if (serror < 1000)
-                    printf("OK: ");
+        glGenTextures(1, &imagetex);
+        glBindTexture(GL_TEXTURE_2D, imagetex);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        scale = 0;
+
+        if (ppm_open(demo->image_path, &img, true)) {
+            const size_t size = (size_t) img.width * img.height * 4 * sizeof(uint16_t);
+
+            glGenBuffers(1, &pbo);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+            data = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+
+            if (data && ppm_copy_rgba16f(&img, data, (size_t) img.width * 4 * sizeof(uint16_t), &maxrgb, &avgrgb)) {
+                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, img.width, img.height, 0, GL_RGBA, GL_HALF_FLOAT, NULL);
+
+                scale = (img.format == PPM_FORMAT_RGB8 || img.format == PPM_FORMAT_RGB16) ? maxL : 1;
+                sx = ((float) img.width / (float) img.height) / aspect;
+                sy = 1;
+                if (sx > 1) {
+                    sy = 1 / sx;
+                    sx = 1;
+                }
 
-                printf("msc %li, tSwapComplete %li - ust %li = %f usecs stimonset error: ", msc, tSwapComplete, ust * 1000, serror);
+                printf("HDR stimulus image %s: %i x %i %s, max %f nits, average %f nits, loaded in %f msecs.\n",
+                       demo->image_path, img.width, img.height, formats[img.format], maxrgb * scale, avgrgb * scale,
+                       (getTimeInNanoseconds() - t) / 1e6);
+            }
+            else if (data) {
+                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
             }
 
-            // Override with accurate value:
-            tSwapComplete = ust * 1000;
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            glDeleteBuffers(1, &pbo);
+            ppm_close(&img);
         }
+
+        if (scale == 0)
+            printf("Could not load HDR stimulus image '%s', drawing black.\n", demo->image_path);
+
+        // The image covers sx * sy of the black display:
+        setHdrMetadata(demo, maxrgb * scale, avgrgb * scale * sx * sy);
     }
-#endif
 
-    if (demo->timestamping_enabled)
-        printf("ifi = %f msecs. tSwapComplete - tPostSwapRequested = %f msecs.\n",
-               (double)(tSwapComplete - tlastSwapComplete) / 1000000.0,
-               (double)(tSwapComplete - tPostSwapRequested) / 1000000.0);
+    glClearColor(0, 0, 0, 1.0);
+    glClear(GL_COLOR_BUFFER_BIT);
 
-    // Update last swap complete for next cycle:
-    tlastSwapComplete = tSwapComplete;
+    if (scale == 0)
+        return;
 
-    if (demo->VK_GOOGLE_display_timing_enabled) {
-        // Look at what happened to previous presents, and make appropriate
-        // adjustments in timing:
-        DemoUpdateTargetIPD(demo);
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    glScalef(sx, sy, 1);
 
-        // Note: a real application would position its geometry to that it's in
-        // the correct locatoin for when the next image is presented.  It might
-        // also wait, so that there's less latency between any input and when
-        // the next image is rendered/presented.  This demo program is so
-        // simple that it doesn't do either of those.
-    }
+    glColor3f(scale, scale, scale);
+    glBindTexture(GL_TEXTURE_2D, imagetex);
+    glEnable(GL_TEXTURE_2D);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
 
-    #if defined(VK_USE_PLATFORM_DISPLAY_KHR) || defined(VK_USE_PLATFORM_WIN32_KHR)
-        draw_opengl(demo);
-    #endif
+    // Rows are top to bottom:
+    glBegin(GL_QUADS);
+    glTexCoord2f(0.0, 1.0);
+    glVertex2f(-1.0, -1.0);
+    glTexCoord2f(1.0, 1.0);
+    glVertex2f(1.0, -1.0);
+    glTexCoord2f(1.0, 0.0);
+    glVertex2f(1.0, 1.0);
+    glTexCoord2f(0.0, 0.0);
+    glVertex2f(-1.0, 1.0);
+    glEnd();
 
-    demo_update_data_buffer(demo);
+    glDisable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
 
-    // Wait for the image acquired semaphore to be signaled to ensure
-    // that the image won't be rendered to until the presentation
-    // engine has fully released ownership to the application, and it is
-    // okay to render to the image.
-    VkPipelineStageFlags pipe_stage_flags;
-    VkSubmitInfo submit_info;
-    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submit_info.pNext = NULL;
-    submit_info.pWaitDstStageMask = &pipe_stage_flags;
-    pipe_stage_flags = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    submit_info.waitSemaphoreCount = 1;
-    submit_info.pWaitSemaphores = &demo->image_acquired_semaphores[demo->frame_index];
-    submit_info.commandBufferCount = 1;
-    submit_info.pCommandBuffers = &demo->swapchain_image_resources[demo->current_buffer].cmd;
-    submit_info.signalSemaphoreCount = 1;
-    submit_info.pSignalSemaphores = &demo->draw_complete_semaphores[demo->frame_index];
-    err = vkQueueSubmit(demo->graphics_queue, 1, &submit_info,
-                        demo->fences[demo->frame_index]);
-    assert(!err);
+void draw_opengl_client(struct demo* demo)
+{
+    static bool firsttime = true;
+    int w = demo->textures[0].tex_width;
+    int h = demo->textures[0].tex_height;
 
-    if (demo->separate_present_queue) {
-        // If we are using separate queues, change image ownership to the
-        // present queue before presenting, waiting for the draw complete
-        // semaphore and signalling the ownership released semaphore when finished
-        VkFence nullFence = VK_NULL_HANDLE;
-        pipe_stage_flags = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-        submit_info.waitSemaphoreCount = 1;
-        submit_info.pWaitSemaphores = &demo->draw_complete_semaphores[demo->frame_index];
-        submit_info.commandBufferCount = 1;
-        submit_info.pCommandBuffers =
-            &demo->swapchain_image_resources[demo->current_buffer].graphics_to_present_cmd;
-        submit_info.signalSemaphoreCount = 1;
-        submit_info.pSignalSemaphores = &demo->image_ownership_semaphores[demo->frame_index];
-        err = vkQueueSubmit(demo->present_queue, 1, &submit_info, nullFence);
-        assert(!err);
-    }
+    switch (demo->testpattern) {
+        case 0:
+        default:
+            draw_jesse(demo);
+            break;
 
-    // If we are using separate queues we have to wait for image ownership,
-    // otherwise wait for draw complete
-    VkPresentInfoKHR present = {
-        .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
-        .pNext = NULL,
-        .waitSemaphoreCount = 1,
-        .pWaitSemaphores = (demo->separate_present_queue)
-                               ? &demo->image_ownership_semaphores[demo->frame_index]
-                               : &demo->draw_complete_semaphores[demo->frame_index],
-        .swapchainCount = 1,
-        .pSwapchains = &demo->swapchain,
-        .pImageIndices = &demo->current_buffer,
-    };
+        case 1:
+            draw_centerpatch(demo, false, false);
+            break;
 
-    if (demo->VK_KHR_incremental_present_enabled) {
-        // If using VK_KHR_incremental_present, we provide a hint of the region
-        // that contains changed content relative to the previously-presented
-        // image.  The implementation can use this hint in order to save
-        // work/power (by only copying the region in the hint).  The
-        // implementation is free to ignore the hint though, and so we must
-        // ensure that the entire image has the correctly-drawn content.
-        uint32_t eighthOfWidth = demo->width / 8;
-        uint32_t eighthOfHeight = demo->height / 8;
-        VkRectLayerKHR rect = {
-            .offset.x = eighthOfWidth,
-            .offset.y = eighthOfHeight,
-            .extent.width = eighthOfWidth * 6,
-            .extent.height = eighthOfHeight * 6,
-            .layer = 0,
-        };
-        VkPresentRegionKHR region = {
-            .rectangleCount = 1,
-            .pRectangles = &rect,
-        };
-        VkPresentRegionsKHR regions = {
-            .sType = VK_STRUCTURE_TYPE_PRESENT_REGIONS_KHR,
-            .pNext = present.pNext,
-            .swapchainCount = present.swapchainCount,
-            .pRegions = &region,
-        };
-        present.pNext = &regions;
-    }
+        case 2:
+            draw_centerpatch(demo, true, false);
+            break;
 
-    if (demo->VK_GOOGLE_display_timing_enabled) {
-        VkPresentTimeGOOGLE ptime;
-        if (demo->prev_desired_present_time == 0) {
-            // This must be the first present for this swapchain.
-            //
-            // We don't know where we are relative to the presentation engine's
-            // display's refresh cycle.  We also don't know how long rendering
-            // takes.  Let's make a grossly-simplified assumption that the
-            // desiredPresentTime should be half way between now and
-            // now+target_IPD.  We will adjust over time.
-            uint64_t curtime = getTimeInNanoseconds();
-            if (curtime == 0) {
-                // Since we didn't find out the current time, don't give a
-                // desiredPresentTime:
-                ptime.desiredPresentTime = 0;
-            } else {
-                ptime.desiredPresentTime = curtime + (demo->target_IPD >> 1);
-            }
-        } else {
-            ptime.desiredPresentTime = (demo->prev_desired_present_time +
-                                        demo->target_IPD);
-        }
+        case 3:
+            draw_centerpatch(demo, false, true);
+            break;
 
-        printf("\tdesired present time %f delta %f\n",
-               ptime.desiredPresentTime / 1e9,
-               ptime.desiredPresentTime / 1e9 - demo->prev_desired_present_time / 1e9);
+        case 4:
+            draw_fullscreen(demo, false);
+            break;
+
+        case 5:
+            draw_fullscreen(demo, true);
+            break;
 
-        ptime.presentID = demo->next_present_id++;
-        demo->prev_desired_present_time = ptime.desiredPresentTime;
+        case 6:
+            draw_pqramp(demo);
+            break;
 
-        VkPresentTimesInfoGOOGLE present_time = {
-            .sType = VK_STRUCTURE_TYPE_PRESENT_TIMES_INFO_GOOGLE,
-            .pNext = present.pNext,
-            .swapchainCount = present.swapchainCount,
-            .pTimes = &ptime,
-        };
-        if (demo->VK_GOOGLE_display_timing_enabled) {
-            present.pNext = &present_time;
-        }
+        case 7:
+            draw_image(demo);
+            break;
     }
+}
 
-#ifndef WIN32
-    if (demo->waitMsecs >= 0) {
-        usleep(demo->waitMsecs * 1000);
+void draw_opengl(struct demo* demo)
+{
+    static bool firsttime = true;
+    int w = demo->textures[0].tex_width;
+    int h = demo->textures[0].tex_height;
+    GLuint srctexture = demo->srctexture;
+    GLenum layout = GL_LAYOUT_COLOR_ATTACHMENT_EXT;
+#if defined(VK_USE_PLATFORM_DISPLAY_KHR)
+    struct gl_slot *slot = &demo->glslots[demo->glslot_read];
+#endif
+
+    if (!demo->interop_enabled)
+        return;
+
+    if (firsttime) {
+        glClampColor(GL_CLAMP_VERTEX_COLOR, GL_FALSE);
+        glClampColor(GL_CLAMP_FRAGMENT_COLOR, GL_FALSE);
+        glViewport(0, 0, w, h);
+        printf("Vulkan target fbo size: %i x %i\n", w, h);
+        firsttime = false;
     }
-    else {
-        // Randomized wait time:
-        usleep(-1000 * demo->waitMsecs * ((double) random() / (double) RAND_MAX));
+
+#if defined(VK_USE_PLATFORM_DISPLAY_KHR)
+    if (demo->use_glthread) {
+        // Nothing new from the client thread? Then let Vulkan present the
+        // previous interop image again, instead of waiting for the client:
+        if (atomic_load_explicit(&slot->state, memory_order_acquire) != GLSLOT_READY)
+            return;
+
+        // GPU side wait for the client rendering, then post-process its image:
+        glWaitSync(slot->fence, 0, GL_TIMEOUT_IGNORED);
+        glDeleteSync(slot->fence);
+        srctexture = slot->texture;
+
+        // Light levels the client set for this image, before its tone mapping:
+        if (slot->hdr_update)
+            demo_apply_content_light_levels(demo, slot->maxL, slot->avgL);
     }
-#else
-    Sleep(demo->waitMsecs);
+    else
 #endif
+    {
+        // Bind fbo with our virtual OpenGL framebuffer, so simulated client code
+        // can render the stimulus image in RGBA16F nits, BT2020/2100 color space.
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, demo->srcfbo);
 
-    uint64_t tPreSwapRequested = getTimeInNanoseconds();
-    err = demo->fpQueuePresentKHR(demo->present_queue, &present);
-    tPostSwapRequested = getTimeInNanoseconds();
+        // Call simulated client rendering code:
+        demo->clientFrame = demo->curFrame;
+        draw_opengl_client(demo);
+    }
 
-    demo->frame_index += 1;
-    demo->frame_index %= FRAME_LAG;
+    // Vulkan must be done reading the interop image, before we overwrite it:
+    if (demo->interop_vk_signalled) {
+        glWaitSemaphoreEXT(demo->glReady, 0, NULL, 1, &demo->color, &layout);
+        demo->interop_vk_signalled = false;
+    }
 
-#if 0
-    if (demo->fpGetSwapchainCounterEXT) {
-    uint64_t counter;
+    // Bind FBO with our Vulkan interop texture:
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, demo->dstfbo);
 
-    demo->fpGetSwapchainCounterEXT(demo->device,
-                       demo->swapchain,
-                       0,
-                       &counter);
+    if (true) {
+        glMatrixMode(GL_PROJECTION);
+        glLoadIdentity();
+        glMatrixMode(GL_MODELVIEW);
+        glLoadIdentity();
+        //glEnable(GL_TEXTURE_2D);
+        glBindTexture(GL_TEXTURE_2D, srctexture);
+        //glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        if (demo->hdr_encode == HDR_ENCODE_LUT) {
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_1D, demo->hdr_lut);
+            glActiveTexture(GL_TEXTURE0);
+        }
+        if (demo->dither_levels) {
+            glActiveTexture(GL_TEXTURE2);
+            glBindTexture(GL_TEXTURE_2D, demo->dither_noise);
+            glActiveTexture(GL_TEXTURE0);
+        }
+        glUseProgram(demo->hdr_shader);
+        if (demo->eetf_dirty) {
+            glUniform4fv(glGetUniformLocation(demo->hdr_shader, "Eetf"), 1, demo->eetf);
+            demo->eetf_dirty = false;
+        }
+        if (demo->dither_levels)
+            glUniform1i(demo->dither_frame_loc, demo->clientFrame % HDR_DITHER_FRAMES);
+        glBegin(GL_QUADS);
+        glTexCoord2f(0.0, 0.0);
+        glVertex2f(-1.0, -1.0);
+        glTexCoord2f(1.0, 0.0);
+        glVertex2f(1.0, -1.0);
+        glTexCoord2f(1.0, 1.0);
+        glVertex2f(1.0, 1.0);
+        glTexCoord2f(0.0, 1.0);
+        glVertex2f(-1.0, 1.0);
+        glEnd();
+        glUseProgram(0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        if (demo->hdr_encode == HDR_ENCODE_LUT) {
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_1D, 0);
+            glActiveTexture(GL_TEXTURE0);
+        }
+        if (demo->dither_levels) {
+            glActiveTexture(GL_TEXTURE2);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            glActiveTexture(GL_TEXTURE0);
+        }
+        //glDisable(GL_TEXTURE_2D);
+    }
+    else {
+        // Simple blit from src to dst, no OETF HDR shader applied:
+        glBlitNamedFramebuffer(demo->srcfbo, demo->dstfbo, 0, 0, w, h, 0, 0, w, h, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    }
+
+#if defined(VK_USE_PLATFORM_DISPLAY_KHR)
+    if (demo->use_glthread) {
+        // Hand the slot back to the client thread, which must wait for our
+        // post-processing to be done with it, before rendering into it again:
+        slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+        atomic_store_explicit(&slot->state, GLSLOT_FREE, memory_order_release);
+        demo->glslot_read = (demo->glslot_read + 1) % GL_SLOT_COUNT;
+
+        // Wake the client thread, if it waits for a free slot:
+        pthread_mutex_lock(&demo->glthread_mutex);
+        pthread_cond_signal(&demo->glthread_cond);
+        pthread_mutex_unlock(&demo->glthread_mutex);
     }
 #endif
 
-    if (err == VK_ERROR_OUT_OF_DATE_KHR) {
-        // demo->swapchain is out of date (e.g. the window was resized) and
-        // must be recreated:
-        demo_resize(demo);
-    } else if (err == VK_SUBOPTIMAL_KHR) {
-        // demo->swapchain is not as optimal as it could be, but the platform's
-        // presentation engine will still present the image correctly.
-    } else {
-        assert(!err);
+    if (demo->interop_semaphores) {
+        // Hand the interop image over to Vulkan's next submit:
+        glSignalSemaphoreEXT(demo->glComplete, 0, NULL, 1, &demo->color, &layout);
+        glFlush();
+        demo->interop_gl_signalled = true;
+    }
+    else {
+        // Poor man's sync until we use semaphores properly:
+        glFinish();
     }
 
-    if (false)
-        printf("tPostSwapRequested - tPreSwapRequested = %f msecs. tPostSwapRequested - tSwapComplete = %f msecs.\n",
-            (double)(tPostSwapRequested - tPreSwapRequested) / 1000000.0,
-            (double)(tPostSwapRequested - tSwapComplete) / 1000000.0);
+    // Unbind, so Vulkan can texture / blit from it:
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
 }
 
-static void demo_prepare_buffers(struct demo *demo) {
-    VkResult U_ASSERT_ONLY err;
-    VkSwapchainKHR oldSwapchain = demo->swapchain;
+#if defined(VK_USE_PLATFORM_DISPLAY_KHR)
+// MK: Client thread for threaded OpenGL client rendering. Renders stimulus images
+// into free slots on its own context, and queues them for draw_opengl() on the
+// Vulkan thread, which applies the HDR post-processing and hands them to Vulkan:
+static void *demo_glthread_main(void *arg)
+{
+    struct demo *demo = (struct demo*) arg;
+    int w = demo->textures[0].tex_width;
+    int h = demo->textures[0].tex_height;
+    uint32_t i;
 
-    // Check the surface capabilities and formats
-    VkSurfaceCapabilitiesKHR surfCapabilities;
-    err = demo->fpGetPhysicalDeviceSurfaceCapabilitiesKHR(
-        demo->gpu, demo->surface, &surfCapabilities);
-    assert(!err);
+    if (demo->egl_display)
+        eglMakeCurrent(demo->egl_display, demo->glthread_egl_surface, demo->glthread_egl_surface, demo->glthread_egl_context);
+    else
+        glXMakeContextCurrent(demo->display, demo->drawable, demo->drawable, demo->glthread_context);
 
-    uint32_t presentModeCount;
-    err = demo->fpGetPhysicalDeviceSurfacePresentModesKHR(
-        demo->gpu, demo->surface, &presentModeCount, NULL);
-    assert(!err);
-    VkPresentModeKHR *presentModes =
-        (VkPresentModeKHR *)malloc(presentModeCount * sizeof(VkPresentModeKHR));
-    assert(presentModes);
-    err = demo->fpGetPhysicalDeviceSurfacePresentModesKHR(
-        demo->gpu, demo->surface, &presentModeCount, presentModes);
-    assert(!err);
-    printf("%d present modes [0] = %d\n", presentModeCount, presentModes[0]);
+    // Fbo's and the default texture are not shared, so set up our own:
+    for (i = 0; i < GL_SLOT_COUNT; i++) {
+        glCreateFramebuffers(1, &demo->glslots[i].fbo);
+        glNamedFramebufferTexture(demo->glslots[i].fbo, GL_COLOR_ATTACHMENT0, demo->glslots[i].texture, 0);
+    }
 
-    VkExtent2D swapchainExtent;
-    // width and height are either both 0xFFFFFFFF, or both not 0xFFFFFFFF.
-    if (surfCapabilities.currentExtent.width == 0xFFFFFFFF) {
-        // If the surface size is undefined, the size is set to the size
-        // of the images requested, which must fit within the minimum and
-        // maximum values.
-        swapchainExtent.width = demo->width;
-        swapchainExtent.height = demo->height;
+    demo_upload_client_texture();
 
-        if (swapchainExtent.width < surfCapabilities.minImageExtent.width) {
-            swapchainExtent.width = surfCapabilities.minImageExtent.width;
-        } else if (swapchainExtent.width > surfCapabilities.maxImageExtent.width) {
-            swapchainExtent.width = surfCapabilities.maxImageExtent.width;
-        }
+    // Last of the startup uploads. The main thread may still load textures on
+    // resize, but the image cache lock serializes that with this flush:
+    demo_flush_image_cache();
 
-        if (swapchainExtent.height < surfCapabilities.minImageExtent.height) {
-            swapchainExtent.height = surfCapabilities.minImageExtent.height;
-        } else if (swapchainExtent.height > surfCapabilities.maxImageExtent.height) {
-            swapchainExtent.height = surfCapabilities.maxImageExtent.height;
-        }
-    } else {
-        // If the surface size is defined, the swap chain size must match
-        swapchainExtent = surfCapabilities.currentExtent;
-        demo->width = surfCapabilities.currentExtent.width;
-        demo->height = surfCapabilities.currentExtent.height;
-        printf("Swapchain size: %i x %i\n", demo->width, demo->height);
-    }
+    glClampColor(GL_CLAMP_VERTEX_COLOR, GL_FALSE);
+    glClampColor(GL_CLAMP_FRAGMENT_COLOR, GL_FALSE);
+    glViewport(0, 0, w, h);
 
-    // The FIFO present mode is guaranteed by the spec to be supported
-    // and to have no tearing.  It's a great default present mode to use.
-    VkPresentModeKHR swapchainPresentMode = VK_PRESENT_MODE_FIFO_KHR;
+    while (!atomic_load(&demo->glthread_quit)) {
+        struct gl_slot *slot = &demo->glslots[demo->glslot_write];
 
-    //  There are times when you may wish to use another present mode.  The
-    //  following code shows how to select them, and the comments provide some
-    //  reasons you may wish to use them.
-    //
-    // It should be noted that Vulkan 1.0 doesn't provide a method for
-    // synchronizing rendering with the presentation engine's display.  There
-    // is a method provided for throttling rendering with the display, but
-    // there are some presentation engines for which this method will not work.
-    // If an application doesn't throttle its rendering, and if it renders much
-    // faster than the refresh rate of the display, this can waste power on
-    // mobile devices.  That is because power is being spent rendering images
-    // that may never be seen.
+        // All slots queued up, ie. Vulkan is behind? Sleep until it frees this one:
+        if (atomic_load_explicit(&slot->state, memory_order_acquire) != GLSLOT_FREE) {
+            pthread_mutex_lock(&demo->glthread_mutex);
+            while (atomic_load_explicit(&slot->state, memory_order_acquire) != GLSLOT_FREE &&
+                   !atomic_load(&demo->glthread_quit))
+                pthread_cond_wait(&demo->glthread_cond, &demo->glthread_mutex);
+            pthread_mutex_unlock(&demo->glthread_mutex);
+            continue;
+        }
 
-    // VK_PRESENT_MODE_IMMEDIATE_KHR is for applications that don't care about
-    // tearing, or have some way of synchronizing their rendering with the
-    // display.
-    // VK_PRESENT_MODE_MAILBOX_KHR may be useful for applications that
-    // generally render a new presentable image every refresh cycle, but are
-    // occasionally early.  In this case, the application wants the new image
-    // to be displayed instead of the previously-queued-for-presentation image
-    // that has not yet been displayed.
-    // VK_PRESENT_MODE_FIFO_RELAXED_KHR is for applications that generally
-    // render a new presentable image every refresh cycle, but are occasionally
-    // late.  In this case (perhaps because of stuttering/latency concerns),
-    // the application wants the late image to be immediately displayed, even
-    // though that may mean some tearing.
+        // GPU side wait for the post-processing of the previous image in this slot:
+        if (slot->fence) {
+            glWaitSync(slot->fence, 0, GL_TIMEOUT_IGNORED);
+            glDeleteSync(slot->fence);
+        }
 
-    if (demo->presentMode !=  swapchainPresentMode) {
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, slot->fbo);
+        demo->clientFrame = demo->glthread_frame++;
+        demo->glthread_hdr_update = false;
+        draw_opengl_client(demo);
 
-        for (size_t i = 0; i < presentModeCount; ++i) {
-            if (presentModes[i] == demo->presentMode) {
-                swapchainPresentMode = demo->presentMode;
-                break;
-            }
-        }
-    }
-    if (swapchainPresentMode != demo->presentMode) {
-        ERR_EXIT("Present mode specified is not supported\n", "Present mode unsupported");
-    }
+        slot->hdr_update = demo->glthread_hdr_update;
+        slot->maxL = demo->glthread_maxL;
+        slot->avgL = demo->glthread_avgL;
 
-    // Determine the number of VkImages to use in the swap chain.
-    // Application desires to acquire 2 images at a time for double
-    // buffering: MK Changed to 2 for timestamping hack.
-    uint32_t desiredNumOfSwapchainImages = 2;
-    if (desiredNumOfSwapchainImages < surfCapabilities.minImageCount) {
-        desiredNumOfSwapchainImages = surfCapabilities.minImageCount;
-    }
-    // If maxImageCount is 0, we can ask for as many images as we want;
-    // otherwise we're limited to maxImageCount
-    if ((surfCapabilities.maxImageCount > 0) &&
-        (desiredNumOfSwapchainImages > surfCapabilities.maxImageCount)) {
-        // Application must settle for fewer images than desired:
-        desiredNumOfSwapchainImages = surfCapabilities.maxImageCount;
-    }
+        // Flush, so the fence is visible to, and signals for, the other context:
+        slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
 
-    VkSurfaceTransformFlagsKHR preTransform;
-    if (surfCapabilities.supportedTransforms &
-        VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR) {
-        preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
-    } else {
-        preTransform = surfCapabilities.currentTransform;
+        atomic_store_explicit(&slot->state, GLSLOT_READY, memory_order_release);
+        demo->glslot_write = (demo->glslot_write + 1) % GL_SLOT_COUNT;
     }
 
-    // Find a supported composite alpha mode - one of these is guaranteed to be set
-    VkCompositeAlphaFlagBitsKHR compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-    VkCompositeAlphaFlagBitsKHR compositeAlphaFlags[4] = {
-        VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
-        VK_COMPOSITE_ALPHA_PRE_MULTIPLIED_BIT_KHR,
-        VK_COMPOSITE_ALPHA_POST_MULTIPLIED_BIT_KHR,
-        VK_COMPOSITE_ALPHA_INHERIT_BIT_KHR,
-    };
-    for (uint32_t i = 0; i < sizeof(compositeAlphaFlags); i++) {
-        if (surfCapabilities.supportedCompositeAlpha & compositeAlphaFlags[i]) {
-            compositeAlpha = compositeAlphaFlags[i];
-            break;
-        }
-    }
+    glFinish();
+    for (i = 0; i < GL_SLOT_COUNT; i++)
+        glDeleteFramebuffers(1, &demo->glslots[i].fbo);
 
-#if defined(WIN32)
-    VkSurfaceFullScreenExclusiveWin32InfoEXT fullscreen_exclusive_info_win32 = {
-        .sType = VK_STRUCTURE_TYPE_SURFACE_FULL_SCREEN_EXCLUSIVE_WIN32_INFO_EXT,
-        .pNext = NULL,
-        .hmonitor = MonitorFromWindow(demo->window, MONITOR_DEFAULTTOPRIMARY),
-    };
+    if (demo->egl_display)
+        eglMakeCurrent(demo->egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    else
+        glXMakeContextCurrent(demo->display, None, None, NULL);
 
-    VkSurfaceFullScreenExclusiveInfoEXT fullscreen_exclusive_info = {
-        .sType = VK_STRUCTURE_TYPE_SURFACE_FULL_SCREEN_EXCLUSIVE_INFO_EXT,
-        .pNext = &fullscreen_exclusive_info_win32,
-        .fullScreenExclusive = VK_FULL_SCREEN_EXCLUSIVE_APPLICATION_CONTROLLED_EXT,
-    };
-#endif
+    return NULL;
+}
 
-    VkSwapchainCreateInfoKHR swapchain_ci = {
-        .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
-#if defined(WIN32)
-        .pNext = &fullscreen_exclusive_info,
-#else
-        .pNext = NULL,
-#endif
-        .surface = demo->surface,
-        .minImageCount = desiredNumOfSwapchainImages,
-        .imageFormat = demo->format,
-        .imageColorSpace = demo->color_space,
-        .imageExtent =
-            {
-             .width = swapchainExtent.width, .height = swapchainExtent.height,
-            },
-        .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
-        .preTransform = preTransform,
-        .compositeAlpha = compositeAlpha,
-        .imageArrayLayers = 1,
-        .imageSharingMode = VK_SHARING_MODE_EXCLUSIVE,
-        .queueFamilyIndexCount = 0,
-        .pQueueFamilyIndices = NULL,
-        .presentMode = swapchainPresentMode,
-        .oldSwapchain = oldSwapchain,
-        .clipped = true,
+static void demo_start_glthread(struct demo *demo)
+{
+    static const EGLint pbuffer_attribs[] = {
+        EGL_WIDTH, 1,
+        EGL_HEIGHT, 1,
+        EGL_NONE
     };
+    int w = demo->textures[0].tex_width;
+    int h = demo->textures[0].tex_height;
     uint32_t i;
-    err = demo->fpCreateSwapchainKHR(demo->device, &swapchain_ci, NULL,
-                                     &demo->swapchain);
-    assert(!err);
 
-    // If we just re-created an existing swapchain, we should destroy the old
-    // swapchain at this point.
-    // Note: destroying the swapchain also cleans up all its associated
-    // presentable images once the platform is done with them.
-    if (oldSwapchain != VK_NULL_HANDLE) {
-        // AMD driver times out waiting on fences used in AcquireNextImage on
-        // a swapchain that is subsequently destroyed before the wait.
-        vkWaitForFences(demo->device, FRAME_LAG, demo->fences, VK_TRUE, UINT64_MAX);
-//        vkResetFences(demo->device, FRAME_LAG, demo->fences);
-        demo->fpDestroySwapchainKHR(demo->device, oldSwapchain, NULL);
+    if (!demo->interop_enabled)
+        demo->use_glthread = false;
+
+    if (!demo->use_glthread)
+        return;
+
+    // Client thread context, sharing textures and sync objects with ours:
+    if (demo->egl_display) {
+        demo->glthread_egl_context = eglCreateContext(demo->egl_display, demo->egl_config, demo->egl_context, NULL);
+        demo->glthread_egl_surface = EGL_NO_SURFACE;
+        if (demo->egl_surface != EGL_NO_SURFACE)
+            demo->glthread_egl_surface = eglCreatePbufferSurface(demo->egl_display, demo->egl_config, pbuffer_attribs);
+
+        if (demo->glthread_egl_context == EGL_NO_CONTEXT) {
+            fprintf(stderr, "eglCreateContext for client thread failed, not using threaded OpenGL.\n");
+            demo->use_glthread = false;
+            return;
+        }
+    }
+    else {
+        demo->glthread_context = glXCreateNewContext(demo->display, demo->fb_config, GLX_RGBA_TYPE, demo->context, True);
+        if (!demo->glthread_context) {
+            fprintf(stderr, "glXCreateNewContext for client thread failed, not using threaded OpenGL.\n");
+            demo->use_glthread = false;
+            return;
+        }
     }
 
-    err = demo->fpGetSwapchainImagesKHR(demo->device, demo->swapchain,
-                                        &demo->swapchainImageCount, NULL);
-    assert(!err);
+    for (i = 0; i < GL_SLOT_COUNT; i++) {
+        glCreateTextures(GL_TEXTURE_2D, 1, &demo->glslots[i].texture);
+        glTextureStorage2D(demo->glslots[i].texture, 1, GL_RGBA16F, w, h);
+        demo->glslots[i].fence = NULL;
+        atomic_init(&demo->glslots[i].state, GLSLOT_FREE);
+    }
 
-    // MK Important for timestamping hack:
-    if (demo->swapchainImageCount > desiredNumOfSwapchainImages) {
-        printf("Got %i swapchain images, more than the desired %i ones. Clamping.\n",
-               demo->swapchainImageCount, desiredNumOfSwapchainImages);
-        demo->swapchainImageCount = desiredNumOfSwapchainImages;
+    // Run the client once on this thread, so its one-time setup, e.g., setting
+    // HDR metadata and default colors, is done before the client thread exists:
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, demo->srcfbo);
+    draw_opengl_client(demo);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+
+    // Textures must be complete before the other context uses them:
+    glFinish();
+
+    demo->glslot_read = 0;
+    demo->glslot_write = 0;
+    demo->glthread_frame = 0;
+    atomic_init(&demo->glthread_quit, false);
+    pthread_mutex_init(&demo->glthread_mutex, NULL);
+    pthread_cond_init(&demo->glthread_cond, NULL);
+    demo->glthread_running = true;
+
+    if (pthread_create(&demo->glthread, NULL, demo_glthread_main, demo)) {
+        fprintf(stderr, "Failed to create OpenGL client thread, not using threaded OpenGL.\n");
+        demo->glthread_running = false;
+        pthread_cond_destroy(&demo->glthread_cond);
+        pthread_mutex_destroy(&demo->glthread_mutex);
+        demo->use_glthread = false;
+        return;
     }
 
-    VkImage *swapchainImages =
-        (VkImage *)malloc(demo->swapchainImageCount * sizeof(VkImage));
-    assert(swapchainImages);
-    err = demo->fpGetSwapchainImagesKHR(demo->device, demo->swapchain,
-                                        &demo->swapchainImageCount,
-                                        swapchainImages);
-    assert(err == VK_INCOMPLETE || err == VK_SUCCESS);
+    printf("Using threaded OpenGL client rendering with %i slots.\n", GL_SLOT_COUNT);
+}
 
-    demo->swapchain_image_resources = (SwapchainImageResources *)malloc(sizeof(SwapchainImageResources) *
-                                               demo->swapchainImageCount);
-    assert(demo->swapchain_image_resources);
+static void demo_stop_glthread(struct demo *demo)
+{
+    uint32_t i;
 
-    for (i = 0; i < demo->swapchainImageCount; i++) {
-        VkImageViewCreateInfo color_image_view = {
-            .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
-            .pNext = NULL,
-            .format = demo->format,
-            .components =
-                {
-                 .r = VK_COMPONENT_SWIZZLE_R,
-                 .g = VK_COMPONENT_SWIZZLE_G,
-                 .b = VK_COMPONENT_SWIZZLE_B,
-                 .a = VK_COMPONENT_SWIZZLE_A,
-                },
-            .subresourceRange = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-                                 .baseMipLevel = 0,
-                                 .levelCount = 1,
-                                 .baseArrayLayer = 0,
-                                 .layerCount = 1},
-            .viewType = VK_IMAGE_VIEW_TYPE_2D,
-            .flags = 0,
-        };
+    if (!demo->use_glthread)
+        return;
 
-        demo->swapchain_image_resources[i].image = swapchainImages[i];
+    pthread_mutex_lock(&demo->glthread_mutex);
+    atomic_store(&demo->glthread_quit, true);
+    pthread_cond_signal(&demo->glthread_cond);
+    pthread_mutex_unlock(&demo->glthread_mutex);
 
-        color_image_view.image = demo->swapchain_image_resources[i].image;
+    pthread_join(demo->glthread, NULL);
+    demo->glthread_running = false;
+    demo->use_glthread = false;
+    pthread_cond_destroy(&demo->glthread_cond);
+    pthread_mutex_destroy(&demo->glthread_mutex);
 
-        err = vkCreateImageView(demo->device, &color_image_view, NULL,
-                                &demo->swapchain_image_resources[i].view);
-        assert(!err);
+    for (i = 0; i < GL_SLOT_COUNT; i++) {
+        if (demo->glslots[i].fence)
+            glDeleteSync(demo->glslots[i].fence);
+        glDeleteTextures(1, &demo->glslots[i].texture);
     }
 
-    if (demo->VK_GOOGLE_display_timing_enabled) {
-        VkRefreshCycleDurationGOOGLE rc_dur;
-        err = demo->fpGetRefreshCycleDurationGOOGLE(demo->device,
-                                                    demo->swapchain,
-                                                    &rc_dur);
-        assert(!err);
+    if (demo->egl_display) {
+        if (demo->glthread_egl_surface != EGL_NO_SURFACE)
+            eglDestroySurface(demo->egl_display, demo->glthread_egl_surface);
+        eglDestroyContext(demo->egl_display, demo->glthread_egl_context);
+    }
+    else {
+        glXDestroyContext(demo->display, demo->glthread_context);
+    }
+}
 
-        demo->syncd_with_actual_presents = false;
-        // Initially target 1X the refresh duration:
-        demo->refresh_duration_multiplier = 1;
-        demo->target_IPD = DemoRefreshDuration(demo) * demo->refresh_duration_multiplier;
+// MK: Movie playback of an image sequence at a target frame rate. Reader threads
+// prefetch and decode frames ahead into persistently mapped staging buffers, the
+// Vulkan thread uploads each frame through the upload ring into the interop image,
+// just in time for its scheduled onset. Frames are taken as already encoded
+// signal values, e.g., PQ, in the interop image format:
+static bool demo_movie_supported(struct demo *demo, const struct ppm_image *img)
+{
+    if (img->width > demo->textures[0].tex_width || img->height > demo->textures[0].tex_height)
+        return false;
 
-        demo->prev_desired_present_time = 0;
-        demo->next_present_id = 1;
-    }
+    switch (demo->interop_tex_format) {
+        case VK_FORMAT_R8G8B8A8_UNORM:
+            return img->format == PPM_FORMAT_RGB8;
 
-    if (NULL != presentModes) {
-        free(presentModes);
+        case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+            return img->format == PPM_FORMAT_RGB8 || img->format == PPM_FORMAT_RGB16;
+
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+            return true;
+
+        default:
+            return false;
     }
+}
 
-#if defined(WIN32)
-    err = demo->fpAcquireFullScreenExclusiveModeEXT(demo->device, demo->swapchain);
-    switch (err) {
-        case VK_SUCCESS:
-            printf("Switched to fullscreen exclusive mode.\n");
+// Decode one frame into the staging buffer of its slot, rows tightly packed:
+static bool demo_movie_decode(struct demo *demo, const struct ppm_image *img, struct upload_slot *slot, ppm_kernel kernel)
+{
+    if (!demo_movie_supported(demo, img))
+        return false;
+
+    switch (demo->interop_tex_format) {
+        case VK_FORMAT_R8G8B8A8_UNORM:
+            ppm_copy_rgba(img, slot->data, 4 * (size_t) img->width, kernel);
             break;
 
-        case VK_ERROR_INITIALIZATION_FAILED:
-            printf("Could not switch to fullscreen exclusive mode.\n");
+        case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+            if (!ppm_copy_rgb10a2(img, slot->data, 4 * (size_t) img->width))
+                return false;
             break;
 
         default:
-            printf("Error during switch to fullscreen exclusive mode.\n");
+            if (!ppm_copy_rgba16f(img, slot->data, 8 * (size_t) img->width, NULL, NULL))
+                return false;
             break;
     }
-#endif
 
-    if (demo->hdr_enabled) {
-        if (demo->fpSetLocalDimmingAMD)
-            demo->fpSetLocalDimmingAMD(demo->device, demo->swapchain, demo->local_dimming_enabled);
-    }
+    slot->width = img->width;
+    slot->height = img->height;
+
+    return true;
 }
 
-static void demo_prepare_depth(struct demo *demo) {
-    const VkFormat depth_format = VK_FORMAT_D16_UNORM;
-    const VkImageCreateInfo image = {
-        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
-        .pNext = NULL,
-        .imageType = VK_IMAGE_TYPE_2D,
-        .format = depth_format,
-        .extent = {demo->width, demo->height, 1},
-        .mipLevels = 1,
-        .arrayLayers = 1,
-        .samples = VK_SAMPLE_COUNT_1_BIT,
-        .tiling = VK_IMAGE_TILING_OPTIMAL,
-        .usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-        .flags = 0,
-    };
+static void *demo_moviethread_main(void *arg)
+{
+    struct demo *demo = (struct demo*) arg;
+    const ppm_kernel kernel = ppm_get_kernels().rgb_to_rgba;
+    // Each thread decodes every MOVIE_THREAD_COUNT'th frame, starting with its own index:
+    int64_t n = atomic_fetch_add(&demo->moviethread_next, 1);
+
+    while (!atomic_load(&demo->moviethread_quit)) {
+        struct upload_slot *slot = &demo->upload.slots[n % UPLOAD_SLOT_COUNT];
+        const int index = (int) (n % demo->movie_frame_count);
+        uint64_t t;
+        bool ok;
+
+        // Far enough ahead, ie. previous frame of this slot not yet uploaded? Back off a bit:
+        if (atomic_load_explicit(&slot->state, memory_order_acquire) != UPLOADSLOT_FREE) {
+            usleep(250);
+            continue;
+        }
 
-    VkImageViewCreateInfo view = {
-        .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
-        .pNext = NULL,
-        .image = VK_NULL_HANDLE,
-        .format = depth_format,
-        .subresourceRange = {.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT,
-                             .baseMipLevel = 0,
-                             .levelCount = 1,
-                             .baseArrayLayer = 0,
-                             .layerCount = 1},
-        .flags = 0,
-        .viewType = VK_IMAGE_VIEW_TYPE_2D,
-    };
+        t = getTimeInNanoseconds();
 
-    VkMemoryRequirements mem_reqs;
-    VkResult U_ASSERT_ONLY err;
-    bool U_ASSERT_ONLY pass;
+        if (demo->movie_files) {
+            struct ppm_image img;
 
-    demo->depth.format = depth_format;
+            // Populate, so all file i/o happens here, not while decoding:
+            ok = ppm_open(demo->movie_files[index], &img, true);
+            if (ok) {
+                ok = demo_movie_decode(demo, &img, slot, kernel);
+                ppm_close(&img);
+            }
+        }
+        else {
+            ok = demo_movie_decode(demo, &demo->movie_frames[index], slot, kernel);
+        }
 
-    /* create image */
-    err = vkCreateImage(demo->device, &image, NULL, &demo->depth.image);
-    assert(!err);
+        // Failed frames are dropped by the Vulkan thread, instead of stalling playback:
+        if (!ok) {
+            fprintf(stderr, "Failed to decode movie frame %i.\n", index);
+            slot->width = 0;
+        }
 
-    vkGetImageMemoryRequirements(demo->device, demo->depth.image, &mem_reqs);
-    assert(!err);
+        slot->frame = n;
+        slot->decode_ns = getTimeInNanoseconds() - t;
+        atomic_store_explicit(&slot->state, UPLOADSLOT_READY, memory_order_release);
 
-    demo->depth.mem_alloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    demo->depth.mem_alloc.pNext = NULL;
-    demo->depth.mem_alloc.allocationSize = mem_reqs.size;
-    demo->depth.mem_alloc.memoryTypeIndex = 0;
+        n += MOVIE_THREAD_COUNT;
+    }
 
-    pass = memory_type_from_properties(demo, mem_reqs.memoryTypeBits,
-                                       VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                                       &demo->depth.mem_alloc.memoryTypeIndex);
-    assert(pass);
+    return NULL;
+}
 
-    /* allocate memory */
-    err = vkAllocateMemory(demo->device, &demo->depth.mem_alloc, NULL,
-                           &demo->depth.mem);
-    assert(!err);
+static int demo_movie_compare(const void *a, const void *b)
+{
+    return strcmp(*(const char * const *) a, *(const char * const *) b);
+}
 
-    /* bind memory */
-    err =
-        vkBindImageMemory(demo->device, demo->depth.image, demo->depth.mem, 0);
-    assert(!err);
+// Collect the frames of the movie, either all .ppm and .pfm files of a directory in
+// lexical order, or all images of one file. Checks the headers of all frames upfront,
+// so unsupported frames are found before playback:
+static bool demo_open_movie(struct demo *demo)
+{
+    DIR *dir = opendir(demo->movie_path);
+    struct ppm_image img;
+    int capacity = 0;
+    int i;
 
-    /* create image view */
-    view.image = demo->depth.image;
-    err = vkCreateImageView(demo->device, &view, NULL, &demo->depth.view);
-    assert(!err);
-}
+    demo->movie_files = NULL;
+    demo->movie_frames = NULL;
+    demo->movie_frame_count = 0;
 
-/* Load a ppm file into memory */
-bool loadTexture(const char *filename, uint8_t *rgba_data,
-                 VkSubresourceLayout *layout, int32_t *width, int32_t *height) {
+    if (dir) {
+        struct dirent *entry;
 
-#if (defined(VK_USE_PLATFORM_IOS_MVK) || defined(VK_USE_PLATFORM_MACOS_MVK))
-    filename =[[[NSBundle mainBundle] resourcePath] stringByAppendingPathComponent: @(filename)].UTF8String;
-#endif
+        while ((entry = readdir(dir))) {
+            const char *ext = strrchr(entry->d_name, '.');
 
-#ifdef __ANDROID__
-#include <lunarg.ppm.h>
-    char *cPtr;
-    cPtr = (char*)lunarg_ppm;
-    if ((unsigned char*)cPtr >= (lunarg_ppm + lunarg_ppm_len) || strncmp(cPtr, "P6\n", 3)) {
-        return false;
-    }
-    while(strncmp(cPtr++, "\n", 1));
-    sscanf(cPtr, "%u %u", width, height);
-    if (rgba_data == NULL) {
-        return true;
-    }
-    while(strncmp(cPtr++, "\n", 1));
-    if ((unsigned char*)cPtr >= (lunarg_ppm + lunarg_ppm_len) || strncmp(cPtr, "255\n", 4)) {
-        return false;
-    }
-    while(strncmp(cPtr++, "\n", 1));
+            if (!ext || (strcmp(ext, ".ppm") && strcmp(ext, ".pfm")))
+                continue;
 
-    for (int y = 0; y < *height; y++) {
-        uint8_t *rowPtr = rgba_data;
-        for (int x = 0; x < *width; x++) {
-            memcpy(rowPtr, cPtr, 3);
-            rowPtr[3] = 255; /* Alpha of 1 */
-            rowPtr += 4;
-            cPtr += 3;
+            if (demo->movie_frame_count == capacity) {
+                capacity = (capacity) ? 2 * capacity : 256;
+                demo->movie_files = realloc(demo->movie_files, capacity * sizeof(char*));
+            }
+
+            demo->movie_files[demo->movie_frame_count] = malloc(strlen(demo->movie_path) + strlen(entry->d_name) + 2);
+            sprintf(demo->movie_files[demo->movie_frame_count++], "%s/%s", demo->movie_path, entry->d_name);
         }
-        rgba_data += layout->rowPitch;
-    }
+        closedir(dir);
 
-    return true;
-#else
-    FILE *fPtr = fopen(filename, "rb");
-    char header[256], *cPtr, *tmp;
+        qsort(demo->movie_files, demo->movie_frame_count, sizeof(char*), demo_movie_compare);
 
-    if (!fPtr)
-        return false;
+        for (i = 0; i < demo->movie_frame_count; i++) {
+            if (!ppm_open(demo->movie_files[i], &img, false)) {
+                fprintf(stderr, "Movie frame %s is not a valid PPM or PFM image.\n", demo->movie_files[i]);
+                return false;
+            }
 
-    cPtr = fgets(header, 256, fPtr); // P6
-    if (cPtr == NULL || strncmp(header, "P6\n", 3)) {
-        fclose(fPtr);
-        return false;
-    }
+            if (!demo_movie_supported(demo, &img)) {
+                fprintf(stderr, "Movie frame %s is larger than the display, or its format unsupported by the interop image.\n",
+                        demo->movie_files[i]);
+                ppm_close(&img);
+                return false;
+            }
 
-    do {
-        cPtr = fgets(header, 256, fPtr);
-        if (cPtr == NULL) {
-            fclose(fPtr);
+            ppm_close(&img);
+        }
+    }
+    else {
+        if (!ppm_open(demo->movie_path, &demo->movie_container, false)) {
+            fprintf(stderr, "Movie %s is neither a directory, nor a valid PPM or PFM image.\n", demo->movie_path);
             return false;
         }
-    } while (!strncmp(header, "#", 1));
+        demo->movie_container_open = true;
+
+        img = demo->movie_container;
+        do {
+            if (!demo_movie_supported(demo, &img)) {
+                fprintf(stderr, "Movie frame %i is larger than the display, or its format unsupported by the interop image.\n",
+                        demo->movie_frame_count);
+                return false;
+            }
 
-    sscanf(header, "%u %u", width, height);
-    if (rgba_data == NULL) {
-        fclose(fPtr);
-        return true;
-    }
-    tmp = fgets(header, 256, fPtr); // Format
-    (void)tmp;
-    if (cPtr == NULL || strncmp(header, "255\n", 3)) {
-        fclose(fPtr);
-        return false;
+            if (demo->movie_frame_count == capacity) {
+                capacity = (capacity) ? 2 * capacity : 256;
+                demo->movie_frames = realloc(demo->movie_frames, capacity * sizeof(struct ppm_image));
+            }
+
+            demo->movie_frames[demo->movie_frame_count++] = img;
+        } while (ppm_next(&img));
     }
 
-    for (int y = 0; y < *height; y++) {
-        uint8_t *rowPtr = rgba_data;
-        for (int x = 0; x < *width; x++) {
-            size_t s = fread(rowPtr, 3, 1, fPtr);
-            (void)s;
-            rowPtr[3] = 255; /* Alpha of 1 */
-            rowPtr += 4;
-        }
-        rgba_data += layout->rowPitch;
+    if (demo->movie_frame_count == 0) {
+        fprintf(stderr, "Movie %s has no frames.\n", demo->movie_path);
+        return false;
     }
-    fclose(fPtr);
+
     return true;
-#endif
 }
 
-static void demo_prepare_texture_image(struct demo *demo, const char *filename,
-                                       struct texture_object *tex_obj,
-                                       VkImageTiling tiling,
-                                       VkImageUsageFlags usage,
-                                       VkFlags required_props) {
-    const VkFormat tex_format = demo->interop_tex_format;
-    int32_t tex_width;
-    int32_t tex_height;
-    VkResult U_ASSERT_ONLY err;
-    bool U_ASSERT_ONLY pass;
+static void demo_close_movie(struct demo *demo)
+{
+    int i;
 
-    // No OpenGL interop?
-    if (required_props & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
-        // Get needed texture size for image:
-        if (!loadTexture(filename, NULL, NULL, &tex_width, &tex_height)) {
-            ERR_EXIT("Failed to load textures", "Load Texture Failure");
-        }
-    }
-    else {
-        // OpenGL interop: Allocate interop texture the size of the true
-        // framebuffer:
-        tex_width = demo->width;
-        tex_height = demo->height;
+    if (demo->movie_files) {
+        for (i = 0; i < demo->movie_frame_count; i++)
+            free(demo->movie_files[i]);
+        free(demo->movie_files);
+        demo->movie_files = NULL;
     }
 
-    tex_obj->tex_width = tex_width;
-    tex_obj->tex_height = tex_height;
+    // Also if the first frame was rejected and there aren't any movie_frames yet:
+    if (demo->movie_container_open) {
+        ppm_close(&demo->movie_container);
+        demo->movie_container_open = false;
+    }
 
-    const VkImageCreateInfo image_create_info = {
-        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
-        .pNext = NULL,
-        .imageType = VK_IMAGE_TYPE_2D,
-        .format = tex_format,
-        .extent = {tex_width, tex_height, 1},
-        .mipLevels = 1,
-        .arrayLayers = 1,
-        .samples = VK_SAMPLE_COUNT_1_BIT,
-        .tiling = tiling,
-        .usage = usage,
-        .flags = 0,
-        .initialLayout = VK_IMAGE_LAYOUT_PREINITIALIZED,
-    };
+    free(demo->movie_frames);
+    demo->movie_frames = NULL;
+}
 
-    VkMemoryRequirements mem_reqs;
+static void demo_stop_movie(struct demo *demo)
+{
+    int i;
 
-    err = vkCreateImage(demo->device, &image_create_info, NULL, &tex_obj->image);
-    assert(!err);
+    if (!demo->use_movie)
+        return;
 
-    vkGetImageMemoryRequirements(demo->device, tex_obj->image, &mem_reqs);
+    atomic_store(&demo->moviethread_quit, true);
+    for (i = 0; i < demo->moviethread_count; i++)
+        pthread_join(demo->moviethreads[i], NULL);
+    demo->use_movie = false;
 
-    VkExportMemoryAllocateInfo exportAllocInfo = {
-        .sType = VK_STRUCTURE_TYPE_EXPORT_MEMORY_ALLOCATE_INFO,
-        .pNext = NULL,
-#if defined(WIN32)
-        .handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_WIN32_BIT,
-#else
-        .handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT,
-#endif
-    };
+    // The ring's slots are free for other uploads again:
+    demo_upload_drain(demo);
+    demo_close_movie(demo);
 
-    tex_obj->mem_alloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    tex_obj->mem_alloc.pNext = (demo->interop_enabled) ? &exportAllocInfo : NULL;
-    tex_obj->mem_alloc.allocationSize = mem_reqs.size;
-    tex_obj->mem_alloc.memoryTypeIndex = 0;
+    printf("Movie: %i frames shown, %i late, %i dropped, %i starved. Max decode time %f msecs.\n",
+           demo->movie_shown, demo->movie_late, demo->movie_dropped, demo->movie_starved,
+           (double) demo->movie_decode_max / 1000000.0);
+}
 
-    pass = memory_type_from_properties(demo, mem_reqs.memoryTypeBits,
-                                       required_props,
-                                       &tex_obj->mem_alloc.memoryTypeIndex);
-    assert(pass);
+static void demo_start_movie(struct demo *demo)
+{
+    const VkDeviceSize size = (VkDeviceSize) demo->textures[0].tex_width * demo->textures[0].tex_height *
+                              demo_format_size(demo->interop_tex_format);
 
-    /* allocate memory */
-    err = vkAllocateMemory(demo->device, &tex_obj->mem_alloc, NULL,
-                           &(tex_obj->mem));
-    assert(!err);
+    if (!demo->use_movie)
+        return;
 
-    /* bind memory */
-    err = vkBindImageMemory(demo->device, tex_obj->image, tex_obj->mem, 0);
-    assert(!err);
+    if (!demo_open_movie(demo)) {
+        demo_close_movie(demo);
+        demo->use_movie = false;
+        return;
+    }
 
-    memset(&demo->interophandles, 0, sizeof(demo->interophandles));
+    // The reader threads own all slots of the upload ring while playing:
+    demo_prepare_upload_ring(demo, size, UPLOAD_SLOT_COUNT);
+    demo_upload_drain(demo);
 
-    if ((usage & VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT) && demo->interop_enabled) {
-#ifdef WIN32
-        // Get handle for shared memory with OpenGL:
-        VkMemoryGetWin32HandleInfoKHR memorygetwinhandleinfo = {
-            .sType = VK_STRUCTURE_TYPE_MEMORY_GET_WIN32_HANDLE_INFO_KHR,
-            .pNext = NULL,
-            .memory = tex_obj->mem,
-            .handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_WIN32_BIT,
-        };
+    demo->movie_next = 0;
+    demo->movie_pending = -1;
+    demo->movie_t0 = 0;
+    demo->movie_period = (demo->movie_fps > 0) ? (uint64_t) (1e9 / demo->movie_fps) : 0;
+    demo->movie_ifi = 0;
+    demo->movie_decode_max = 0;
+    demo->movie_flips = 0;
+    demo->movie_shown = demo->movie_late = demo->movie_dropped = demo->movie_starved = 0;
+    atomic_init(&demo->moviethread_quit, false);
+    atomic_init(&demo->moviethread_next, 0);
 
-        //printf("PRE memory handle %p\n", demo->interophandles.memory);
-        err = demo->fpGetMemoryWin32HandleKHR(demo->device, &memorygetwinhandleinfo, &demo->interophandles.memory);
-        assert(!err);
-        printf("GOT memory handle %p\n", demo->interophandles.memory);
-#else
-        // Get fd for shared memory with OpenGL:
-        VkMemoryGetFdInfoKHR memorygetfdinfo = {
-            .sType = VK_STRUCTURE_TYPE_MEMORY_GET_FD_INFO_KHR,
-            .pNext = NULL,
-            .memory = tex_obj->mem,
-            .handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT,
-        };
+    for (demo->moviethread_count = 0; demo->moviethread_count < MOVIE_THREAD_COUNT; demo->moviethread_count++) {
+        if (pthread_create(&demo->moviethreads[demo->moviethread_count], NULL, demo_moviethread_main, demo))
+            break;
+    }
 
-        //printf("PRE memory fd %i\n", demo->interophandles.memory);
-        err = demo->fpGetMemoryFdKHR(demo->device, &memorygetfdinfo, &demo->interophandles.memory);
-        assert(!err);
-        printf("GOT memory fd %i\n", demo->interophandles.memory);
-#endif
+    // Every thread decodes a fixed share of the frames, so all must run:
+    if (demo->moviethread_count < MOVIE_THREAD_COUNT) {
+        fprintf(stderr, "Failed to create movie reader threads, no movie playback.\n");
+        demo_stop_movie(demo);
+        return;
     }
 
-    if (required_props & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
-        const VkImageSubresource subres = {
-            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-            .mipLevel = 0,
-            .arrayLayer = 0,
-        };
-        VkSubresourceLayout layout;
-        void *data;
+    // No client sets HDR metadata for the movie, so use display defaults, unless measured:
+    if (!demo->lightlevel_pipeline)
+        demo_send_hdr_metadata(demo, 0, 0);
 
-        vkGetImageSubresourceLayout(demo->device, tex_obj->image, &subres,
-                                    &layout);
+    printf("Playing %i movie frames from %s at %f fps, with %i reader threads and %i upload slots.\n",
+           demo->movie_frame_count, demo->movie_path, demo->movie_fps, MOVIE_THREAD_COUNT, UPLOAD_SLOT_COUNT);
+}
 
-        err = vkMapMemory(demo->device, tex_obj->mem, 0,
-                          tex_obj->mem_alloc.allocationSize, 0, &data);
-        assert(!err);
+// MK: Called once per flip, after the flip at tSwapComplete, with the duration 'ifi' of the
+// last flip interval. Accounts the onset of the frame presented last, and picks the frame
+// whose scheduled onset is closest to the next flip. Returns its slot with the upload
+// recorded, for submission ahead of the draw commands, or NULL to keep the current frame:
+static struct upload_slot *demo_movie_update(struct demo *demo, uint64_t tSwapComplete, uint64_t ifi)
+{
+    struct upload_slot *slot = NULL;
+    uint64_t tNext;
+    int64_t due;
+    int i;
+
+    // Slots whose upload completed go back to the reader threads:
+    demo_upload_reclaim(demo);
+
+    // Flip interval estimate. The first two intervals include startup, later outliers are
+    // skipped flips, which must not disturb the estimate:
+    if (++demo->movie_flips == 3)
+        demo->movie_ifi = ifi;
+    else if (demo->movie_flips > 3 && ifi < demo->movie_ifi * 3 / 2 && ifi > demo->movie_ifi / 2)
+        demo->movie_ifi = (7 * demo->movie_ifi + ifi) / 8;
+
+    if (!demo->movie_ifi)
+        return NULL;
+
+    // The frame uploaded last cycle had its onset at this flip:
+    if (demo->movie_pending >= 0) {
+        const double error = ((double) tSwapComplete - (double) (demo->movie_t0 + demo->movie_pending * demo->movie_period)) / 1000000.0;
+
+        if (error > (double) demo->movie_ifi / 2000000.0)
+            demo->movie_late++;
+
+        if (demo->timestamping_enabled)
+            printf("Movie frame %li onset error %f msecs.\n", (long) demo->movie_pending, error);
 
-        printf("Vulkan texture image row pitch is %i bytes.\n", (int) layout.rowPitch);
+        demo->movie_pending = -1;
+    }
+
+    tNext = tSwapComplete + demo->movie_ifi;
 
-        if (!loadTexture(filename, data, &layout, &tex_width, &tex_height)) {
-            fprintf(stderr, "Error loading texture: %s\n", filename);
+    // Start once the reader threads filled all staging buffers, with frame 0 at the next flip:
+    if (!demo->movie_t0) {
+        for (i = 0; i < UPLOAD_SLOT_COUNT; i++) {
+            if (atomic_load_explicit(&demo->upload.slots[i].state, memory_order_acquire) != UPLOADSLOT_READY)
+                return NULL;
         }
 
-        vkUnmapMemory(demo->device, tex_obj->mem);
+        if (!demo->movie_period)
+            demo->movie_period = demo->movie_ifi;
+        demo->movie_t0 = tNext;
     }
 
-    // MK tex_obj->imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    tex_obj->imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-}
+    due = (int64_t) (((double) tNext - (double) demo->movie_t0) / (double) demo->movie_period + 0.5);
 
-static void demo_destroy_texture_image(struct demo *demo,
-                                       struct texture_object *tex_objs) {
-    /* clean up staging resources */
-    vkFreeMemory(demo->device, tex_objs->mem, NULL);
-    vkDestroyImage(demo->device, tex_objs->image, NULL);
-}
+    // Pick the latest decoded frame that is due, dropping the ones it supersedes:
+    while (demo->movie_next <= due) {
+        struct upload_slot *s = &demo->upload.slots[demo->movie_next % UPLOAD_SLOT_COUNT];
 
-static void demo_prepare_textures(struct demo *demo) {
-    const VkFormat tex_format = demo->interop_tex_format;
-    VkFormatProperties props;
-    uint32_t i;
+        if (atomic_load_explicit(&s->state, memory_order_acquire) != UPLOADSLOT_READY) {
+            // Not decoded in time:
+            demo->movie_starved++;
+            break;
+        }
 
-    vkGetPhysicalDeviceFormatProperties(demo->gpu, tex_format, &props);
+        if (s->decode_ns > demo->movie_decode_max)
+            demo->movie_decode_max = s->decode_ns;
 
-    for (i = 0; i < DEMO_TEXTURE_COUNT; i++) {
-        VkResult U_ASSERT_ONLY err;
+        if (!s->width) {
+            // Failed to decode:
+            atomic_store_explicit(&s->state, UPLOADSLOT_FREE, memory_order_release);
+            demo->movie_dropped++;
+        }
+        else {
+            if (slot) {
+                atomic_store_explicit(&slot->state, UPLOADSLOT_FREE, memory_order_release);
+                demo->movie_dropped++;
+            }
+            slot = s;
+        }
 
-        // MK: Need linear tiling for OpenGL interop on AMD:
-        if (((props.linearTilingFeatures &
-            (VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT)) == (VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT)) &&
-            !demo->use_staging_buffer &&
-            !demo->interop_tiled_texture) {
-            demo->interop_tiled_texture = false;
-            printf("Will use linear textures for OpenGL->Vulkan interop via render-to-texture to texture %i\n", i);
-            /* Device can texture using linear textures */
-            demo_prepare_texture_image(
-                demo, tex_files[i], &demo->textures[i], VK_IMAGE_TILING_LINEAR,
-                VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | ((i == 0) ? VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT : 0),
-                ((!demo->interop_enabled) ?
-                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT :
-                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)); // MK Require device local bit.
+        demo->movie_next++;
+    }
 
-            // Nothing in the pipeline needs to be complete to start, and don't allow fragment
-            // shader to run until layout transition completes
-            demo_set_image_layout(demo, demo->textures[i].image, VK_IMAGE_ASPECT_COLOR_BIT,
-                                  VK_IMAGE_LAYOUT_PREINITIALIZED, demo->textures[i].imageLayout,
-                                  VK_ACCESS_HOST_WRITE_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-                                  VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, NULL);
+    if (!slot)
+        return NULL;
 
-            demo->staging_texture.image = 0;
-        } else if ((props.optimalTilingFeatures &
-                (VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT)) == (VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT)) {
-            /* Must use staging buffer to copy linear texture to optimized */
-            demo->interop_tiled_texture = true;
-            printf("Will use optimal tiled textures for OpenGL->Vulkan interop via render-to-texture to texture %i\n", i);
-            memset(&demo->staging_texture, 0, sizeof(demo->staging_texture));
-            demo_prepare_texture_image(
-                demo, tex_files[i], &demo->staging_texture, VK_IMAGE_TILING_LINEAR,
-                VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
-                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                    VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    demo_upload_record(demo, slot, &demo->textures[0]);
+    demo->movie_pending = slot->frame;
+    demo->movie_shown++;
 
-            demo_prepare_texture_image(
-                demo, tex_files[i], &demo->textures[i], VK_IMAGE_TILING_OPTIMAL,
-                (VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT |
-                ((i == 0) ? VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT : 0)),
-                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);  // MK Require device local bit.
+    return slot;
+}
+#endif
+
+// hdrFragmentShaderSrc currently implements the ST-2084 PQ OETF, for EOTF
+// decoding in the display. Iow. it implements the HDR-10 mapping from a
+// linear color intensity input range (in nits aka cd/m2) from 0 - 10000 nits
+// to the PQ mapped range 0.0 - 1.0, which then can get encoded into typically
+// 10 bits per color channel and transmitted to the display for decoding.
+//
+// The encoding is either evaluated exactly, with two pow()'s and a division
+// per channel, or looked up in a precomputed LUT, or a piecewise polynomial.
+// The latter two index by a log spaced coordinate, so only need one log().
+// If the Vulkan side pass encodes, ENCODE 3 leaves linear nits. GAMUT > 0 maps
+// BT.2020 to the display's native primaries first, see demo_prepare_gamut_map().
+// demo_build_hdr_shader() prepends the #define's for ENCODE, HLG, etc.
+static char hdrFragmentShaderSrc[] =
+"uniform sampler2D Image; \n"
+"uniform sampler1D Lut; \n"
+"uniform vec4 Poly[SEGMENTS]; \n"
+"uniform mat3 Gamut; \n"
+"uniform vec3 GamutLuma; \n"
+"uniform vec4 Eetf; \n"
+"uniform sampler2D Noise; \n"
+"uniform float DitherOffset[DITHERFRAMES]; \n"
+"uniform int DitherFrame; \n"
+"\n"
+"/* Spatiotemporal blue noise dither by one code value of DITHER + 1 output levels. \n"
+"   The tiled blue noise is spatially shifted in value per frame by the golden ratio, \n"
+"   so each pixel's noise over time is low discrepancy. Shaped into a triangular \n"
+"   distribution, so noise power doesn't depend on the signal */ \n"
+"vec3 dither(vec3 v) \n"
+"{ \n"
+"   float n = fract(texture2D(Noise, gl_FragCoord.xy / NOISESIZE).r + DitherOffset[DitherFrame]); \n"
+"   n = 2.0 * n - 1.0; \n"
+"   n = sign(n) * (1.0 - sqrt(1.0 - abs(n))); \n"
+"   return v + n / float(DITHER); \n"
+"} \n"
+"\n"
+"/* BT.2390 EETF tone mapping, per channel in the PQ domain. Eetf.x is the PQ code \n"
+"   of the source peak, which normalizes input to [0, 1], Eetf.y the start of the \n"
+"   knee, Eetf.z and Eetf.w target peak and black, relative to the source range */ \n"
+"vec3 eetf(vec3 v) \n"
+"{ \n"
+"   vec3 E1 = clamp(v / Eetf.x, 0.0, 1.0); \n"
+"   vec3 T = clamp((E1 - Eetf.y) / max(1.0 - Eetf.y, 0.000001), 0.0, 1.0); \n"
+"   vec3 T2 = T * T; \n"
+"   vec3 T3 = T2 * T; \n"
+"   vec3 P = (2.0 * T3 - 3.0 * T2 + 1.0) * Eetf.y + (T3 - 2.0 * T2 + T) * (1.0 - Eetf.y) + \n"
+"            (-2.0 * T3 + 3.0 * T2) * Eetf.z; \n"
+"   vec3 E2 = mix(E1, P, step(Eetf.y, E1)); \n"
+"   vec3 B = 1.0 - E2; \n"
+"   return (E2 + Eetf.w * B * B * B * B) * Eetf.x; \n"
+"} \n"
+"\n"
+"/* Out of gamut colors have negative components after the matrix. Soft clipping \n"
+"   compresses saturation relative to gray of the same luminance above GAMUT_KNEE, \n"
+"   so colors approach the gamut boundary smoothly instead of clipping per channel */ \n"
+"vec3 gamut_map(vec3 c) \n"
+"{ \n"
+"#if GAMUT == 2 \n"
+"   float Y = max(dot(c, GamutLuma), 0.0); \n"
+"   float s = (Y > 0.0) ? (Y - min(min(c.r, c.g), c.b)) / Y : 0.0; \n"
+"   if (s > GAMUT_KNEE) { \n"
+"      float x = (s - GAMUT_KNEE) / (1.0 - GAMUT_KNEE); \n"
+"      c = Y + (c - Y) * ((GAMUT_KNEE + (1.0 - GAMUT_KNEE) * x / (1.0 + x)) / s); \n"
+"   } \n"
+"#endif \n"
+"   return max(c, 0.0); \n"
+"} \n"
+"\n"
+"/* Exact ST 2084 PQ OETF, or HLG OETF for a nominal peak of LMAX nits */ \n"
+"vec3 encode_exact(vec3 L) \n"
+"{ \n"
+"#if HLG \n"
+"   vec3 E = clamp(L / LMAX, 0.0, 1.0); \n"
+"   vec3 lo = sqrt(3.0 * E); \n"
+"   vec3 hi = 0.17883277 * log(max(12.0 * E - 0.28466892, 0.000001)) + 0.55991073; \n"
+"   return mix(lo, hi, step(1.0 / 12.0, E)); \n"
+"#else \n"
+"   vec3 Lp, f; \n"
+"\n"
+"   /* Normalize input range [0 - 10000.0 nits] to [0.0 - 1.0]; */ \n"
+"   L = L / 10000.0; \n"
+"\n"
+"   /* Apply ST 2084 PQ OETF */ \n"
+"   Lp = pow(L, vec3(0.1593017578125)); \n"
+"   f = (0.8359375 + 18.8515625 * Lp) / (1.0 + 18.6875 * Lp); \n"
+"   return pow(f, vec3(78.84375)); \n"
+"#endif \n"
+"} \n"
+"\n"
+"/* Log spaced coordinate in [0, 1] for 0 - LMAX nits, linear below KNEE nits */ \n"
+"vec3 encode_coord(vec3 L) \n"
+"{ \n"
+"   return log(1.0 + clamp(L, 0.0, LMAX) / KNEE) * SCALE; \n"
+"} \n"
+"\n"
+"float poly(vec4 c, float t) \n"
+"{ \n"
+"   return ((c.w * t + c.z) * t + c.y) * t + c.x; \n"
+"} \n"
+"\n"
+"void main() \n"
+"{ \n"
+"   vec3 u, v; \n"
+"\n"
+"   /* Get source color sample */ \n"
+"   vec4 uFragColor = texture2D(Image, gl_TexCoord[0].st); \n"
+"\n"
+"#if GAMUT > 0 \n"
+"   /* BT.2020 to display native primaries, before encoding */ \n"
+"   uFragColor.rgb = gamut_map(Gamut * uFragColor.rgb); \n"
+"#endif \n"
+"\n"
+"#if ENCODE == 1 \n"
+"   /* Lookup table, linear filtering between entries. Map [0, 1] to texel centers: */ \n"
+"   u = encode_coord(uFragColor.rgb) * ((LUTSIZE - 1.0) / LUTSIZE) + 0.5 / LUTSIZE; \n"
+"   v = vec3(texture1D(Lut, u.r).r, texture1D(Lut, u.g).r, texture1D(Lut, u.b).r); \n"
+"#elif ENCODE == 2 \n"
+"   /* Piecewise cubic, uniform segments: */ \n"
+"   u = encode_coord(uFragColor.rgb) * float(SEGMENTS); \n"
+"   vec3 seg = min(floor(u), float(SEGMENTS - 1)); \n"
+"   u = u - seg; \n"
+"   v = vec3(poly(Poly[int(seg.r)], u.r), poly(Poly[int(seg.g)], u.g), poly(Poly[int(seg.b)], u.b)); \n"
+"#elif ENCODE == 3 \n"
+"   /* No encoding, the Vulkan side pass does it: */ \n"
+"   v = uFragColor.rgb; \n"
+"#else \n"
+"   v = encode_exact(uFragColor.rgb); \n"
+"#endif \n"
+"\n"
+"#if TONEMAP \n"
+"   /* Compress content above panel peak, fused into the PQ encoding */ \n"
+"   v = eetf(v); \n"
+"#endif \n"
+"\n"
+"#if DITHER > 0 \n"
+"   v = dither(v); \n"
+"#endif \n"
+"\n"
+"   /* Debug range check: If red input value greater than some nits, color it red */ \n"
+"   if (false && (uFragColor.r >= 1000.0)) \n"
+"      v = vec3(1.0, 0.0, 0.0); \n"
+"\n"
+"   /* Assign PQ mapped to output */ \n"
+"   gl_FragColor.a = uFragColor.a; \n"
+"   gl_FragColor.rgb = v; \n"
+"} \n";
 
-            demo_set_image_layout(demo, demo->staging_texture.image,
-                                  VK_IMAGE_ASPECT_COLOR_BIT,
-                                  VK_IMAGE_LAYOUT_PREINITIALIZED,
-                                  VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                                  VK_ACCESS_HOST_WRITE_BIT,
-                                  VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-                                  VK_PIPELINE_STAGE_TRANSFER_BIT, NULL);
-
-            demo_set_image_layout(demo, demo->textures[i].image,
-                                  VK_IMAGE_ASPECT_COLOR_BIT,
-                                  VK_IMAGE_LAYOUT_PREINITIALIZED,
-                                  VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                                  VK_ACCESS_HOST_WRITE_BIT,
-                                  VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-                                  VK_PIPELINE_STAGE_TRANSFER_BIT, NULL);
+GLuint PsychCreateGLSLProgram(const char* fragmentsrc, const char* vertexsrc)
+{
+    GLuint glsl = 0;
+    GLuint shader;
+    GLint status;
+    char errtxt[10000];
 
-            VkImageCopy copy_region = {
-                .srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
-                .srcOffset = {0, 0, 0},
-                .dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
-                .dstOffset = {0, 0, 0},
-                .extent = {demo->staging_texture.tex_width,
-                           demo->staging_texture.tex_height, 1},
-            };
-            vkCmdCopyImage(
-                demo->cmd, demo->staging_texture.image,
-                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, demo->textures[i].image,
-                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy_region);
+    // Reset error state:
+    while (glGetError());
 
-            demo_set_image_layout(demo, demo->textures[i].image,
-                                  VK_IMAGE_ASPECT_COLOR_BIT,
-                                  VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                                  demo->textures[i].imageLayout,
-                                  VK_ACCESS_TRANSFER_WRITE_BIT,
-                                  VK_PIPELINE_STAGE_TRANSFER_BIT,
-                                  VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, NULL);
+    // Supported at all on this hardware?
+    if (!glewIsSupported("GL_ARB_shader_objects") || !glewIsSupported("GL_ARB_shading_language_100")) {
+        printf("PTB-ERROR: Your graphics hardware does not support GLSL fragment shaders! Use of imaging pipeline with current settings impossible!\n");
+        return(0);
+    }
 
-        } else {
-            /* Can't support VK_FORMAT_R8G8B8A8_UNORM !? */
-            assert(!"No support for R8G8B8A8_UNORM as texture image format");
+    // Create GLSL program object:
+    glsl = glCreateProgram();
+
+    // Fragment shader wanted?
+    if (fragmentsrc) {
+        printf("PTB-INFO: Creating the following fragment shader, GLSL source code follows:\n\n%s\n\n", fragmentsrc);
+
+        // Supported on this hardware?
+        if (!glewIsSupported("GL_ARB_fragment_shader")) {
+            printf("PTB-ERROR: Your graphics hardware does not support GLSL fragment shaders! Use of imaging pipeline with current settings impossible!\n");
+            return(0);
         }
 
-        const VkSamplerCreateInfo sampler = {
-            .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
-            .pNext = NULL,
-            .magFilter = VK_FILTER_NEAREST,
-            .minFilter = VK_FILTER_NEAREST,
-            .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
-            .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
-            .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
-            .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
-            .mipLodBias = 0.0f,
-            .anisotropyEnable = VK_FALSE,
-            .maxAnisotropy = 1,
-            .compareOp = VK_COMPARE_OP_NEVER,
-            .minLod = 0.0f,
-            .maxLod = 0.0f,
-            .borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE,
-            .unnormalizedCoordinates = VK_FALSE,
-        };
+        // Create shader object:
+        shader = glCreateShader(GL_FRAGMENT_SHADER);
+
+        // Feed it with GLSL source code:
+        glShaderSource(shader, 1, (const char**) &fragmentsrc, NULL);
 
-        VkImageViewCreateInfo view = {
-            .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
-            .pNext = NULL,
-            .image = VK_NULL_HANDLE,
-            .viewType = VK_IMAGE_VIEW_TYPE_2D,
-            .format = tex_format,
-            .components =
-                {
-                 VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G,
-                 VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A,
-                },
-            .subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1},
-            .flags = 0,
-        };
+        // Compile shader:
+        glCompileShader(shader);
 
-        /* create sampler */
-        err = vkCreateSampler(demo->device, &sampler, NULL,
-                              &demo->textures[i].sampler);
-        assert(!err);
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+        if (status != GL_TRUE) {
+            printf("PTB-ERROR: Shader compilation for builtin fragment shader failed:\n");
+            glGetShaderInfoLog(shader, 9999, NULL, (GLchar*) &errtxt);
+            printf("%s\n\n", errtxt);
 
-        /* create image view */
-        view.image = demo->textures[i].image;
-        err = vkCreateImageView(demo->device, &view, NULL,
-                                &demo->textures[i].view);
-        assert(!err);
+            glDeleteShader(shader);
+            glDeleteProgram(glsl);
+
+            // Failed!
+            while (glGetError());
+
+            return(0);
+        }
+
+        // Attach it to program object:
+        glAttachShader(glsl, shader);
     }
-}
 
-void demo_prepare_cube_data_buffers(struct demo *demo) {
-    VkBufferCreateInfo buf_info;
-    VkMemoryRequirements mem_reqs;
-    VkMemoryAllocateInfo mem_alloc;
-    uint8_t *pData;
-    mat4x4 MVP, VP;
-    VkResult U_ASSERT_ONLY err;
-    bool U_ASSERT_ONLY pass;
-    struct vktexcube_vs_uniform data;
-
-    mat4x4_mul(VP, demo->projection_matrix, demo->view_matrix);
-    mat4x4_mul(MVP, VP, demo->model_matrix);
-    memcpy(data.mvp, MVP, sizeof(MVP));
-    //    dumpMatrix("MVP", MVP);
-
-    for (unsigned int i = 0; i < 2 * 3; i++) {
-        data.position[i][0] = g_vertex_buffer_data[i * 3];
-        data.position[i][1] = g_vertex_buffer_data[i * 3 + 1];
-        data.position[i][2] = g_vertex_buffer_data[i * 3 + 2];
-        data.position[i][3] = 1.0f;
-        data.attr[i][0] = g_uv_buffer_data[2 * i];
-        data.attr[i][1] = g_uv_buffer_data[2 * i + 1];
-        data.attr[i][2] = 0;
-        data.attr[i][3] = 0;
-    }
-
-    memset(&buf_info, 0, sizeof(buf_info));
-    buf_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    buf_info.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
-    buf_info.size = sizeof(data);
-
-    for (unsigned int i = 0; i < demo->swapchainImageCount; i++) {
-        err =
-            vkCreateBuffer(demo->device, &buf_info, NULL,
-                           &demo->swapchain_image_resources[i].uniform_buffer);
-        assert(!err);
+    // Vertex shader wanted?
+    if (vertexsrc) {
+        printf("PTB-INFO: Creating the following vertex shader, GLSL source code follows:\n\n%s\n\n", vertexsrc);
 
-        vkGetBufferMemoryRequirements(demo->device,
-                                      demo->swapchain_image_resources[i].uniform_buffer,
-                                      &mem_reqs);
+        // Supported on this hardware?
+        if (!glewIsSupported("GL_ARB_vertex_shader")) {
+            printf("PTB-ERROR: Your graphics hardware does not support GLSL vertex shaders! Use of imaging pipeline with current settings impossible!\n");
+            return(0);
+        }
 
-        mem_alloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        mem_alloc.pNext = NULL;
-        mem_alloc.allocationSize = mem_reqs.size;
-        mem_alloc.memoryTypeIndex = 0;
+        // Create shader object:
+        shader = glCreateShader(GL_VERTEX_SHADER);
 
-        pass = memory_type_from_properties(
-            demo, mem_reqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                                           VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-            &mem_alloc.memoryTypeIndex);
-        assert(pass);
+        // Feed it with GLSL source code:
+        glShaderSource(shader, 1, (const char**) &vertexsrc, NULL);
 
-        err = vkAllocateMemory(demo->device, &mem_alloc, NULL,
-                           &demo->swapchain_image_resources[i].uniform_memory);
-        assert(!err);
+        // Compile shader:
+        glCompileShader(shader);
 
-        err = vkMapMemory(demo->device, demo->swapchain_image_resources[i].uniform_memory, 0,
-                      VK_WHOLE_SIZE, 0, (void **)&pData);
-        assert(!err);
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+        if (status != GL_TRUE) {
+            printf("PTB-ERROR: Shader compilation for builtin vertex shader failed:\n");
+            glGetShaderInfoLog(shader, 9999, NULL, (GLchar*) &errtxt);
+            printf("%s\n\n", errtxt);
+
+            glDeleteShader(shader);
+            glDeleteProgram(glsl);
 
-        memcpy(pData, &data, sizeof data);
+            // Failed!
+            while (glGetError());
 
-        vkUnmapMemory(demo->device, demo->swapchain_image_resources[i].uniform_memory);
+            return(0);
+        }
 
-        err = vkBindBufferMemory(demo->device, demo->swapchain_image_resources[i].uniform_buffer,
-                             demo->swapchain_image_resources[i].uniform_memory, 0);
-        assert(!err);
+        // Attach it to program object:
+        glAttachShader(glsl, shader);
     }
-}
 
-static void demo_prepare_descriptor_layout(struct demo *demo) {
-    const VkDescriptorSetLayoutBinding layout_bindings[2] = {
-            [0] =
-                {
-                 .binding = 0,
-                 .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-                 .descriptorCount = 1,
-                 .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
-                 .pImmutableSamplers = NULL,
-                },
-            [1] =
-                {
-                 .binding = 1,
-                 .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                 .descriptorCount = DEMO_TEXTURE_COUNT,
-                 .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
-                 .pImmutableSamplers = NULL,
-                },
-    };
-    const VkDescriptorSetLayoutCreateInfo descriptor_layout = {
-        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
-        .pNext = NULL,
-        .bindingCount = 2,
-        .pBindings = layout_bindings,
-    };
-    VkResult U_ASSERT_ONLY err;
+    // Link into final program object:
+    glLinkProgram(glsl);
 
-    err = vkCreateDescriptorSetLayout(demo->device, &descriptor_layout, NULL,
-                                      &demo->desc_layout);
-    assert(!err);
+    // Check link status:
+    glGetProgramiv(glsl, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE) {
+        printf("PTB-ERROR: Shader link operation for builtin glsl program failed:\n");
+        glGetProgramInfoLog(glsl, 9999, NULL, (GLchar*) &errtxt);
+        printf("Error output follows:\n\n%s\n\n", errtxt);
 
-    const VkPipelineLayoutCreateInfo pPipelineLayoutCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-        .pNext = NULL,
-        .setLayoutCount = 1,
-        .pSetLayouts = &demo->desc_layout,
-    };
+        glDeleteProgram(glsl);
 
-    err = vkCreatePipelineLayout(demo->device, &pPipelineLayoutCreateInfo, NULL,
-                                 &demo->pipeline_layout);
-    assert(!err);
+        // Failed!
+        while (glGetError());
+
+        return(0);
+    }
+
+    while (glGetError());
+
+    // Return new GLSL program object handle:
+    return(glsl);
 }
 
-static void demo_prepare_render_pass(struct demo *demo) {
-    // The initial layout for the color and depth attachments will be LAYOUT_UNDEFINED
-    // because at the start of the renderpass, we don't care about their contents.
-    // At the start of the subpass, the color attachment's layout will be transitioned
-    // to LAYOUT_COLOR_ATTACHMENT_OPTIMAL and the depth stencil attachment's layout
-    // will be transitioned to LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL.  At the end of
-    // the renderpass, the color attachment's layout will be transitioned to
-    // LAYOUT_PRESENT_SRC_KHR to be ready to present.  This is all done as part of
-    // the renderpass, no barriers are necessary.
-    const VkAttachmentDescription attachments[2] = {
-            [0] =
-                {
-                 .format = demo->format,
-                 .flags = 0,
-                 .samples = VK_SAMPLE_COUNT_1_BIT,
-                 .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
-                 .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
-                 .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
-                 .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
-                 .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-                 .finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-                },
-            [1] =
-                {
-                 .format = demo->depth.format,
-                 .flags = 0,
-                 .samples = VK_SAMPLE_COUNT_1_BIT,
-                 .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
-                 .storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
-                 .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
-                 .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
-                 .initialLayout =
-                     VK_IMAGE_LAYOUT_UNDEFINED,
-                 .finalLayout =
-                     VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
-                },
-    };
-    const VkAttachmentReference color_reference = {
-        .attachment = 0, .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-    };
-    const VkAttachmentReference depth_reference = {
-        .attachment = 1,
-        .layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
-    };
-    const VkSubpassDescription subpass = {
-        .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
-        .flags = 0,
-        .inputAttachmentCount = 0,
-        .pInputAttachments = NULL,
-        .colorAttachmentCount = 1,
-        .pColorAttachments = &color_reference,
-        .pResolveAttachments = NULL,
-        .pDepthStencilAttachment = &depth_reference,
-        .preserveAttachmentCount = 0,
-        .pPreserveAttachments = NULL,
-    };
-    const VkRenderPassCreateInfo rp_info = {
-        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
-        .pNext = NULL,
-        .flags = 0,
-        .attachmentCount = 2,
-        .pAttachments = attachments,
-        .subpassCount = 1,
-        .pSubpasses = &subpass,
-        .dependencyCount = 0,
-        .pDependencies = NULL,
-    };
-    VkResult U_ASSERT_ONLY err;
+// MK: Double precision reference ST-2084 PQ OETF, nits to signal in [0, 1]:
+static double demo_pq_oetf(double nits)
+{
+    double L = fmin(fmax(nits / 10000.0, 0.0), 1.0);
+    double Lp = pow(L, 0.1593017578125);
 
-    err = vkCreateRenderPass(demo->device, &rp_info, NULL, &demo->render_pass);
-    assert(!err);
+    return pow((0.8359375 + 18.8515625 * Lp) / (1.0 + 18.6875 * Lp), 78.84375);
 }
 
-//TODO: Merge shader reading
-#ifndef __ANDROID__
-static VkShaderModule
-demo_prepare_shader_module(struct demo *demo, const void *code, size_t size) {
-    VkShaderModule module;
-    VkShaderModuleCreateInfo moduleCreateInfo;
-    VkResult U_ASSERT_ONLY err;
+// MK: Double precision reference HLG OETF, for a nominal peak of 1000 nits:
+static double demo_hlg_oetf(double nits)
+{
+    double E = fmin(fmax(nits / 1000.0, 0.0), 1.0);
 
-    moduleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    moduleCreateInfo.pNext = NULL;
+    if (E <= 1.0 / 12.0)
+        return sqrt(3.0 * E);
 
-    moduleCreateInfo.codeSize = size;
-    moduleCreateInfo.pCode = code;
-    moduleCreateInfo.flags = 0;
-    err = vkCreateShaderModule(demo->device, &moduleCreateInfo, NULL, &module);
-    assert(!err);
+    return 0.17883277 * log(12.0 * E - 0.28466892) + 0.55991073;
+}
 
-    return module;
+// Input range in nits covered by LUT and polynomial:
+static double demo_hdr_encode_lmax(bool hlg)
+{
+    return (hlg) ? 1000.0 : 10000.0;
 }
 
-char *demo_read_spv(const char *filename, size_t *psize) {
-    long int size;
-    size_t U_ASSERT_ONLY retval;
-    void *shader_code;
+// Inverse of encode_coord() in the shader, log spaced coordinate u in [0, 1] to nits:
+static double demo_hdr_encode_nits(double u, bool hlg)
+{
+    u = fmin(fmax(u, 0.0), 1.0);
+    return HDR_LUT_KNEE * (exp(u * log(1.0 + demo_hdr_encode_lmax(hlg) / HDR_LUT_KNEE)) - 1.0);
+}
 
-#if (defined(VK_USE_PLATFORM_IOS_MVK) || defined(VK_USE_PLATFORM_MACOS_MVK))
-    filename =[[[NSBundle mainBundle] resourcePath] stringByAppendingPathComponent: @(filename)].UTF8String;
-#endif
+static double demo_hdr_encode_exact(double nits, bool hlg)
+{
+    return (hlg) ? demo_hlg_oetf(nits) : demo_pq_oetf(nits);
+}
 
-    FILE *fp = fopen(filename, "rb");
-    if (!fp)
-        return NULL;
+// MK: Build LUT texture for HDR_ENCODE_LUT. Entries are the exact encoding at log spaced nits:
+static GLuint demo_build_hdr_lut(bool hlg)
+{
+    float *lut = malloc(HDR_LUT_SIZE * sizeof(float));
+    GLuint tex;
+    int i;
 
-    fseek(fp, 0L, SEEK_END);
-    size = ftell(fp);
+    for (i = 0; i < HDR_LUT_SIZE; i++)
+        lut[i] = (float) demo_hdr_encode_exact(demo_hdr_encode_nits((double) i / (HDR_LUT_SIZE - 1), hlg), hlg);
 
-    fseek(fp, 0L, SEEK_SET);
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_1D, tex);
+    glTexImage1D(GL_TEXTURE_1D, 0, GL_R32F, HDR_LUT_SIZE, 0, GL_RED, GL_FLOAT, lut);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_1D, 0);
 
-    shader_code = malloc(size);
-    retval = fread(shader_code, size, 1, fp);
-    assert(retval == 1);
+    free(lut);
+    return tex;
+}
 
-    *psize = size;
+// MK: Set or clear pixel p of the blue noise binary pattern, and update the energy of
+// all pixels by the gaussian kernel, which is indexed by toroidal offset:
+static void demo_blue_noise_flip(uint8_t *pattern, float *energy, const float *kernel, int size, int p, bool set)
+{
+    const int px = p % size, py = p / size;
+    const float sign = (set) ? 1.0f : -1.0f;
+    int x, y;
 
-    fclose(fp);
-    return shader_code;
+    pattern[p] = set;
+    for (y = 0; y < size; y++) {
+        const float *k = &kernel[((y - py + size) % size) * size];
+        float *e = &energy[y * size];
+
+        // Offset x - px, wrapped around:
+        for (x = 0; x < px; x++)
+            e[x] += sign * k[x - px + size];
+        for (x = px; x < size; x++)
+            e[x] += sign * k[x - px];
+    }
 }
-#endif
 
-static VkShaderModule demo_prepare_vs(struct demo *demo) {
-#ifdef __ANDROID__
-    VkShaderModuleCreateInfo sh_info = {};
-    sh_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+// MK: Tightest cluster, ie. set pixel of highest energy, or largest void, ie. unset pixel
+// of lowest energy, of the blue noise binary pattern:
+static int demo_blue_noise_find(const uint8_t *pattern, const float *energy, int n, bool cluster)
+{
+    int i, best = -1;
 
-#include "cube.vert.h"
-    sh_info.codeSize = sizeof(cube_vert);
-    sh_info.pCode = cube_vert;
-    VkResult U_ASSERT_ONLY err = vkCreateShaderModule(demo->device, &sh_info, NULL, &demo->vert_shader_module);
-    assert(!err);
-#else
-    void *vertShaderCode;
-    size_t size;
+    for (i = 0; i < n; i++) {
+        if (pattern[i] == cluster &&
+            (best < 0 || (cluster ? energy[i] > energy[best] : energy[i] < energy[best])))
+            best = i;
+    }
 
-    vertShaderCode = demo_read_spv("cube-vert.spv", &size);
-    if (!vertShaderCode) {
-        ERR_EXIT("Failed to load cube-vert.spv", "Load Shader Failure");
+    return best;
+}
+
+// MK: Build the tiling blue noise texture for dithering with the void-and-cluster method.
+// Pixels are ranked by taking the tightest clusters out of an evenly spread initial
+// pattern, and by filling its largest voids. Texel values are the ranks, uniform in [0, 1]:
+static GLuint demo_build_blue_noise(void)
+{
+    const int size = HDR_DITHER_SIZE, n = size * size, ones = n / 10;
+    const double sigma = 1.5;
+    float *kernel = malloc(n * sizeof(float));
+    float *energy = calloc(n, sizeof(float));
+    float *initial_energy = malloc(n * sizeof(float));
+    float *noise = malloc(n * sizeof(float));
+    uint8_t *pattern = calloc(n, 1);
+    uint8_t *initial = malloc(n);
+    uint32_t seed = 1;
+    int x, y, i, rank, removed, added;
+    GLuint tex;
+
+    for (y = 0; y < size; y++) {
+        for (x = 0; x < size; x++) {
+            int dx = (x > size / 2) ? size - x : x;
+            int dy = (y > size / 2) ? size - y : y;
+            kernel[y * size + x] = (float) exp(-(dx * dx + dy * dy) / (2 * sigma * sigma));
+        }
     }
 
-    demo->vert_shader_module =
-        demo_prepare_shader_module(demo, vertShaderCode, size);
+    // Initial pattern: Random pixels, then move the tightest cluster into the largest
+    // void, until the largest void is where the tightest cluster was:
+    for (i = 0; i < ones; ) {
+        seed = seed * 1664525 + 1013904223;
+        if (!pattern[(seed >> 8) % n]) {
+            demo_blue_noise_flip(pattern, energy, kernel, size, (seed >> 8) % n, true);
+            i++;
+        }
+    }
 
-    free(vertShaderCode);
-#endif
+    do {
+        removed = demo_blue_noise_find(pattern, energy, n, true);
+        demo_blue_noise_flip(pattern, energy, kernel, size, removed, false);
+        added = demo_blue_noise_find(pattern, energy, n, false);
+        demo_blue_noise_flip(pattern, energy, kernel, size, added, true);
+    } while (added != removed);
+
+    memcpy(initial, pattern, n);
+    memcpy(initial_energy, energy, n * sizeof(float));
+
+    // Ranks below the initial pattern's: Remove tightest clusters:
+    for (rank = ones - 1; rank >= 0; rank--) {
+        removed = demo_blue_noise_find(pattern, energy, n, true);
+        demo_blue_noise_flip(pattern, energy, kernel, size, removed, false);
+        noise[removed] = (rank + 0.5f) / n;
+    }
+
+    // Ranks above: Fill largest voids. Beyond half, this is the same as removing
+    // the tightest clusters of unset pixels, as the kernel sums up to a constant:
+    memcpy(pattern, initial, n);
+    memcpy(energy, initial_energy, n * sizeof(float));
+    for (rank = ones; rank < n; rank++) {
+        added = demo_blue_noise_find(pattern, energy, n, false);
+        demo_blue_noise_flip(pattern, energy, kernel, size, added, true);
+        noise[added] = (rank + 0.5f) / n;
+    }
+
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, size, size, 0, GL_RED, GL_FLOAT, noise);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
 
-    return demo->vert_shader_module;
+    free(initial);
+    free(pattern);
+    free(noise);
+    free(initial_energy);
+    free(energy);
+    free(kernel);
+
+    return tex;
 }
 
-static VkShaderModule demo_prepare_fs(struct demo *demo) {
-#ifdef __ANDROID__
-    VkShaderModuleCreateInfo sh_info = {};
-    sh_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+// MK: Fit a cubic Hermite polynomial per segment for HDR_ENCODE_POLY, through the exact
+// values at the segment ends. Slopes are central differences, limited Fritsch-Carlson
+// style to avoid overshoot where the curve gets infinitely steep, e.g., PQ near 0 nits:
+static void demo_build_hdr_poly(float poly[HDR_POLY_SEGMENTS][4], bool hlg)
+{
+    const double h = 1e-7;
+    int s;
 
-#include "cube.frag.h"
-    sh_info.codeSize = sizeof(cube_frag);
-    sh_info.pCode = cube_frag;
-    VkResult U_ASSERT_ONLY err = vkCreateShaderModule(demo->device, &sh_info, NULL, &demo->frag_shader_module);
-    assert(!err);
-#else
-    void *fragShaderCode;
-    size_t size;
+    for (s = 0; s < HDR_POLY_SEGMENTS; s++) {
+        double u0 = (double) s / HDR_POLY_SEGMENTS;
+        double u1 = (double) (s + 1) / HDR_POLY_SEGMENTS;
+        double f0 = demo_hdr_encode_exact(demo_hdr_encode_nits(u0, hlg), hlg);
+        double f1 = demo_hdr_encode_exact(demo_hdr_encode_nits(u1, hlg), hlg);
+        double d0, d1;
 
-    fragShaderCode = demo_read_spv("cube-frag.spv", &size);
-    if (!fragShaderCode) {
-        ERR_EXIT("Failed to load cube-frag.spv", "Load Shader Failure");
-    }
+        // Slopes wrt. t in [0, 1] within the segment, one-sided at the range ends:
+        d0 = demo_hdr_encode_exact(demo_hdr_encode_nits(u0 + h, hlg), hlg) -
+             demo_hdr_encode_exact(demo_hdr_encode_nits((s > 0) ? u0 - h : u0, hlg), hlg);
+        d0 = d0 / ((s > 0) ? 2 * h : h) / HDR_POLY_SEGMENTS;
 
-    demo->frag_shader_module =
-        demo_prepare_shader_module(demo, fragShaderCode, size);
+        d1 = demo_hdr_encode_exact(demo_hdr_encode_nits((s < HDR_POLY_SEGMENTS - 1) ? u1 + h : u1, hlg), hlg) -
+             demo_hdr_encode_exact(demo_hdr_encode_nits(u1 - h, hlg), hlg);
+        d1 = d1 / ((s < HDR_POLY_SEGMENTS - 1) ? 2 * h : h) / HDR_POLY_SEGMENTS;
 
-    free(fragShaderCode);
-#endif
+        d0 = fmin(d0, 3.0 * (f1 - f0));
+        d1 = fmin(d1, 3.0 * (f1 - f0));
 
-    return demo->frag_shader_module;
+        poly[s][0] = (float) f0;
+        poly[s][1] = (float) d0;
+        poly[s][2] = (float) (3.0 * (f1 - f0) - 2.0 * d0 - d1);
+        poly[s][3] = (float) (2.0 * (f0 - f1) + d0 + d1);
+    }
 }
 
-static void demo_prepare_pipeline(struct demo *demo) {
-    VkGraphicsPipelineCreateInfo pipeline;
-    VkPipelineCacheCreateInfo pipelineCache;
-    VkPipelineVertexInputStateCreateInfo vi;
-    VkPipelineInputAssemblyStateCreateInfo ia;
-    VkPipelineRasterizationStateCreateInfo rs;
-    VkPipelineColorBlendStateCreateInfo cb;
-    VkPipelineDepthStencilStateCreateInfo ds;
-    VkPipelineViewportStateCreateInfo vp;
-    VkPipelineMultisampleStateCreateInfo ms;
-    VkDynamicState dynamicStateEnables[VK_DYNAMIC_STATE_RANGE_SIZE];
-    VkPipelineDynamicStateCreateInfo dynamicState;
-    VkResult U_ASSERT_ONLY err;
+// MK: Build HDR post-processing shader for a given encoding, and set its uniforms:
+static void demo_invert3x3(double a[3][3], double inv[3][3])
+{
+    double det = a[0][0] * (a[1][1] * a[2][2] - a[1][2] * a[2][1]) -
+                 a[0][1] * (a[1][0] * a[2][2] - a[1][2] * a[2][0]) +
+                 a[0][2] * (a[1][0] * a[2][1] - a[1][1] * a[2][0]);
+
+    inv[0][0] = (a[1][1] * a[2][2] - a[1][2] * a[2][1]) / det;
+    inv[0][1] = (a[0][2] * a[2][1] - a[0][1] * a[2][2]) / det;
+    inv[0][2] = (a[0][1] * a[1][2] - a[0][2] * a[1][1]) / det;
+    inv[1][0] = (a[1][2] * a[2][0] - a[1][0] * a[2][2]) / det;
+    inv[1][1] = (a[0][0] * a[2][2] - a[0][2] * a[2][0]) / det;
+    inv[1][2] = (a[0][2] * a[1][0] - a[0][0] * a[1][2]) / det;
+    inv[2][0] = (a[1][0] * a[2][1] - a[1][1] * a[2][0]) / det;
+    inv[2][1] = (a[0][1] * a[2][0] - a[0][0] * a[2][1]) / det;
+    inv[2][2] = (a[0][0] * a[1][1] - a[0][1] * a[1][0]) / det;
+}
 
-    memset(dynamicStateEnables, 0, sizeof dynamicStateEnables);
-    memset(&dynamicState, 0, sizeof dynamicState);
-    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-    dynamicState.pDynamicStates = dynamicStateEnables;
+// MK: RGB to CIE XYZ matrix for the given xy chromaticities of primaries and white point,
+// normalized so RGB = 1, 1, 1 is white with Y = 1:
+static void demo_rgb_to_xyz(const VkXYColorEXT primaries[3], VkXYColorEXT white, double m[3][3])
+{
+    double p[3][3], inv[3][3], w[3], scale[3];
+    int i, j;
 
-    memset(&pipeline, 0, sizeof(pipeline));
-    pipeline.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipeline.layout = demo->pipeline_layout;
+    for (i = 0; i < 3; i++) {
+        p[0][i] = primaries[i].x / primaries[i].y;
+        p[1][i] = 1.0;
+        p[2][i] = (1.0 - primaries[i].x - primaries[i].y) / primaries[i].y;
+    }
 
-    memset(&vi, 0, sizeof(vi));
-    vi.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    w[0] = white.x / white.y;
+    w[1] = 1.0;
+    w[2] = (1.0 - white.x - white.y) / white.y;
 
-    memset(&ia, 0, sizeof(ia));
-    ia.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    ia.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    demo_invert3x3(p, inv);
+    for (i = 0; i < 3; i++)
+        scale[i] = inv[i][0] * w[0] + inv[i][1] * w[1] + inv[i][2] * w[2];
 
-    memset(&rs, 0, sizeof(rs));
-    rs.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-    rs.polygonMode = VK_POLYGON_MODE_FILL;
-    rs.cullMode = VK_CULL_MODE_BACK_BIT;
-    rs.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-    rs.depthClampEnable = VK_FALSE;
-    rs.rasterizerDiscardEnable = VK_FALSE;
-    rs.depthBiasEnable = VK_FALSE;
-    rs.lineWidth = 1.0f;
+    for (i = 0; i < 3; i++)
+        for (j = 0; j < 3; j++)
+            m[i][j] = p[i][j] * scale[j];
+}
 
-    memset(&cb, 0, sizeof(cb));
-    cb.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-    VkPipelineColorBlendAttachmentState att_state[1];
-    memset(att_state, 0, sizeof(att_state));
-    att_state[0].colorWriteMask = 0xf;
-    att_state[0].blendEnable = VK_FALSE;
-    cb.attachmentCount = 1;
-    cb.pAttachments = att_state;
+// MK: Gamut mapping from BT.2020 to the display's native primaries, computed once.
+// Absolute colorimetric, ie. no white point adaptation, so stimuli specified in
+// BT.2020 come out as specified, as far as they are inside the native gamut:
+static void demo_prepare_gamut_map(struct demo *demo)
+{
+    const VkXYColorEXT bt2020[3] = { { 0.708, 0.292 }, { 0.170, 0.797 }, { 0.131, 0.046 } };
+    const VkXYColorEXT d65 = { 0.3127, 0.3290 };
+    const VkHdrMetadataEXT *native = &demo->nativeDisplayHdrMetadata;
+    VkXYColorEXT primaries[3] = { native->displayPrimaryRed, native->displayPrimaryGreen, native->displayPrimaryBlue };
+    double src[3][3], dst[3][3], inv[3][3], m[3][3];
+    int i, j, k;
 
-    memset(&vp, 0, sizeof(vp));
-    vp.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-    vp.viewportCount = 1;
-    dynamicStateEnables[dynamicState.dynamicStateCount++] =
-        VK_DYNAMIC_STATE_VIEWPORT;
-    vp.scissorCount = 1;
-    dynamicStateEnables[dynamicState.dynamicStateCount++] =
-        VK_DYNAMIC_STATE_SCISSOR;
+    if (demo->gamut_map < 0)
+        demo->gamut_map = (demo->color_space == VK_COLOR_SPACE_DISPLAY_NATIVE_AMD) ? HDR_GAMUT_SOFT : HDR_GAMUT_OFF;
 
-    memset(&ds, 0, sizeof(ds));
-    ds.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-    ds.depthTestEnable = VK_TRUE;
-    ds.depthWriteEnable = VK_TRUE;
-    ds.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
-    ds.depthBoundsTestEnable = VK_FALSE;
-    ds.back.failOp = VK_STENCIL_OP_KEEP;
-    ds.back.passOp = VK_STENCIL_OP_KEEP;
-    ds.back.compareOp = VK_COMPARE_OP_ALWAYS;
-    ds.stencilTestEnable = VK_FALSE;
-    ds.front = ds.back;
+    if (demo->gamut_map == HDR_GAMUT_OFF)
+        return;
 
-    memset(&ms, 0, sizeof(ms));
-    ms.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-    ms.pSampleMask = NULL;
-    ms.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+    if (primaries[0].y <= 0 || primaries[1].y <= 0 || primaries[2].y <= 0 || native->whitePoint.y <= 0) {
+        printf("Display native primaries unknown. No gamut mapping.\n");
+        demo->gamut_map = HDR_GAMUT_OFF;
+        return;
+    }
 
-    // Two stages: vs and fs
-    pipeline.stageCount = 2;
-    VkPipelineShaderStageCreateInfo shaderStages[2];
-    memset(&shaderStages, 0, 2 * sizeof(VkPipelineShaderStageCreateInfo));
+    demo_rgb_to_xyz(bt2020, d65, src);
+    demo_rgb_to_xyz(primaries, native->whitePoint, dst);
+    demo_invert3x3(dst, inv);
 
-    shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-    shaderStages[0].module = demo_prepare_vs(demo);
-    shaderStages[0].pName = "main";
+    for (i = 0; i < 3; i++) {
+        for (j = 0; j < 3; j++) {
+            m[i][j] = 0;
+            for (k = 0; k < 3; k++)
+                m[i][j] += inv[i][k] * src[k][j];
 
-    shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-    shaderStages[1].module = demo_prepare_fs(demo);
-    shaderStages[1].pName = "main";
+            // Column major for OpenGL:
+            demo->gamut_matrix[j * 3 + i] = (float) m[i][j];
+        }
 
-    memset(&pipelineCache, 0, sizeof(pipelineCache));
-    pipelineCache.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        demo->gamut_luma[i] = (float) dst[1][i];
+    }
 
-    err = vkCreatePipelineCache(demo->device, &pipelineCache, NULL,
-                                &demo->pipelineCache);
-    assert(!err);
+    printf("Gamut mapping BT.2020 to display native primaries, %s clipping:\n",
+           (demo->gamut_map == HDR_GAMUT_SOFT) ? "soft" : "hard");
+    for (i = 0; i < 3; i++)
+        printf("  [%9.6f %9.6f %9.6f]\n", m[i][0], m[i][1], m[i][2]);
+}
 
-    pipeline.pVertexInputState = &vi;
-    pipeline.pInputAssemblyState = &ia;
-    pipeline.pRasterizationState = &rs;
-    pipeline.pColorBlendState = &cb;
-    pipeline.pMultisampleState = &ms;
-    pipeline.pViewportState = &vp;
-    pipeline.pDepthStencilState = &ds;
-    pipeline.pStages = shaderStages;
-    pipeline.renderPass = demo->render_pass;
-    pipeline.pDynamicState = &dynamicState;
+static GLuint demo_build_hdr_shader(int encode, bool hlg, float poly[HDR_POLY_SEGMENTS][4],
+                                    int gamut, const float *gamut_matrix, const float *gamut_luma,
+                                    bool tonemap, int dither_levels)
+{
+    char *src = malloc(sizeof(hdrFragmentShaderSrc) + 1024);
+    GLuint shader;
 
-    pipeline.renderPass = demo->render_pass;
+    sprintf(src, "#define ENCODE %i\n#define HLG %i\n#define LMAX %.1f\n#define KNEE %.10f\n"
+            "#define SCALE %.10f\n#define LUTSIZE %i.0\n#define SEGMENTS %i\n"
+            "#define GAMUT %i\n#define GAMUT_KNEE %f\n#define TONEMAP %i\n"
+            "#define DITHER %i\n#define NOISESIZE %i.0\n#define DITHERFRAMES %i\n%s",
+            encode, (int) hlg, demo_hdr_encode_lmax(hlg), HDR_LUT_KNEE,
+            1.0 / log(1.0 + demo_hdr_encode_lmax(hlg) / HDR_LUT_KNEE),
+            HDR_LUT_SIZE, HDR_POLY_SEGMENTS, gamut, HDR_GAMUT_KNEE,
+            (int) (tonemap && !hlg && encode != HDR_ENCODE_NONE),
+            (encode != HDR_ENCODE_NONE) ? dither_levels : 0, HDR_DITHER_SIZE, HDR_DITHER_FRAMES,
+            hdrFragmentShaderSrc);
+
+    shader = PsychCreateGLSLProgram(src, NULL);
+    free(src);
+
+    if (shader) {
+        glUseProgram(shader);
+        glUniform1i(glGetUniformLocation(shader, "Image"), 0);
+        glUniform1i(glGetUniformLocation(shader, "Lut"), 1);
+        if (encode == HDR_ENCODE_POLY)
+            glUniform4fv(glGetUniformLocation(shader, "Poly"), HDR_POLY_SEGMENTS, &poly[0][0]);
+        if (gamut != HDR_GAMUT_OFF) {
+            glUniformMatrix3fv(glGetUniformLocation(shader, "Gamut"), 1, GL_FALSE, gamut_matrix);
+            glUniform3fv(glGetUniformLocation(shader, "GamutLuma"), 1, gamut_luma);
+        }
+        if (dither_levels && encode != HDR_ENCODE_NONE) {
+            // Golden ratio sequence, as table to avoid precision loss at high frame counts:
+            float offsets[HDR_DITHER_FRAMES];
+            int i;
 
-    err = vkCreateGraphicsPipelines(demo->device, demo->pipelineCache, 1,
-                                    &pipeline, NULL, &demo->pipeline);
-    assert(!err);
+            for (i = 0; i < HDR_DITHER_FRAMES; i++)
+                offsets[i] = (float) fmod(i * 0.61803398874989, 1.0);
 
-    vkDestroyShaderModule(demo->device, demo->frag_shader_module, NULL);
-    vkDestroyShaderModule(demo->device, demo->vert_shader_module, NULL);
+            glUniform1i(glGetUniformLocation(shader, "Noise"), 2);
+            glUniform1fv(glGetUniformLocation(shader, "DitherOffset"), HDR_DITHER_FRAMES, offsets);
+        }
+        glUseProgram(0);
+    }
+
+    return shader;
 }
 
-static void demo_prepare_descriptor_pool(struct demo *demo) {
-    const VkDescriptorPoolSize type_counts[2] = {
-            [0] =
-                {
-                 .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-                 .descriptorCount = demo->swapchainImageCount,
-                },
-            [1] =
-                {
-                 .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                 .descriptorCount = demo->swapchainImageCount * DEMO_TEXTURE_COUNT,
-                },
-    };
-    const VkDescriptorPoolCreateInfo descriptor_pool = {
-        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-        .pNext = NULL,
-        .maxSets = demo->swapchainImageCount,
-        .poolSizeCount = 2,
-        .pPoolSizes = type_counts,
-    };
-    VkResult U_ASSERT_ONLY err;
+// MK: Accuracy mode: Run a few hundred thousand test intensities through each
+// encoding of PQ and HLG on the GPU, and report the maximum code value error against
+// the double precision formula, for 10 and 12 bit output:
+static void demo_hdr_encode_accuracy(struct demo *demo)
+{
+    const char *names[3] = { "exact", "LUT", "polynomial" };
+    const int w = 1024, h = 256, n = w * h * 3;
+    float *nits = malloc(n * sizeof(float));
+    float *result = malloc(w * h * 4 * sizeof(float));
+    float poly[HDR_POLY_SEGMENTS][4];
+    GLuint srctex, dsttex, fbo, lut;
+    int hlg, encode, i;
+
+    glGenTextures(1, &srctex);
+    glGenTextures(1, &dsttex);
+    glGenFramebuffers(1, &fbo);
+
+    glBindTexture(GL_TEXTURE_2D, dsttex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, w, h, 0, GL_RGBA, GL_FLOAT, NULL);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, dsttex, 0);
+    glViewport(0, 0, w, h);
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
 
-    err = vkCreateDescriptorPool(demo->device, &descriptor_pool, NULL,
-                                 &demo->desc_pool);
-    assert(!err);
-}
+    printf("\nHDR encoding accuracy: Maximum code value error vs. exact formula, %i samples:\n", n);
 
-static void demo_prepare_descriptor_set(struct demo *demo) {
-    VkDescriptorImageInfo tex_descs[DEMO_TEXTURE_COUNT];
-    VkWriteDescriptorSet writes[2];
-    VkResult U_ASSERT_ONLY err;
+    for (hlg = 0; hlg < 2; hlg++) {
+        const double lmax = demo_hdr_encode_lmax(hlg);
 
-    VkDescriptorSetAllocateInfo alloc_info = {
-        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
-        .pNext = NULL,
-        .descriptorPool = demo->desc_pool,
-        .descriptorSetCount = 1,
-        .pSetLayouts = &demo->desc_layout};
+        // Half the samples log spaced from 1e-6 nits, half linear, both up to max nits:
+        for (i = 0; i < n; i++)
+            nits[i] = (i & 1) ? (float) (1e-6 * pow(lmax / 1e-6, (double) i / n)) : (float) (lmax * i / n);
 
-    VkDescriptorBufferInfo buffer_info;
-    buffer_info.offset = 0;
-    buffer_info.range = sizeof(struct vktexcube_vs_uniform);
+        float *rgba = malloc(w * h * 4 * sizeof(float));
+        for (i = 0; i < w * h; i++) {
+            rgba[i * 4 + 0] = nits[i * 3 + 0];
+            rgba[i * 4 + 1] = nits[i * 3 + 1];
+            rgba[i * 4 + 2] = nits[i * 3 + 2];
+            rgba[i * 4 + 3] = 1;
+        }
 
-    memset(&tex_descs, 0, sizeof(tex_descs));
-    for (unsigned int i = 0; i < DEMO_TEXTURE_COUNT; i++) {
-        tex_descs[i].sampler = demo->textures[i].sampler;
-        tex_descs[i].imageView = demo->textures[i].view;
-        tex_descs[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
-    }
+        glBindTexture(GL_TEXTURE_2D, srctex);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, w, h, 0, GL_RGBA, GL_FLOAT, rgba);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        free(rgba);
+
+        lut = demo_build_hdr_lut(hlg);
+        demo_build_hdr_poly(poly, hlg);
+
+        for (encode = HDR_ENCODE_EXACT; encode <= HDR_ENCODE_POLY; encode++) {
+            GLuint shader = demo_build_hdr_shader(encode, hlg, poly, HDR_GAMUT_OFF, NULL, NULL, false, 0);
+            double maxerr = 0, maxnits = 0;
+
+            if (!shader)
+                continue;
+
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_1D, lut);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, srctex);
+            glUseProgram(shader);
+            glBegin(GL_QUADS);
+            glTexCoord2f(0.0, 0.0);
+            glVertex2f(-1.0, -1.0);
+            glTexCoord2f(1.0, 0.0);
+            glVertex2f(1.0, -1.0);
+            glTexCoord2f(1.0, 1.0);
+            glVertex2f(1.0, 1.0);
+            glTexCoord2f(0.0, 1.0);
+            glVertex2f(-1.0, 1.0);
+            glEnd();
+            glUseProgram(0);
+            glDeleteProgram(shader);
+
+            glReadPixels(0, 0, w, h, GL_RGBA, GL_FLOAT, result);
+
+            for (i = 0; i < n; i++) {
+                double err = fabs(result[(i / 3) * 4 + (i % 3)] - demo_hdr_encode_exact(nits[i], hlg));
+                if (err > maxerr) {
+                    maxerr = err;
+                    maxnits = nits[i];
+                }
+            }
 
-    memset(&writes, 0, sizeof(writes));
+            printf("%s %-10s: %8.4f codes at 10 bit, %8.4f codes at 12 bit, worst at %f nits.\n",
+                   (hlg) ? "HLG" : "PQ ", names[encode], maxerr * 1023, maxerr * 4095, maxnits);
+        }
 
-    writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    writes[0].descriptorCount = 1;
-    writes[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    writes[0].pBufferInfo = &buffer_info;
+        // Same for the cpu transfer functions, e.g., for verification of gpu output against cpu encoded references:
+        {
+            struct tf_kernels k = tf_get_kernels();
+            double maxerr = 0, maxnits = 0;
+
+            (hlg ? k.hlg_encode : k.pq_encode)(nits, result, n);
+            for (i = 0; i < n; i++) {
+                double err = fabs(result[i] - demo_hdr_encode_exact(nits[i], hlg));
+                if (err > maxerr) {
+                    maxerr = err;
+                    maxnits = nits[i];
+                }
+            }
 
-    writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    writes[1].dstBinding = 1;
-    writes[1].descriptorCount = DEMO_TEXTURE_COUNT;
-    writes[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    writes[1].pImageInfo = tex_descs;
+            printf("%s cpu %-6s: %8.4f codes at 10 bit, %8.4f codes at 12 bit, worst at %f nits.\n",
+                   (hlg) ? "HLG" : "PQ ", k.name, maxerr * 1023, maxerr * 4095, maxnits);
+        }
 
-    for (unsigned int i = 0; i < demo->swapchainImageCount; i++) {
-        err = vkAllocateDescriptorSets(demo->device, &alloc_info, &demo->swapchain_image_resources[i].descriptor_set);
-        assert(!err);
-        buffer_info.buffer = demo->swapchain_image_resources[i].uniform_buffer;
-        writes[0].dstSet = demo->swapchain_image_resources[i].descriptor_set;
-        writes[1].dstSet = demo->swapchain_image_resources[i].descriptor_set;
-        vkUpdateDescriptorSets(demo->device, 2, writes, 0, NULL);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_1D, 0);
+        glActiveTexture(GL_TEXTURE0);
+        glDeleteTextures(1, &lut);
     }
-}
 
-static void demo_prepare_framebuffers(struct demo *demo) {
-    VkImageView attachments[2];
-    attachments[1] = demo->depth.view;
+    printf("\n");
 
-    const VkFramebufferCreateInfo fb_info = {
-        .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
-        .pNext = NULL,
-        .renderPass = demo->render_pass,
-        .attachmentCount = 2,
-        .pAttachments = attachments,
-        .width = demo->width,
-        .height = demo->height,
-        .layers = 1,
-    };
-    VkResult U_ASSERT_ONLY err;
-    uint32_t i;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteTextures(1, &dsttex);
+    glDeleteTextures(1, &srctex);
+    glViewport(0, 0, demo->textures[0].tex_width, demo->textures[0].tex_height);
 
-    for (i = 0; i < demo->swapchainImageCount; i++) {
-        attachments[0] = demo->swapchain_image_resources[i].view;
-        err = vkCreateFramebuffer(demo->device, &fb_info, NULL,
-                                  &demo->swapchain_image_resources[i].framebuffer);
-        assert(!err);
-    }
+    free(result);
+    free(nits);
 }
 
-static void demo_prepare(struct demo *demo) {
-    VkResult U_ASSERT_ONLY err;
+// MK: Transfer function benchmark: Verify each SIMD variant of the cpu transfer functions
+// against the scalar reference, then report throughput of all variants in gigapixels per
+// second, for RGBA pixels, ie. 4 floats per pixel:
+static void demo_tf_benchmark(void)
+{
+    const size_t n = 4 * 1024 * 1024;
+    const int reps = 10;
+    float *in = malloc(n * sizeof(float));
+    float *out = malloc(n * sizeof(float));
+    float *ref = malloc(n * sizeof(float));
+    uint16_t *half = malloc(n * sizeof(uint16_t));
+    struct tf_kernels scalar = tf_get_kernels_level(0);
+    size_t i;
+    int level, f, r;
+
+    printf("\nCPU transfer functions, %zu values, %i repetitions, kernels selected for this cpu: %s\n",
+           n, reps, tf_get_kernels().name);
+
+    for (level = 0; level <= 2; level++) {
+        struct tf_kernels k = tf_get_kernels_level(level);
+        struct {
+            const char *name;
+            tf_kernel fn, reffn;
+            float range, outrange;
+        } funcs[6] = {
+            { "PQ encode", k.pq_encode, scalar.pq_encode, 10000, 1 },
+            { "PQ decode", k.pq_decode, scalar.pq_decode, 1, 10000 },
+            { "HLG encode", k.hlg_encode, scalar.hlg_encode, 1000, 1 },
+            { "HLG decode", k.hlg_decode, scalar.hlg_decode, 1, 1000 },
+            { "sRGB encode", k.srgb_encode, scalar.srgb_encode, 1, 1 },
+            { "sRGB decode", k.srgb_decode, scalar.srgb_decode, 1, 1 },
+        };
 
-    const VkCommandPoolCreateInfo cmd_pool_info = {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-        .pNext = NULL,
-        .queueFamilyIndex = demo->graphics_queue_family_index,
-        .flags = 0,
-    };
-    err = vkCreateCommandPool(demo->device, &cmd_pool_info, NULL,
-                              &demo->cmd_pool);
-    assert(!err);
+        // Lower levels fall back to the same kernels if the cpu lacks support:
+        if (level > 0 && k.pq_encode == tf_get_kernels_level(level - 1).pq_encode)
+            continue;
 
-    const VkCommandBufferAllocateInfo cmd = {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-        .pNext = NULL,
-        .commandPool = demo->cmd_pool,
-        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-        .commandBufferCount = 1,
-    };
-    err = vkAllocateCommandBuffers(demo->device, &cmd, &demo->cmd);
-    assert(!err);
-    VkCommandBufferBeginInfo cmd_buf_info = {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-        .pNext = NULL,
-        .flags = 0,
-        .pInheritanceInfo = NULL,
-    };
-    err = vkBeginCommandBuffer(demo->cmd, &cmd_buf_info);
-    assert(!err);
+        printf("%s:\n", k.name);
+
+        for (f = 0; f < 6; f++) {
+            double maxerr = 0;
+            uint64_t t;
+
+            for (i = 0; i < n; i++)
+                in[i] = funcs[f].range * (float) i / (float) (n - 1);
+
+            // Max relative error vs. scalar reference, relative to at least 0.1% of full range:
+            funcs[f].fn(in, out, n);
+            funcs[f].reffn(in, ref, n);
+            for (i = 0; i < n; i++) {
+                double err = fabs(out[i] - ref[i]) / fmax(fabs(ref[i]), 0.001 * funcs[f].outrange);
+                if (err > maxerr)
+                    maxerr = err;
+            }
 
-    demo_prepare_buffers(demo);
-    demo_prepare_depth(demo);
-    demo_prepare_textures(demo);
-    demo_prepare_cube_data_buffers(demo);
+            t = getTimeInNanoseconds();
+            for (r = 0; r < reps; r++)
+                funcs[f].fn(in, out, n);
+            t = getTimeInNanoseconds() - t;
 
-    demo_prepare_descriptor_layout(demo);
-    demo_prepare_render_pass(demo);
-    demo_prepare_pipeline(demo);
+            printf("  %-12s: %8.4f Gpix/s, max relative error %g\n", funcs[f].name,
+                   (double) n / 4 * reps / (double) t, maxerr);
+        }
 
-    for (uint32_t i = 0; i < demo->swapchainImageCount; i++) {
-        err =
-            vkAllocateCommandBuffers(demo->device, &cmd, &demo->swapchain_image_resources[i].cmd);
-        assert(!err);
-    }
+        // Half conversion must be bit exact, except for NaN payloads:
+        {
+            uint16_t ref_half;
+            uint64_t t;
+            int mismatch = 0;
 
-    if (demo->separate_present_queue) {
-        const VkCommandPoolCreateInfo present_cmd_pool_info = {
-            .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-            .pNext = NULL,
-            .queueFamilyIndex = demo->present_queue_family_index,
-            .flags = 0,
-        };
-        err = vkCreateCommandPool(demo->device, &present_cmd_pool_info, NULL,
-                                  &demo->present_cmd_pool);
-        assert(!err);
-        const VkCommandBufferAllocateInfo present_cmd_info = {
-            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-            .pNext = NULL,
-            .commandPool = demo->present_cmd_pool,
-            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-            .commandBufferCount = 1,
-        };
-        for (uint32_t i = 0; i < demo->swapchainImageCount; i++) {
-            err = vkAllocateCommandBuffers(
-                demo->device, &present_cmd_info, &demo->swapchain_image_resources[i].graphics_to_present_cmd);
-            assert(!err);
-            demo_build_image_ownership_cmd(demo, i);
+            for (i = 0; i < n; i++) {
+                uint32_t bits = (uint32_t) (i * 2654435761u);
+                memcpy(&in[i], &bits, sizeof(bits));
+            }
+
+            k.float_to_half(in, half, n);
+            for (i = 0; i < n; i++) {
+                ref_half = tf_float_to_half_ref(in[i]);
+                if (half[i] != ref_half && !(isnan(in[i]) && (half[i] & 0x7c00) == 0x7c00 && (half[i] & 0x3ff)))
+                    mismatch++;
+            }
+
+            t = getTimeInNanoseconds();
+            for (r = 0; r < reps; r++)
+                k.float_to_half(in, half, n);
+            t = getTimeInNanoseconds() - t;
+            printf("  %-12s: %8.4f Gpix/s, %i mismatches\n", "float->half", (double) n / 4 * reps / (double) t, mismatch);
+
+            for (i = 0; i < 65536; i++)
+                half[i] = (uint16_t) i;
+            k.half_to_float(half, out, 65536);
+            mismatch = 0;
+            for (i = 0; i < 65536; i++) {
+                float reff = tf_half_to_float_ref(half[i]);
+                if (memcmp(&out[i], &reff, sizeof(float)))
+                    mismatch++;
+            }
+
+            t = getTimeInNanoseconds();
+            for (r = 0; r < reps; r++)
+                k.half_to_float(half, out, n);
+            t = getTimeInNanoseconds() - t;
+            printf("  %-12s: %8.4f Gpix/s, %i mismatches\n", "half->float", (double) n / 4 * reps / (double) t, mismatch);
         }
     }
 
-    demo_prepare_descriptor_pool(demo);
-    demo_prepare_descriptor_set(demo);
+    printf("\n");
 
-    demo_prepare_framebuffers(demo);
+    free(half);
+    free(ref);
+    free(out);
+    free(in);
+}
 
-    for (uint32_t i = 0; i < demo->swapchainImageCount; i++) {
-        demo->current_buffer = i;
-        demo_draw_build_cmd(demo, demo->swapchain_image_resources[i].cmd);
-    }
+// MK: The old PPM loader, one fread() per pixel, as baseline for the benchmark:
+static bool demo_ppm_load_fread(const char *filename, uint8_t *rgba_data, size_t rowPitch)
+{
+    FILE *fPtr = fopen(filename, "rb");
+    char header[256];
+    int32_t width, height;
 
-    /*
-     * Prepare functions above may generate pipeline commands
-     * that need to be flushed before beginning the render loop.
-     */
-    demo_flush_init_cmd(demo);
-    if (demo->staging_texture.image) {
-        demo_destroy_texture_image(demo, &demo->staging_texture);
+    if (!fPtr)
+        return false;
+
+    if (!fgets(header, 256, fPtr) || strncmp(header, "P6\n", 3) || !fgets(header, 256, fPtr) ||
+        sscanf(header, "%d %d", &width, &height) != 2 || !fgets(header, 256, fPtr)) {
+        fclose(fPtr);
+        return false;
     }
 
-    demo->current_buffer = 0;
-    demo->prepared = true;
+    for (int y = 0; y < height; y++) {
+        uint8_t *rowPtr = rgba_data;
+        for (int x = 0; x < width; x++) {
+            size_t s = fread(rowPtr, 3, 1, fPtr);
+            (void)s;
+            rowPtr[3] = 255; /* Alpha of 1 */
+            rowPtr += 4;
+        }
+        rgba_data += rowPitch;
+    }
+    fclose(fPtr);
+    return true;
 }
 
-static void demo_cleanup(struct demo *demo) {
-    uint32_t i;
+// MK: PPM loader benchmark: Write stimulus sized random PPM's to the temp directory, then
+// load each with the old per pixel fread() loader and with ppm_open() + ppm_copy_rgba() with
+// all SIMD variants, into a destination with a row pitch aligned to 256 bytes, as for linear
+// Vulkan images. Verifies all variants against the old loader, and reports best of a few
+// runs. Files are in the page cache after writing, so this measures warm cache loading:
+static void demo_ppm_benchmark(void)
+{
+    static const int32_t sizes[3][2] = { { 1001, 777 }, { 3840, 2160 }, { 7680, 4320 } };
+    const int reps = 3;
+    char path[512];
+    const char *tmpdir;
+    int s, level, r;
+
+#if defined(_WIN32)
+    tmpdir = getenv("TEMP");
+    if (!tmpdir)
+        tmpdir = ".";
+#else
+    tmpdir = "/tmp";
+#endif
 
-    demo->prepared = false;
-    vkDeviceWaitIdle(demo->device);
+    printf("\nPPM loader, best of %i runs, kernels selected for this cpu: %s\n", reps, ppm_get_kernels().name);
+
+    for (s = 0; s < 3; s++) {
+        int32_t w = sizes[s][0], h = sizes[s][1];
+        size_t pitch = ((size_t) w * 4 + 255) & ~(size_t) 255;
+        size_t rgbsize = (size_t) w * h * 3;
+        uint8_t *rgb = malloc(rgbsize);
+        uint8_t *ref = malloc(pitch * h);
+        uint8_t *out = malloc(pitch * h);
+        uint64_t t, best;
+        uint32_t seed = 12345;
+        size_t i;
+        FILE *f;
+
+        snprintf(path, sizeof(path), "%s/ppmbench-%dx%d.ppm", tmpdir, w, h);
+
+        for (i = 0; i < rgbsize; i++) {
+            seed = seed * 1664525u + 1013904223u;
+            rgb[i] = (uint8_t) (seed >> 24);
+        }
 
-    // Wait for fences from present operations
-    for (i = 0; i < FRAME_LAG; i++) {
-        vkWaitForFences(demo->device, 1, &demo->fences[i], VK_TRUE, UINT64_MAX);
-        vkDestroyFence(demo->device, demo->fences[i], NULL);
-        vkDestroySemaphore(demo->device, demo->image_acquired_semaphores[i], NULL);
-        vkDestroySemaphore(demo->device, demo->draw_complete_semaphores[i], NULL);
-        if (demo->separate_present_queue) {
-            vkDestroySemaphore(demo->device, demo->image_ownership_semaphores[i], NULL);
+        f = fopen(path, "wb");
+        if (!f || fprintf(f, "P6\n%d %d\n255\n", w, h) < 0 || fwrite(rgb, 1, rgbsize, f) != rgbsize) {
+            printf("Could not write %s. Skipped.\n", path);
+            if (f)
+                fclose(f);
+            free(out);
+            free(ref);
+            free(rgb);
+            continue;
         }
-    }
+        fclose(f);
+
+        printf("%d x %d, %.1f MB, row pitch %zu:\n", w, h, rgbsize / 1e6, pitch);
+
+        // Padding between rows must stay untouched:
+        memset(ref, 0, pitch * h);
+        best = UINT64_MAX;
+        for (r = 0; r < reps; r++) {
+            t = getTimeInNanoseconds();
+            demo_ppm_load_fread(path, ref, pitch);
+            t = getTimeInNanoseconds() - t;
+            if (t < best)
+                best = t;
+        }
+        printf("  %-18s: load %8.2f msecs\n", "fread per pixel", best / 1e6);
+
+        for (level = 0; level <= 2; level++) {
+            struct ppm_kernels k = ppm_get_kernels_level(level);
+            struct ppm_image img;
+            uint64_t bestcopy = UINT64_MAX;
+            int mismatch = 0;
+            int32_t y;
+
+            // Lower levels fall back to the same kernel if the cpu lacks support:
+            if (level > 0 && k.rgb_to_rgba == ppm_get_kernels_level(level - 1).rgb_to_rgba)
+                continue;
+
+            memset(out, 0, pitch * h);
+            best = UINT64_MAX;
+            for (r = 0; r < reps; r++) {
+                t = getTimeInNanoseconds();
+                if (!ppm_open(path, &img, true)) {
+                    printf("  %-18s: ppm_open() failed!\n", k.name);
+                    break;
+                }
 
-    for (i = 0; i < demo->swapchainImageCount; i++) {
-        vkDestroyFramebuffer(demo->device, demo->swapchain_image_resources[i].framebuffer, NULL);
-    }
-    vkDestroyDescriptorPool(demo->device, demo->desc_pool, NULL);
+                ppm_copy_rgba(&img, out, pitch, k.rgb_to_rgba);
+                ppm_close(&img);
+                t = getTimeInNanoseconds() - t;
+                if (t < best)
+                    best = t;
+            }
 
-    vkDestroyPipeline(demo->device, demo->pipeline, NULL);
-    vkDestroyPipelineCache(demo->device, demo->pipelineCache, NULL);
-    vkDestroyRenderPass(demo->device, demo->render_pass, NULL);
-    vkDestroyPipelineLayout(demo->device, demo->pipeline_layout, NULL);
-    vkDestroyDescriptorSetLayout(demo->device, demo->desc_layout, NULL);
+            // Expansion alone, from an already populated mapping:
+            if (ppm_open(path, &img, true)) {
+                for (r = 0; r < reps; r++) {
+                    t = getTimeInNanoseconds();
+                    ppm_copy_rgba(&img, out, pitch, k.rgb_to_rgba);
+                    t = getTimeInNanoseconds() - t;
+                    if (t < bestcopy)
+                        bestcopy = t;
+                }
+                ppm_close(&img);
+            }
 
-    for (i = 0; i < DEMO_TEXTURE_COUNT; i++) {
-        vkDestroyImageView(demo->device, demo->textures[i].view, NULL);
-        vkDestroyImage(demo->device, demo->textures[i].image, NULL);
-        vkFreeMemory(demo->device, demo->textures[i].mem, NULL);
-        vkDestroySampler(demo->device, demo->textures[i].sampler, NULL);
-    }
-    demo->fpDestroySwapchainKHR(demo->device, demo->swapchain, NULL);
+            for (y = 0; y < h; y++)
+                if (memcmp(out + y * pitch, ref + y * pitch, pitch))
+                    mismatch++;
 
-    vkDestroyImageView(demo->device, demo->depth.view, NULL);
-    vkDestroyImage(demo->device, demo->depth.image, NULL);
-    vkFreeMemory(demo->device, demo->depth.mem, NULL);
+            printf("  %-18s: load %8.2f msecs, expand %8.2f msecs = %7.3f Gpix/s, %i mismatching rows\n", k.name,
+                   best / 1e6, bestcopy / 1e6, (double) w * h / (double) bestcopy, mismatch);
+        }
 
-    for (i = 0; i < demo->swapchainImageCount; i++) {
-        vkDestroyImageView(demo->device, demo->swapchain_image_resources[i].view, NULL);
-        vkFreeCommandBuffers(demo->device, demo->cmd_pool, 1,
-                             &demo->swapchain_image_resources[i].cmd);
-        vkDestroyBuffer(demo->device, demo->swapchain_image_resources[i].uniform_buffer, NULL);
-        vkFreeMemory(demo->device, demo->swapchain_image_resources[i].uniform_memory, NULL);
-    }
-    free(demo->swapchain_image_resources);
-    free(demo->queue_props);
-    vkDestroyCommandPool(demo->device, demo->cmd_pool, NULL);
+        // What loadTexture() does: Decode into the image cache on a miss, then copy the view to
+        // the destination's row pitch, which is all a hit costs:
+        {
+            struct ppm_view view;
+            uint64_t bestcopy = UINT64_MAX;
+            int mismatch = 0;
+            int32_t y;
+
+            memset(out, 0, pitch * h);
+            best = UINT64_MAX;
+            for (r = 0; r < reps; r++) {
+                ppm_cache_flush();
+                t = getTimeInNanoseconds();
+                if (!ppm_cache_get(path, &view)) {
+                    printf("  %-18s: ppm_cache_get() failed!\n", "image cache");
+                    break;
+                }
 
-    if (demo->separate_present_queue) {
-        vkDestroyCommandPool(demo->device, demo->present_cmd_pool, NULL);
-    }
-    vkDeviceWaitIdle(demo->device);
+                ppm_view_copy(&view, out, pitch);
+                t = getTimeInNanoseconds() - t;
+                if (t < best)
+                    best = t;
+
+                t = getTimeInNanoseconds();
+                if (ppm_cache_get(path, &view))
+                    ppm_view_copy(&view, out, pitch);
+                t = getTimeInNanoseconds() - t;
+                if (t < bestcopy)
+                    bestcopy = t;
+            }
+            ppm_cache_flush();
 
-    // Release display from direct display mode under Linux:
-    PFN_vkReleaseDisplayEXT m_pvkReleaseDisplayEXT = (PFN_vkReleaseDisplayEXT) vkGetInstanceProcAddr(demo->inst, "vkReleaseDisplayEXT" );
-    if (m_pvkReleaseDisplayEXT)
-        m_pvkReleaseDisplayEXT(demo->gpu, demo->vkdisplay);
+            for (y = 0; y < h; y++)
+                if (memcmp(out + y * pitch, ref + y * pitch, pitch))
+                    mismatch++;
 
-    vkDestroyDevice(demo->device, NULL);
-    if (demo->validate) {
-        demo->DestroyDebugReportCallback(demo->inst, demo->msg_callback, NULL);
+            printf("  %-18s: miss %8.2f msecs, hit    %8.2f msecs = %7.3f Gpix/s, %i mismatching rows\n", "image cache",
+                   best / 1e6, bestcopy / 1e6, (double) w * h / (double) bestcopy, mismatch);
+        }
+
+        remove(path);
+        free(out);
+        free(ref);
+        free(rgb);
     }
-    vkDestroySurfaceKHR(demo->inst, demo->surface, NULL);
-    vkDestroyInstance(demo->inst, NULL);
 
-#if defined(VK_USE_PLATFORM_XLIB_KHR)
-    XDestroyWindow(demo->display, demo->xlib_window);
-    XCloseDisplay(demo->display);
-#elif defined(VK_USE_PLATFORM_XCB_KHR) || defined(VK_USE_PLATFORM_DISPLAY_KHR)
-    printf("Bye bye!\n");
-    xcb_disconnect(demo->connection);
-    free(demo->atom_wm_delete_window);
-#elif defined(VK_USE_PLATFORM_WAYLAND_KHR)
-    wl_shell_surface_destroy(demo->shell_surface);
-    wl_surface_destroy(demo->window);
-    wl_shell_destroy(demo->shell);
-    wl_compositor_destroy(demo->compositor);
-    wl_registry_destroy(demo->registry);
-    wl_display_disconnect(demo->display);
-#elif defined(VK_USE_PLATFORM_MIR_KHR)
-#endif
+    printf("\n");
 }
 
-// Forward define:
-static void demo_create_opengl_interop(struct demo* demo);
+// FNV-1a hash of the decoded texels, to keep the known answers short:
+static uint32_t demo_ktx_hash(const uint8_t *data, size_t size)
+{
+    uint32_t h = 2166136261u;
 
-static void demo_resize(struct demo *demo) {
-    uint32_t i;
+    while (size--) {
+        h ^= *data++;
+        h *= 16777619u;
+    }
 
-#if defined(VK_USE_PLATFORM_DISPLAY_KHR)
-    // MK: Not needed for direct display mode:
-    return;
-#endif
+    return h;
+}
 
-    // Don't react to resize until after first initialization.
-    if (!demo->prepared) {
-        return;
+// MK: Known-answer test of the cpu BC7 and BC6H decoders in ktx.h, for fixed blocks of every
+// BC7 mode, also with rotation and index selection, and every BC6H mode, unsigned and signed,
+// transformed or not. Expected texels were decoded by Mesa's BPTC decoder, and are compared by
+// their hash, with texels in little endian byte order:
+static bool demo_ktx_test(void)
+{
+    static const struct {
+        uint8_t block[16];
+        uint32_t hash;
+    } bc7[] = {
+        { { 0x47, 0x1a, 0x49, 0xe2, 0xd9, 0xe7, 0x18, 0x40, 0xfa, 0xe0, 0x20, 0xb6, 0xdd, 0x74, 0x7b, 0x73 }, 0x87af4302 }, // Mode 0
+        { { 0xca, 0xd8, 0x7a, 0xcc, 0x51, 0x4c, 0x4f, 0xc8, 0x53, 0xbf, 0x5c, 0x80, 0x8f, 0x9a, 0x4c, 0x34 }, 0x36c03eb1 }, // Mode 1
+        { { 0x54, 0x85, 0x58, 0x14, 0x75, 0x83, 0x59, 0x21, 0x9a, 0xaf, 0x93, 0xb9, 0xb9, 0x72, 0x54, 0x96 }, 0x98ff61b6 }, // Mode 2
+        { { 0x38, 0x0b, 0xd3, 0x65, 0xc9, 0xb0, 0xea, 0x3a, 0x84, 0xb0, 0x9c, 0x7b, 0x48, 0x4f, 0x7e, 0x1f }, 0x8bf41561 }, // Mode 3
+        { { 0xb0, 0x52, 0x69, 0x3f, 0x0a, 0x68, 0x26, 0x64, 0x84, 0xe8, 0xe4, 0x1d, 0xae, 0xa0, 0xaf, 0xa4 }, 0x2da46385 }, // Mode 4, rotation 1, index selection
+        { { 0x60, 0x97, 0x3c, 0xc2, 0xc0, 0x08, 0xb8, 0x2d, 0x5c, 0xfb, 0x81, 0x00, 0x6e, 0x42, 0xda, 0x1a }, 0xde0f3556 }, // Mode 5, rotation 1
+        { { 0x40, 0xb6, 0x19, 0x85, 0xcd, 0x00, 0xdf, 0x27, 0xaa, 0x53, 0x40, 0x61, 0xad, 0xce, 0x0d, 0x66 }, 0xc1bc9bf6 }, // Mode 6
+        { { 0x80, 0x7c, 0x93, 0x5f, 0xfe, 0x28, 0x7d, 0xba, 0x7b, 0x76, 0xb8, 0x29, 0xc3, 0xec, 0x83, 0x2a }, 0xb8073768 }, // Mode 7
+        { { 0x50, 0xf8, 0x09, 0x3d, 0x99, 0x0c, 0x29, 0xfa, 0xdb, 0x4f, 0x58, 0xba, 0xc9, 0xa0, 0xb4, 0x9b }, 0xc65403c3 }, // Mode 4, rotation 2, no index selection
+        { { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, 0xdfde6ac5 }, // Reserved
+    }, bc6h[2][14] = {
+        {
+            { { 0xb4, 0xcb, 0xbc, 0xee, 0xee, 0x3b, 0x3f, 0x6c, 0x64, 0x87, 0x75, 0xc3, 0x2b, 0x9b, 0x62, 0x49 }, 0xf79e73af }, // Unsigned mode 1, code 0x00
+            { { 0xbd, 0x76, 0xdc, 0xf3, 0xea, 0x9e, 0xed, 0xe2, 0xcf, 0xcd, 0x61, 0x0f, 0x37, 0x8d, 0xae, 0xf5 }, 0x15e28171 }, // Unsigned mode 2, code 0x01
+            { { 0x42, 0xac, 0x9c, 0x53, 0xa1, 0xbe, 0x49, 0x43, 0x81, 0x2a, 0x71, 0x51, 0xaf, 0x72, 0x23, 0x61 }, 0x0e964233 }, // Unsigned mode 3, code 0x02
+            { { 0xa6, 0xa1, 0x3c, 0x66, 0xe3, 0x1d, 0x59, 0x5b, 0x20, 0x52, 0x15, 0xfc, 0x53, 0xe4, 0xc9, 0x1c }, 0xce5526f8 }, // Unsigned mode 4, code 0x06
+            { { 0xea, 0x59, 0x1f, 0xa7, 0xca, 0x80, 0x2a, 0xb0, 0x1e, 0xf0, 0xe6, 0x09, 0x7b, 0x67, 0x35, 0x54 }, 0xdc77fb93 }, // Unsigned mode 5, code 0x0a
+            { { 0x0e, 0xfc, 0xd5, 0x87, 0x4a, 0x44, 0xdd, 0x50, 0x4c, 0xf8, 0xb3, 0xd1, 0x9c, 0xc2, 0x98, 0xa8 }, 0xf592cf26 }, // Unsigned mode 6, code 0x0e
+            { { 0xf2, 0x21, 0x32, 0x38, 0xc0, 0xa9, 0xb6, 0x9d, 0x6a, 0xfb, 0x94, 0xd5, 0xe1, 0x44, 0xcd, 0xf6 }, 0xf97e0174 }, // Unsigned mode 7, code 0x12
+            { { 0x36, 0x21, 0x58, 0x7f, 0x87, 0x23, 0x2f, 0x23, 0xb6, 0x6e, 0xfa, 0x93, 0xb4, 0x1d, 0x6f, 0x2a }, 0xce430b3e }, // Unsigned mode 8, code 0x16
+            { { 0xfa, 0x67, 0xc9, 0x86, 0x81, 0xaf, 0x03, 0x64, 0x7b, 0x03, 0xbf, 0x52, 0x55, 0xa8, 0xe3, 0x0f }, 0xcad3fcfb }, // Unsigned mode 9, code 0x1a
+            { { 0xde, 0xbd, 0x78, 0xa8, 0xaa, 0x1d, 0x46, 0xaa, 0xa4, 0xf4, 0x32, 0xf8, 0x62, 0xbd, 0x6b, 0x22 }, 0x700d47f3 }, // Unsigned mode 10, code 0x1e, untransformed
+            { { 0xe3, 0xa0, 0xd9, 0x46, 0xaa, 0x62, 0x6d, 0xd5, 0x48, 0x54, 0x2d, 0xd3, 0x70, 0x03, 0x33, 0x5c }, 0x360b43e0 }, // Unsigned mode 11, code 0x03, untransformed
+            { { 0x87, 0x8f, 0xef, 0x91, 0x63, 0xe9, 0x62, 0x2e, 0x3f, 0x60, 0x23, 0x6d, 0x91, 0x3e, 0x67, 0x08 }, 0x38f1f227 }, // Unsigned mode 12, code 0x07
+            { { 0x6b, 0x59, 0x5e, 0x61, 0x81, 0xe2, 0x92, 0x33, 0xae, 0xce, 0x2c, 0x5c, 0xee, 0x9d, 0x3d, 0x8e }, 0x0f771705 }, // Unsigned mode 13, code 0x0b
+            { { 0x2f, 0x6d, 0x79, 0xfd, 0x0a, 0x92, 0x01, 0x6c, 0x97, 0x1d, 0x1a, 0x12, 0x50, 0x0f, 0x07, 0x46 }, 0x2fb1c01d }, // Unsigned mode 14, code 0x0f
+        },
+        {
+            { { 0x50, 0x2f, 0x56, 0xf3, 0xed, 0xa4, 0x56, 0x36, 0x6d, 0xe4, 0x89, 0xa9, 0xb2, 0x90, 0x44, 0x48 }, 0x4d4882bb }, // Signed mode 1, code 0x00
+            { { 0x5d, 0x40, 0xd7, 0xe3, 0x96, 0x78, 0xeb, 0x96, 0x9e, 0x27, 0xea, 0xbb, 0xd1, 0x76, 0xb0, 0x3a }, 0x098aaa1e }, // Signed mode 2, code 0x01
+            { { 0xc2, 0xd5, 0xc3, 0x4f, 0x7a, 0x72, 0xdf, 0x09, 0x29, 0x9e, 0x99, 0x28, 0xbe, 0xc9, 0x51, 0x23 }, 0xf4776f71 }, // Signed mode 3, code 0x02
+            { { 0x26, 0x03, 0xcd, 0x6d, 0xa7, 0x4d, 0x26, 0x51, 0x29, 0x10, 0xe8, 0xef, 0x6b, 0x8a, 0x8c, 0x37 }, 0x9901af59 }, // Signed mode 4, code 0x06
+            { { 0x4a, 0xc8, 0x24, 0xfb, 0x7d, 0x18, 0x02, 0xb7, 0xf4, 0xfe, 0xee, 0xea, 0x9a, 0x38, 0x8a, 0x83 }, 0xe3dffdc1 }, // Signed mode 5, code 0x0a
+            { { 0xae, 0xb3, 0xa8, 0x20, 0x00, 0x35, 0x0d, 0x55, 0x9c, 0xaa, 0x58, 0x9d, 0xfb, 0x40, 0x5c, 0x58 }, 0xa184fb5e }, // Signed mode 6, code 0x0e
+            { { 0xb2, 0xce, 0x20, 0x4b, 0xf6, 0xe6, 0x9e, 0xdf, 0x13, 0x9d, 0xf9, 0xa0, 0xe8, 0xd7, 0x69, 0xb9 }, 0xb0c2220f }, // Signed mode 7, code 0x12
+            { { 0xb6, 0xfd, 0x2a, 0xa2, 0xb8, 0x53, 0x1f, 0x2d, 0xa4, 0x63, 0x09, 0xac, 0x51, 0x35, 0x76, 0xe6 }, 0x9d6fb735 }, // Signed mode 8, code 0x16
+            { { 0x9a, 0x3f, 0xcc, 0x02, 0x4b, 0x4c, 0x13, 0xb4, 0xff, 0xc3, 0x67, 0x3d, 0x1a, 0x09, 0x2e, 0x1c }, 0xccd989b8 }, // Signed mode 9, code 0x1a
+            { { 0xfe, 0xf3, 0x7e, 0x7c, 0xd3, 0x75, 0x4f, 0xb3, 0x72, 0x0a, 0x66, 0x6d, 0x85, 0x80, 0x15, 0x4d }, 0x2daa9da5 }, // Signed mode 10, code 0x1e, untransformed
+            { { 0xe3, 0x2a, 0x36, 0x23, 0x19, 0x98, 0x0d, 0xfe, 0x7a, 0x5f, 0xe5, 0xbe, 0xc9, 0x94, 0x9d, 0xe7 }, 0xf6b6e1e7 }, // Signed mode 11, code 0x03, untransformed
+            { { 0xa7, 0xf5, 0x7d, 0xde, 0x23, 0xf3, 0xfb, 0xd2, 0x50, 0x14, 0x59, 0xee, 0x9f, 0x5d, 0x35, 0xa6 }, 0x75c7c975 }, // Signed mode 12, code 0x07
+            { { 0x8b, 0xb8, 0x79, 0x36, 0xc1, 0x8a, 0x4b, 0xa1, 0x7f, 0xf2, 0xdf, 0xc6, 0xd2, 0x60, 0x57, 0x68 }, 0x7060ad28 }, // Signed mode 13, code 0x0b
+            { { 0xef, 0x04, 0xf1, 0xf6, 0xde, 0xff, 0x8e, 0xc1, 0xdb, 0x0d, 0x39, 0xe0, 0x68, 0xe3, 0xc6, 0x47 }, 0xe8544188 }, // Signed mode 14, code 0x0f
+        },
+    };
+    uint8_t texels[16][4];
+    uint16_t half_texels[16][4];
+    uint8_t bytes[16 * 4 * 2];
+    int errors = 0;
+    int i, s, r;
+    uint32_t h;
+    uint64_t t;
+    const int reps = 10000;
+
+    for (i = 0; i < (int) (sizeof(bc7) / sizeof(bc7[0])); i++) {
+        ktx_decode_bc7_block(bc7[i].block, texels);
+        h = demo_ktx_hash(&texels[0][0], sizeof(texels));
+        if (h != bc7[i].hash) {
+            printf("KTX test FAILED: BC7 block %i, mode byte 0x%02x, hash 0x%08x instead of 0x%08x.\n",
+                   i, bc7[i].block[0], h, bc7[i].hash);
+            errors++;
+        }
     }
-    // In order to properly resize the window, we must re-create the swapchain
-    // AND redo the command buffers, etc.
-    //
-    // First, perform part of the demo_cleanup() function:
-    demo->prepared = false;
-    vkDeviceWaitIdle(demo->device);
 
-    for (i = 0; i < demo->swapchainImageCount; i++) {
-        vkDestroyFramebuffer(demo->device, demo->swapchain_image_resources[i].framebuffer, NULL);
+    for (s = 0; s < 2; s++) {
+        for (i = 0; i < 14; i++) {
+            ktx_decode_bc6h_block(bc6h[s][i].block, s, half_texels);
+            for (r = 0; r < 16 * 4; r++) {
+                bytes[2 * r] = (uint8_t) ((&half_texels[0][0])[r] & 0xff);
+                bytes[2 * r + 1] = (uint8_t) ((&half_texels[0][0])[r] >> 8);
+            }
+
+            h = demo_ktx_hash(bytes, sizeof(bytes));
+            if (h != bc6h[s][i].hash) {
+                printf("KTX test FAILED: BC6H %s mode %i, hash 0x%08x instead of 0x%08x.\n",
+                       (s) ? "signed" : "unsigned", i + 1, h, bc6h[s][i].hash);
+                errors++;
+            }
+        }
     }
-    vkDestroyDescriptorPool(demo->device, demo->desc_pool, NULL);
 
-    vkDestroyPipeline(demo->device, demo->pipeline, NULL);
-    vkDestroyPipelineCache(demo->device, demo->pipelineCache, NULL);
-    vkDestroyRenderPass(demo->device, demo->render_pass, NULL);
-    vkDestroyPipelineLayout(demo->device, demo->pipeline_layout, NULL);
-    vkDestroyDescriptorSetLayout(demo->device, demo->desc_layout, NULL);
+    t = getTimeInNanoseconds();
+    for (r = 0; r < reps; r++) {
+        for (i = 0; i < 8; i++)
+            ktx_decode_bc7_block(bc7[i].block, texels);
+    }
+    t = getTimeInNanoseconds() - t;
+    printf("BC7 decode of one 4x4 block takes %f usecs.\n", (double) t / (reps * 8) / 1000.0);
 
-    for (i = 0; i < DEMO_TEXTURE_COUNT; i++) {
-        vkDestroyImageView(demo->device, demo->textures[i].view, NULL);
-        vkDestroyImage(demo->device, demo->textures[i].image, NULL);
-        vkFreeMemory(demo->device, demo->textures[i].mem, NULL);
-        vkDestroySampler(demo->device, demo->textures[i].sampler, NULL);
+    t = getTimeInNanoseconds();
+    for (r = 0; r < reps; r++) {
+        for (i = 0; i < 14; i++)
+            ktx_decode_bc6h_block(bc6h[r & 1][i].block, r & 1, half_texels);
     }
+    t = getTimeInNanoseconds() - t;
+    printf("BC6H decode of one 4x4 block takes %f usecs.\n", (double) t / (reps * 14) / 1000.0);
 
-    vkDestroyImageView(demo->device, demo->depth.view, NULL);
-    vkDestroyImage(demo->device, demo->depth.image, NULL);
-    vkFreeMemory(demo->device, demo->depth.mem, NULL);
+    printf("KTX test %s, %i errors.\n", errors ? "FAILED" : "passed", errors);
 
-    for (i = 0; i < demo->swapchainImageCount; i++) {
-        vkDestroyImageView(demo->device, demo->swapchain_image_resources[i].view, NULL);
-        vkFreeCommandBuffers(demo->device, demo->cmd_pool, 1,
-                             &demo->swapchain_image_resources[i].cmd);
-        vkDestroyBuffer(demo->device, demo->swapchain_image_resources[i].uniform_buffer, NULL);
-        vkFreeMemory(demo->device, demo->swapchain_image_resources[i].uniform_memory, NULL);
+    return errors == 0;
+}
+
+// MK: Get the display's EDID, from the --edid file, the RandR output property, if
+// already fetched while selecting the output, or from the kernel's DRM connectors:
+static void demo_read_edid(struct demo *demo) {
+    uint64_t t0 = getTimeInNanoseconds();
+
+    if (demo->edid_path[0]) {
+        demo->edid_len = edid_read_file(demo->edid_path, demo->edid_data, sizeof(demo->edid_data));
+        if (!demo->edid_len)
+            printf("Could not read EDID from file %s.\n", demo->edid_path);
     }
-    vkDestroyCommandPool(demo->device, demo->cmd_pool, NULL);
-    if (demo->separate_present_queue) {
-        vkDestroyCommandPool(demo->device, demo->present_cmd_pool, NULL);
+
+#if defined(__linux__)
+    // sysfs connector names like card0-DP-1 don't match RandR names like DisplayPort-0,
+    // so only the first connected display is a safe guess if no output was selected:
+    if (!demo->edid_len && !demo->edid_path[0])
+        demo->edid_len = edid_read_sysfs(demo->output_name, demo->edid_data, sizeof(demo->edid_data));
+#endif
+
+    if (demo->edid_len && !edid_parse(demo->edid_data, demo->edid_len, &demo->edid)) {
+        printf("Invalid EDID ignored.\n");
+        demo->edid_len = 0;
     }
-    free(demo->swapchain_image_resources);
 
-    // Second, re-perform the demo_prepare() function, which will re-create the
-    // swapchain:
-    demo_prepare(demo);
+    if (!demo->edid_len) {
+        memset(&demo->edid, 0, sizeof(demo->edid));
+        printf("No EDID available, relying on the driver for display properties.\n");
+        return;
+    }
 
-    // Renitialize OpenGL side of OpenGL->Vulkan interop.
-    demo_create_opengl_interop(demo);
+    printf("Display properties from %zu bytes of EDID, parsed in %f msecs:\n", demo->edid_len,
+           (getTimeInNanoseconds() - t0) / 1e6);
+    edid_print(&demo->edid);
 }
 
-// Simulated OpenGL rendering code -- would correspond to PTB user drawing code:
-void draw_jesse(struct demo* demo)
-{
-    // Draw Jesse the cat - i assume?
-    static bool firsttime = true;
-
-    float maxL = (demo->nativeDisplayHdrMetadata.maxLuminance > 0.0) ? demo->nativeDisplayHdrMetadata.maxLuminance : 600;
+// MK: Override display properties reported by the driver with the ones from the
+// EDID, where they are missing or differ beyond the EDID's precision:
+static void demo_apply_edid(struct demo *demo) {
+    VkHdrMetadataEXT *native = &demo->nativeDisplayHdrMetadata;
+    const struct edid_info *edid = &demo->edid;
+    const float *edid_xy[4] = { edid->red, edid->green, edid->blue, edid->white };
+    VkXYColorEXT *native_xy[4] = { &native->displayPrimaryRed, &native->displayPrimaryGreen,
+                                   &native->displayPrimaryBlue, &native->whitePoint };
+    const char *names[4] = { "R", "G", "B", "WP" };
+    int i;
 
-    if (firsttime) {
-        firsttime = false;
+    if (!demo->edid_len)
+        return;
 
-        // Default background color to maxFALL:
-        if (demo->rgb[0] == -1 && demo->nativeDisplayHdrMetadata.maxFrameAverageLightLevel > 0.0)
-            demo->rgb[0] = demo->nativeDisplayHdrMetadata.maxFrameAverageLightLevel;
+    // Chromaticities have 10 bits of precision, all zero if undefined:
+    if (edid->white[0] > 0 && edid->white[1] > 0) {
+        for (i = 0; i < 4; i++) {
+            if (fabsf(native_xy[i]->x - edid_xy[i][0]) > 1.0f / 1024 ||
+                fabsf(native_xy[i]->y - edid_xy[i][1]) > 1.0f / 1024) {
+                printf("EDID overrides driver gamut %s: [%f, %f] -> [%f, %f]\n", names[i],
+                       native_xy[i]->x, native_xy[i]->y, edid_xy[i][0], edid_xy[i][1]);
+                native_xy[i]->x = edid_xy[i][0];
+                native_xy[i]->y = edid_xy[i][1];
+            }
+        }
+    }
 
-        if (demo->rgb[1] == -1 && demo->nativeDisplayHdrMetadata.maxFrameAverageLightLevel > 0.0)
-            demo->rgb[1] = demo->nativeDisplayHdrMetadata.maxFrameAverageLightLevel;
+    // Max luminances are coded in steps of ~2%:
+    if (edid->max_luminance > 0 && fabsf(native->maxLuminance - edid->max_luminance) > 0.03f * edid->max_luminance) {
+        printf("EDID overrides driver maxLuminance: %f -> %f nits\n", native->maxLuminance, edid->max_luminance);
+        native->maxLuminance = edid->max_luminance;
+    }
 
-        if (demo->rgb[2] == -1 && demo->nativeDisplayHdrMetadata.maxFrameAverageLightLevel > 0.0)
-            demo->rgb[2] = demo->nativeDisplayHdrMetadata.maxFrameAverageLightLevel;
+    if (edid->max_fall > 0 && fabsf(native->maxFrameAverageLightLevel - edid->max_fall) > 0.03f * edid->max_fall) {
+        printf("EDID overrides driver maxFrameAverageLightLevel: %f -> %f nits\n", native->maxFrameAverageLightLevel, edid->max_fall);
+        native->maxFrameAverageLightLevel = edid->max_fall;
+    }
 
-        // Set maxL to, well, maxL. Set maxFALL to a weighted average of input rgb, because most of
-        // the content is background color, and the 10% of Jesse are a bit "who cares?":
-        setHdrMetadata(demo, maxL, 0.2126 * demo->rgb[0] + 0.7152 * demo->rgb[1] + 0.0722 * demo->rgb[2]);
+    // Min luminance is printed with 3 decimals by most tools, so allow for that:
+    if (edid->min_luminance > 0 && fabsf(native->minLuminance - edid->min_luminance) > 0.01f * edid->min_luminance + 0.0005f) {
+        printf("EDID overrides driver minLuminance: %f -> %f nits\n", native->minLuminance, edid->min_luminance);
+        native->minLuminance = edid->min_luminance;
     }
+}
 
-    // Background in user-specified R, G, B:
-    glClearColor(demo->rgb[0], demo->rgb[1], demo->rgb[2], 1.0);
-    glClear(GL_COLOR_BUFFER_BIT);
+// MK: EDID of the Samsung C27HG70 HDR monitor, rebuilt from the decoded dump in
+// Samsung_C27HG70HDR-edid.txt: Base block, and a CTA-861 extension with the data
+// blocks listed there. The vendor specific data block payload isn't in the dump,
+// so it is filler, as are the detailed timings of the extension. Checksums are
+// computed, so they differ from the ones in the dump:
+static void demo_edid_samsung_c27hg70(uint8_t *edid)
+{
+    static const uint8_t base[] = {
+        0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00,     // Header.
+        0x4c, 0x2d, 0x16, 0x0e, 0x52, 0x34, 0x57, 0x43,     // SAM, model e16, serial 1129788498.
+        0x00, 0x1c, 0x01, 0x04,                             // Week, year (filler), EDID 1.4.
+        0xb5, 0x3c, 0x22, 0x78, 0x3b,                       // DisplayPort 10 bpc, 60 x 34 cm, gamma 2.2, features.
+        0x49, 0x35,                                         // Chromaticity low bits: R, G, B, W.
+        0xad, 0x51, 0x46, 0xa9, 0x27, 0x0f, 0x50, 0x54,     // Chromaticity high bits.
+    };
+    static const uint8_t descriptors[] = {
+        // 2560x1440 at 143 Hz:
+        0x22, 0xe5, 0x00, 0x50, 0xa0, 0xa0, 0x67, 0x50, 0x08, 0x20, 0xf8, 0x0c, 0x56, 0x50, 0x21, 0x00, 0x00, 0x1a,
+        // Range limits 48 - 144 Hz, 223 kHz, 590 MHz:
+        0x00, 0x00, 0x00, 0xfd, 0x00, 0x30, 0x90, 0xdf, 0xdf, 0x3b, 0x00, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20,
+        // Monitor name:
+        0x00, 0x00, 0x00, 0xfc, 0x00, 'C', '2', '7', 'H', 'G', '7', 'x', 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20,
+        // Serial number:
+        0x00, 0x00, 0x00, 0xff, 0x00, 'H', '4', 'Z', 'M', 'C', '0', '0', '0', '1', '0', 0x0a, 0x20, 0x20,
+    };
+    static const uint8_t cta[] = {
+        0x02, 0x03, 0x2e, 0xf1,                             // CTA-861 rev 3, 42 bytes of data blocks.
+        0x48, 0x90, 0x1f, 0x04, 0x13, 0x03, 0x12, 0x3f, 0x40, // Video: VIC 16 (native), 31, 4, 19, 3, 18, 63, 64.
+        0x23, 0x09, 0x07, 0x07,                             // Audio: LPCM 2 channels, 48/44.1/32 kHz, 24/20/16 bit.
+        0x83, 0x01, 0x00, 0x00,                             // Speakers: FL/FR.
+        0xe3, 0x05, 0xc0, 0x00,                             // Colorimetry: BT2020YCC, BT2020RGB.
+        0x6d, 0x1a, 0x00, 0x00, 0x02, 0x01, 0x30, 0x90,     // Vendor specific, OUI 00001a, filler.
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0xe6, 0x06, 0x05, 0x01, 0x73, 0x5a, 0x17,           // HDR static metadata: SDR, ST2084, type 1, 115, 90, 23.
+    };
+    uint8_t sum;
+    int b, i;
 
-    // Map max intensity r, g, b in the cat picture to maxL nits:
-    glColor3f(maxL, maxL, maxL);
+    memset(edid, 0, 2 * EDID_BLOCK_SIZE);
+    memcpy(edid, base, sizeof(base));
+    memcpy(edid + 54, descriptors, sizeof(descriptors));
+    edid[126] = 1;
+    memcpy(edid + EDID_BLOCK_SIZE, cta, sizeof(cta));
 
-    // Draw some rotating square into the center, textured with the cat pic:
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
+    for (b = 0; b < 2; b++) {
+        for (sum = 0, i = 0; i < EDID_BLOCK_SIZE - 1; i++)
+            sum += edid[b * EDID_BLOCK_SIZE + i];
+        edid[b * EDID_BLOCK_SIZE + 127] = (uint8_t) -sum;
+    }
+}
+
+// MK: EDID parser self test: Parse the Samsung C27HG70 EDID, in binary and as xrandr
+// style hex dump, and check against the values decoded by edid-decode, as listed in
+// Samsung_C27HG70HDR-edid.txt, then time the parsing. Returns true on success:
+static bool demo_edid_test(struct demo *demo)
+{
+    uint8_t edid[2 * EDID_BLOCK_SIZE];
+    uint8_t hex_edid[EDID_MAX_SIZE];
+    char hex[16 + 2 * EDID_BLOCK_SIZE * 4];
+    struct edid_info info;
+    int errors = 0;
+    int i, n = 0;
+    uint64_t t;
+    const int reps = 10000;
+
+    #define EDID_CHECK(cond) do { if (!(cond)) { printf("EDID test FAILED: %s\n", #cond); errors++; } } while (0)
+
+    demo_edid_samsung_c27hg70(edid);
+
+    EDID_CHECK(edid_parse(edid, sizeof(edid), &info));
+    edid_print(&info);
+
+    EDID_CHECK(!strcmp(info.vendor, "SAM"));
+    EDID_CHECK(info.product == 0x0e16);
+    EDID_CHECK(info.serial == 1129788498);
+    EDID_CHECK(!strcmp(info.name, "C27HG7x"));
+    EDID_CHECK(info.version == 1 && info.revision == 4);
+    EDID_CHECK(info.bpc == 10);
+    EDID_CHECK(info.extensions == 1);
+    EDID_CHECK(info.checksum_ok);
+
+    // edid-decode prints the chromaticity truncated to 4 decimals:
+    EDID_CHECK(fabsf(info.red[0] - 0.6767f) < 0.0001f && fabsf(info.red[1] - 0.3164f) < 0.0001f);
+    EDID_CHECK(fabsf(info.green[0] - 0.2753f) < 0.0001f && fabsf(info.green[1] - 0.6611f) < 0.0001f);
+    EDID_CHECK(fabsf(info.blue[0] - 0.1523f) < 0.0001f && fabsf(info.blue[1] - 0.0615f) < 0.0001f);
+    EDID_CHECK(fabsf(info.white[0] - 0.3134f) < 0.0001f && fabsf(info.white[1] - 0.3291f) < 0.0001f);
+
+    EDID_CHECK(info.has_colorimetry);
+    EDID_CHECK(info.colorimetry == (EDID_COLORIMETRY_BT2020_RGB | EDID_COLORIMETRY_BT2020_YCC));
+
+    EDID_CHECK(info.has_hdr);
+    EDID_CHECK(info.eotfs == (EDID_EOTF_SDR | EDID_EOTF_ST2084));
+    EDID_CHECK(info.metadata_types == 1);
+    EDID_CHECK(fabsf(info.max_luminance - 603.666f) < 0.001f);
+    EDID_CHECK(fabsf(info.max_fall - 351.250f) < 0.001f);
+    EDID_CHECK(fabsf(info.min_luminance - 0.049f) < 0.0005f);
+
+    // Corrupted checksum is detected, but doesn't prevent parsing:
+    edid[EDID_BLOCK_SIZE + 10] ^= 0xff;
+    EDID_CHECK(edid_parse(edid, sizeof(edid), &info) && !info.checksum_ok && info.max_luminance > 600);
+    edid[EDID_BLOCK_SIZE + 10] ^= 0xff;
+
+    // Base block only, e.g., truncated read:
+    EDID_CHECK(edid_parse(edid, EDID_BLOCK_SIZE, &info) && !info.has_hdr && info.bpc == 10);
+
+    // Not an EDID:
+    EDID_CHECK(!edid_parse(edid + 1, sizeof(edid) - 1, &info));
+
+    // Hex dump as printed by xrandr --verbose:
+    n = sprintf(hex, "\tEDID: \n");
+    for (i = 0; i < (int) sizeof(edid); i++)
+        n += sprintf(hex + n, "%s%02x%s", (i % 16) ? "" : "\t\t", edid[i], (i % 16 == 15) ? "\n" : "");
+    n = (int) edid_from_hex(hex, n, hex_edid, sizeof(hex_edid));
+    EDID_CHECK(n >= (int) sizeof(edid) + 1 && !memcmp(hex_edid + n - sizeof(edid), edid, sizeof(edid)));
+
+    t = getTimeInNanoseconds();
+    for (i = 0; i < reps; i++)
+        edid_parse(edid, sizeof(edid), &info);
+    t = getTimeInNanoseconds() - t;
+
+    #undef EDID_CHECK
+
+    printf("EDID parse of %i bytes takes %f usecs.\n", (int) sizeof(edid), (double) t / reps / 1000.0);
+    printf("EDID test %s, %i errors.\n", errors ? "FAILED" : "passed", errors);
+
+    // Also parse the EDID of the display, if one is available:
+    if (demo->edid_path[0] || !demo->output_name[0]) {
+        printf("\n");
+        demo_read_edid(demo);
+    }
+
+    return errors == 0;
+}
 
-    glTranslatef(demo->tx, demo->ty, 0.0);
-    glRotatef((float)(demo->curFrame % 360), 0, 0, 1);
-    glScalef(0.15, 0.15, 1);
+// Load image again, this time into the backing store of the GL_TEXTURE_2D
+// default binding 0 of the current context -- Yes, old school like it's 1992!
+// MK: Upload the decoded image from the image cache, which the Vulkan textures already
+// loaded it into, at the cache's row pitch:
+static void demo_upload_client_texture(void)
+{
+    const char* filename = tex_files[0];
+    struct ppm_view view;
 
-    glEnable(GL_TEXTURE_2D);
-    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    demo_lock_image_cache();
 
-    glBegin(GL_QUADS);
-    glTexCoord2f(0.0, 0.0);
-    glVertex2f(-1.0, -1.0);
-    glTexCoord2f(1.0, 0.0);
-    glVertex2f(1.0, -1.0);
-    glTexCoord2f(1.0, 1.0);
-    glVertex2f(1.0, 1.0);
-    glTexCoord2f(0.0, 1.0);
-    glVertex2f(-1.0, 1.0);
-    glEnd();
+    if (!ppm_cache_get(filename, &view)) {
+        demo_unlock_image_cache();
+        fprintf(stderr, "Error loading texture: %s\n", filename);
+        return;
+    }
 
-    glDisable(GL_TEXTURE_2D);
+    // glTexImage2D() copies from client memory before it returns:
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, (GLint) (view.rowPitch / 4));
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, view.width, view.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, view.pixels);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+    demo_unlock_image_cache();
 }
 
-void draw_centerpatch(struct demo* demo, bool flash, bool move)
+#if defined(VK_USE_PLATFORM_DISPLAY_KHR)
+// MK: Import the Vulkan exported DMA-BUF as EGLImage and use it as storage of demo->color.
+// EGL gets the DRM format modifier chosen by the Vulkan driver, and the layout of each
+// memory plane, so the GL sees the exact same (possibly tiled or compressed) layout:
+static void demo_import_dmabuf_texture(struct demo* demo)
 {
-    // Draw a RGB patch filling the center 10% of the display:
-    static bool firsttime = true;
+    PFNEGLCREATEIMAGEKHRPROC eglCreateImageKHR = (PFNEGLCREATEIMAGEKHRPROC) eglGetProcAddress("eglCreateImageKHR");
+    PFNGLEGLIMAGETARGETTEXSTORAGEEXTPROC glEGLImageTargetTexStorageEXT = (PFNGLEGLIMAGETARGETTEXSTORAGEEXTPROC) eglGetProcAddress("glEGLImageTargetTexStorageEXT");
+    PFNGLEGLIMAGETARGETTEXTURE2DOESPROC glEGLImageTargetTexture2DOES = (PFNGLEGLIMAGETARGETTEXTURE2DOESPROC) eglGetProcAddress("glEGLImageTargetTexture2DOES");
+    const EGLint plane_attribs[4][5] = {
+        { EGL_DMA_BUF_PLANE0_FD_EXT, EGL_DMA_BUF_PLANE0_OFFSET_EXT, EGL_DMA_BUF_PLANE0_PITCH_EXT,
+          EGL_DMA_BUF_PLANE0_MODIFIER_LO_EXT, EGL_DMA_BUF_PLANE0_MODIFIER_HI_EXT },
+        { EGL_DMA_BUF_PLANE1_FD_EXT, EGL_DMA_BUF_PLANE1_OFFSET_EXT, EGL_DMA_BUF_PLANE1_PITCH_EXT,
+          EGL_DMA_BUF_PLANE1_MODIFIER_LO_EXT, EGL_DMA_BUF_PLANE1_MODIFIER_HI_EXT },
+        { EGL_DMA_BUF_PLANE2_FD_EXT, EGL_DMA_BUF_PLANE2_OFFSET_EXT, EGL_DMA_BUF_PLANE2_PITCH_EXT,
+          EGL_DMA_BUF_PLANE2_MODIFIER_LO_EXT, EGL_DMA_BUF_PLANE2_MODIFIER_HI_EXT },
+        { EGL_DMA_BUF_PLANE3_FD_EXT, EGL_DMA_BUF_PLANE3_OFFSET_EXT, EGL_DMA_BUF_PLANE3_PITCH_EXT,
+          EGL_DMA_BUF_PLANE3_MODIFIER_LO_EXT, EGL_DMA_BUF_PLANE3_MODIFIER_HI_EXT },
+    };
+    EGLint attribs[7 + 4 * 10 + 1];
+    int n = 0;
+
+    if (!eglCreateImageKHR || (!glEGLImageTargetTexStorageEXT && !glEGLImageTargetTexture2DOES))
+        ERR_EXIT("EGL lacks EGLImage support for DMA-BUF interop.", "DMA-BUF Interop Failure");
+
+    attribs[n++] = EGL_WIDTH;
+    attribs[n++] = demo->textures[0].tex_width;
+    attribs[n++] = EGL_HEIGHT;
+    attribs[n++] = demo->textures[0].tex_height;
+    attribs[n++] = EGL_LINUX_DRM_FOURCC_EXT;
+    attribs[n++] = demo_drm_fourcc(demo->interop_tex_format);
+
+    // All memory planes live in the one exported dma-buf, at different offsets:
+    for (uint32_t i = 0; i < demo->dmabuf_plane_count; i++) {
+        attribs[n++] = plane_attribs[i][0];
+        attribs[n++] = demo->interophandles.memory;
+        attribs[n++] = plane_attribs[i][1];
+        attribs[n++] = (EGLint) demo->dmabuf_planes[i].offset;
+        attribs[n++] = plane_attribs[i][2];
+        attribs[n++] = (EGLint) demo->dmabuf_planes[i].rowPitch;
+        attribs[n++] = plane_attribs[i][3];
+        attribs[n++] = (EGLint) (demo->dmabuf_modifier & 0xffffffff);
+        attribs[n++] = plane_attribs[i][4];
+        attribs[n++] = (EGLint) (demo->dmabuf_modifier >> 32);
+    }
+    attribs[n++] = EGL_NONE;
+
+    demo->egl_image = eglCreateImageKHR(demo->egl_display, EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT, NULL, attribs);
+    if (demo->egl_image == EGL_NO_IMAGE_KHR) {
+        printf("eglCreateImageKHR failed with EGL error 0x%x\n", eglGetError());
+        ERR_EXIT("Could not import DMA-BUF interop image into EGL.", "DMA-BUF Interop Failure");
+    }
+
+    // EGL does not take ownership of the fd, so demo_release_interop_handles() closes it.
+    // Prefer immutable storage, fall back to the OES variant:
+    glBindTexture(GL_TEXTURE_2D, demo->color);
+    if (glEGLImageTargetTexStorageEXT)
+        glEGLImageTargetTexStorageEXT(GL_TEXTURE_2D, demo->egl_image, NULL);
+    else
+        glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, demo->egl_image);
 
-    float maxL = (demo->nativeDisplayHdrMetadata.maxLuminance > 0.0) ? demo->nativeDisplayHdrMetadata.maxLuminance : 600;
+    printf("Interop texture DMA-BUF import size: %i x %i, modifier 0x%" PRIx64 "\n",
+           demo->textures[0].tex_width, demo->textures[0].tex_height, demo->dmabuf_modifier);
 
-    if (firsttime) {
-        firsttime = false;
+    if (glGetError())
+        printf("Stage 3: GL ERROR during EGLImage import!\n");
+}
+#endif
 
-        // Default color to maxLuminance:
-        if (demo->rgb[0] == -1)
-            demo->rgb[0] = maxL;
-        else
-            if (demo->rgb[0] > maxL)
-                maxL = demo->rgb[0];
+static void demo_prepare_opengl_client(struct demo* demo);
 
-        if (demo->rgb[1] == -1)
-            demo->rgb[1] = maxL;
-        else
-            if (demo->rgb[1] > maxL)
-                maxL = demo->rgb[1];
+static void demo_create_opengl_interop(struct demo* demo)
+{
+    GLint tilingMode;
+    GLenum err;
 
-        if (demo->rgb[2] == -1)
-            demo->rgb[2] = maxL;
-        else
-            if (demo->rgb[2] > maxL)
-                maxL = demo->rgb[2];
+    if (!demo->interop_enabled)
+        return;
 
-        // Set maxL to, well, maxL. Set maxFALL to a weighted average of input rgb * 0.1, because only 10% are non-black:
-        setHdrMetadata(demo, maxL, (0.2126 * demo->rgb[0] + 0.7152 * demo->rgb[1] + 0.0722 * demo->rgb[2]) * 0.1);
-    }
+    while (glGetError());
 
-    // Background in black:
-    glClearColor(0, 0, 0, 1.0);
-    glClear(GL_COLOR_BUFFER_BIT);
+    // Create the texture for the FBO color attachment.
+    // This only reserves the ID, it doesn't allocate memory
+    glCreateTextures(GL_TEXTURE_2D, 1, &demo->color);
 
-    // User defined RGB values in nits:
-    if (!flash || ((demo->curFrame % 600) < 200))
-        glColor3f(demo->rgb[0], demo->rgb[1], demo->rgb[2]);
-    else
-        glColor3f(0, 0, 0);
+    // Import semaphores - they don't depend on size, so only once:
+    if (!demo->glReady) {
+        glGenSemaphoresEXT(1, &demo->glReady);
+        glGenSemaphoresEXT(1, &demo->glComplete);
 
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
+        err = glGetError();
+        if (err)
+            printf("Stage 1: GL ERROR: %i\n", err);
 
-    if (move) {
-        float v = ((float)(demo->curFrame % 2000) / 1000.0) - 1.0;
-        glTranslatef(sin(v * 3.1415) * 1.5, sin(v * 3.1415) * 1.5, 0.0);
-    } else {
-        glTranslatef(demo->tx, demo->ty, 0.0);
-    }
+#ifdef WIN32
+        // Platform specific import.  On non-Win32 systems use glImportSemaphoreFdEXT instead
+        //glImportSemaphoreWin32HandleEXT(demo->glReady, GL_HANDLE_TYPE_OPAQUE_WIN32_EXT, demo->interophandles.glReady);
+        //glImportSemaphoreWin32HandleEXT(demo->glComplete, GL_HANDLE_TYPE_OPAQUE_WIN32_EXT, demo->interophandles.glComplete);
+#else
+        int imported = 0;
 
-    // Scale square to cover the center 10% of the display area:
-    glScalef(0.31623, 0.31623, 1);
+        demo_export_interop_semaphores(demo);
 
-    glBegin(GL_QUADS);
-    glVertex2f(-1.0, -1.0);
-    glVertex2f(1.0, -1.0);
-    glVertex2f(1.0, 1.0);
-    glVertex2f(-1.0, 1.0);
-    glEnd();
-}
+        // Successful import transfers fd ownership to the GL. Only import fd's Vulkan actually exported:
+        if (demo->interophandles.glReady >= 0) {
+            glImportSemaphoreFdEXT(demo->glReady, GL_HANDLE_TYPE_OPAQUE_FD_EXT, demo->interophandles.glReady);
+            if (!glGetError()) {
+                demo->interophandles.glReady = -1;
+                imported++;
+            }
+        }
 
-void draw_fullscreen(struct demo* demo, bool flash)
-{
-    // Draw a RGB color filling the whole display:
-    static bool firsttime = true;
+        if (demo->interophandles.glComplete >= 0) {
+            glImportSemaphoreFdEXT(demo->glComplete, GL_HANDLE_TYPE_OPAQUE_FD_EXT, demo->interophandles.glComplete);
+            if (!glGetError()) {
+                demo->interophandles.glComplete = -1;
+                imported++;
+            }
+        }
 
-    float maxFALL = (demo->nativeDisplayHdrMetadata.maxFrameAverageLightLevel > 0.0) ? demo->nativeDisplayHdrMetadata.maxFrameAverageLightLevel : demo->nativeDisplayHdrMetadata.maxLuminance;
-    if (maxFALL == 0)
-        maxFALL = 600.0;
+        // Only sync via semaphores if both made it, otherwise stick to glFinish():
+        demo->interop_semaphores = (imported == 2);
+        if (demo->interop_semaphores)
+            printf("Using OpenGL <-> Vulkan interop semaphores.\n");
+#endif
 
-    if (firsttime) {
-        firsttime = false;
+        err = glGetError();
+        if (err)
+            printf("Stage 2: GL ERROR: %i\n", err);
+    }
 
-        // Default background color to maxFALL:
-        if (demo->rgb[0] == -1)
-            demo->rgb[0] = maxFALL;
+    glBindTexture(GL_TEXTURE_2D, demo->color);
 
-        if (demo->rgb[1] == -1)
-            demo->rgb[1] = maxFALL;
+    // Use the imported memory as backing for the OpenGL texture.  The internalFormat, dimensions
+    // and mip count should match the ones used by Vulkan to create the image and determine it's memory
+    // allocation.
+    GLenum internalFormat = (GLenum)0;
+    switch (demo->interop_tex_format) {
+    case VK_FORMAT_R8G8B8A8_UNORM:
+        internalFormat = GL_RGBA8;
+        printf("OpenGL->Vulkan interop texture is format RGBA8\n");
+        break;
 
-        if (demo->rgb[2] == -1)
-            demo->rgb[2] = maxFALL;
+    case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+        internalFormat = GL_RGB10_A2;
+        printf("OpenGL->Vulkan interop texture is format RGB10A2\n");
+        break;
 
-        maxFALL = (0.2126 * demo->rgb[0] + 0.7152 * demo->rgb[1] + 0.0722 * demo->rgb[2]);
+    case VK_FORMAT_R16G16B16A16_SFLOAT:
+        internalFormat = GL_RGBA16F;
+        printf("OpenGL->Vulkan interop texture is format RGBA16F\n");
+        break;
 
-        // Set maxL and maxFALL to a weighted average of input rgb:
-        setHdrMetadata(demo, maxFALL, maxFALL);
+    default:
+        printf("demo_create_opengl_interop: Invalid texture format!\n");
     }
 
-    if (!flash || ((demo->curFrame % 600) < 200)) {
-        // Background in user specified color:
-        glClearColor(demo->rgb[0], demo->rgb[1], demo->rgb[2], 1.0);
+#if defined(VK_USE_PLATFORM_DISPLAY_KHR)
+    if (demo->use_dmabuf) {
+        // DMA-BUF with driver chosen DRM format modifier, imported via EGLImage:
+        demo_import_dmabuf_texture(demo);
+        demo_release_interop_handles(demo);
     }
-    else {
-        // Background black:
-        glClearColor(0, 0, 0, 1);
+    else
+#endif
+    {
+        // Import memory
+        glCreateMemoryObjectsEXT(1, &demo->mem);
+
+        // Must mark the memory object as dedicated before import, if Vulkan used a dedicated allocation:
+        if (demo->interop_dedicated) {
+            GLint dedicated = GL_TRUE;
+            glMemoryObjectParameterivEXT(demo->mem, GL_DEDICATED_MEMORY_OBJECT_EXT, &dedicated);
+            printf("Importing interop memory as dedicated memory object.\n");
+        }
+
+#ifdef WIN32
+        // Platform specific import.  On non-Win32 systems use glImportMemoryFdEXT instead
+        glImportMemoryWin32HandleEXT(demo->mem, demo->textures[0].mem_alloc.allocationSize, GL_HANDLE_TYPE_OPAQUE_WIN32_EXT, demo->interophandles.memory);
+#else
+        glImportMemoryFdEXT(demo->mem, demo->textures[0].mem_alloc.allocationSize, GL_HANDLE_TYPE_OPAQUE_FD_EXT, demo->interophandles.memory);
+#endif
+
+        err = glGetError();
+        if (err)
+            printf("Stage 3: GL ERROR: %i\n", err);
+#ifndef WIN32
+        else
+            demo->interophandles.memory = -1; // GL owns the fd now.
+#endif
+
+        // Close whatever we still own, GL holds its own references after import:
+        demo_release_interop_handles(demo);
+
+        glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_TILING_EXT, &tilingMode);
+        if (tilingMode == GL_OPTIMAL_TILING_EXT)
+            printf("Initially optimal tiling for shared texture.\n");
+        else if (tilingMode == GL_LINEAR_TILING_EXT)
+            printf("Initially linear tiling for shared texture.\n");
+        else
+            printf("Initially UNKNOWN tiling 0x%x for shared texture!\n", tilingMode);
+
+        glGetInternalformativ(GL_TEXTURE_2D, internalFormat, GL_NUM_TILING_TYPES_EXT, 1, &tilingMode);
+        printf("GL_NUM_TILING_TYPES_EXT %i\n", tilingMode);
+
+        // Set tiling mode for rendering into textures:
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_TILING_EXT, (demo->interop_tiled_texture) ? GL_OPTIMAL_TILING_EXT : GL_LINEAR_TILING_EXT);
+
+        glTextureStorageMem2DEXT(demo->color, 1, internalFormat, demo->textures[0].tex_width, demo->textures[0].tex_height, demo->mem, 0);
+        printf("Interop texture import size: %i x %i\n", demo->textures[0].tex_width, demo->textures[0].tex_height);
+        err = glGetError();
+        if (err)
+            printf("Stage 4: GL ERROR: %i\n", err);
+
+        // Query actual tiling mode of texture:
+        glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_TILING_EXT, &tilingMode);
+        if (tilingMode == GL_OPTIMAL_TILING_EXT)
+            printf("Using optimal tiling for shared texture.\n");
+        else if (tilingMode == GL_LINEAR_TILING_EXT)
+            printf("Using linear tiling for shared texture.\n");
+        else
+            printf("Using UNKNOWN tiling 0x%x for shared texture!\n", tilingMode);
+
+        err = glGetError();
+        if (err)
+            printf("Stage 5: GL ERROR: %i\n", err);
     }
 
-    glClear(GL_COLOR_BUFFER_BIT);
+    // Create destination FBO, attach our imported/Vulkan-shared texture as color
+    // buffer, so we can render-to-texture in OpenGL, present in Vulkan:
+    glCreateFramebuffers(1, &demo->dstfbo);
+    glNamedFramebufferTexture(demo->dstfbo, GL_COLOR_ATTACHMENT0, demo->color, 0);
+
+    demo_prepare_opengl_client(demo);
 }
 
-void draw_opengl_client(struct demo* demo)
+// MK: Source FBO for the simulated client, and the HDR post-processing which renders
+// from it into demo->dstfbo, ie. the interop image:
+static void demo_prepare_opengl_client(struct demo* demo)
 {
-    static bool firsttime = true;
-    int w = demo->textures[0].tex_width;
-    int h = demo->textures[0].tex_height;
+    GLenum err;
 
-    switch (demo->testpattern) {
-        case 0:
-        default:
-            draw_jesse(demo);
-            break;
+    // Create our source FBO, into which our simulated OpenGL client renders. It has
+    // the interop image size, so it is rebuilt with the interop image on a resize:
+    glCreateTextures(GL_TEXTURE_2D, 1, &demo->srctexture);
+    glBindTexture(GL_TEXTURE_2D, demo->srctexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, demo->textures[0].tex_width, demo->textures[0].tex_height, 0, GL_RGBA, GL_FLOAT, NULL);
+    glBindTexture(GL_TEXTURE_2D, 0);
 
-        case 1:
-            draw_centerpatch(demo, false, false);
-            break;
+    glCreateFramebuffers(1, &demo->srcfbo);
+    glNamedFramebufferTexture(demo->srcfbo, GL_COLOR_ATTACHMENT0, demo->srctexture, 0);
 
-        case 2:
-            draw_centerpatch(demo, true, false);
-            break;
+    // Everything below does not depend on size, so is only built once:
+    if (demo->hdr_shader)
+        return;
 
-        case 3:
-            draw_centerpatch(demo, false, true);
-            break;
+    if (demo->hdr_encode_accuracy)
+        demo_hdr_encode_accuracy(demo);
 
-        case 4:
-            draw_fullscreen(demo, false);
-            break;
+    // Build HDR post-processing shader, and the tables for its encoding:
+    if (demo->hdr_encode == HDR_ENCODE_LUT)
+        demo->hdr_lut = demo_build_hdr_lut(false);
 
-        case 5:
-            draw_fullscreen(demo, true);
-            break;
-    }
-}
+    if (demo->hdr_encode == HDR_ENCODE_POLY)
+        demo_build_hdr_poly(demo->hdr_poly, false);
 
-void draw_opengl(struct demo* demo)
-{
-    static bool firsttime = true;
-    int w = demo->textures[0].tex_width;
-    int h = demo->textures[0].tex_height;
+    // Dither to the lowest bit depth on the way to the display, interop image or swapchain:
+    demo->dither_levels = 0;
+    if (demo->use_dither) {
+        const int interop_levels = demo_format_levels(demo->interop_tex_format);
+        const int swapchain_levels = demo_format_levels(demo->format);
 
-    if (!demo->interop_enabled)
-        return;
+        demo->dither_levels = (interop_levels && (!swapchain_levels || interop_levels < swapchain_levels)) ?
+                              interop_levels : swapchain_levels;
 
-    if (firsttime) {
-        glClampColor(GL_CLAMP_VERTEX_COLOR, GL_FALSE);
-        glClampColor(GL_CLAMP_FRAGMENT_COLOR, GL_FALSE);
-        glViewport(0, 0, w, h);
-        printf("Vulkan target fbo size: %i x %i\n", w, h);
-        firsttime = false;
+        if (demo->output_tf != OUTPUT_TF_NONE || !demo->dither_levels) {
+            printf("Dithering disabled, as OpenGL doesn't encode or output is floating point.\n");
+            demo->dither_levels = 0;
+        }
+        else {
+            printf("Blue noise dithering to %i bits.\n", (demo->dither_levels == 1023) ? 10 : 8);
+            demo->dither_noise = demo_build_blue_noise();
+        }
     }
 
-    // Bind fbo with our virtual OpenGL framebuffer, so simulated client code
-    // can render the stimulus image in RGBA16F nits, BT2020/2100 color space.
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, demo->srcfbo);
+    demo->hdr_shader = demo_build_hdr_shader((demo->output_tf != OUTPUT_TF_NONE) ? HDR_ENCODE_NONE : demo->hdr_encode,
+                                             false, demo->hdr_poly, demo->gamut_map,
+                                             demo->gamut_matrix, demo->gamut_luma, demo->use_tonemap,
+                                             demo->dither_levels);
+    demo->dither_frame_loc = glGetUniformLocation(demo->hdr_shader, "DitherFrame");
+    demo->eetf_dirty = true;
 
-    // Call simulated client rendering code:
-    draw_opengl_client(demo);
+    demo_upload_client_texture();
 
-    // Bind FBO with our Vulkan interop texture:
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, demo->dstfbo);
+    err = glGetError();
+    if (err)
+        printf("Stage 6: GL ERROR: %i\n", err);
+}
 
-    if (true) {
-        glMatrixMode(GL_PROJECTION);
-        glLoadIdentity();
-        glMatrixMode(GL_MODELVIEW);
-        glLoadIdentity();
-        //glEnable(GL_TEXTURE_2D);
-        glBindTexture(GL_TEXTURE_2D, demo->srctexture);
-        //glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glUseProgram(demo->hdr_shader);
-        glBegin(GL_QUADS);
-        glTexCoord2f(0.0, 0.0);
-        glVertex2f(-1.0, -1.0);
-        glTexCoord2f(1.0, 0.0);
-        glVertex2f(1.0, -1.0);
-        glTexCoord2f(1.0, 1.0);
-        glVertex2f(1.0, 1.0);
-        glTexCoord2f(0.0, 1.0);
-        glVertex2f(-1.0, 1.0);
-        glEnd();
-        glUseProgram(0);
-        glBindTexture(GL_TEXTURE_2D, 0);
-        //glDisable(GL_TEXTURE_2D);
+// Release OpenGL side of OpenGL->Vulkan interop. Only size dependent objects, unless 'all':
+static void demo_destroy_opengl_interop(struct demo* demo, bool all)
+{
+    if (!demo->interop_enabled)
+        return;
+
+    // Delete objects referencing the shared memory first, then the memory object itself:
+    glDeleteFramebuffers(1, &demo->dstfbo);
+    glDeleteFramebuffers(1, &demo->srcfbo);
+    glDeleteTextures(1, &demo->srctexture);
+    glDeleteTextures(1, &demo->color);
+    if (demo->mem)
+        glDeleteMemoryObjectsEXT(1, &demo->mem);
+    demo->dstfbo = demo->srcfbo = demo->srctexture = demo->color = demo->mem = 0;
+
+#if defined(VK_USE_PLATFORM_DISPLAY_KHR)
+    if (demo->egl_image) {
+        PFNEGLDESTROYIMAGEKHRPROC eglDestroyImageKHR = (PFNEGLDESTROYIMAGEKHRPROC) eglGetProcAddress("eglDestroyImageKHR");
+        eglDestroyImageKHR(demo->egl_display, demo->egl_image);
+        demo->egl_image = EGL_NO_IMAGE_KHR;
     }
-    else {
-        // Simple blit from src to dst, no OETF HDR shader applied:
-        glBlitNamedFramebuffer(demo->srcfbo, demo->dstfbo, 0, 0, w, h, 0, 0, w, h, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+#endif
+
+    if (all) {
+        glDeleteSemaphoresEXT(1, &demo->glReady);
+        glDeleteSemaphoresEXT(1, &demo->glComplete);
+        glDeleteProgram(demo->hdr_shader);
+        glDeleteTextures(1, &demo->hdr_lut);
+        glDeleteTextures(1, &demo->dither_noise);
+        demo->glReady = demo->glComplete = demo->hdr_shader = demo->hdr_lut = demo->dither_noise = 0;
     }
 
-    // Poor man's sync until we use semaphores properly:
+    // Make sure the GL is really done with the memory before Vulkan frees it:
     glFinish();
+}
 
-    // Unbind, so Vulkan can texture / blit from it:
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+// On MS-Windows, make this a global, so it's available to WndProc()
+struct demo demo;
+
+#if defined(VK_USE_PLATFORM_WIN32_KHR)
+static void demo_run(struct demo *demo) {
+    if (!demo->prepared)
+        return;
+
+    demo_draw(demo);
+    demo->curFrame++;
+    if (demo->frameCount != INT_MAX && demo->curFrame == demo->frameCount) {
+        PostQuitMessage(validation_error);
+    }
 }
 
-// hdrFragmentShaderSrc currently implements the ST-2084 PQ OETF, for EOTF
-// decoding in the display. Iow. it implements the HDR-10 mapping from a
-// linear color intensity input range (in nits aka cd/m2) from 0 - 10000 nits
-// to the PQ mapped range 0.0 - 1.0, which then can get encoded into typically
-// 10 bits per color channel and transmitted to the display for decoding.
-static char hdrFragmentShaderSrc[] =
-"uniform sampler2D Image; \n"
-"\n"
-"void main() \n"
-"{ \n"
-"   vec3 L, Lp, f, v; \n"
-"\n"
-"   /* Get source color sample */ \n"
-"   vec4 uFragColor = texture2D(Image, gl_TexCoord[0].st); \n"
-"\n"
-"   /* Normalize input range [0 - 10000.0 nits] to [0.0 - 1.0]; */ \n"
-"   L = uFragColor.rgb; \n"
-"   L = L / 10000.0; \n"
-"\n"
-"   /* Apply ST 2084 PQ OETF */ \n"
-"   Lp = pow(L, vec3(0.1593017578125)); \n"
-"   f = (0.8359375 + 18.8515625 * Lp) / (1.0 + 18.6875 * Lp); \n"
-"   v  = pow(f, vec3(78.84375)); \n"
-"\n"
-"   /* Debug range check: If red input value greater than some nits, color it red */ \n"
-"   if (false && (uFragColor.r >= 1000.0)) \n"
-"      v = vec3(1.0, 0.0, 0.0); \n"
-"\n"
-"   /* Assign PQ mapped to output */ \n"
-"   gl_FragColor.a = uFragColor.a; \n"
-"   gl_FragColor.rgb = v; \n"
-"} \n";
+// MS-Windows event handling function:
+LRESULT CALLBACK WndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
+    switch (uMsg) {
+    case WM_CHAR:
+        if (wParam != 'q')
+            break;
+        // fallthrough to WM_CLOSE if q key pressed:
+    case WM_CLOSE:
+        PostQuitMessage(validation_error);
+        break;
+    case WM_PAINT:
+        // The validation callback calls MessageBox which can generate paint
+        // events - don't make more Vulkan calls if we got here from the
+        // callback
+        if (!in_callback) {
+            demo_run(&demo);
+        }
+        break;
+    case WM_GETMINMAXINFO:     // set window's minimum size
+        ((MINMAXINFO*)lParam)->ptMinTrackSize = demo.minsize;
+        return 0;
+    case WM_SIZE:
+        // Resize the application to the new window size, except when
+        // it was minimized. Vulkan doesn't support images or swapchains
+        // with width=0 and height=0.
+        if (wParam != SIZE_MINIMIZED) {
+            demo.width = lParam & 0xffff;
+            demo.height = (lParam & 0xffff0000) >> 16;
+            demo_resize(&demo);
+        }
+        break;
+    default:
+        break;
+    }
+    return (DefWindowProc(hWnd, uMsg, wParam, lParam));
+}
 
-GLuint PsychCreateGLSLProgram(const char* fragmentsrc, const char* vertexsrc)
-{
-    GLuint glsl = 0;
-    GLuint shader;
-    GLint status;
-    char errtxt[10000];
+static void demo_create_window(struct demo *demo) {
+    WNDCLASSEX win_class;
+    int pf;
+    GLenum glerr;
+    HWND glwindow;
+    HDC hDC;
+    HGLRC glcontext;
+    PIXELFORMATDESCRIPTOR pfd;
+    POINT p;
+    HMONITOR hmonitor;
+    MONITORINFOEX moninfo;
 
-    // Reset error state:
-    while (glGetError());
+    GetCursorPos(&p);
+    hmonitor = MonitorFromPoint(p, MONITOR_DEFAULTTOPRIMARY);
+    moninfo.cbSize = sizeof(moninfo);
+    GetMonitorInfoA(hmonitor, (LPMONITORINFOEX) &moninfo);
 
-    // Supported at all on this hardware?
-    if (!glewIsSupported("GL_ARB_shader_objects") || !glewIsSupported("GL_ARB_shading_language_100")) {
-        printf("PTB-ERROR: Your graphics hardware does not support GLSL fragment shaders! Use of imaging pipeline with current settings impossible!\n");
-        return(0);
+    // Initialize the window class structure:
+    win_class.cbSize = sizeof(WNDCLASSEX);
+    win_class.style = CS_HREDRAW | CS_VREDRAW | CS_OWNDC;
+    win_class.lpfnWndProc = WndProc;
+    win_class.cbClsExtra = 0;
+    win_class.cbWndExtra = 0;
+    win_class.hInstance = demo->connection; // hInstance
+    win_class.hIcon = LoadIcon(NULL, IDI_APPLICATION);
+    win_class.hCursor = LoadCursor(NULL, IDC_ARROW);
+    win_class.hbrBackground = (HBRUSH)GetStockObject(WHITE_BRUSH);
+    win_class.lpszMenuName = NULL;
+    win_class.lpszClassName = demo->name;
+    win_class.hIconSm = LoadIcon(NULL, IDI_WINLOGO);
+    // Register window class:
+    if (!RegisterClassEx(&win_class)) {
+        // It didn't work, so try to give a useful error:
+        printf("Unexpected error trying to start the application!\n");
+        fflush(stdout);
+        exit(1);
     }
 
-    // Create GLSL program object:
-    glsl = glCreateProgram();
+    printf("Displaying fullscreen on monitor %s.\n", moninfo.szDevice);
 
-    // Fragment shader wanted?
-    if (fragmentsrc) {
-        printf("PTB-INFO: Creating the following fragment shader, GLSL source code follows:\n\n%s\n\n", fragmentsrc);
+    // Create window with the registered class:
+    //RECT wr = {0, 0, GetSystemMetrics(SM_CXFULLSCREEN), GetSystemMetrics(SM_CYFULLSCREEN)};
+    //AdjustWindowRectEx(&wr, WS_POPUP | WS_VISIBLE | WS_CLIPSIBLINGS | WS_CLIPCHILDREN, 0, WS_EX_TOPMOST | WS_EX_APPWINDOW);
+    demo->window = CreateWindowEx(WS_EX_TOPMOST | WS_EX_APPWINDOW,
+                                  demo->name,           // class name
+                                  demo->name,           // app name
+                                  WS_POPUP | WS_VISIBLE | WS_CLIPSIBLINGS | WS_CLIPCHILDREN, // window style | WS_SYSMENU,
+                                  moninfo.rcMonitor.left, // x coord
+                                  moninfo.rcMonitor.top,  // y coord
+                                  moninfo.rcMonitor.right - moninfo.rcMonitor.left, // width
+                                  moninfo.rcMonitor.bottom - moninfo.rcMonitor.top, // height
+                                  NULL,               // handle to parent
+                                  NULL,               // handle to menu
+                                  demo->connection,   // hInstance
+                                  NULL);              // no extra parameters
+    if (!demo->window) {
+        // It didn't work, so try to give a useful error:
+        printf("Cannot create a window in which to draw!\n");
+        fflush(stdout);
+        exit(1);
+    }
 
-        // Supported on this hardware?
-        if (!glewIsSupported("GL_ARB_fragment_shader")) {
-            printf("PTB-ERROR: Your graphics hardware does not support GLSL fragment shaders! Use of imaging pipeline with current settings impossible!\n");
-            return(0);
-        }
+    // Window client area size must be at least 1 pixel high, to prevent crash.
+    demo->minsize.x = GetSystemMetrics(SM_CXSCREEN); // GetSystemMetrics(SM_CXMINTRACK);
+    demo->minsize.y = GetSystemMetrics(SM_CYSCREEN); // GetSystemMetrics(SM_CYMINTRACK) + 1;
 
-        // Create shader object:
-        shader = glCreateShader(GL_FRAGMENT_SHADER);
+    glwindow = CreateWindowEx(0,
+                              demo->name,           // class name
+                              demo->name,           // app name
+                              WS_POPUP | WS_CLIPSIBLINGS | WS_CLIPCHILDREN, // window style
+                              0, 0,  // x/y coords
+                              100, // width
+                              100, // height
+                              NULL, // handle to parent
+                              NULL, // handle to menu
+                              demo->connection, // hInstance
+                              NULL); // no extra parameters
 
-        // Feed it with GLSL source code:
-        glShaderSource(shader, 1, (const char**) &fragmentsrc, NULL);
+    if (!glwindow) {
+        // It didn't work, so try to give a useful error:
+        printf("Cannot create a OpenGL dummy window!\n");
+        fflush(stdout);
+        exit(1);
+    }
 
-        // Compile shader:
-        glCompileShader(shader);
+    hDC = GetDC(glwindow);
 
-        glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
-        if (status != GL_TRUE) {
-            printf("PTB-ERROR: Shader compilation for builtin fragment shader failed:\n");
-            glGetShaderInfoLog(shader, 9999, NULL, (GLchar*) &errtxt);
-            printf("%s\n\n", errtxt);
+    // Build pixelformat descriptor:
+    memset(&pfd, 0, sizeof(pfd));
+    pfd.nSize = sizeof(pfd);
+    pfd.nVersion = 1;
+    pfd.dwFlags = PFD_DRAW_TO_WINDOW | PFD_SUPPORT_OPENGL | PFD_SWAP_EXCHANGE | PFD_DOUBLEBUFFER;  // Want OpenGL capable window with bufferswap via page-flipping...
+    pfd.iPixelType = PFD_TYPE_RGBA; // Want a RGBA pixel format.
+    pfd.cColorBits = 32;
+    pfd.cAlphaBits = 8; // Usually want an at least 8 bit alpha-buffer, unless high color bit depths formats requested.
+    pf = ChoosePixelFormat(hDC, &pfd);
 
-            glDeleteShader(shader);
-            glDeleteProgram(glsl);
+    // Do we have a valid pixelformat?
+    if (pf == 0) {
+        // Nope. We give up!
+        printf("\nChoosePixelFormat() failed: Unknown error, Win32 specific.\n\n");
+        exit(1);
+    }
 
-            // Failed!
-            while (glGetError());
+    // Yes. Set it:
+    if (SetPixelFormat(hDC, pf, &pfd) == FALSE) {
+        printf("\nSetPixelFormat() failed: Unknown error, Win32 specific.\n\n");
+        exit(1);
+    }
 
-            return(0);
-        }
+    glcontext = wglCreateContext(hDC);
+    if (glcontext == NULL) {
+        printf("\nOpenGL context creation failed: Unknown, Win32 specific.\n\n");
+        exit(1);
+    }
 
-        // Attach it to program object:
-        glAttachShader(glsl, shader);
+    wglMakeCurrent(hDC, glcontext);
+
+    // Ok, the OpenGL rendering context is up and running. Auto-detect and bind all
+    // available OpenGL extensions via GLEW:
+    glerr = glewInit();
+    if (GLEW_OK != glerr) {
+        /* Problem: glewInit failed, something is seriously wrong. */
+        printf("\nGLEW init failed: %s: Will try to continue, but may crash soon!\n\n", glewGetErrorString(glerr));
+        fflush(NULL);
+        exit(1);
     }
+}
 
-    // Vertex shader wanted?
-    if (vertexsrc) {
-        printf("PTB-INFO: Creating the following vertex shader, GLSL source code follows:\n\n%s\n\n", vertexsrc);
+#elif defined(VK_USE_PLATFORM_XLIB_KHR)
+static void demo_create_xlib_window(struct demo *demo) {
 
-        // Supported on this hardware?
-        if (!glewIsSupported("GL_ARB_vertex_shader")) {
-            printf("PTB-ERROR: Your graphics hardware does not support GLSL vertex shaders! Use of imaging pipeline with current settings impossible!\n");
-            return(0);
-        }
+    XInitThreads();
+    demo->display = XOpenDisplay(NULL);
+    long visualMask = VisualScreenMask;
+    int numberOfVisuals;
+    XVisualInfo vInfoTemplate={};
+    vInfoTemplate.screen = DefaultScreen(demo->display);
+    XVisualInfo *visualInfo = XGetVisualInfo(demo->display, visualMask,
+                                             &vInfoTemplate, &numberOfVisuals);
 
-        // Create shader object:
-        shader = glCreateShader(GL_VERTEX_SHADER);
+    Colormap colormap = XCreateColormap(
+                demo->display, RootWindow(demo->display, vInfoTemplate.screen),
+                visualInfo->visual, AllocNone);
 
-        // Feed it with GLSL source code:
-        glShaderSource(shader, 1, (const char**) &vertexsrc, NULL);
+    XSetWindowAttributes windowAttributes={};
+    windowAttributes.colormap = colormap;
+    windowAttributes.background_pixel = 0xFFFFFFFF;
+    windowAttributes.border_pixel = 0;
+    windowAttributes.event_mask =
+            KeyPressMask | KeyReleaseMask | StructureNotifyMask | ExposureMask;
 
-        // Compile shader:
-        glCompileShader(shader);
+    demo->xlib_window = XCreateWindow(
+                demo->display, RootWindow(demo->display, vInfoTemplate.screen), 0, 0,
+                demo->width, demo->height, 0, visualInfo->depth, InputOutput,
+                visualInfo->visual,
+                CWBackPixel | CWBorderPixel | CWEventMask | CWColormap, &windowAttributes);
 
-        glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
-        if (status != GL_TRUE) {
-            printf("PTB-ERROR: Shader compilation for builtin vertex shader failed:\n");
-            glGetShaderInfoLog(shader, 9999, NULL, (GLchar*) &errtxt);
-            printf("%s\n\n", errtxt);
+    XSelectInput(demo->display, demo->xlib_window, ExposureMask | KeyPressMask);
+    XMapWindow(demo->display, demo->xlib_window);
+    XFlush(demo->display);
+    demo->xlib_wm_delete_window =
+            XInternAtom(demo->display, "WM_DELETE_WINDOW", False);
+}
+static void demo_handle_xlib_event(struct demo *demo, const XEvent *event) {
+    switch(event->type) {
+    case ClientMessage:
+        if ((Atom)event->xclient.data.l[0] == demo->xlib_wm_delete_window)
+            demo->quit = true;
+        break;
+    case KeyPress:
+        switch (event->xkey.keycode) {
+        case 0x9: // Escape
+            demo->quit = true;
+            break;
+        case 0x71: // left arrow key
+            demo->spin_angle -= demo->spin_increment;
+            break;
+        case 0x72: // right arrow key
+            demo->spin_angle += demo->spin_increment;
+            break;
+        case 0x41: // space bar
+            demo->pause = !demo->pause;
+            break;
+        case 0x1c: // t key
+            demo_cycle_output_tf(demo);
+            break;
+        }
+        break;
+    case ConfigureNotify:
+        if ((demo->width != event->xconfigure.width) ||
+            (demo->height != event->xconfigure.height)) {
+            demo->width = event->xconfigure.width;
+            demo->height = event->xconfigure.height;
+            demo_resize(demo);
+        }
+        break;
+    default:
+        break;
+    }
 
-            glDeleteShader(shader);
-            glDeleteProgram(glsl);
+}
 
-            // Failed!
-            while (glGetError());
+static void demo_run_xlib(struct demo *demo) {
 
-            return(0);
+    while (!demo->quit) {
+        XEvent event;
+
+        if (demo->pause) {
+            XNextEvent(demo->display, &event);
+            demo_handle_xlib_event(demo, &event);
+        }
+        while (XPending(demo->display) > 0) {
+            XNextEvent(demo->display, &event);
+            demo_handle_xlib_event(demo, &event);
         }
 
-        // Attach it to program object:
-        glAttachShader(glsl, shader);
+        demo_draw(demo);
+        demo->curFrame++;
+        if (demo->frameCount != INT32_MAX && demo->curFrame == demo->frameCount)
+            demo->quit = true;
     }
+}
+#elif defined(VK_USE_PLATFORM_XCB_KHR) || defined(VK_USE_PLATFORM_DISPLAY_KHR)
 
-    // Link into final program object:
-    glLinkProgram(glsl);
+static void demo_handle_xcb_event(struct demo *demo,
+                              const xcb_generic_event_t *event) {
+    uint8_t event_code = event->response_type & 0x7f;
+    switch (event_code) {
+    case XCB_EXPOSE:
+        // TODO: Resize window
+        printf("XCB_EXPOSE\n");
 
-    // Check link status:
-    glGetProgramiv(glsl, GL_LINK_STATUS, &status);
-    if (status != GL_TRUE) {
-        printf("PTB-ERROR: Shader link operation for builtin glsl program failed:\n");
-        glGetProgramInfoLog(glsl, 9999, NULL, (GLchar*) &errtxt);
-        printf("Error output follows:\n\n%s\n\n", errtxt);
+        break;
+    case XCB_CLIENT_MESSAGE:
+        if ((*(xcb_client_message_event_t *)event).data.data32[0] ==
+            (*demo->atom_wm_delete_window).atom) {
+            demo->quit = true;
+        }
+        printf("XCB_CLIENT_MESSAGE\n");
 
-        glDeleteProgram(glsl);
+        break;
+    case XCB_KEY_RELEASE: {
+        const xcb_key_release_event_t *key =
+            (const xcb_key_release_event_t *)event;
 
-        // Failed!
-        while (glGetError());
+        switch (key->detail) {
+        case 0x9: // Escape
+    case 0x18: // q key
+            demo->quit = true;
+            break;
+        case 0x71: // left arrow key
+            demo->spin_angle -= demo->spin_increment;
+            break;
+        case 0x72: // right arrow key
+            demo->spin_angle += demo->spin_increment;
+            break;
+        case 0x41: // space bar
+            demo->pause = !demo->pause;
+            break;
+        case 0x1c: // t key
+            demo_cycle_output_tf(demo);
+            break;
+        }
+        printf("KEY %x\n", key->detail);
+    } break;
+    case XCB_CONFIGURE_NOTIFY: {
+        const xcb_configure_notify_event_t *cfg =
+            (const xcb_configure_notify_event_t *)event;
+            printf("XCB_CONFIGURE_NOTIFY\n");
 
-        return(0);
+/*
+        if ((demo->width != cfg->width) || (demo->height != cfg->height)) {
+            demo->width = cfg->width;
+            demo->height = cfg->height;
+            demo_resize(demo);
+        }
+*/
+    } break;
+    default:
+        break;
     }
-
-    while (glGetError());
-
-    // Return new GLSL program object handle:
-    return(glsl);
 }
 
-static void demo_create_opengl_interop(struct demo* demo)
-{
-    GLint tilingMode;
-    GLenum err;
+static void demo_run_xcb(struct demo *demo) {
+    unsigned char keys_return[32];
+    unsigned int keysdown, i, j;
 
-    if (!demo->interop_enabled)
-        return;
+    xcb_flush(demo->connection);
 
-    while (glGetError());
+    while (!demo->quit) {
+        xcb_generic_event_t *event;
 
-    // Create the texture for the FBO color attachment.
-    // This only reserves the ID, it doesn't allocate memory
-    glCreateTextures(GL_TEXTURE_2D, 1, &demo->color);
+        if (demo->pause) {
+            event = xcb_wait_for_event(demo->connection);
+        }
+        else {
+            event = xcb_poll_for_event(demo->connection);
+        }
+        while (event) {
+            demo_handle_xcb_event(demo, event);
+            free(event);
+            event = xcb_poll_for_event(demo->connection);
+        }
 
-    // Import semaphores
-    glGenSemaphoresEXT(1, &demo->glReady);
-    glGenSemaphoresEXT(1, &demo->glComplete);
+        memset(keys_return, 0, sizeof(keys_return));
+        keysdown = 0;
 
-    err = glGetError();
-    if (err)
-        printf("Stage 1: GL ERROR: %i\n", err);
+        if (demo->display)
+            XQueryKeymap(demo->display, (char*) keys_return);
 
-#ifdef WIN32
-    // Platform specific import.  On non-Win32 systems use glImportSemaphoreFdEXT instead
-    //glImportSemaphoreWin32HandleEXT(demo->glReady, GL_HANDLE_TYPE_OPAQUE_WIN32_EXT, demo->interophandles.glReady);
-    //glImportSemaphoreWin32HandleEXT(demo->glComplete, GL_HANDLE_TYPE_OPAQUE_WIN32_EXT, demo->interophandles.glComplete);
-#else
-    glImportSemaphoreFdEXT(demo->glReady, GL_HANDLE_TYPE_OPAQUE_FD_EXT, demo->interophandles.glReady);
-    glImportSemaphoreFdEXT(demo->glComplete, GL_HANDLE_TYPE_OPAQUE_FD_EXT, demo->interophandles.glComplete);
-#endif
+        for (i = 0; i < 32; i++) keysdown+=(unsigned int) keys_return[i];
 
-    err = glGetError();
-    if (err)
-        printf("Stage 2: GL ERROR: %i\n", err);
+        // Map 32 times 8 bitvector to 256 element return vector:
+        for(i = 0; i < 32 && !keysdown; i++) {
+            for(j = 0; j < 8; j++) {
+                // This button or key down?
+                if (keys_return[i] & (1<<j)) {
+                    keysdown = i * 8 + j;
+                    break;
+                }
+            }
+        }
 
-    // Import memory
-    glCreateMemoryObjectsEXT(1, &demo->mem);
-#ifdef WIN32
-    // Platform specific import.  On non-Win32 systems use glImportMemoryFdEXT instead
-    glImportMemoryWin32HandleEXT(demo->mem, demo->textures[0].mem_alloc.allocationSize, GL_HANDLE_TYPE_OPAQUE_WIN32_EXT, demo->interophandles.memory);
-#else
-    glImportMemoryFdEXT(demo->mem, demo->textures[0].mem_alloc.allocationSize, GL_HANDLE_TYPE_OPAQUE_FD_EXT, demo->interophandles.memory);
-#endif
+        if (keysdown)
+            printf("keysdown %i\n", keysdown);
 
-    err = glGetError();
-    if (err)
-        printf("Stage 3: GL ERROR: %i\n", err);
+        switch (keysdown) {
+            case 0x1: // q key
+                demo->quit = true;
+                break;
+            case 0x2: // left arrow key
+                demo->spin_angle -= demo->spin_increment;
+                break;
+            case 0x4: // right arrow key
+                demo->spin_angle += demo->spin_increment;
+                break;
+            case 0x41: // space bar
+                demo->pause = !demo->pause;
+                break;
+        }
 
-    // Query actual tiling mode of texture:
-    glBindTexture(GL_TEXTURE_2D, demo->color);
+        demo_draw(demo);
+        demo->curFrame++;
+        if (demo->frameCount != INT32_MAX && demo->curFrame == demo->frameCount)
+            demo->quit = true;
+    }
+}
 
-    // Use the imported memory as backing for the OpenGL texture.  The internalFormat, dimensions
-    // and mip count should match the ones used by Vulkan to create the image and determine it's memory
-    // allocation.
-    GLenum internalFormat = (GLenum)0;
-    switch (demo->interop_tex_format) {
-    case VK_FORMAT_R8G8B8A8_UNORM:
-        internalFormat = GL_RGBA8;
-        printf("OpenGL->Vulkan interop texture is format RGBA8\n");
-        break;
+static void demo_create_xcb_window(struct demo *demo) {
+    uint32_t value_mask, value_list[32];
+    uint32_t override_redirect = 1;
 
-    case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
-        internalFormat = GL_RGB10_A2;
-        printf("OpenGL->Vulkan interop texture is format RGB10A2\n");
-        break;
+    demo->xcb_window = xcb_generate_id(demo->connection);
+
+    value_mask = XCB_CW_BACK_PIXEL | XCB_CW_EVENT_MASK;
+    value_list[0] = demo->screen->black_pixel;
+    value_list[1] = XCB_EVENT_MASK_KEY_RELEASE | XCB_EVENT_MASK_EXPOSURE |
+                    XCB_EVENT_MASK_STRUCTURE_NOTIFY;
 
-    case VK_FORMAT_R16G16B16A16_SFLOAT:
-        internalFormat = GL_RGBA16F;
-        printf("OpenGL->Vulkan interop texture is format RGBA16F\n");
-        break;
+    demo->visualID = demo->screen->root_visual;
 
-    default:
-        printf("demo_create_opengl_interop: Invalid texture format!\n");
-    }
+    // MK TODO: Adjust x start position to viewport of output which displays Vulkan,
+    // instead of hard-coded 300 for the internal output:
+    xcb_create_window(demo->connection, XCB_COPY_FROM_PARENT, demo->xcb_window,
+                      demo->screen->root, 300, 0, demo->width, demo->height, 0,
+                      XCB_WINDOW_CLASS_INPUT_OUTPUT, /*demo->screen->root_visual*/ demo->visualID,
+                      value_mask, value_list);
 
-    glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_TILING_EXT, &tilingMode);
-    if (tilingMode == GL_OPTIMAL_TILING_EXT)
-        printf("Initially optimal tiling for shared texture.\n");
-    else if (tilingMode == GL_LINEAR_TILING_EXT)
-        printf("Initially linear tiling for shared texture.\n");
-    else
-        printf("Initially UNKNOWN tiling 0x%x for shared texture!\n", tilingMode);
+    /* Magic code that will send notification when window is destroyed */
+    xcb_intern_atom_cookie_t cookie =
+        xcb_intern_atom(demo->connection, 1, 12, "WM_PROTOCOLS");
+    xcb_intern_atom_reply_t *reply =
+        xcb_intern_atom_reply(demo->connection, cookie, 0);
 
-    glGetInternalformativ(GL_TEXTURE_2D, internalFormat, GL_NUM_TILING_TYPES_EXT, 1, &tilingMode);
-    printf("GL_NUM_TILING_TYPES_EXT %i\n", tilingMode);
+    xcb_intern_atom_cookie_t cookie2 =
+        xcb_intern_atom(demo->connection, 0, 16, "WM_DELETE_WINDOW");
+    demo->atom_wm_delete_window =
+        xcb_intern_atom_reply(demo->connection, cookie2, 0);
 
-    // Set tiling mode for rendering into textures:
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_TILING_EXT, (demo->interop_tiled_texture) ? GL_OPTIMAL_TILING_EXT : GL_LINEAR_TILING_EXT);
+    xcb_change_property(demo->connection, XCB_PROP_MODE_REPLACE, demo->xcb_window,
+                        (*reply).atom, 4, 32, 1,
+                        &(*demo->atom_wm_delete_window).atom);
+    free(reply);
 
-    glTextureStorageMem2DEXT(demo->color, 1, internalFormat, demo->textures[0].tex_width, demo->textures[0].tex_height, demo->mem, 0);
-    printf("Interop texture import size: %i x %i\n", demo->textures[0].tex_width, demo->textures[0].tex_height);
-    err = glGetError();
-    if (err)
-        printf("Stage 4: GL ERROR: %i\n", err);
-
-    // Query actual tiling mode of texture:
-    glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_TILING_EXT, &tilingMode);
-    if (tilingMode == GL_OPTIMAL_TILING_EXT)
-        printf("Using optimal tiling for shared texture.\n");
-    else if (tilingMode == GL_LINEAR_TILING_EXT)
-        printf("Using linear tiling for shared texture.\n");
-    else
-        printf("Using UNKNOWN tiling 0x%x for shared texture!\n", tilingMode);
+    // MK Need override_redirect so WM does leave our window on the target display output for Vulkan:
+    xcb_change_window_attributes(demo->connection, demo->xcb_window, XCB_CW_OVERRIDE_REDIRECT, &override_redirect);
 
-    err = glGetError();
-    if (err)
-        printf("Stage 5: GL ERROR: %i\n", err);
+    // MK this is not enough though. We need to set the X-Screens primary output to
+    // the Vulkan output, so the DDX selects the right crtc, given that it ignores
+    // all crtc's with disconnected outputs, and therefore the normal "max viewport <-> window intersection area"
+    // method does not work, and the primary output is always chosen for (msc,ust) queries.
+    //
+    // Well that, or hack the DDX to "consider_disabled" crtc's during crtc picking
+    // DRI3/Present...
 
-    // Create destination FBO, attach our imported/Vulkan-shared texture as color
-    // buffer, so we can render-to-texture in OpenGL, present in Vulkan:
-    glCreateFramebuffers(1, &demo->dstfbo);
-    glNamedFramebufferTexture(demo->dstfbo, GL_COLOR_ATTACHMENT0, demo->color, 0);
+    xcb_map_window(demo->connection, demo->xcb_window);
+    xcb_flush(demo->connection);
+}
 
-    // Create our source FBO, into which our simulated OpenGL client renders.
-    glCreateTextures(GL_TEXTURE_2D, 1, &demo->srctexture);
-    glBindTexture(GL_TEXTURE_2D, demo->srctexture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, demo->textures[0].tex_width, demo->textures[0].tex_height, 0, GL_RGBA, GL_FLOAT, NULL);
-    glBindTexture(GL_TEXTURE_2D, 0);
+/*
+ *        Attribs filter the list of FBConfigs returned by glXChooseFBConfig().
+ *        Visual attribs further described in glXGetFBConfigAttrib(3)
+ */
+static int visual_attribs[] =
+{
+    GLX_X_RENDERABLE, True,
+    GLX_DRAWABLE_TYPE, GLX_WINDOW_BIT,
+    GLX_RENDER_TYPE, GLX_RGBA_BIT,
+    GLX_X_VISUAL_TYPE, GLX_TRUE_COLOR,
+    GLX_RED_SIZE, 8,
+    GLX_GREEN_SIZE, 8,
+    GLX_BLUE_SIZE, 8,
+    GLX_ALPHA_SIZE, 8,
+    GLX_DEPTH_SIZE, 24,
+    GLX_STENCIL_SIZE, 8,
+    GLX_DOUBLEBUFFER, True,
+    //GLX_SAMPLE_BUFFERS  , 1,
+    //GLX_SAMPLES         , 4,
+    None
+};
 
-    glCreateFramebuffers(1, &demo->srcfbo);
-    glNamedFramebufferTexture(demo->srcfbo, GL_COLOR_ATTACHMENT0, demo->srctexture, 0);
+static void demo_create_glx_opengl1(struct demo *demo)
+{
+    int visualID = 0;
 
-    // Build HDR post-processing shader:
-    demo->hdr_shader = PsychCreateGLSLProgram(hdrFragmentShaderSrc, NULL);
+    /* Query framebuffer configurations that match visual_attribs */
+    GLXFBConfig *fb_configs = 0;
+    int num_fb_configs = 0;
 
-    // Load image again, this time into the backing store of the GL_TEXTURE_2D
-    // default binding 0 -- Yes, old school like it's 1992!
+    fb_configs = glXChooseFBConfig(demo->display, DefaultScreen(demo->display), visual_attribs, &num_fb_configs);
+    if(!fb_configs || num_fb_configs == 0)
     {
-        VkSubresourceLayout layout;
-        uint8_t* data;
-        int32_t width, height;
-        const char* filename = tex_files[0];
-        layout.rowPitch = 1024;
+        fprintf(stderr, "glXGetFBConfigs failed\n");
+        exit(1);
+    }
 
-        if (!loadTexture(filename, NULL, NULL, &width, &height)) {
-            fprintf(stderr, "Error probe-loading texture: %s\n", filename);
-        }
+    printf("Found %d matching FB configs\n", num_fb_configs);
 
-        data = calloc(width * height * 4, sizeof(uint8_t));
+    /* Select first framebuffer config and query visualID */
+    GLXFBConfig fb_config = fb_configs[0];
+    glXGetFBConfigAttrib(demo->display, fb_config, GLX_VISUAL_ID , &visualID);
 
-        if (!loadTexture(filename, data, &layout, &width, &height)) {
-            fprintf(stderr, "Error real-loading texture: %s\n", filename);
-        }
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-        free(data);
+    demo->visualID = visualID;
+
+    /* Create OpenGL context */
+    demo->context = glXCreateNewContext(demo->display, fb_config, GLX_RGBA_TYPE, 0, True);
+    if(!demo->context)
+    {
+        fprintf(stderr, "glXCreateNewContext failed\n");
+        exit(1);
     }
 
-    err = glGetError();
-    if (err)
-        printf("Stage 6: GL ERROR: %i\n", err);
+    demo->fb_config = fb_config;
 }
 
-// On MS-Windows, make this a global, so it's available to WndProc()
-struct demo demo;
+static void demo_create_glx_opengl2(struct demo *demo)
+{
+    /* Create GLX Window */
+    GLXDrawable drawable = 0;
 
-#if defined(VK_USE_PLATFORM_WIN32_KHR)
-static void demo_run(struct demo *demo) {
-    if (!demo->prepared)
-        return;
+    GLXWindow glxwindow = glXCreateWindow(
+        demo->display,
+        demo->fb_config,
+        demo->xcb_window,
+        0);
 
-    demo_draw(demo);
-    demo->curFrame++;
-    if (demo->frameCount != INT_MAX && demo->curFrame == demo->frameCount) {
-        PostQuitMessage(validation_error);
-    }
-}
+    if(!glxwindow)
+    {
+        xcb_destroy_window(demo->connection, demo->xcb_window);
+        glXDestroyContext(demo->display, demo->context);
 
-// MS-Windows event handling function:
-LRESULT CALLBACK WndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
-    switch (uMsg) {
-    case WM_CHAR:
-        if (wParam != 'q')
-            break;
-        // fallthrough to WM_CLOSE if q key pressed:
-    case WM_CLOSE:
-        PostQuitMessage(validation_error);
-        break;
-    case WM_PAINT:
-        // The validation callback calls MessageBox which can generate paint
-        // events - don't make more Vulkan calls if we got here from the
-        // callback
-        if (!in_callback) {
-            demo_run(&demo);
-        }
-        break;
-    case WM_GETMINMAXINFO:     // set window's minimum size
-        ((MINMAXINFO*)lParam)->ptMinTrackSize = demo.minsize;
-        return 0;
-    case WM_SIZE:
-        // Resize the application to the new window size, except when
-        // it was minimized. Vulkan doesn't support images or swapchains
-        // with width=0 and height=0.
-        if (wParam != SIZE_MINIMIZED) {
-            demo.width = lParam & 0xffff;
-            demo.height = (lParam & 0xffff0000) >> 16;
-            demo_resize(&demo);
-        }
-        break;
-    default:
-        break;
+        fprintf(stderr, "glXDestroyContext failed\n");
+        exit(1);
     }
-    return (DefWindowProc(hWnd, uMsg, wParam, lParam));
-}
 
-static void demo_create_window(struct demo *demo) {
-    WNDCLASSEX win_class;
-    int pf;
-    GLenum glerr;
-    HWND glwindow;
-    HDC hDC;
-    HGLRC glcontext;
-    PIXELFORMATDESCRIPTOR pfd;
-    POINT p;
-    HMONITOR hmonitor;
-    MONITORINFOEX moninfo;
+    drawable = glxwindow;
 
-    GetCursorPos(&p);
-    hmonitor = MonitorFromPoint(p, MONITOR_DEFAULTTOPRIMARY);
-    moninfo.cbSize = sizeof(moninfo);
-    GetMonitorInfoA(hmonitor, (LPMONITORINFOEX) &moninfo);
+    /* make OpenGL context current */
+    if(!glXMakeContextCurrent(demo->display, drawable, drawable, demo->context))
+    {
+        xcb_destroy_window(demo->connection, demo->xcb_window);
+        glXDestroyContext(demo->display, demo->context);
 
-    // Initialize the window class structure:
-    win_class.cbSize = sizeof(WNDCLASSEX);
-    win_class.style = CS_HREDRAW | CS_VREDRAW | CS_OWNDC;
-    win_class.lpfnWndProc = WndProc;
-    win_class.cbClsExtra = 0;
-    win_class.cbWndExtra = 0;
-    win_class.hInstance = demo->connection; // hInstance
-    win_class.hIcon = LoadIcon(NULL, IDI_APPLICATION);
-    win_class.hCursor = LoadCursor(NULL, IDC_ARROW);
-    win_class.hbrBackground = (HBRUSH)GetStockObject(WHITE_BRUSH);
-    win_class.lpszMenuName = NULL;
-    win_class.lpszClassName = demo->name;
-    win_class.hIconSm = LoadIcon(NULL, IDI_WINLOGO);
-    // Register window class:
-    if (!RegisterClassEx(&win_class)) {
-        // It didn't work, so try to give a useful error:
-        printf("Unexpected error trying to start the application!\n");
-        fflush(stdout);
+        fprintf(stderr, "glXMakeContextCurrent failed\n");
         exit(1);
     }
+    demo->drawable = drawable;
 
-    printf("Displaying fullscreen on monitor %s.\n", moninfo.szDevice);
-
-    // Create window with the registered class:
-    //RECT wr = {0, 0, GetSystemMetrics(SM_CXFULLSCREEN), GetSystemMetrics(SM_CYFULLSCREEN)};
-    //AdjustWindowRectEx(&wr, WS_POPUP | WS_VISIBLE | WS_CLIPSIBLINGS | WS_CLIPCHILDREN, 0, WS_EX_TOPMOST | WS_EX_APPWINDOW);
-    demo->window = CreateWindowEx(WS_EX_TOPMOST | WS_EX_APPWINDOW,
-                                  demo->name,           // class name
-                                  demo->name,           // app name
-                                  WS_POPUP | WS_VISIBLE | WS_CLIPSIBLINGS | WS_CLIPCHILDREN, // window style | WS_SYSMENU,
-                                  moninfo.rcMonitor.left, // x coord
-                                  moninfo.rcMonitor.top,  // y coord
-                                  moninfo.rcMonitor.right - moninfo.rcMonitor.left, // width
-                                  moninfo.rcMonitor.bottom - moninfo.rcMonitor.top, // height
-                                  NULL,               // handle to parent
-                                  NULL,               // handle to menu
-                                  demo->connection,   // hInstance
-                                  NULL);              // no extra parameters
-    if (!demo->window) {
-        // It didn't work, so try to give a useful error:
-        printf("Cannot create a window in which to draw!\n");
-        fflush(stdout);
+    GLenum glerr = glewInit();
+    if (glerr != GLEW_OK) {
+        printf("glewInit failed!\n");
         exit(1);
     }
+    printf("\nUsing GLEW version %s for OpenGL.\n", glewGetString(GLEW_VERSION));
+    printf("OpenGL renderer: %s %s - OpenGL %s\n", glGetString(GL_VENDOR), glGetString(GL_RENDERER), glGetString(GL_VERSION));
 
-    // Window client area size must be at least 1 pixel high, to prevent crash.
-    demo->minsize.x = GetSystemMetrics(SM_CXSCREEN); // GetSystemMetrics(SM_CXMINTRACK);
-    demo->minsize.y = GetSystemMetrics(SM_CYSCREEN); // GetSystemMetrics(SM_CYMINTRACK) + 1;
+    glXGetSyncValuesOML = (PFNGLXGETSYNCVALUESOMLPROC) glXGetProcAddress("glXGetSyncValuesOML");
+}
 
-    glwindow = CreateWindowEx(0,
-                              demo->name,           // class name
-                              demo->name,           // app name
-                              WS_POPUP | WS_CLIPSIBLINGS | WS_CLIPCHILDREN, // window style
-                              0, 0,  // x/y coords
-                              100, // width
-                              100, // height
-                              NULL, // handle to parent
-                              NULL, // handle to menu
-                              demo->connection, // hInstance
-                              NULL); // no extra parameters
+#if defined(VK_USE_PLATFORM_DISPLAY_KHR)
+// MK: Create an OpenGL context via EGL, without need for an X-Server or window.
+// Uses Mesa's surfaceless platform if available, otherwise the EGL device platform.
+// All OpenGL rendering goes to fbo's, so no surface is needed, or only a dummy
+// 1x1 pbuffer if the implementation can't make a context current without surface.
+static bool demo_create_egl_opengl(struct demo *demo)
+{
+    PFNEGLGETPLATFORMDISPLAYEXTPROC eglGetPlatformDisplayEXT;
+    PFNEGLQUERYDEVICESEXTPROC eglQueryDevicesEXT;
+    const char *clientexts;
+    EGLDisplay dpy = EGL_NO_DISPLAY;
+    EGLSurface surface = EGL_NO_SURFACE;
+    EGLContext ctx;
+    EGLConfig config;
+    EGLint major, minor, num_configs;
+    GLenum glerr;
+
+    static const EGLint config_attribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_RED_SIZE, 8,
+        EGL_GREEN_SIZE, 8,
+        EGL_BLUE_SIZE, 8,
+        EGL_ALPHA_SIZE, 8,
+        EGL_NONE
+    };
 
-    if (!glwindow) {
-        // It didn't work, so try to give a useful error:
-        printf("Cannot create a OpenGL dummy window!\n");
-        fflush(stdout);
-        exit(1);
+    static const EGLint pbuffer_attribs[] = {
+        EGL_WIDTH, 1,
+        EGL_HEIGHT, 1,
+        EGL_NONE
+    };
+
+    clientexts = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    eglGetPlatformDisplayEXT = (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (!clientexts || !eglGetPlatformDisplayEXT) {
+        fprintf(stderr, "EGL client extensions or eglGetPlatformDisplayEXT unsupported.\n");
+        return false;
     }
 
-    hDC = GetDC(glwindow);
+    if (strstr(clientexts, "EGL_MESA_platform_surfaceless")) {
+        dpy = eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        if (dpy != EGL_NO_DISPLAY)
+            printf("Using EGL surfaceless platform for OpenGL.\n");
+    }
 
-    // Build pixelformat descriptor:
-    memset(&pfd, 0, sizeof(pfd));
-    pfd.nSize = sizeof(pfd);
-    pfd.nVersion = 1;
-    pfd.dwFlags = PFD_DRAW_TO_WINDOW | PFD_SUPPORT_OPENGL | PFD_SWAP_EXCHANGE | PFD_DOUBLEBUFFER;  // Want OpenGL capable window with bufferswap via page-flipping...
-    pfd.iPixelType = PFD_TYPE_RGBA; // Want a RGBA pixel format.
-    pfd.cColorBits = 32;
-    pfd.cAlphaBits = 8; // Usually want an at least 8 bit alpha-buffer, unless high color bit depths formats requested.
-    pf = ChoosePixelFormat(hDC, &pfd);
+    if ((dpy == EGL_NO_DISPLAY) && strstr(clientexts, "EGL_EXT_platform_device")) {
+        EGLDeviceEXT devices[16];
+        EGLint num_devices = 0;
+        EGLint devindex;
 
-    // Do we have a valid pixelformat?
-    if (pf == 0) {
-        // Nope. We give up!
-        printf("\nChoosePixelFormat() failed: Unknown error, Win32 specific.\n\n");
-        exit(1);
+        eglQueryDevicesEXT = (PFNEGLQUERYDEVICESEXTPROC) eglGetProcAddress("eglQueryDevicesEXT");
+        if (eglQueryDevicesEXT && eglQueryDevicesEXT(16, devices, &num_devices) && (num_devices > 0)) {
+            // Try to stick to the gpu selected via --gpu. EGL and Vulkan need not
+            // enumerate in the same order, so this may need the right index from the user:
+            devindex = (demo->gpuindex < (uint32_t) num_devices) ? (EGLint) demo->gpuindex : 0;
+            dpy = eglGetPlatformDisplayEXT(EGL_PLATFORM_DEVICE_EXT, devices[devindex], NULL);
+            if (dpy != EGL_NO_DISPLAY)
+                printf("Using EGL device platform, device %i of %i, for OpenGL.\n", devindex, num_devices);
+        }
     }
 
-    // Yes. Set it:
-    if (SetPixelFormat(hDC, pf, &pfd) == FALSE) {
-        printf("\nSetPixelFormat() failed: Unknown error, Win32 specific.\n\n");
-        exit(1);
+    if ((dpy == EGL_NO_DISPLAY) || !eglInitialize(dpy, &major, &minor)) {
+        fprintf(stderr, "Failed to get or initialize a windowless EGL display.\n");
+        return false;
     }
 
-    glcontext = wglCreateContext(hDC);
-    if (glcontext == NULL) {
-        printf("\nOpenGL context creation failed: Unknown, Win32 specific.\n\n");
-        exit(1);
+    printf("EGL version %i.%i from %s.\n", major, minor, eglQueryString(dpy, EGL_VENDOR));
+
+    if (!eglBindAPI(EGL_OPENGL_API) ||
+        !eglChooseConfig(dpy, config_attribs, &config, 1, &num_configs) || (num_configs < 1)) {
+        fprintf(stderr, "EGL does not support desktop OpenGL pbuffer configs.\n");
+        eglTerminate(dpy);
+        return false;
     }
 
-    wglMakeCurrent(hDC, glcontext);
+    // No attributes, so we get a compatibility context like glXCreateNewContext(),
+    // as the simulated client code uses fixed function OpenGL:
+    ctx = eglCreateContext(dpy, config, EGL_NO_CONTEXT, NULL);
+    if (ctx == EGL_NO_CONTEXT) {
+        fprintf(stderr, "eglCreateContext failed\n");
+        eglTerminate(dpy);
+        return false;
+    }
 
-    // Ok, the OpenGL rendering context is up and running. Auto-detect and bind all
-    // available OpenGL extensions via GLEW:
+    if (!strstr(eglQueryString(dpy, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context"))
+        surface = eglCreatePbufferSurface(dpy, config, pbuffer_attribs);
+
+    if (!eglMakeCurrent(dpy, surface, surface, ctx)) {
+        fprintf(stderr, "eglMakeCurrent failed\n");
+        eglDestroyContext(dpy, ctx);
+        eglTerminate(dpy);
+        return false;
+    }
+
+    demo->egl_display = dpy;
+    demo->egl_context = ctx;
+    demo->egl_surface = surface;
+    demo->egl_config = config;
+
+    // Our GLEW is built for GLX and resolves GL entry points via glXGetProcAddress,
+    // which returns the same glvnd dispatch stubs that route to the current EGL
+    // context. Only the GLX extension part of glewInit fails without a GLX display:
     glerr = glewInit();
-    if (GLEW_OK != glerr) {
-        /* Problem: glewInit failed, something is seriously wrong. */
-        printf("\nGLEW init failed: %s: Will try to continue, but may crash soon!\n\n", glewGetErrorString(glerr));
-        fflush(NULL);
+    if (glerr != GLEW_OK && glerr != GLEW_ERROR_NO_GLX_DISPLAY) {
+        printf("glewInit failed!\n");
         exit(1);
     }
+    printf("\nUsing GLEW version %s for OpenGL.\n", glewGetString(GLEW_VERSION));
+    printf("OpenGL renderer: %s %s - OpenGL %s\n", glGetString(GL_VENDOR), glGetString(GL_RENDERER), glGetString(GL_VERSION));
+
+    return true;
 }
 
-#elif defined(VK_USE_PLATFORM_XLIB_KHR)
-static void demo_create_xlib_window(struct demo *demo) {
+static void demo_destroy_egl_opengl(struct demo *demo)
+{
+    if (!demo->egl_display)
+        return;
 
-    XInitThreads();
-    demo->display = XOpenDisplay(NULL);
-    long visualMask = VisualScreenMask;
-    int numberOfVisuals;
-    XVisualInfo vInfoTemplate={};
-    vInfoTemplate.screen = DefaultScreen(demo->display);
-    XVisualInfo *visualInfo = XGetVisualInfo(demo->display, visualMask,
-                                             &vInfoTemplate, &numberOfVisuals);
+    eglMakeCurrent(demo->egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (demo->egl_surface != EGL_NO_SURFACE)
+        eglDestroySurface(demo->egl_display, demo->egl_surface);
+    eglDestroyContext(demo->egl_display, demo->egl_context);
+    eglTerminate(demo->egl_display);
+    demo->egl_display = NULL;
+}
 
-    Colormap colormap = XCreateColormap(
-                demo->display, RootWindow(demo->display, vInfoTemplate.screen),
-                visualInfo->visual, AllocNone);
+// MK: Reference stimulus of the test patterns in nits, for pixel x, y of a w x h image,
+// as draw_opengl_client() renders it in frame 'frame'. Returns false for pixels on or
+// next to edges of the pattern geometry, where rasterization rules or nearest neighbour
+// texture sampling may legitimately pick either side:
+static bool demo_verify_reference(struct demo *demo, int frame, int x, int y, int w, int h,
+                                  const uint8_t *cat, int cat_w, int cat_h, float nits[3])
+{
+    const float maxL = demo->nativeDisplayHdrMetadata.maxLuminance;
+    const float px = 2.0f / w, py = 2.0f / h;
+    const float cx = (x + 0.5f) * px - 1.0f, cy = (y + 0.5f) * py - 1.0f;
+    float tx = demo->tx, ty = demo->ty;
+    bool on = true;
+    int i;
 
-    XSetWindowAttributes windowAttributes={};
-    windowAttributes.colormap = colormap;
-    windowAttributes.background_pixel = 0xFFFFFFFF;
-    windowAttributes.border_pixel = 0;
-    windowAttributes.event_mask =
-            KeyPressMask | KeyReleaseMask | StructureNotifyMask | ExposureMask;
+    for (i = 0; i < 3; i++)
+        nits[i] = 0;
 
-    demo->xlib_window = XCreateWindow(
-                demo->display, RootWindow(demo->display, vInfoTemplate.screen), 0, 0,
-                demo->width, demo->height, 0, visualInfo->depth, InputOutput,
-                visualInfo->visual,
-                CWBackPixel | CWBorderPixel | CWEventMask | CWColormap, &windowAttributes);
+    switch (demo->testpattern) {
+        case 0: {
+            // Cat quad, rotated by frame degrees, scaled by 0.15, texture modulated by maxL:
+            const float a = (float) (frame % 360) * 3.14159265f / 180.0f;
+            const float dx = cx - tx, dy = cy - ty;
+            const float u = (cosf(a) * dx + sinf(a) * dy) / 0.15f;
+            const float v = (-sinf(a) * dx + cosf(a) * dy) / 0.15f;
+            const float margin = 1.5f * ((px > py) ? px : py) / 0.15f;
+            float s, t;
+
+            for (i = 0; i < 3; i++)
+                nits[i] = demo->rgb[i];
+
+            if (fabsf(fabsf(u) - 1.0f) < margin || fabsf(fabsf(v) - 1.0f) < margin)
+                return false;
+
+            if (fabsf(u) > 1.0f || fabsf(v) > 1.0f)
+                return true;
 
-    XSelectInput(demo->display, demo->xlib_window, ExposureMask | KeyPressMask);
-    XMapWindow(demo->display, demo->xlib_window);
-    XFlush(demo->display);
-    demo->xlib_wm_delete_window =
-            XInternAtom(demo->display, "WM_DELETE_WINDOW", False);
-}
-static void demo_handle_xlib_event(struct demo *demo, const XEvent *event) {
-    switch(event->type) {
-    case ClientMessage:
-        if ((Atom)event->xclient.data.l[0] == demo->xlib_wm_delete_window)
-            demo->quit = true;
-        break;
-    case KeyPress:
-        switch (event->xkey.keycode) {
-        case 0x9: // Escape
-            demo->quit = true;
-            break;
-        case 0x71: // left arrow key
-            demo->spin_angle -= demo->spin_increment;
-            break;
-        case 0x72: // right arrow key
-            demo->spin_angle += demo->spin_increment;
-            break;
-        case 0x41: // space bar
-            demo->pause = !demo->pause;
-            break;
+            s = (u + 1.0f) / 2.0f * cat_w;
+            t = (v + 1.0f) / 2.0f * cat_h;
+            if (fabsf(s - roundf(s)) < 0.02f || fabsf(t - roundf(t)) < 0.02f)
+                return false;
+
+            for (i = 0; i < 3; i++)
+                nits[i] = cat[((int) t * cat_w + (int) s) * 4 + i] / 255.0f * maxL;
+
+            return true;
         }
-        break;
-    case ConfigureNotify:
-        if ((demo->width != event->xconfigure.width) ||
-            (demo->height != event->xconfigure.height)) {
-            demo->width = event->xconfigure.width;
-            demo->height = event->xconfigure.height;
-            demo_resize(demo);
+
+        case 3: {
+            float v = ((float)(frame % 2000) / 1000.0) - 1.0;
+            tx = ty = sin(v * 3.1415) * 1.5;
+        }
+        // Fall through:
+        case 1:
+        case 2:
+            // Center patch covering 10% of the area:
+            if (fabsf(fabsf(cx - tx) - 0.31623f) < px || fabsf(fabsf(cy - ty) - 0.31623f) < py)
+                return false;
+
+            on = (demo->testpattern != 2 || (frame % 600) < 200);
+            if (on && fabsf(cx - tx) < 0.31623f && fabsf(cy - ty) < 0.31623f) {
+                for (i = 0; i < 3; i++)
+                    nits[i] = demo->rgb[i];
+            }
+            return true;
+
+        case 4:
+        case 5:
+            on = (demo->testpattern != 5 || (frame % 600) < 200);
+            for (i = 0; i < 3 && on; i++)
+                nits[i] = demo->rgb[i];
+            return true;
+
+        case 6: {
+            // PQ ramp, 1024 steps across, bands of gray, red, green and blue from bottom up:
+            const float u = (x + 0.5f) / w * 1024;
+            const int band = (int) ((y + 0.5f) / h * 4);
+            const float code = tf_pq_encode_ref(maxL) * (float) (int) u / (float) (1024 - 1);
+            const float L = tf_pq_decode_ref(code);
+
+            if (fabsf(u - roundf(u)) < 0.02f || fabsf((y + 0.5f) / h * 4 - roundf((y + 0.5f) / h * 4)) < 0.02f)
+                return false;
+
+            nits[0] = (band == 0 || band == 1) ? L : 0;
+            nits[1] = (band == 0 || band == 2) ? L : 0;
+            nits[2] = (band == 0 || band == 3) ? L : 0;
+            return true;
         }
+    }
+
+    return false;
+}
+
+// MK: Store pixel 'rgba' in 'format', one of the interop image formats:
+static void demo_verify_pack(VkFormat format, const float *rgba, void *dst)
+{
+    int c;
+
+    switch (format) {
+    case VK_FORMAT_R16G16B16A16_SFLOAT:
+        for (c = 0; c < 4; c++)
+            ((uint16_t *) dst)[c] = tf_float_to_half_ref(rgba[c]);
+        break;
+
+    case VK_FORMAT_A2B10G10R10_UNORM_PACK32: {
+        uint32_t v = (uint32_t) lrintf(tf_clampf(rgba[3], 0.0f, 1.0f) * 3) << 30;
+
+        for (c = 0; c < 3; c++)
+            v |= (uint32_t) lrintf(tf_clampf(rgba[c], 0.0f, 1.0f) * 1023) << (10 * c);
+        memcpy(dst, &v, sizeof(v));
         break;
+    }
+
     default:
+        for (c = 0; c < 4; c++)
+            ((uint8_t *) dst)[c] = (uint8_t) lrintf(tf_clampf(rgba[c], 0.0f, 1.0f) * 255);
+        break;
+    }
+}
+
+// MK: Load pixel 'rgba' from 'format', one of the interop image or swapchain formats:
+static void demo_verify_unpack(VkFormat format, const void *src, float *rgba)
+{
+    const uint8_t *b = src;
+    int c;
+
+    switch (format) {
+    case VK_FORMAT_R16G16B16A16_SFLOAT:
+        for (c = 0; c < 4; c++)
+            rgba[c] = tf_half_to_float_ref(((const uint16_t *) src)[c]);
+        break;
+
+    case VK_FORMAT_A2B10G10R10_UNORM_PACK32: {
+        uint32_t v;
+
+        memcpy(&v, src, sizeof(v));
+        for (c = 0; c < 3; c++)
+            rgba[c] = ((v >> (10 * c)) & 0x3ff) / 1023.0f;
+        rgba[3] = (v >> 30) / 3.0f;
         break;
     }
 
+    case VK_FORMAT_B8G8R8A8_UNORM:
+        rgba[0] = b[2] / 255.0f;
+        rgba[1] = b[1] / 255.0f;
+        rgba[2] = b[0] / 255.0f;
+        rgba[3] = b[3] / 255.0f;
+        break;
+
+    default:
+        for (c = 0; c < 4; c++)
+            rgba[c] = b[c] / 255.0f;
+        break;
+    }
 }
 
-static void demo_run_xlib(struct demo *demo) {
+static const char *demo_verify_format_name(VkFormat format)
+{
+    switch (format) {
+    case VK_FORMAT_R16G16B16A16_SFLOAT:
+        return "RGBA16F";
 
-    while (!demo->quit) {
-        XEvent event;
+    case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+        return "RGB10A2";
 
-        if (demo->pause) {
-            XNextEvent(demo->display, &event);
-            demo_handle_xlib_event(demo, &event);
-        }
-        while (XPending(demo->display) > 0) {
-            XNextEvent(demo->display, &event);
-            demo_handle_xlib_event(demo, &event);
-        }
+    case VK_FORMAT_B8G8R8A8_UNORM:
+        return "BGRA8";
 
-        demo_draw(demo);
-        demo->curFrame++;
-        if (demo->frameCount != INT32_MAX && demo->curFrame == demo->frameCount)
-            demo->quit = true;
+    default:
+        return "RGBA8";
     }
 }
-#elif defined(VK_USE_PLATFORM_XCB_KHR) || defined(VK_USE_PLATFORM_DISPLAY_KHR)
 
-static void demo_handle_xcb_event(struct demo *demo,
-                              const xcb_generic_event_t *event) {
-    uint8_t event_code = event->response_type & 0x7f;
-    switch (event_code) {
-    case XCB_EXPOSE:
-        // TODO: Resize window
-        printf("XCB_EXPOSE\n");
+// Render test pattern 'pattern' at frame 'frame' through draw_opengl() into demo->dstfbo, and
+// read it back as w x h RGBA float 'pixels':
+static void demo_verify_render(struct demo *demo, int pattern, int frame, int w, int h, float *pixels)
+{
+    demo->testpattern = pattern;
+    demo->curFrame = frame;
 
-        break;
-    case XCB_CLIENT_MESSAGE:
-        if ((*(xcb_client_message_event_t *)event).data.data32[0] ==
-            (*demo->atom_wm_delete_window).atom) {
-            demo->quit = true;
+    draw_opengl(demo);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, demo->dstfbo);
+    glReadPixels(0, 0, w, h, GL_RGBA, GL_FLOAT, pixels);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+}
+
+// Compare w x h RGBA float 'pixels' of a run at frame 'frame' against the cpu reference,
+// encoded with output transfer function 'tf', where OUTPUT_TF_NONE is PQ as well. Errors
+// are in code values of 'levels', rounded to whole codes if 'quantize', or in half float
+// ulps for linear output. Accumulates per channel max and sum, and counts skipped pixels:
+static void demo_verify_compare(struct demo *demo, int frame, int w, int h, const uint8_t *cat, int cat_w, int cat_h,
+                                const float *pixels, int tf, int levels, bool quantize,
+                                double maxerr[3], double sumerr[3], int *skipped)
+{
+    int x, y, c;
+
+    for (y = 0; y < h; y++) {
+        for (x = 0; x < w; x++) {
+            const float *out = &pixels[(y * w + x) * 4];
+            float nits[3];
+
+            if (!demo_verify_reference(demo, frame, x, y, w, h, cat, cat_w, cat_h, nits)) {
+                (*skipped)++;
+                continue;
+            }
+
+            for (c = 0; c < 3; c++) {
+                // The client renders in half precision:
+                const float L = tf_half_to_float_ref(tf_float_to_half_ref(nits[c]));
+                double ref, val, error;
+
+                switch (tf) {
+                case OUTPUT_TF_NONE:
+                case OUTPUT_TF_PQ:
+                    ref = demo_pq_oetf(L) * levels;
+                    break;
+
+                case OUTPUT_TF_HLG:
+                    ref = demo_hlg_oetf(L) * levels;
+                    break;
+
+                case OUTPUT_TF_SRGB:
+                    ref = tf_srgb_encode_ref(L / 80.0f) * levels;
+                    break;
+
+                default:
+                    // Both are non-negative, so the distance of the bit patterns is in ulps:
+                    ref = tf_float_to_half_ref(L / 80.0f);
+                    break;
+                }
+
+                if (tf == OUTPUT_TF_LINEAR) {
+                    val = tf_float_to_half_ref(out[c]);
+                }
+                else {
+                    val = out[c] * levels;
+                    if (quantize) {
+                        ref = floor(ref + 0.5);
+                        val = floor(val + 0.5);
+                    }
+                }
+
+                error = fabs(val - ref);
+                if (error > maxerr[c])
+                    maxerr[c] = error;
+                sumerr[c] += error;
+            }
         }
-        printf("XCB_CLIENT_MESSAGE\n");
+    }
+}
 
-        break;
-    case XCB_KEY_RELEASE: {
-        const xcb_key_release_event_t *key =
-            (const xcb_key_release_event_t *)event;
+// Print the error and timing columns of one run. Returns true if no error exceeds one:
+static bool demo_verify_report(int w, int h, const double maxerr[3], const double sumerr[3], int skipped,
+                               uint64_t t0, uint64_t t1, uint64_t t2)
+{
+    const int count = w * h - skipped;
 
-        switch (key->detail) {
-        case 0x9: // Escape
-    case 0x18: // q key
-            demo->quit = true;
-            break;
-        case 0x71: // left arrow key
-            demo->spin_angle -= demo->spin_increment;
-            break;
-        case 0x72: // right arrow key
-            demo->spin_angle += demo->spin_increment;
-            break;
-        case 0x41: // space bar
-            demo->pause = !demo->pause;
+    printf("%8.4f %8.4f %8.4f %8.4f %8.4f %8.4f %8i %6.2fms %6.2fms\n",
+           maxerr[0], maxerr[1], maxerr[2], sumerr[0] / count, sumerr[1] / count,
+           sumerr[2] / count, skipped, (t1 - t0) / 1e6, (t2 - t1) / 1e6);
+
+    return maxerr[0] <= 1.0 && maxerr[1] <= 1.0 && maxerr[2] <= 1.0;
+}
+
+// MK: Headless Vulkan device for demo_verify_vulkan(), without any WSI. Prefers a cpu device,
+// e.g., Mesa's lavapipe, which needs no gpu either, over the --gpu one. Returns false if there
+// is no Vulkan device:
+static bool demo_verify_init_vk(struct demo *demo)
+{
+    const VkApplicationInfo app = {
+        .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
+        .pNext = NULL,
+        .pApplicationName = APP_SHORT_NAME,
+        .applicationVersion = 0,
+        .pEngineName = APP_SHORT_NAME,
+        .engineVersion = 0,
+        .apiVersion = VK_API_VERSION_1_0,
+    };
+    const VkInstanceCreateInfo inst_info = {
+        .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+        .pNext = NULL,
+        .pApplicationInfo = &app,
+        .enabledLayerCount = 0,
+        .ppEnabledLayerNames = NULL,
+        .enabledExtensionCount = 0,
+        .ppEnabledExtensionNames = NULL,
+    };
+    VkPhysicalDeviceFeatures features;
+    VkPhysicalDevice *gpus;
+    VkExtensionProperties *extensions;
+    uint32_t gpu_count = 0, extension_count = 0, i;
+
+    if (vkCreateInstance(&inst_info, NULL, &demo->inst)) {
+        printf("No Vulkan instance.\n");
+        return false;
+    }
+
+    vkEnumeratePhysicalDevices(demo->inst, &gpu_count, NULL);
+    if (gpu_count == 0) {
+        printf("No Vulkan device.\n");
+        vkDestroyInstance(demo->inst, NULL);
+        demo->inst = VK_NULL_HANDLE;
+        return false;
+    }
+
+    gpus = malloc(gpu_count * sizeof(*gpus));
+    vkEnumeratePhysicalDevices(demo->inst, &gpu_count, gpus);
+    demo->gpu = gpus[(demo->gpuindex < gpu_count) ? demo->gpuindex : 0];
+    for (i = 0; i < gpu_count; i++) {
+        vkGetPhysicalDeviceProperties(gpus[i], &demo->gpu_props);
+        if (demo->gpu_props.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU) {
+            demo->gpu = gpus[i];
             break;
         }
-        printf("KEY %x\n", key->detail);
-    } break;
-    case XCB_CONFIGURE_NOTIFY: {
-        const xcb_configure_notify_event_t *cfg =
-            (const xcb_configure_notify_event_t *)event;
-            printf("XCB_CONFIGURE_NOTIFY\n");
+    }
+    free(gpus);
 
-/*
-        if ((demo->width != cfg->width) || (demo->height != cfg->height)) {
-            demo->width = cfg->width;
-            demo->height = cfg->height;
-            demo_resize(demo);
+    vkGetPhysicalDeviceProperties(demo->gpu, &demo->gpu_props);
+    vkGetPhysicalDeviceMemoryProperties(demo->gpu, &demo->memory_properties);
+    vkGetPhysicalDeviceFeatures(demo->gpu, &features);
+    demo->storage_write_without_format = features.shaderStorageImageWriteWithoutFormat;
+
+    // One queue for graphics, compute and transfers:
+    vkGetPhysicalDeviceQueueFamilyProperties(demo->gpu, &demo->queue_family_count, NULL);
+    demo->queue_props = malloc(demo->queue_family_count * sizeof(VkQueueFamilyProperties));
+    vkGetPhysicalDeviceQueueFamilyProperties(demo->gpu, &demo->queue_family_count, demo->queue_props);
+    demo->graphics_queue_family_index = 0;
+    for (i = 0; i < demo->queue_family_count; i++) {
+        if ((demo->queue_props[i].queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) ==
+            (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) {
+            demo->graphics_queue_family_index = i;
+            break;
         }
-*/
-    } break;
-    default:
-        break;
     }
+    demo->separate_present_queue = false;
+
+    // The swapchain extension only for the VK_IMAGE_LAYOUT_PRESENT_SRC_KHR layout of the
+    // offscreen swapchain image:
+    demo->enabled_extension_count = 0;
+    vkEnumerateDeviceExtensionProperties(demo->gpu, NULL, &extension_count, NULL);
+    extensions = malloc(extension_count * sizeof(*extensions));
+    vkEnumerateDeviceExtensionProperties(demo->gpu, NULL, &extension_count, extensions);
+    for (i = 0; i < extension_count; i++) {
+        if (!strcmp(VK_KHR_SWAPCHAIN_EXTENSION_NAME, extensions[i].extensionName))
+            demo->extension_names[demo->enabled_extension_count++] = VK_KHR_SWAPCHAIN_EXTENSION_NAME;
+    }
+    free(extensions);
+
+    demo_create_device(demo);
+    vkGetDeviceQueue(demo->device, demo->graphics_queue_family_index, 0, &demo->graphics_queue);
+
+    return true;
 }
 
-static void demo_run_xcb(struct demo *demo) {
-    unsigned char keys_return[32];
-    unsigned int keysdown, i, j;
+// Optimal tiled w x h image 'tex' of 'format' with 'usage', and its view:
+static void demo_verify_image(struct demo *demo, VkFormat format, VkImageUsageFlags usage, int w, int h,
+                              struct texture_object *tex)
+{
+    VkMemoryRequirements mem_reqs;
+    VkResult U_ASSERT_ONLY err;
+    bool U_ASSERT_ONLY pass;
 
-    xcb_flush(demo->connection);
+    const VkImageCreateInfo image_create_info = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .pNext = NULL,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = format,
+        .extent = {w, h, 1},
+        .mipLevels = 1,
+        .arrayLayers = 1,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = usage,
+        .flags = 0,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+    };
 
-    while (!demo->quit) {
-        xcb_generic_event_t *event;
+    memset(tex, 0, sizeof(*tex));
+    tex->tex_width = w;
+    tex->tex_height = h;
+    tex->format = format;
+    tex->mip_levels = 1;
+    tex->imageLayout = VK_IMAGE_LAYOUT_GENERAL;
 
-        if (demo->pause) {
-            event = xcb_wait_for_event(demo->connection);
-        }
-        else {
-            event = xcb_poll_for_event(demo->connection);
-        }
-        while (event) {
-            demo_handle_xcb_event(demo, event);
-            free(event);
-            event = xcb_poll_for_event(demo->connection);
-        }
+    err = vkCreateImage(demo->device, &image_create_info, NULL, &tex->image);
+    assert(!err);
 
-        memset(keys_return, 0, sizeof(keys_return));
-        keysdown = 0;
+    vkGetImageMemoryRequirements(demo->device, tex->image, &mem_reqs);
+    pass = demo_memory_alloc(demo, &mem_reqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, true, &tex->alloc);
+    assert(pass);
 
-        if (demo->display)
-            XQueryKeymap(demo->display, (char*) keys_return);
+    err = vkBindImageMemory(demo->device, tex->image, tex->alloc.mem, tex->alloc.offset);
+    assert(!err);
 
-        for (i = 0; i < 32; i++) keysdown+=(unsigned int) keys_return[i];
+    const VkImageViewCreateInfo view = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+        .pNext = NULL,
+        .image = tex->image,
+        .viewType = VK_IMAGE_VIEW_TYPE_2D,
+        .format = format,
+        .components =
+            {
+             VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G,
+             VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A,
+            },
+        .subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1},
+        .flags = 0,
+    };
 
-        // Map 32 times 8 bitvector to 256 element return vector:
-        for(i = 0; i < 32 && !keysdown; i++) {
-            for(j = 0; j < 8; j++) {
-                // This button or key down?
-                if (keys_return[i] & (1<<j)) {
-                    keysdown = i * 8 + j;
-                    break;
-                }
-            }
-        }
+    err = vkCreateImageView(demo->device, &view, NULL, &tex->view);
+    assert(!err);
+}
 
-        if (keysdown)
-            printf("keysdown %i\n", keysdown);
+static void demo_verify_destroy_image(struct demo *demo, struct texture_object *tex)
+{
+    vkDestroyImageView(demo->device, tex->view, NULL);
+    vkDestroyImage(demo->device, tex->image, NULL);
+    demo_memory_free(demo, &tex->alloc);
+    vkDestroySampler(demo->device, tex->sampler, NULL);
+    memset(tex, 0, sizeof(*tex));
+}
 
-        switch (keysdown) {
-            case 0x1: // q key
-                demo->quit = true;
-                break;
-            case 0x2: // left arrow key
-                demo->spin_angle -= demo->spin_increment;
-                break;
-            case 0x4: // right arrow key
-                demo->spin_angle += demo->spin_increment;
-                break;
-            case 0x41: // space bar
-                demo->pause = !demo->pause;
-                break;
+// MK: Vulkan side of the golden image test: Hand the OpenGL output of a few runs to the
+// real Vulkan presentation path, i.e., demo_draw_build_cmd() with the objects of
+// demo_prepare(), rendering into an offscreen image of a swapchain format instead of a
+// swapchain image, then read that back and compare against the cpu reference. Covers the
+// compute shader conversion, the vkCmdBlitImage() conversion, and the fullscreen triangle
+// with each of the output transfer function pipelines. For those, OpenGL renders linear
+// nits into an RGBA16F image, as it does with --outputtf. Errors are in code values of
+// the coarser of interop and swapchain format, or in half float ulps for linear output.
+// Configurations the device can't do are skipped. Returns true if no error exceeds one, false
+// if there is no Vulkan device, unless demo->verify_allow_skip:
+static bool demo_verify_vulkan(struct demo *demo, int w, int h, const uint8_t *cat, int cat_w, int cat_h,
+                               float *pixels)
+{
+    static const struct {
+        const char *name;
+        bool blit;
+        bool compute;
+        int output_tf;
+    } configs[] = {
+        { "compute convert", true, true, OUTPUT_TF_NONE },
+        { "blit convert", true, false, OUTPUT_TF_NONE },
+        { "shader", false, false, OUTPUT_TF_NONE },
+        { "shader PQ", false, false, OUTPUT_TF_PQ },
+        { "shader HLG", false, false, OUTPUT_TF_HLG },
+        { "shader linear", false, false, OUTPUT_TF_LINEAR },
+        { "shader sRGB", false, false, OUTPUT_TF_SRGB },
+    };
+    static const int runs[][2] = { { 0, 45 }, { 3, 250 }, { 6, 0 } };
+    const VkFormat interop_format = demo->interop_tex_format;
+    const GLuint encoded_shader = demo->hdr_shader, encoded_fbo = demo->dstfbo;
+    SwapchainImageResources *res;
+    struct texture_object target;
+    VkBuffer readback_buffer;
+    struct memory_alloc readback_alloc;
+    const uint8_t *readback;
+    VkCommandBuffer readback_cmd;
+    VkMemoryRequirements mem_reqs;
+    VkFence fence;
+    GLuint linear_shader, linear_color, linear_fbo;
+    VkResult U_ASSERT_ONLY err;
+    bool U_ASSERT_ONLY found;
+    bool pass = true;
+    int n, r, x, c;
+
+    // Not testing anything must not look like a pass:
+    if (!demo_verify_init_vk(demo)) {
+        if (demo->verify_allow_skip) {
+            printf("Skipping the Vulkan side of the golden image test, as allowed by --allow-skip.\n");
+            return true;
         }
 
-        demo_draw(demo);
-        demo->curFrame++;
-        if (demo->frameCount != INT32_MAX && demo->curFrame == demo->frameCount)
-            demo->quit = true;
+        printf("Golden image test of the Vulkan side FAILED: No Vulkan device. Use --allow-skip to skip it.\n");
+        return false;
     }
-}
 
-static void demo_create_xcb_window(struct demo *demo) {
-    uint32_t value_mask, value_list[32];
-    uint32_t override_redirect = 1;
+    printf("\nGolden image test of the Vulkan side on %s, %i x %i. Errors in code values, or half float ulps:\n",
+           demo->gpu_props.deviceName, w, h);
+    printf("config           interop swapchain pattern frame    max R    max G    max B   mean R   mean G   mean B  skipped  render   check\n");
 
-    demo->xcb_window = xcb_generate_id(demo->connection);
+    // OpenGL output with --outputtf, ie. without encode:
+    linear_shader = demo_build_hdr_shader(HDR_ENCODE_NONE, false, demo->hdr_poly, demo->gamut_map,
+                                          demo->gamut_matrix, demo->gamut_luma, demo->use_tonemap, 0);
+    glCreateTextures(GL_TEXTURE_2D, 1, &linear_color);
+    glTextureStorage2D(linear_color, 1, GL_RGBA16F, w, h);
+    glCreateFramebuffers(1, &linear_fbo);
+    glNamedFramebufferTexture(linear_fbo, GL_COLOR_ATTACHMENT0, linear_color, 0);
 
-    value_mask = XCB_CW_BACK_PIXEL | XCB_CW_EVENT_MASK;
-    value_list[0] = demo->screen->black_pixel;
-    value_list[1] = XCB_EVENT_MASK_KEY_RELEASE | XCB_EVENT_MASK_EXPOSURE |
-                    XCB_EVENT_MASK_STRUCTURE_NOTIFY;
+    // One offscreen "swapchain image", and the fullscreen transform of demo_init():
+    demo->width = w;
+    demo->height = h;
+    demo->current_buffer = 0;
+    demo->swapchainImageCount = 1;
+    demo->swapchain_image_resources = calloc(1, sizeof(SwapchainImageResources));
+    res = &demo->swapchain_image_resources[0];
 
-    demo->visualID = demo->screen->root_visual;
+    mat4x4_ortho(demo->projection_matrix, -1.0, 1.0, -1.0, 1.0, -1.0, 1.0);
+    mat4x4_identity(demo->view_matrix);
+    mat4x4_identity(demo->model_matrix);
+    demo->projection_matrix[1][1] *= -1;
 
-    // MK TODO: Adjust x start position to viewport of output which displays Vulkan,
-    // instead of hard-coded 300 for the internal output:
-    xcb_create_window(demo->connection, XCB_COPY_FROM_PARENT, demo->xcb_window,
-                      demo->screen->root, 300, 0, demo->width, demo->height, 0,
-                      XCB_WINDOW_CLASS_INPUT_OUTPUT, /*demo->screen->root_visual*/ demo->visualID,
-                      value_mask, value_list);
+    const VkCommandPoolCreateInfo cmd_pool_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .pNext = NULL,
+        .queueFamilyIndex = demo->graphics_queue_family_index,
+        .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+    };
+    err = vkCreateCommandPool(demo->device, &cmd_pool_info, NULL, &demo->cmd_pool);
+    assert(!err);
 
-    /* Magic code that will send notification when window is destroyed */
-    xcb_intern_atom_cookie_t cookie =
-        xcb_intern_atom(demo->connection, 1, 12, "WM_PROTOCOLS");
-    xcb_intern_atom_reply_t *reply =
-        xcb_intern_atom_reply(demo->connection, cookie, 0);
+    const VkCommandBufferAllocateInfo cmd_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .pNext = NULL,
+        .commandPool = demo->cmd_pool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1,
+    };
+    err = vkAllocateCommandBuffers(demo->device, &cmd_info, &res->cmd);
+    assert(!err);
+    err = vkAllocateCommandBuffers(demo->device, &cmd_info, &readback_cmd);
+    assert(!err);
 
-    xcb_intern_atom_cookie_t cookie2 =
-        xcb_intern_atom(demo->connection, 0, 16, "WM_DELETE_WINDOW");
-    demo->atom_wm_delete_window =
-        xcb_intern_atom_reply(demo->connection, cookie2, 0);
+    const VkCommandBufferBeginInfo cmd_buf_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .pInheritanceInfo = NULL,
+    };
 
-    xcb_change_property(demo->connection, XCB_PROP_MODE_REPLACE, demo->xcb_window,
-                        (*reply).atom, 4, 32, 1,
-                        &(*demo->atom_wm_delete_window).atom);
-    free(reply);
+    const VkFenceCreateInfo fence_info = {
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+    };
+    err = vkCreateFence(demo->device, &fence_info, NULL, &fence);
+    assert(!err);
 
-    // MK Need override_redirect so WM does leave our window on the target display output for Vulkan:
-    xcb_change_window_attributes(demo->connection, demo->xcb_window, XCB_CW_OVERRIDE_REDIRECT, &override_redirect);
+    // Host visible copy of the offscreen image, large enough for all formats:
+    const VkBufferCreateInfo buf_info = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .pNext = NULL,
+        .size = (VkDeviceSize) w * h * 8,
+        .usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+    };
+    err = vkCreateBuffer(demo->device, &buf_info, NULL, &readback_buffer);
+    assert(!err);
 
-    // MK this is not enough though. We need to set the X-Screens primary output to
-    // the Vulkan output, so the DDX selects the right crtc, given that it ignores
-    // all crtc's with disconnected outputs, and therefore the normal "max viewport <-> window intersection area"
-    // method does not work, and the primary output is always chosen for (msc,ust) queries.
-    //
-    // Well that, or hack the DDX to "consider_disabled" crtc's during crtc picking
-    // DRI3/Present...
+    vkGetBufferMemoryRequirements(demo->device, readback_buffer, &mem_reqs);
+    found = demo_memory_alloc(demo, &mem_reqs,
+                              VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT |
+                              VK_MEMORY_PROPERTY_HOST_CACHED_BIT, false, &readback_alloc) ||
+            demo_memory_alloc(demo, &mem_reqs,
+                              VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                              false, &readback_alloc);
+    assert(found);
+    err = vkBindBufferMemory(demo->device, readback_buffer, readback_alloc.mem, readback_alloc.offset);
+    assert(!err);
+    readback = demo_memory_map(demo, &readback_alloc);
+
+    // The OpenGL output goes in through the upload ring, as a movie frame would:
+    demo_prepare_upload_ring(demo, (VkDeviceSize) w * h * 8, 1);
+
+    for (n = 0; n < (int) (sizeof(configs) / sizeof(configs[0])); n++) {
+        const int tf = configs[n].output_tf;
+        VkFormatProperties interop_props, swapchain_props;
+        VkFormatFeatureFlags interop_needed = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+        VkFormatFeatureFlags swapchain_needed = 0;
+        VkImageUsageFlags usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+                                  VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        int levels, interop_levels, swapchain_levels;
+
+        demo->use_blit = configs[n].blit;
+        demo->use_compute_convert = configs[n].compute;
+        demo->output_tf = tf;
+        demo->interop_tex_format = (tf == OUTPUT_TF_NONE) ? interop_format : VK_FORMAT_R16G16B16A16_SFLOAT;
+        demo->hdr_shader = (tf == OUTPUT_TF_NONE) ? encoded_shader : linear_shader;
+        demo->dstfbo = (tf == OUTPUT_TF_NONE) ? encoded_fbo : linear_fbo;
+
+        // Swapchain formats as the surface would offer them for each transfer function,
+        // always a different one than the interop format, so there is a conversion:
+        switch (tf) {
+        case OUTPUT_TF_NONE:
+            demo->format = (interop_format == VK_FORMAT_A2B10G10R10_UNORM_PACK32) ?
+                           VK_FORMAT_B8G8R8A8_UNORM : VK_FORMAT_A2B10G10R10_UNORM_PACK32;
+            break;
 
-    xcb_map_window(demo->connection, demo->xcb_window);
-    xcb_flush(demo->connection);
-}
+        case OUTPUT_TF_LINEAR:
+            demo->format = VK_FORMAT_R16G16B16A16_SFLOAT;
+            break;
 
-/*
- *        Attribs filter the list of FBConfigs returned by glXChooseFBConfig().
- *        Visual attribs further described in glXGetFBConfigAttrib(3)
- */
-static int visual_attribs[] =
-{
-    GLX_X_RENDERABLE, True,
-    GLX_DRAWABLE_TYPE, GLX_WINDOW_BIT,
-    GLX_RENDER_TYPE, GLX_RGBA_BIT,
-    GLX_X_VISUAL_TYPE, GLX_TRUE_COLOR,
-    GLX_RED_SIZE, 8,
-    GLX_GREEN_SIZE, 8,
-    GLX_BLUE_SIZE, 8,
-    GLX_ALPHA_SIZE, 8,
-    GLX_DEPTH_SIZE, 24,
-    GLX_STENCIL_SIZE, 8,
-    GLX_DOUBLEBUFFER, True,
-    //GLX_SAMPLE_BUFFERS  , 1,
-    //GLX_SAMPLES         , 4,
-    None
-};
+        case OUTPUT_TF_SRGB:
+            demo->format = VK_FORMAT_B8G8R8A8_UNORM;
+            break;
+
+        default:
+            demo->format = VK_FORMAT_A2B10G10R10_UNORM_PACK32;
+            break;
+        }
+
+        interop_levels = demo_format_levels(demo->interop_tex_format) ? demo_format_levels(demo->interop_tex_format) : 1023;
+        swapchain_levels = demo_format_levels(demo->format) ? demo_format_levels(demo->format) : 1023;
+        levels = (interop_levels < swapchain_levels) ? interop_levels : swapchain_levels;
+
+        if (demo->use_compute_convert) {
+            swapchain_needed |= VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT;
+            usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+        }
+        else if (demo->use_blit) {
+            interop_needed |= VK_FORMAT_FEATURE_BLIT_SRC_BIT;
+            swapchain_needed |= VK_FORMAT_FEATURE_BLIT_DST_BIT;
+        }
+        else {
+            swapchain_needed |= VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT;
+        }
+
+        vkGetPhysicalDeviceFormatProperties(demo->gpu, demo->interop_tex_format, &interop_props);
+        vkGetPhysicalDeviceFormatProperties(demo->gpu, demo->format, &swapchain_props);
+        if ((interop_props.optimalTilingFeatures & interop_needed) != interop_needed ||
+            (swapchain_props.optimalTilingFeatures & swapchain_needed) != swapchain_needed ||
+            (demo->use_compute_convert && !demo->storage_write_without_format)) {
+            printf("%-16s %7s %9s skipped, as the device can't do it.\n", configs[n].name,
+                   demo_verify_format_name(demo->interop_tex_format), demo_verify_format_name(demo->format));
+            continue;
+        }
+
+        // Stand-ins for interop image and swapchain image, then everything else as demo_prepare() does it:
+        demo_verify_image(demo, demo->interop_tex_format, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+                          VK_IMAGE_USAGE_TRANSFER_DST_BIT, w, h, &demo->textures[0]);
+        demo_verify_image(demo, demo->format, usage, w, h, &target);
+        res->image = target.image;
+        res->view = target.view;
+
+        const VkSamplerCreateInfo sampler = {
+            .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+            .pNext = NULL,
+            .magFilter = VK_FILTER_NEAREST,
+            .minFilter = VK_FILTER_NEAREST,
+            .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+            .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+            .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+            .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+            .mipLodBias = 0.0f,
+            .anisotropyEnable = VK_FALSE,
+            .maxAnisotropy = 1,
+            .compareOp = VK_COMPARE_OP_NEVER,
+            .minLod = 0.0f,
+            .maxLod = 0.0f,
+            .borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE,
+            .unnormalizedCoordinates = VK_FALSE,
+        };
+        err = vkCreateSampler(demo->device, &sampler, NULL, &demo->textures[0].sampler);
+        assert(!err);
 
-static void demo_create_glx_opengl1(struct demo *demo)
-{
-    int visualID = 0;
+        // Swapchain images start out presentable:
+        err = vkAllocateCommandBuffers(demo->device, &cmd_info, &demo->cmd);
+        assert(!err);
+        err = vkBeginCommandBuffer(demo->cmd, &cmd_buf_info);
+        assert(!err);
+        demo_set_image_layout(demo, target.image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+                              VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, 0, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                              VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, NULL);
+        demo_flush_init_cmd(demo);
+
+        demo_prepare_descriptor_layout(demo);
+        demo_prepare_render_pass(demo);
+        demo_prepare_pipeline(demo);
+        demo_prepare_descriptor_pool(demo);
+        demo_prepare_descriptor_set(demo);
+        demo_prepare_convert_pipeline(demo);
+        demo_prepare_convert_descriptors(demo);
+        demo_prepare_framebuffers(demo);
+        demo_draw_build_cmd(demo, res->cmd);
+
+        // Copy of the presentable image to the host:
+        err = vkBeginCommandBuffer(readback_cmd, &cmd_buf_info);
+        assert(!err);
 
-    /* Query framebuffer configurations that match visual_attribs */
-    GLXFBConfig *fb_configs = 0;
-    int num_fb_configs = 0;
+        demo_set_image_layout(demo, target.image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                              VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                              VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+                              VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, readback_cmd);
+
+        const VkBufferImageCopy region = {
+            .bufferOffset = 0,
+            .bufferRowLength = 0,
+            .bufferImageHeight = 0,
+            .imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+            .imageOffset = {0, 0, 0},
+            .imageExtent = {w, h, 1},
+        };
+        vkCmdCopyImageToBuffer(readback_cmd, target.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readback_buffer,
+                               1, &region);
 
-    fb_configs = glXChooseFBConfig(demo->display, DefaultScreen(demo->display), visual_attribs, &num_fb_configs);
-    if(!fb_configs || num_fb_configs == 0)
-    {
-        fprintf(stderr, "glXGetFBConfigs failed\n");
-        exit(1);
-    }
+        const VkBufferMemoryBarrier buffer_barrier = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+            .pNext = NULL,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .buffer = readback_buffer,
+            .offset = 0,
+            .size = VK_WHOLE_SIZE,
+        };
+        vkCmdPipelineBarrier(readback_cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+                             0, NULL, 1, &buffer_barrier, 0, NULL);
 
-    printf("Found %d matching FB configs\n", num_fb_configs);
+        demo_set_image_layout(demo, target.image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                              VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_ACCESS_TRANSFER_READ_BIT,
+                              VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, readback_cmd);
 
-    /* Select first framebuffer config and query visualID */
-    GLXFBConfig fb_config = fb_configs[0];
-    glXGetFBConfigAttrib(demo->display, fb_config, GLX_VISUAL_ID , &visualID);
+        err = vkEndCommandBuffer(readback_cmd);
+        assert(!err);
 
-    demo->visualID = visualID;
+        for (r = 0; r < (int) (sizeof(runs) / sizeof(runs[0])); r++) {
+            const uint32_t texel_size = demo_format_size(demo->interop_tex_format);
+            const uint32_t target_size = demo_format_size(demo->format);
+            const VkCommandBuffer cmd_bufs[2] = { res->cmd, readback_cmd };
+            double maxerr[3] = { 0, 0, 0 }, sumerr[3] = { 0, 0, 0 };
+            struct upload_slot *slot;
+            uint64_t t0, t1, t2;
+            int skipped = 0;
+
+            if (runs[r][0] == 0 && !cat)
+                continue;
+
+            t0 = getTimeInNanoseconds();
+            demo_verify_render(demo, runs[r][0], runs[r][1], w, h, pixels);
+
+            slot = demo_upload_acquire(demo);
+            for (x = 0; x < w * h; x++)
+                demo_verify_pack(demo->interop_tex_format, &pixels[x * 4], (uint8_t *) slot->data + x * texel_size);
+            slot->width = w;
+            slot->height = h;
+            demo_upload_record(demo, slot, &demo->textures[0]);
+            demo_upload_submit(demo, slot);
+
+            const VkSubmitInfo submit_info = {
+                .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+                .pNext = NULL,
+                .waitSemaphoreCount = 0,
+                .commandBufferCount = 2,
+                .pCommandBuffers = cmd_bufs,
+                .signalSemaphoreCount = 0,
+            };
+            err = vkQueueSubmit(demo->graphics_queue, 1, &submit_info, fence);
+            assert(!err);
+            vkWaitForFences(demo->device, 1, &fence, VK_TRUE, UINT64_MAX);
+            vkResetFences(demo->device, 1, &fence);
+            t1 = getTimeInNanoseconds();
 
-    /* Create OpenGL context */
-    demo->context = glXCreateNewContext(demo->display, fb_config, GLX_RGBA_TYPE, 0, True);
-    if(!demo->context)
-    {
-        fprintf(stderr, "glXCreateNewContext failed\n");
-        exit(1);
-    }
+            // The OpenGL output is uploaded already, so reuse its buffer for the readback:
+            for (x = 0; x < w * h; x++)
+                demo_verify_unpack(demo->format, readback + x * target_size, &pixels[x * 4]);
 
-    demo->fb_config = fb_config;
+            demo_verify_compare(demo, runs[r][1], w, h, cat, cat_w, cat_h, pixels, tf, levels, true,
+                                maxerr, sumerr, &skipped);
+            t2 = getTimeInNanoseconds();
+
+            printf("%-16s %7s %9s %7i %5i ", configs[n].name, demo_verify_format_name(demo->interop_tex_format),
+                   demo_verify_format_name(demo->format), runs[r][0], runs[r][1]);
+            pass = demo_verify_report(w, h, maxerr, sumerr, skipped, t0, t1, t2) && pass;
+        }
+
+        vkDeviceWaitIdle(demo->device);
+        demo_upload_drain(demo);
+        vkDestroyFramebuffer(demo->device, res->framebuffer, NULL);
+        vkDestroyDescriptorPool(demo->device, demo->desc_pool, NULL);
+        for (c = 0; c < OUTPUT_TF_COUNT; c++)
+            vkDestroyPipeline(demo->device, demo->tf_pipelines[c], NULL);
+        vkDestroyPipelineCache(demo->device, demo->pipelineCache, NULL);
+        vkDestroyRenderPass(demo->device, demo->render_pass, NULL);
+        vkDestroyPipelineLayout(demo->device, demo->pipeline_layout, NULL);
+        vkDestroyDescriptorSetLayout(demo->device, demo->desc_layout, NULL);
+        demo_destroy_convert_pipeline(demo, true);
+        demo_verify_destroy_image(demo, &demo->textures[0]);
+        demo_verify_destroy_image(demo, &target);
+    }
+
+    printf("Golden image test of the Vulkan side %s.\n", pass ? "passed" : "FAILED");
+
+    demo->hdr_shader = encoded_shader;
+    demo->dstfbo = encoded_fbo;
+    glDeleteFramebuffers(1, &linear_fbo);
+    glDeleteTextures(1, &linear_color);
+    glDeleteProgram(linear_shader);
+
+    demo_destroy_upload_ring(demo);
+    vkDestroyBuffer(demo->device, readback_buffer, NULL);
+    demo_memory_free(demo, &readback_alloc);
+    vkDestroyFence(demo->device, fence, NULL);
+    vkDestroyCommandPool(demo->device, demo->cmd_pool, NULL);
+    demo_memory_destroy(demo);
+    vkDestroyDevice(demo->device, NULL);
+    vkDestroyInstance(demo->inst, NULL);
+    free(demo->swapchain_image_resources);
+    free(demo->queue_props);
+
+    return pass;
 }
 
-static void demo_create_glx_opengl2(struct demo *demo)
+// MK: Headless golden image test: Render each test pattern through the real OpenGL client
+// and HDR post-processing path of draw_opengl(), on a windowless EGL context, e.g., Mesa
+// llvmpipe, into an offscreen image of the interop format, which is what the Vulkan side
+// presents if swapchain and interop format match. Compare all code values against a cpu
+// reference of pattern geometry and PQ encode, and report per channel max and mean error
+// in code values of the output format, or 10 bit codes for RGBA16F. Then the same for the
+// Vulkan side, see demo_verify_vulkan(). Returns true if no code value is off by more than one:
+static bool demo_verify(struct demo *demo)
 {
-    /* Create GLX Window */
-    GLXDrawable drawable = 0;
-
-    GLXWindow glxwindow = glXCreateWindow(
-        demo->display,
-        demo->fb_config,
-        demo->xcb_window,
-        0);
+    static const int runs[][2] = {
+        { 0, 0 }, { 0, 45 }, { 1, 0 }, { 2, 0 }, { 2, 300 }, { 3, 0 }, { 3, 250 },
+        { 4, 0 }, { 5, 0 }, { 5, 300 }, { 6, 0 },
+    };
+    const int w = 1024, h = 512;
+
+    // No surface to pick the interop format from, so --format maps directly:
+    demo->interop_tex_format = (demo->interop_tex_format >= 2) ? VK_FORMAT_R16G16B16A16_SFLOAT :
+                               (demo->interop_tex_format == 1) ? VK_FORMAT_A2B10G10R10_UNORM_PACK32 :
+                               VK_FORMAT_R8G8B8A8_UNORM;
+
+    const int levels = demo_format_levels(demo->interop_tex_format) ? demo_format_levels(demo->interop_tex_format) : 1023;
+    const GLenum internalFormat = (demo->interop_tex_format == VK_FORMAT_R16G16B16A16_SFLOAT) ? GL_RGBA16F :
+                                  (demo->interop_tex_format == VK_FORMAT_A2B10G10R10_UNORM_PACK32) ? GL_RGB10_A2 : GL_RGBA8;
+    float *pixels = malloc(w * h * 4 * sizeof(float));
+    const uint8_t *cat = NULL;
+    struct ppm_view cat_view;
+    int32_t cat_w = 0, cat_h = 0;
+    bool pass = true;
+    int r;
+
+    // Simulated display and plain PQ encoding, the options which alter the encoded
+    // output beyond the reference are off:
+    demo->textures[0].tex_width = w;
+    demo->textures[0].tex_height = h;
+    demo->format = demo->interop_tex_format;
+    demo->nativeDisplayHdrMetadata.maxLuminance = 600;
+    demo->nativeDisplayHdrMetadata.maxFrameAverageLightLevel = 300;
+    demo->hdr_enabled = false;
+    demo->output_tf = OUTPUT_TF_NONE;
+    demo->gamut_map = HDR_GAMUT_OFF;
+    demo->use_tonemap = false;
+    demo->use_dither = false;
+    demo->use_glthread = false;
+    demo->interop_enabled = true;
 
-    if(!glxwindow)
-    {
-        xcb_destroy_window(demo->connection, demo->xcb_window);
-        glXDestroyContext(demo->display, demo->context);
+    if (!demo_create_egl_opengl(demo))
+        return false;
 
-        fprintf(stderr, "glXDestroyContext failed\n");
-        exit(1);
+    if (ppm_cache_get(tex_files[0], &cat_view)) {
+        cat = cat_view.pixels;
+        cat_w = cat_view.width;
+        cat_h = cat_view.height;
+    }
+    else {
+        printf("Could not load %s, skipping test pattern 0.\n", tex_files[0]);
     }
 
-    drawable = glxwindow;
+    glCreateTextures(GL_TEXTURE_2D, 1, &demo->color);
+    glTextureStorage2D(demo->color, 1, internalFormat, w, h);
+    glCreateFramebuffers(1, &demo->dstfbo);
+    glNamedFramebufferTexture(demo->dstfbo, GL_COLOR_ATTACHMENT0, demo->color, 0);
+    demo_prepare_opengl_client(demo);
 
-    /* make OpenGL context current */
-    if(!glXMakeContextCurrent(demo->display, drawable, drawable, demo->context))
-    {
-        xcb_destroy_window(demo->connection, demo->xcb_window);
-        glXDestroyContext(demo->display, demo->context);
+    printf("\nGolden image test, %i x %i, %s output, encode mode %i. Errors in code values of %i levels:\n",
+           w, h, (internalFormat == GL_RGBA16F) ? "RGBA16F" : (internalFormat == GL_RGB10_A2) ? "RGB10A2" : "RGBA8",
+           demo->hdr_encode, levels + 1);
+    printf("pattern frame    max R    max G    max B   mean R   mean G   mean B  skipped  render   check\n");
 
-        fprintf(stderr, "glXMakeContextCurrent failed\n");
-        exit(1);
-    }
-    demo->drawable = drawable;
+    for (r = 0; r < (int) (sizeof(runs) / sizeof(runs[0])); r++) {
+        double maxerr[3] = { 0, 0, 0 }, sumerr[3] = { 0, 0, 0 };
+        uint64_t t0, t1, t2;
+        int skipped = 0;
 
-    GLenum glerr = glewInit();
-    if (glerr != GLEW_OK) {
-        printf("glewInit failed!\n");
-        exit(1);
+        if (runs[r][0] == 0 && !cat)
+            continue;
+
+        t0 = getTimeInNanoseconds();
+        demo_verify_render(demo, runs[r][0], runs[r][1], w, h, pixels);
+        t1 = getTimeInNanoseconds();
+
+        // The client renders into RGBA16F, so the encode sees half precision nits:
+        demo_verify_compare(demo, runs[r][1], w, h, cat, cat_w, cat_h, pixels, OUTPUT_TF_PQ, levels,
+                            internalFormat != GL_RGBA16F, maxerr, sumerr, &skipped);
+        t2 = getTimeInNanoseconds();
+
+        printf("%7i %5i ", runs[r][0], runs[r][1]);
+        pass = demo_verify_report(w, h, maxerr, sumerr, skipped, t0, t1, t2) && pass;
     }
-    printf("\nUsing GLEW version %s for OpenGL.\n", glewGetString(GLEW_VERSION));
-    printf("OpenGL renderer: %s %s - OpenGL %s\n", glGetString(GL_VENDOR), glGetString(GL_RENDERER), glGetString(GL_VERSION));
 
-    glXGetSyncValuesOML = (PFNGLXGETSYNCVALUESOMLPROC) glXGetProcAddress("glXGetSyncValuesOML");
+    printf("Golden image test %s.\n", pass ? "passed" : "FAILED");
+
+    pass = demo_verify_vulkan(demo, w, h, cat, cat_w, cat_h, pixels) && pass;
+
+    // No interop semaphores or memory objects, which the GL may not even support:
+    glDeleteFramebuffers(1, &demo->dstfbo);
+    glDeleteFramebuffers(1, &demo->srcfbo);
+    glDeleteTextures(1, &demo->srctexture);
+    glDeleteTextures(1, &demo->color);
+    glDeleteTextures(1, &demo->hdr_lut);
+    glDeleteTextures(1, &demo->dither_noise);
+    glDeleteProgram(demo->hdr_shader);
+    demo_destroy_egl_opengl(demo);
+    ppm_cache_flush();
+    free(pixels);
+
+    return pass;
 }
+#endif
 
 // VK_USE_PLATFORM_XCB_KHR
 #elif defined(VK_USE_PLATFORM_WAYLAND_KHR)
@@ -4431,6 +9678,31 @@ static VkBool32 demo_check_layers(uint32_t check_count, char **check_names,
 
 #if defined(VK_USE_PLATFORM_DISPLAY_KHR)
 
+// MK: Get the EDID of a RandR output from its EDID output property:
+static void demo_get_randr_edid(struct demo *demo, xcb_connection_t *connection, xcb_randr_output_t output)
+{
+    xcb_intern_atom_reply_t *atom_r = xcb_intern_atom_reply(connection, xcb_intern_atom(connection, 1, 4, "EDID"), NULL);
+
+    if (!atom_r)
+        return;
+
+    if (atom_r->atom != XCB_ATOM_NONE) {
+        xcb_randr_get_output_property_cookie_t gop_c = xcb_randr_get_output_property(connection, output, atom_r->atom,
+                                                                                      XCB_ATOM_ANY, 0, EDID_MAX_SIZE / 4, 0, 0);
+        xcb_randr_get_output_property_reply_t *gop_r = xcb_randr_get_output_property_reply(connection, gop_c, NULL);
+
+        if (gop_r && gop_r->format == 8 && gop_r->num_items >= EDID_BLOCK_SIZE) {
+            demo->edid_len = gop_r->num_items - gop_r->num_items % EDID_BLOCK_SIZE;
+            memcpy(demo->edid_data, xcb_randr_get_output_property_data(gop_r), demo->edid_len);
+            printf("Got %zu bytes of EDID from RandR output property.\n", demo->edid_len);
+        }
+
+        free(gop_r);
+    }
+
+    free(atom_r);
+}
+
 static VkBool32 get_x_lease(struct demo *demo, VkDisplayKHR khr_display)
 {
     xcb_connection_t *connection;
@@ -4528,6 +9800,10 @@ static VkBool32 get_x_lease(struct demo *demo, VkDisplayKHR khr_display)
                 if (!demo->output_name[0] || strstr(xcb_randr_get_output_info_name(goi_r), demo->output_name)) {
                     output = ro[o];
                     printf("Selected output %s [%i 0x%x].\n", xcb_randr_get_output_info_name(goi_r), ro[o], ro[o]);
+
+                    // Get the output's EDID, unless one was given via --edid:
+                    if (!demo->edid_path[0])
+                        demo_get_randr_edid(demo, connection, output);
                 }
             }
 
@@ -4554,7 +9830,9 @@ static VkBool32 get_x_lease(struct demo *demo, VkDisplayKHR khr_display)
         //printf("Using output 0x%x\n", output);
 
         #if defined(VK_USE_PLATFORM_DISPLAY_KHR)
-        demo_create_glx_opengl1(demo);
+        // EGL doesn't need a GLX context, the window is still useful for timestamping:
+        if (!demo->use_egl)
+            demo_create_glx_opengl1(demo);
         demo_create_xcb_window(demo);
         #endif
 
@@ -4782,6 +10060,13 @@ static void demo_init_vk(struct demo *demo) {
                 printf("found direct mode display extension\n");
                 demo->extension_names[demo->enabled_extension_count++] = VK_EXT_DIRECT_MODE_DISPLAY_EXTENSION_NAME;
             }
+
+            // Needed for querying DRM format modifiers for DMA-BUF interop:
+            if (!strcmp(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME,
+                instance_extensions[i].extensionName)) {
+                demo->extension_names[demo->enabled_extension_count++] =
+                    VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME;
+            }
 #endif
 
             if (!strcmp(VK_KHR_EXTERNAL_MEMORY_CAPABILITIES_EXTENSION_NAME,
@@ -5020,7 +10305,10 @@ static void demo_init_vk(struct demo *demo) {
     VkBool32 fullscreenexclusiveExtFound = 0;
     VkBool32 externalMemoryWin32ExtFound = 0;
     VkBool32 externalSemaphoreWin32ExtFound = 0;
+    VkBool32 getMemoryRequirements2ExtFound = 0;
+    VkBool32 dedicatedAllocationExtFound = 0;
     demo->amddisplaynativehdrExtFound = 0;
+    demo->dedicatedallocationExtFound = 0;
 
 /*
     VkBool32  = 0;
@@ -5111,6 +10399,18 @@ static void demo_init_vk(struct demo *demo) {
                 demo->extension_names[demo->enabled_extension_count++] = VK_KHR_EXTERNAL_SEMAPHORE_FD_EXTENSION_NAME;
             }
 
+            if (!strcmp(VK_KHR_GET_MEMORY_REQUIREMENTS_2_EXTENSION_NAME,
+                device_extensions[i].extensionName)) {
+                getMemoryRequirements2ExtFound = 1;
+                demo->extension_names[demo->enabled_extension_count++] = VK_KHR_GET_MEMORY_REQUIREMENTS_2_EXTENSION_NAME;
+            }
+
+            if (!strcmp(VK_KHR_DEDICATED_ALLOCATION_EXTENSION_NAME,
+                device_extensions[i].extensionName)) {
+                dedicatedAllocationExtFound = 1;
+                demo->extension_names[demo->enabled_extension_count++] = VK_KHR_DEDICATED_ALLOCATION_EXTENSION_NAME;
+            }
+
 #ifdef WIN32
 
             if (!strcmp(VK_KHR_EXTERNAL_MEMORY_WIN32_EXTENSION_NAME,
@@ -5148,6 +10448,37 @@ static void demo_init_vk(struct demo *demo) {
             }
         }
 
+#if defined(VK_USE_PLATFORM_DISPLAY_KHR)
+        if (demo->use_dmabuf) {
+            // MK: DMA-BUF interop with driver chosen DRM format modifiers needs all of these:
+            const char *dmabuf_extensions[] = {
+                VK_EXT_EXTERNAL_MEMORY_DMA_BUF_EXTENSION_NAME,
+                VK_EXT_IMAGE_DRM_FORMAT_MODIFIER_EXTENSION_NAME,
+                VK_KHR_IMAGE_FORMAT_LIST_EXTENSION_NAME,
+                VK_KHR_BIND_MEMORY_2_EXTENSION_NAME,
+                VK_KHR_SAMPLER_YCBCR_CONVERSION_EXTENSION_NAME,
+                VK_EXT_QUEUE_FAMILY_FOREIGN_EXTENSION_NAME,
+            };
+            uint32_t dmabufExtsFound = 0;
+
+            for (uint32_t j = 0; j < ARRAY_SIZE(dmabuf_extensions); j++) {
+                for (uint32_t i = 0; i < device_extension_count; i++) {
+                    if (!strcmp(dmabuf_extensions[j], device_extensions[i].extensionName)) {
+                        demo->extension_names[demo->enabled_extension_count++] = (char *) dmabuf_extensions[j];
+                        dmabufExtsFound++;
+                        break;
+                    }
+                }
+                assert(demo->enabled_extension_count < 64);
+            }
+
+            if (dmabufExtsFound < ARRAY_SIZE(dmabuf_extensions)) {
+                demo->use_dmabuf = false;
+                printf("WARNING: Vulkan driver lacks extensions for DMA-BUF interop. Using opaque fd interop instead.\n");
+            }
+        }
+#endif
+
         if (demo->VK_GOOGLE_display_timing_enabled) {
             // Even though the user "enabled" the extension via the command
             // line, we must make sure that it's enumerated for use with the
@@ -5226,6 +10557,14 @@ static void demo_init_vk(struct demo *demo) {
 #endif
     }
 
+    if (demo->interop_enabled) {
+        // Optional: Dedicated allocations for the interop image, if the driver prefers them:
+        if (getMemoryRequirements2ExtFound && dedicatedAllocationExtFound) {
+            demo->dedicatedallocationExtFound = 1;
+            printf("found VK_KHR_DEDICATED_ALLOCATION_EXTENSION\n");
+        }
+    }
+
     if (demo->hdr_enabled) {
         if (!hdrmetadataExtFound) {
             demo->hdr_enabled = false;
@@ -5309,6 +10648,9 @@ static void demo_init_vk(struct demo *demo) {
     VkPhysicalDeviceFeatures physDevFeatures;
     vkGetPhysicalDeviceFeatures(demo->gpu, &physDevFeatures);
 
+    // Compute shader format conversion writes swapchain images of any format:
+    demo->storage_write_without_format = physDevFeatures.shaderStorageImageWriteWithoutFormat;
+
     GET_INSTANCE_PROC_ADDR(demo->inst, GetPhysicalDeviceSurfaceSupportKHR);
     GET_INSTANCE_PROC_ADDR(demo->inst, GetPhysicalDeviceSurfaceCapabilitiesKHR);
     GET_INSTANCE_PROC_ADDR(demo->inst, GetPhysicalDeviceSurfaceFormatsKHR);
@@ -5322,6 +10664,11 @@ static void demo_create_device(struct demo *demo) {
     VkResult U_ASSERT_ONLY err;
     float queue_priorities[1] = {0.0};
     VkDeviceQueueCreateInfo queues[2];
+    VkPhysicalDeviceFeatures features;
+
+    memset(&features, 0, sizeof(features));
+    features.shaderStorageImageWriteWithoutFormat = demo->storage_write_without_format;
+
     queues[0].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
     queues[0].pNext = NULL;
     queues[0].queueFamilyIndex = demo->graphics_queue_family_index;
@@ -5338,8 +10685,7 @@ static void demo_create_device(struct demo *demo) {
         .ppEnabledLayerNames = NULL,
         .enabledExtensionCount = demo->enabled_extension_count,
         .ppEnabledExtensionNames = (const char *const *)demo->extension_names,
-        .pEnabledFeatures =
-            NULL, // If specific features are required, pass them in here
+        .pEnabledFeatures = &features,
     };
     if (demo->separate_present_queue) {
         queues[1].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
@@ -5493,6 +10839,23 @@ static void demo_init_vk_swapchain(struct demo *demo) {
 #else
     // External memory fd extension:
     GET_DEVICE_PROC_ADDR(demo->device, GetMemoryFdKHR);
+
+    // External semaphore fd extension:
+    if (demo->interop_enabled)
+        GET_DEVICE_PROC_ADDR(demo->device, GetSemaphoreFdKHR);
+#endif
+
+    // Dedicated allocations for interop memory:
+    if (demo->dedicatedallocationExtFound)
+        GET_DEVICE_PROC_ADDR(demo->device, GetImageMemoryRequirements2KHR);
+
+#if defined(VK_USE_PLATFORM_DISPLAY_KHR)
+    // DMA-BUF interop with DRM format modifiers:
+    if (demo->use_dmabuf) {
+        GET_INSTANCE_PROC_ADDR(demo->inst, GetPhysicalDeviceFormatProperties2KHR);
+        GET_INSTANCE_PROC_ADDR(demo->inst, GetPhysicalDeviceImageFormatProperties2KHR);
+        GET_DEVICE_PROC_ADDR(demo->device, GetImageDrmFormatModifierPropertiesEXT);
+    }
 #endif
 
     if (demo->hdr_enabled) {
@@ -5609,6 +10972,10 @@ static void demo_init_vk_swapchain(struct demo *demo) {
     printf("Content maxFrameAverageLightLevel: %f nits\n", demo->nativeDisplayHdrMetadata.maxFrameAverageLightLevel);
     printf("Content maxContentLightLevel: %f nits\n", demo->nativeDisplayHdrMetadata.maxContentLightLevel);
 
+    // Drivers may report missing or bogus values, the EDID is what the display reports:
+    demo_read_edid(demo);
+    demo_apply_edid(demo);
+
     // Get the list of VkFormat's that are supported:
     uint32_t formatCount;
 
@@ -5856,6 +11223,33 @@ static void demo_init_vk_swapchain(struct demo *demo) {
             printf("Using colorspace unknown 0x%x\n", demo->color_space);
     }
 
+    // Encoding by the Vulkan side pass needs linear nits in the interop image, so fp16:
+    if (!demo->use_blit && demo->interop_enabled && (demo->interop_tex_format == VK_FORMAT_R16G16B16A16_SFLOAT)) {
+        if (demo->output_tf < 0)
+            demo->output_tf = demo_output_tf_for_colorspace(demo->color_space);
+    }
+    else {
+        if (demo->output_tf > OUTPUT_TF_NONE)
+            printf("Output transfer function on the Vulkan side needs --useshader and a RGBA16F interop format. Ignored.\n");
+        demo->output_tf = OUTPUT_TF_NONE;
+    }
+
+    printf("Vulkan side output transfer function: %s\n", demo_output_tf_names[demo->output_tf]);
+
+    // Tone mapping is fused into the PQ encoding of OpenGL:
+    if (demo->use_tonemap && (demo->output_tf != OUTPUT_TF_NONE || !demo->hdr_enabled || !demo->interop_enabled)) {
+        printf("Tone mapping needs HDR and PQ encoding on the OpenGL side. Disabled.\n");
+        demo->use_tonemap = false;
+    }
+
+    if (demo->use_tonemap)
+        demo_update_eetf(demo, 0);
+
+    if (demo->hdr_enabled && demo->interop_enabled)
+        demo_prepare_gamut_map(demo);
+    else
+        demo->gamut_map = HDR_GAMUT_OFF;
+
     demo->quit = false;
     demo->curFrame = 0;
 
@@ -5904,6 +11298,29 @@ static void demo_init_vk_swapchain(struct demo *demo) {
     err = vkCreateFence(demo->device, &fence_flipcompletei, NULL, &demo->flipcompletefence);
     assert(!err);
 
+#if defined(VK_USE_PLATFORM_DISPLAY_KHR)
+    // MK Create exportable semaphores for OpenGL <-> Vulkan sync of the threaded client:
+    if (demo->interop_enabled && demo->use_glthread) {
+        VkExportSemaphoreCreateInfo exportSemaphoreCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_EXPORT_SEMAPHORE_CREATE_INFO,
+            .pNext = NULL,
+            .handleTypes = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_OPAQUE_FD_BIT,
+        };
+
+        VkSemaphoreCreateInfo interopSemaphoreCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+            .pNext = &exportSemaphoreCreateInfo,
+            .flags = 0,
+        };
+
+        err = vkCreateSemaphore(demo->device, &interopSemaphoreCreateInfo, NULL, &demo->interop_gl_complete);
+        assert(!err);
+
+        err = vkCreateSemaphore(demo->device, &interopSemaphoreCreateInfo, NULL, &demo->interop_gl_ready);
+        assert(!err);
+    }
+#endif
+
     demo->frame_index = 0;
 
     // Get Memory information and properties
@@ -5980,6 +11397,9 @@ static void demo_init(struct demo *demo, int argc, char **argv) {
     demo->presentMode = VK_PRESENT_MODE_FIFO_KHR;
     demo->frameCount = INT32_MAX;
     demo->interop_tex_format = 1; // 10 bit unorm ~ RGB10A2 by default.
+#if !defined(WIN32)
+    demo->interophandles.memory = demo->interophandles.glReady = demo->interophandles.glComplete = -1;
+#endif
     demo->waitMsecs = 0;
     demo->output_name[0] = 0;
     demo->gpuindex = 0;
@@ -5989,10 +11409,14 @@ static void demo_init(struct demo *demo, int argc, char **argv) {
     demo->interop_tiled_texture = false;
     demo->interop_enabled = true;
     demo->use_blit = true;
+    demo->use_compute_convert = true;
     demo->timestamping_enabled = false;
     demo->hdr_enabled = true;
     demo->local_dimming_enabled = false;
     demo->testpattern = 0;
+    demo->output_tf = -1;
+    demo->use_lightlevel = true;
+    demo->gamut_map = -1;
     demo->tx = 0;
     demo->ty = 0;
     demo->rgb[0] = -1;
@@ -6020,6 +11444,97 @@ static void demo_init(struct demo *demo, int argc, char **argv) {
             continue;
         }
 
+        if (strcmp(argv[i], "--gamut") == 0 && i < argc - 1 &&
+            sscanf(argv[i + 1], "%d", &demo->gamut_map) == 1 &&
+            demo->gamut_map >= HDR_GAMUT_OFF && demo->gamut_map <= HDR_GAMUT_SOFT) {
+            i++;
+            continue;
+        }
+
+        if (strcmp(argv[i], "--outputtf") == 0 && i < argc - 1 &&
+            sscanf(argv[i + 1], "%d", &demo->output_tf) == 1 &&
+            demo->output_tf >= OUTPUT_TF_NONE && demo->output_tf < OUTPUT_TF_COUNT) {
+            i++;
+            continue;
+        }
+
+        if (strcmp(argv[i], "--tfbench") == 0) {
+            demo_tf_benchmark();
+            exit(0);
+        }
+
+        if (strcmp(argv[i], "--ppmbench") == 0) {
+            demo_ppm_benchmark();
+            exit(0);
+        }
+
+        if (strcmp(argv[i], "--ktx-test") == 0)
+            exit(demo_ktx_test() ? 0 : 1);
+
+        if (strcmp(argv[i], "--encode-accuracy") == 0) {
+            demo->hdr_encode_accuracy = true;
+            continue;
+        }
+
+        if (strcmp(argv[i], "--tonemap") == 0) {
+            demo->use_tonemap = true;
+            continue;
+        }
+
+        if (strcmp(argv[i], "--dither") == 0) {
+            demo->use_dither = true;
+            continue;
+        }
+
+        if (strcmp(argv[i], "--edid") == 0 && i < argc - 1 &&
+            sscanf(argv[i + 1], "%255s", demo->edid_path) == 1) {
+            i++;
+            continue;
+        }
+
+        if (strcmp(argv[i], "--image") == 0 && i < argc - 1 &&
+            sscanf(argv[i + 1], "%255s", demo->image_path) == 1) {
+            demo->testpattern = 7;
+            i++;
+            continue;
+        }
+
+        if (strcmp(argv[i], "--texture") == 0 && i < argc - 1 &&
+            sscanf(argv[i + 1], "%255s", demo->texture_path) == 1) {
+            size_t len = strlen(demo->texture_path);
+
+            demo->use_ktx = (len > 5 && strcmp(demo->texture_path + len - 5, ".ktx2") == 0);
+            if (!demo->use_ktx)
+                tex_files[0] = demo->texture_path;
+            i++;
+            continue;
+        }
+
+        if (strcmp(argv[i], "--edid-test") == 0) {
+            demo->edid_test = true;
+            continue;
+        }
+
+        if (strcmp(argv[i], "--verify") == 0) {
+            demo->verify = true;
+            continue;
+        }
+
+        if (strcmp(argv[i], "--allow-skip") == 0) {
+            demo->verify_allow_skip = true;
+            continue;
+        }
+
+        if (strcmp(argv[i], "--no-lightlevel") == 0) {
+            demo->use_lightlevel = false;
+            continue;
+        }
+
+        if (strcmp(argv[i], "--blitconvert") == 0) {
+            demo->use_compute_convert = false;
+            continue;
+        }
+
         if (strcmp(argv[i], "--no-glinterop") == 0) {
             demo->interop_enabled = false;
             continue;
@@ -6030,6 +11545,40 @@ static void demo_init(struct demo *demo, int argc, char **argv) {
             continue;
         }
 
+#if defined(VK_USE_PLATFORM_DISPLAY_KHR)
+        if (strcmp(argv[i], "--egl") == 0) {
+            demo->use_egl = true;
+            continue;
+        }
+
+        if (strcmp(argv[i], "--dmabuf") == 0) {
+            // DMA-BUF import needs EGL:
+            demo->use_dmabuf = true;
+            demo->use_egl = true;
+            continue;
+        }
+
+        if (strcmp(argv[i], "--glthread") == 0) {
+            // Xlib must know about threads before the first connection is opened:
+            XInitThreads();
+            demo->use_glthread = true;
+            continue;
+        }
+
+        if (strcmp(argv[i], "--movie") == 0 && i < argc - 1 &&
+            sscanf(argv[i + 1], "%255s", demo->movie_path) == 1) {
+            demo->use_movie = true;
+            i++;
+            continue;
+        }
+
+        if (strcmp(argv[i], "--movie-fps") == 0 && i < argc - 1 &&
+            sscanf(argv[i + 1], "%lf", &demo->movie_fps) == 1) {
+            i++;
+            continue;
+        }
+#endif
+
         if (strcmp(argv[i], "--gpu") == 0 && i < argc - 1 &&
             sscanf(argv[i + 1], "%d", (int*) &demo->gpuindex) == 1) {
             i++;
@@ -6055,6 +11604,21 @@ static void demo_init(struct demo *demo, int argc, char **argv) {
             continue;
         }
 
+        if (strcmp(argv[i], "--encode") == 0 && i < argc - 1 &&
+            sscanf(argv[i + 1], "%d", &demo->hdr_encode) == 1 &&
+            demo->hdr_encode >= HDR_ENCODE_EXACT && demo->hdr_encode <= HDR_ENCODE_POLY) {
+            i++;
+            continue;
+        }
+
+        if (strcmp(argv[i], "--convert-tile") == 0 && i < argc - 2 &&
+            sscanf(argv[i + 1], "%u", &demo->convert_tile[0]) == 1 &&
+            sscanf(argv[i + 2], "%u", &demo->convert_tile[1]) == 1) {
+            printf("User provided compute conversion workgroup size %u x %u\n", demo->convert_tile[0], demo->convert_tile[1]);
+            i += 2;
+            continue;
+        }
+
         if (strcmp(argv[i], "--translate") == 0 && i < argc - 2 &&
             sscanf(argv[i + 1], "%f", &demo->tx) == 1 &&
             sscanf(argv[i + 2], "%f", &demo->ty) == 1) {
@@ -6156,9 +11720,9 @@ static void demo_init(struct demo *demo, int argc, char **argv) {
 #if defined(ANDROID)
         ERR_EXIT("Usage: cube [--validate]\n", "Usage");
 #else
-        fprintf(stderr, "Usage:\n  %s [--use_staging] [--validate] [--validate-checks-disabled] [--break] [--force-tiling] [--no-glinterop] [--useshader] [--no-hdr] [--localdimming] [--timestamp]\n"
+        fprintf(stderr, "Usage:\n  %s [--use_staging] [--validate] [--validate-checks-disabled] [--break] [--force-tiling] [--no-glinterop] [--egl] [--dmabuf] [--glthread] [--useshader] [--blitconvert] [--encode-accuracy] [--tfbench] [--ppmbench] [--ktx-test] [--edid-test] [--verify] [--allow-skip] [--no-lightlevel] [--tonemap] [--dither] [--no-hdr] [--localdimming] [--timestamp]\n"
                         "[--format <value>], with <value>: 0 = RGBA8, 1 = RGB10A2, 2 = RGBA16F [--ifi <msecs>] [--gpu <index>] [--output <RandROutputName>] [--testpattern <pattern>]\n"
-                        "[--rgb <r g b>], with r,g,b in nits [--translate <x y>] [--c <framecount>] [--mode <max_width max_height min_hz>]\n"
+                        "[--rgb <r g b>], with r,g,b in nits [--translate <x y>] [--convert-tile <w h>] [--encode <mode>], with <mode>: 0 = exact, 1 = LUT, 2 = polynomial [--outputtf <tf>], with <tf>: 0 = none, 1 = PQ, 2 = HLG, 3 = linear, 4 = sRGB [--gamut <mode>], with <mode>: 0 = off, 1 = clip, 2 = soft clip [--edid <file>] [--image <file>] [--texture <file>] [--movie <dir|file>] [--movie-fps <hz>] [--c <framecount>] [--mode <max_width max_height min_hz>]\n"
                         "[--suppress_popups] [--incremental_present] [--display_timing] [--present_mode <present mode enum>]\n"
                         "VK_PRESENT_MODE_IMMEDIATE_KHR = %d\n"
                         "VK_PRESENT_MODE_MAILBOX_KHR = %d\n"
@@ -6171,6 +11735,21 @@ static void demo_init(struct demo *demo, int argc, char **argv) {
 #endif
     }
 
+    if (demo->edid_test)
+        exit(demo_edid_test(demo) ? 0 : 1);
+
+    // MK: The interop image must be renderable, so compressed textures only work without interop, and
+    // the blit path would need them at swapchain size:
+    if (demo->use_ktx && (demo->interop_enabled || demo->use_blit)) {
+        printf("KTX2 texture %s needs --no-glinterop --useshader, using %s instead.\n", demo->texture_path, tex_files[0]);
+        demo->use_ktx = false;
+    }
+
+#if defined(VK_USE_PLATFORM_DISPLAY_KHR)
+    if (demo->verify)
+        exit(demo_verify(demo) ? 0 : 1);
+#endif
+
     demo_init_connection(demo);
 
     demo->width = 512;
@@ -6289,6 +11868,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR pCmdLine,
 
     // Initialize OpenGL side of OpenGL->Vulkan interop.
     demo_create_opengl_interop(&demo);
+    demo_flush_image_cache();
 
     done = false; // initialize loop condition variable
 
@@ -6330,10 +11910,6 @@ static void demo_main(struct demo *demo, void* view) {
 }
 
 static void demo_update_and_draw(struct demo *demo) {
-    // Wait for work to finish before updating MVP.
-    vkDeviceWaitIdle(demo->device);
-    demo_update_data_buffer(demo);
-
     demo_draw(demo);
 }
 
@@ -6456,7 +12032,12 @@ int main(int argc, char **argv) {
 
 // MK:
 #if defined(VK_USE_PLATFORM_DISPLAY_KHR)
-    if (demo.display && demo.interop_enabled) {
+    if (demo.use_egl && demo.interop_enabled) {
+        // Windowless EGL context, works with or without X-Server:
+        if (!demo_create_egl_opengl(&demo))
+            demo.interop_enabled = false;
+    }
+    else if (demo.display && demo.interop_enabled) {
         demo_create_glx_opengl2(&demo);
     }
     else {
@@ -6471,7 +12052,15 @@ int main(int argc, char **argv) {
 
 #if defined(VK_USE_PLATFORM_DISPLAY_KHR)
     demo_create_opengl_interop(&demo);
+    demo_start_glthread(&demo);
+    demo_start_movie(&demo);
+#endif
+
+    // Startup uploads are done, unless the OpenGL client thread still does its own:
+#if defined(VK_USE_PLATFORM_DISPLAY_KHR)
+    if (!demo.use_glthread)
 #endif
+        demo_flush_image_cache();
 
 #if defined(VK_USE_PLATFORM_XCB_KHR) && !defined(VK_USE_PLATFORM_DISPLAY_KHR)
     demo_run_xcb(&demo);
@@ -23,34 +23,56 @@
 #extension GL_ARB_shading_language_420pack : enable
 layout (binding = 1) uniform sampler2D tex;
 
+/* Output transfer function, one pipeline variant per value, so the branches below
+ * are resolved at pipeline creation: 0 = Pass-through, input was already encoded by
+ * OpenGL, otherwise input is in nits: 1 = ST-2084 PQ, 2 = HLG for a nominal peak of
+ * HLG_LMAX nits, 3 = Linear, 1.0 = SDR_WHITE nits, e.g., scRGB, 4 = sRGB with SDR_WHITE
+ * nits as 1.0. */
+layout (constant_id = 0) const int OUTPUT_TF = 0;
+layout (constant_id = 1) const float SDR_WHITE = 80.0;
+layout (constant_id = 2) const float HLG_LMAX = 1000.0;
+
 layout (location = 0) in vec4 texcoord;
 layout (location = 0) out vec4 uFragColor;
 
-/* Simple pass-through fragment shader on the Vulkan side. */
-void main() {
-   uFragColor = texture(tex, texcoord.xy);
-}
-
-/* Unused: Would do the ST-2084 PQ Perceptual Quantizer HDR-10 mapping OETF. */
-void pq_eotf_main() {
-   vec3 L, Lp, f, v;
-
-   /* Get source color sample */
-   uFragColor = texture(tex, texcoord.xy);
+/* ST-2084 PQ Perceptual Quantizer HDR-10 mapping OETF. */
+vec3 pq_oetf(vec3 L) {
+   vec3 Lp, f;
 
    /* Normalize input range [0 - 10000.0 nits] to [0.0 - 1.0]; */
-   L = uFragColor.rgb;
-   L = L / 10000.0;
+   L = clamp(L / 10000.0, 0.0, 1.0);
 
    /* Apply ST 2084 PQ OETF */
    Lp = pow(L, vec3(0.1593017578125));
    f = (0.8359375 + 18.8515625 * Lp) / (1 + 18.6875 * Lp);
-   v  = pow(f, vec3(78.84375));
+   return pow(f, vec3(78.84375));
+}
+
+/* BT.2100 HLG OETF. */
+vec3 hlg_oetf(vec3 L) {
+   vec3 E = clamp(L / HLG_LMAX, 0.0, 1.0);
+   vec3 lo = sqrt(3.0 * E);
+   vec3 hi = 0.17883277 * log(max(12.0 * E - 0.28466892, 0.000001)) + 0.55991073;
+   return mix(lo, hi, step(1.0 / 12.0, E));
+}
 
-   /* Debug range check: If red input value greater than some nits, color it red */
-   if (uFragColor.r >= 1000.0)
-        v = vec3(1.0, 0.0, 0.0);
+/* sRGB OETF. */
+vec3 srgb_oetf(vec3 L) {
+   vec3 x = clamp(L / SDR_WHITE, 0.0, 1.0);
+   vec3 lo = 12.92 * x;
+   vec3 hi = 1.055 * pow(x, vec3(1.0 / 2.4)) - 0.055;
+   return mix(lo, hi, step(0.0031308, x));
+}
+
+void main() {
+   uFragColor = texture(tex, texcoord.xy);
 
-   /* Assign PQ mapped to output */
-   uFragColor.rgb = v;
+   if (OUTPUT_TF == 1)
+      uFragColor.rgb = pq_oetf(uFragColor.rgb);
+   else if (OUTPUT_TF == 2)
+      uFragColor.rgb = hlg_oetf(uFragColor.rgb);
+   else if (OUTPUT_TF == 3)
+      uFragColor.rgb = uFragColor.rgb / SDR_WHITE;
+   else if (OUTPUT_TF == 4)
+      uFragColor.rgb = srgb_oetf(uFragColor.rgb);
 }
@@ -21,11 +21,11 @@
 #version 400
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_ARB_shading_language_420pack : enable
-layout(std140, binding = 0) uniform buf {
+
+/* Only transform of the fullscreen draw, constant for the pre-recorded command buffers. */
+layout(push_constant) uniform pc {
         mat4 MVP;
-        vec4 position[12*3];
-        vec4 attr[12*3];
-} ubuf;
+} pcon;
 
 layout (location = 0) out vec4 texcoord;
 
@@ -33,8 +33,14 @@ out gl_PerVertex {
         vec4 gl_Position;
 };
 
-void main() 
+/* One triangle which covers the [-1, 1] quad, generated from the vertex index without
+ * any vertex data: Vertex 0 is the top-left corner (0,0) in texture space, vertex 1 and
+ * 2 extend twice the quad size downwards and rightwards, so the quad region spans the
+ * texture coordinate range [0, 1]. Vertex order and winding match the old quad. */
+void main()
 {
-   texcoord = ubuf.attr[gl_VertexIndex];
-   gl_Position = ubuf.MVP * ubuf.position[gl_VertexIndex];
+   vec2 uv = vec2(gl_VertexIndex & 2, (gl_VertexIndex << 1) & 2);
+
+   texcoord = vec4(uv, 0.0, 0.0);
+   gl_Position = pcon.MVP * vec4(uv.x * 2.0 - 1.0, 1.0 - uv.y * 2.0, 0.0, 1.0);
 }
@@ -0,0 +1,358 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * EDID parser for the display properties which matter for HDR:
+ *
+ * From the EDID 1.3/1.4 base block: Vendor, product, name, bits per color and
+ * the chromaticity of the primaries and white point. From CTA-861 extension
+ * blocks: The colorimetry data block and the HDR static metadata data block of
+ * CTA-861.3, with the supported EOTFs and the desired content luminance levels.
+ *
+ * EDID's can be read from a binary file or a hex dump as printed by xrandr --verbose,
+ * from the kernel's DRM connectors in sysfs on Linux, or from memory, e.g., the
+ * EDID property of a RandR output.
+ */
+
+#ifndef EDID_H
+#define EDID_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__linux__)
+#include <dirent.h>
+#endif
+
+#define EDID_BLOCK_SIZE 128
+#define EDID_MAX_SIZE (EDID_BLOCK_SIZE * 8)
+
+// CTA-861.3 EOTF bits of the HDR static metadata data block:
+#define EDID_EOTF_SDR    (1 << 0)
+#define EDID_EOTF_HDR    (1 << 1)
+#define EDID_EOTF_ST2084 (1 << 2)
+#define EDID_EOTF_HLG    (1 << 3)
+
+// CTA-861 colorimetry data block bits, second byte shifted up by 8:
+#define EDID_COLORIMETRY_BT2020_CYCC (1 << 5)
+#define EDID_COLORIMETRY_BT2020_YCC  (1 << 6)
+#define EDID_COLORIMETRY_BT2020_RGB  (1 << 7)
+#define EDID_COLORIMETRY_DCI_P3      (1 << 15)
+
+struct edid_info {
+    char vendor[4];
+    uint16_t product;
+    uint32_t serial;
+    char name[14];
+    int version;
+    int revision;
+    int bpc;                    // Bits per color, 0 if undefined or analog.
+    int extensions;
+    bool checksum_ok;           // All blocks, base and extensions.
+
+    // Chromaticity coordinates, 10 bit precision:
+    float red[2];
+    float green[2];
+    float blue[2];
+    float white[2];
+
+    // CTA-861 colorimetry data block:
+    bool has_colorimetry;
+    uint16_t colorimetry;
+
+    // CTA-861.3 HDR static metadata data block. Luminances in nits, 0 if not given:
+    bool has_hdr;
+    uint8_t eotfs;
+    uint8_t metadata_types;
+    float max_luminance;
+    float max_fall;
+    float min_luminance;
+};
+
+static bool edid_checksum(const uint8_t *block)
+{
+    uint8_t sum = 0;
+    int i;
+
+    for (i = 0; i < EDID_BLOCK_SIZE; i++)
+        sum += block[i];
+
+    return sum == 0;
+}
+
+static float edid_chroma(uint8_t hi, uint8_t lo)
+{
+    return (float) ((hi << 2) | (lo & 0x3)) / 1024.0f;
+}
+
+static void edid_parse_cta(const uint8_t *block, struct edid_info *info)
+{
+    // Data block collection runs from byte 4 to the offset of the detailed timings:
+    int end = block[2];
+    int i = 4;
+
+    if (block[1] < 3 || end < 4 || end > EDID_BLOCK_SIZE - 1)
+        return;
+
+    while (i < end) {
+        int tag = block[i] >> 5;
+        int len = block[i] & 0x1f;
+        const uint8_t *d = &block[i + 1];
+
+        if (i + 1 + len > end)
+            break;
+
+        // Extended tag blocks:
+        if (tag == 7 && len >= 1) {
+            switch (d[0]) {
+                case 0x05:
+                    // Colorimetry data block:
+                    if (len >= 2) {
+                        info->has_colorimetry = true;
+                        info->colorimetry = d[1] | ((len >= 3) ? ((d[2] & 0x80) << 8) : 0);
+                    }
+                    break;
+
+                case 0x06:
+                    // HDR static metadata data block. Luminance code values per CTA-861.3:
+                    if (len >= 3) {
+                        info->has_hdr = true;
+                        info->eotfs = d[1];
+                        info->metadata_types = d[2];
+
+                        if (len >= 4 && d[3])
+                            info->max_luminance = 50.0f * powf(2.0f, d[3] / 32.0f);
+
+                        if (len >= 5 && d[4])
+                            info->max_fall = 50.0f * powf(2.0f, d[4] / 32.0f);
+
+                        if (len >= 6 && info->max_luminance > 0)
+                            info->min_luminance = info->max_luminance * (d[5] / 255.0f) * (d[5] / 255.0f) / 100.0f;
+                    }
+                    break;
+            }
+        }
+
+        i += 1 + len;
+    }
+}
+
+// Parse len bytes of EDID into info. Returns false if this is not an EDID. Extension
+// blocks beyond len are ignored, e.g., if only the base block is available:
+static bool edid_parse(const uint8_t *edid, size_t len, struct edid_info *info)
+{
+    static const uint8_t header[8] = { 0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00 };
+    int i, b;
+
+    memset(info, 0, sizeof(*info));
+
+    if (len < EDID_BLOCK_SIZE || memcmp(edid, header, sizeof(header)))
+        return false;
+
+    info->vendor[0] = '@' + ((edid[8] >> 2) & 0x1f);
+    info->vendor[1] = '@' + (((edid[8] & 0x3) << 3) | (edid[9] >> 5));
+    info->vendor[2] = '@' + (edid[9] & 0x1f);
+    info->product = edid[10] | (edid[11] << 8);
+    info->serial = edid[12] | (edid[13] << 8) | (edid[14] << 16) | ((uint32_t) edid[15] << 24);
+    info->version = edid[18];
+    info->revision = edid[19];
+
+    // Digital input with defined color depth (EDID 1.4)?
+    if ((edid[20] & 0x80) && ((edid[20] >> 4) & 0x7) >= 1 && ((edid[20] >> 4) & 0x7) <= 6)
+        info->bpc = 4 + 2 * ((edid[20] >> 4) & 0x7);
+
+    info->red[0] = edid_chroma(edid[27], edid[25] >> 6);
+    info->red[1] = edid_chroma(edid[28], edid[25] >> 4);
+    info->green[0] = edid_chroma(edid[29], edid[25] >> 2);
+    info->green[1] = edid_chroma(edid[30], edid[25]);
+    info->blue[0] = edid_chroma(edid[31], edid[26] >> 6);
+    info->blue[1] = edid_chroma(edid[32], edid[26] >> 4);
+    info->white[0] = edid_chroma(edid[33], edid[26] >> 2);
+    info->white[1] = edid_chroma(edid[34], edid[26]);
+
+    // Monitor name from the display descriptors:
+    for (b = 54; b < 126; b += 18) {
+        if (edid[b] == 0 && edid[b + 1] == 0 && edid[b + 3] == 0xfc) {
+            for (i = 0; i < 13 && edid[b + 5 + i] != 0x0a; i++)
+                info->name[i] = edid[b + 5 + i];
+            info->name[i] = 0;
+        }
+    }
+
+    info->extensions = edid[126];
+    info->checksum_ok = edid_checksum(edid);
+
+    for (b = 1; b <= info->extensions && (size_t) (b + 1) * EDID_BLOCK_SIZE <= len; b++) {
+        const uint8_t *block = &edid[b * EDID_BLOCK_SIZE];
+
+        info->checksum_ok = info->checksum_ok && edid_checksum(block);
+
+        // CTA-861 extension:
+        if (block[0] == 0x02)
+            edid_parse_cta(block, info);
+    }
+
+    return true;
+}
+
+// Convert a hex dump into binary, e.g., as printed by xrandr --verbose or edid-decode.
+// Runs of hex digits may be separated by anything, leading text is skipped later:
+static size_t edid_from_hex(const char *text, size_t len, uint8_t *edid, size_t maxlen)
+{
+    size_t n = 0, i;
+    int nibbles = 0;
+    uint8_t v = 0;
+
+    for (i = 0; i < len && n < maxlen; i++) {
+        char c = text[i];
+        int x = (c >= '0' && c <= '9') ? c - '0' :
+                (c >= 'a' && c <= 'f') ? c - 'a' + 10 :
+                (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+
+        // Drop a trailing odd digit, so each run of digits starts on a byte:
+        if (x < 0) {
+            nibbles = 0;
+            continue;
+        }
+
+        v = (v << 4) | x;
+        if (++nibbles % 2 == 0)
+            edid[n++] = v;
+    }
+
+    return n;
+}
+
+// Read a binary EDID, or a hex dump of one, from file. Returns the size in bytes,
+// 0 on failure:
+static size_t edid_read_file(const char *path, uint8_t *edid, size_t maxlen)
+{
+    static const uint8_t header[8] = { 0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00 };
+    static char text[EDID_MAX_SIZE * 16];
+    size_t len, i;
+    FILE *f = fopen(path, "rb");
+
+    if (!f)
+        return 0;
+
+    len = fread(text, 1, sizeof(text), f);
+    fclose(f);
+
+    if (len >= EDID_BLOCK_SIZE && !memcmp(text, header, sizeof(header))) {
+        len = (len < maxlen) ? len : maxlen;
+        memcpy(edid, text, len);
+        return len - len % EDID_BLOCK_SIZE;
+    }
+
+    len = edid_from_hex(text, len, edid, maxlen);
+
+    // Skip anything in front of the EDID header:
+    for (i = 0; i + EDID_BLOCK_SIZE <= len; i++) {
+        if (!memcmp(&edid[i], header, sizeof(header))) {
+            len -= i;
+            memmove(edid, &edid[i], len);
+            return len - len % EDID_BLOCK_SIZE;
+        }
+    }
+
+    return 0;
+}
+
+#if defined(__linux__)
+// Read the EDID of a connected DRM connector from sysfs. If connector is non-empty,
+// the first connector whose name, e.g., card0-DP-1, contains it is used, otherwise
+// the first connected one with an EDID. Returns the size in bytes, 0 on failure:
+static size_t edid_read_sysfs(const char *connector, uint8_t *edid, size_t maxlen)
+{
+    DIR *dir = opendir("/sys/class/drm");
+    struct dirent *entry;
+    size_t len = 0;
+
+    if (!dir)
+        return 0;
+
+    while (!len && (entry = readdir(dir))) {
+        char path[512];
+        char status[16] = { 0 };
+        FILE *f;
+
+        if (strncmp(entry->d_name, "card", 4) || !strchr(entry->d_name, '-'))
+            continue;
+
+        if (connector && connector[0] && !strstr(entry->d_name, connector))
+            continue;
+
+        snprintf(path, sizeof(path), "/sys/class/drm/%s/status", entry->d_name);
+        f = fopen(path, "r");
+        if (!f)
+            continue;
+
+        if (!fgets(status, sizeof(status), f) || strncmp(status, "connected", 9)) {
+            fclose(f);
+            continue;
+        }
+        fclose(f);
+
+        snprintf(path, sizeof(path), "/sys/class/drm/%s/edid", entry->d_name);
+        f = fopen(path, "rb");
+        if (!f)
+            continue;
+
+        len = fread(edid, 1, maxlen, f);
+        len -= len % EDID_BLOCK_SIZE;
+        fclose(f);
+    }
+
+    closedir(dir);
+
+    return len;
+}
+#endif
+
+static void edid_print(const struct edid_info *info)
+{
+    printf("EDID %i.%i: %s %s, product 0x%04x, serial %u, %i bpc, %i extensions, checksum %s\n",
+           info->version, info->revision, info->vendor, info->name, info->product, info->serial,
+           info->bpc, info->extensions, info->checksum_ok ? "valid" : "INVALID");
+    printf("EDID Gamut  R: [%f, %f]\n", info->red[0], info->red[1]);
+    printf("EDID Gamut  G: [%f, %f]\n", info->green[0], info->green[1]);
+    printf("EDID Gamut  B: [%f, %f]\n", info->blue[0], info->blue[1]);
+    printf("EDID Gamut WP: [%f, %f]\n", info->white[0], info->white[1]);
+
+    if (info->has_colorimetry)
+        printf("EDID Colorimetry:%s%s%s%s\n",
+               (info->colorimetry & EDID_COLORIMETRY_BT2020_RGB) ? " BT2020RGB" : "",
+               (info->colorimetry & EDID_COLORIMETRY_BT2020_YCC) ? " BT2020YCC" : "",
+               (info->colorimetry & EDID_COLORIMETRY_BT2020_CYCC) ? " BT2020cYCC" : "",
+               (info->colorimetry & EDID_COLORIMETRY_DCI_P3) ? " DCI-P3" : "");
+
+    if (info->has_hdr) {
+        printf("EDID EOTFs:%s%s%s%s\n",
+               (info->eotfs & EDID_EOTF_SDR) ? " SDR" : "",
+               (info->eotfs & EDID_EOTF_HDR) ? " HDR-gamma" : "",
+               (info->eotfs & EDID_EOTF_ST2084) ? " ST2084" : "",
+               (info->eotfs & EDID_EOTF_HLG) ? " HLG" : "");
+        printf("EDID desired content maxLuminance: %f nits, maxFALL: %f nits, minLuminance: %f nits\n",
+               info->max_luminance, info->max_fall, info->min_luminance);
+    }
+    else {
+        printf("EDID has no HDR static metadata.\n");
+    }
+}
+
+#endif
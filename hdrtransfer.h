@@ -0,0 +1,508 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * CPU transfer functions for verification of gpu output and generation of stimuli:
+ *
+ * PQ (SMPTE ST-2084) and HLG (BT.2100) encode and decode, sRGB encode and decode,
+ * and float <-> half conversion, over arrays. Each kernel has a scalar reference
+ * implementation, and SSE2 and AVX2+FMA variants, and F16C for half conversion.
+ * tf_get_kernels() returns the fastest variants the cpu supports.
+ *
+ * Units: PQ maps 0 - 10000 nits, HLG 0 - 1000 nits (nominal peak), sRGB 0 - 1,
+ * to a signal in 0 - 1, and decode does the inverse.
+ */
+
+#ifndef HDRTRANSFER_H
+#define HDRTRANSFER_H
+
+#include <math.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TF_X86 1
+#include <immintrin.h>
+#define TF_TARGET(t) __attribute__((target(t)))
+#endif
+
+typedef void (*tf_kernel)(const float *in, float *out, size_t n);
+
+struct tf_kernels {
+    const char *name;
+    tf_kernel pq_encode;
+    tf_kernel pq_decode;
+    tf_kernel hlg_encode;
+    tf_kernel hlg_decode;
+    tf_kernel srgb_encode;
+    tf_kernel srgb_decode;
+    void (*float_to_half)(const float *in, uint16_t *out, size_t n);
+    void (*half_to_float)(const uint16_t *in, float *out, size_t n);
+};
+
+// ST-2084 PQ constants:
+#define TF_PQ_M1 0.1593017578125f
+#define TF_PQ_M2 78.84375f
+#define TF_PQ_C1 0.8359375f
+#define TF_PQ_C2 18.8515625f
+#define TF_PQ_C3 18.6875f
+
+// HLG constants:
+#define TF_HLG_A 0.17883277f
+#define TF_HLG_B 0.28466892f
+#define TF_HLG_C 0.55991073f
+
+// Scalar reference implementations:
+
+static inline float tf_clampf(float x, float lo, float hi) {
+    return (x < lo) ? lo : ((x > hi) ? hi : x);
+}
+
+static inline float tf_pq_encode_ref(float nits) {
+    float Lp = powf(tf_clampf(nits / 10000.0f, 0.0f, 1.0f), TF_PQ_M1);
+
+    return powf((TF_PQ_C1 + TF_PQ_C2 * Lp) / (1.0f + TF_PQ_C3 * Lp), TF_PQ_M2);
+}
+
+static inline float tf_pq_decode_ref(float v) {
+    float Vp = powf(tf_clampf(v, 0.0f, 1.0f), 1.0f / TF_PQ_M2);
+
+    return 10000.0f * powf(fmaxf(Vp - TF_PQ_C1, 0.0f) / (TF_PQ_C2 - TF_PQ_C3 * Vp), 1.0f / TF_PQ_M1);
+}
+
+static inline float tf_hlg_encode_ref(float nits) {
+    float E = tf_clampf(nits / 1000.0f, 0.0f, 1.0f);
+
+    return (E <= 1.0f / 12.0f) ? sqrtf(3.0f * E) : TF_HLG_A * logf(12.0f * E - TF_HLG_B) + TF_HLG_C;
+}
+
+static inline float tf_hlg_decode_ref(float v) {
+    v = tf_clampf(v, 0.0f, 1.0f);
+
+    return 1000.0f * ((v <= 0.5f) ? v * v / 3.0f : (expf((v - TF_HLG_C) / TF_HLG_A) + TF_HLG_B) / 12.0f);
+}
+
+static inline float tf_srgb_encode_ref(float x) {
+    x = tf_clampf(x, 0.0f, 1.0f);
+
+    return (x <= 0.0031308f) ? 12.92f * x : 1.055f * powf(x, 1.0f / 2.4f) - 0.055f;
+}
+
+static inline float tf_srgb_decode_ref(float v) {
+    v = tf_clampf(v, 0.0f, 1.0f);
+
+    return (v <= 0.04045f) ? v / 12.92f : powf((v + 0.055f) / 1.055f, 2.4f);
+}
+
+// Round to nearest even, with denormals, infinities and NaN's:
+static inline uint16_t tf_float_to_half_ref(float f) {
+    uint32_t x, sign, mant;
+    int32_t exp;
+    uint16_t h;
+
+    memcpy(&x, &f, sizeof(x));
+    sign = (x >> 16) & 0x8000;
+    exp = (int32_t) ((x >> 23) & 0xff) - 127 + 15;
+    mant = x & 0x7fffff;
+
+    if (((x >> 23) & 0xff) == 0xff)
+        return (uint16_t) (sign | 0x7c00 | ((mant) ? 0x200 | (mant >> 13) : 0));
+
+    if (exp >= 31)
+        return (uint16_t) (sign | 0x7c00);
+
+    if (exp <= 0) {
+        // Denormal or zero result:
+        if (exp < -10)
+            return (uint16_t) sign;
+
+        mant |= 0x800000;
+        uint32_t shift = (uint32_t) (14 - exp);
+        uint32_t round = (1u << (shift - 1)) - 1 + ((mant >> shift) & 1);
+        return (uint16_t) (sign | ((mant + round) >> shift));
+    }
+
+    // Rounding may carry into the exponent, which is what we want:
+    h = (uint16_t) (sign | ((uint32_t) exp << 10) | (mant >> 13));
+    if ((mant & 0x1fff) > 0x1000 || ((mant & 0x1fff) == 0x1000 && (h & 1)))
+        h++;
+
+    return h;
+}
+
+static inline float tf_half_to_float_ref(uint16_t h) {
+    uint32_t sign = (uint32_t) (h & 0x8000) << 16;
+    uint32_t exp = (h >> 10) & 0x1f;
+    uint32_t mant = h & 0x3ff;
+    uint32_t x;
+    float f;
+
+    if (exp == 0) {
+        // Zero or denormal:
+        f = (float) mant * (1.0f / 16777216.0f);
+        return (sign) ? -f : f;
+    }
+
+    // NaN's come out quiet, as with F16C:
+    if (exp == 31)
+        x = sign | 0x7f800000 | ((mant) ? 0x400000 : 0) | (mant << 13);
+    else
+        x = sign | ((exp - 15 + 127) << 23) | (mant << 13);
+
+    memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+#define TF_SCALAR_KERNEL(name, fn)                                  \
+    static void name(const float *in, float *out, size_t n) {       \
+        for (size_t i = 0; i < n; i++)                              \
+            out[i] = fn(in[i]);                                     \
+    }
+
+TF_SCALAR_KERNEL(tf_pq_encode_scalar, tf_pq_encode_ref)
+TF_SCALAR_KERNEL(tf_pq_decode_scalar, tf_pq_decode_ref)
+TF_SCALAR_KERNEL(tf_hlg_encode_scalar, tf_hlg_encode_ref)
+TF_SCALAR_KERNEL(tf_hlg_decode_scalar, tf_hlg_decode_ref)
+TF_SCALAR_KERNEL(tf_srgb_encode_scalar, tf_srgb_encode_ref)
+TF_SCALAR_KERNEL(tf_srgb_decode_scalar, tf_srgb_decode_ref)
+
+static void tf_float_to_half_scalar(const float *in, uint16_t *out, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        out[i] = tf_float_to_half_ref(in[i]);
+}
+
+static void tf_half_to_float_scalar(const uint16_t *in, float *out, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        out[i] = tf_half_to_float_ref(in[i]);
+}
+
+#ifdef TF_X86
+// SSE2 variants, 4 floats at a time. log2() and exp2() are polynomial approximations
+// with about 1e-7 relative error, pow(x, y) = exp2(y * log2(x)) for x > 0, 0 otherwise.
+
+static inline __m128 tf_log2_sse2(__m128 x) {
+    const __m128 one = _mm_set1_ps(1.0f);
+    __m128i bits = _mm_castps_si128(x);
+    __m128 e = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127)));
+    __m128 m = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x7fffff)), _mm_set1_epi32(0x3f800000)));
+
+    // Mantissa into [sqrt(0.5), sqrt(2)), so the series below converges quickly:
+    __m128 big = _mm_cmpgt_ps(m, _mm_set1_ps(1.41421356f));
+    m = _mm_or_ps(_mm_andnot_ps(big, m), _mm_and_ps(big, _mm_mul_ps(m, _mm_set1_ps(0.5f))));
+    e = _mm_add_ps(e, _mm_and_ps(big, one));
+
+    // log2(m) = 2 / ln(2) * atanh(t), t = (m - 1) / (m + 1):
+    __m128 t = _mm_div_ps(_mm_sub_ps(m, one), _mm_add_ps(m, one));
+    __m128 t2 = _mm_mul_ps(t, t);
+    __m128 p = _mm_set1_ps(1.0f / 9.0f);
+    p = _mm_add_ps(_mm_mul_ps(p, t2), _mm_set1_ps(1.0f / 7.0f));
+    p = _mm_add_ps(_mm_mul_ps(p, t2), _mm_set1_ps(1.0f / 5.0f));
+    p = _mm_add_ps(_mm_mul_ps(p, t2), _mm_set1_ps(1.0f / 3.0f));
+    p = _mm_add_ps(_mm_mul_ps(p, t2), one);
+
+    return _mm_add_ps(e, _mm_mul_ps(_mm_mul_ps(p, t), _mm_set1_ps(2.88539008f)));
+}
+
+static inline __m128 tf_exp2_sse2(__m128 x) {
+    x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(-126.0f)), _mm_set1_ps(127.0f));
+
+    // Split into integer and fraction in [-0.5, 0.5]:
+    __m128i i = _mm_cvtps_epi32(x);
+    __m128 f = _mm_mul_ps(_mm_sub_ps(x, _mm_cvtepi32_ps(i)), _mm_set1_ps(0.69314718f));
+
+    // exp(f) Taylor series up to degree 7:
+    __m128 p = _mm_set1_ps(1.0f / 5040.0f);
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(1.0f / 720.0f));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(1.0f / 120.0f));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(1.0f / 24.0f));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(1.0f / 6.0f));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(0.5f));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(1.0f));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(1.0f));
+
+    return _mm_mul_ps(p, _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(i, _mm_set1_epi32(127)), 23)));
+}
+
+static inline __m128 tf_pow_sse2(__m128 x, float y) {
+    __m128 r = tf_exp2_sse2(_mm_mul_ps(tf_log2_sse2(x), _mm_set1_ps(y)));
+
+    return _mm_and_ps(r, _mm_cmpgt_ps(x, _mm_setzero_ps()));
+}
+
+static inline __m128 tf_clamp_sse2(__m128 x, float lo, float hi) {
+    return _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(lo)), _mm_set1_ps(hi));
+}
+
+static inline __m128 tf_select_sse2(__m128 mask, __m128 a, __m128 b) {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static inline __m128 tf_pq_encode_sse2(__m128 nits) {
+    __m128 Lp = tf_pow_sse2(tf_clamp_sse2(_mm_mul_ps(nits, _mm_set1_ps(1.0f / 10000.0f)), 0.0f, 1.0f), TF_PQ_M1);
+    __m128 f = _mm_div_ps(_mm_add_ps(_mm_set1_ps(TF_PQ_C1), _mm_mul_ps(_mm_set1_ps(TF_PQ_C2), Lp)),
+                          _mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(_mm_set1_ps(TF_PQ_C3), Lp)));
+
+    return tf_pow_sse2(f, TF_PQ_M2);
+}
+
+static inline __m128 tf_pq_decode_sse2(__m128 v) {
+    __m128 Vp = tf_pow_sse2(tf_clamp_sse2(v, 0.0f, 1.0f), 1.0f / TF_PQ_M2);
+    __m128 L = _mm_div_ps(_mm_max_ps(_mm_sub_ps(Vp, _mm_set1_ps(TF_PQ_C1)), _mm_setzero_ps()),
+                          _mm_sub_ps(_mm_set1_ps(TF_PQ_C2), _mm_mul_ps(_mm_set1_ps(TF_PQ_C3), Vp)));
+
+    return _mm_mul_ps(tf_pow_sse2(L, 1.0f / TF_PQ_M1), _mm_set1_ps(10000.0f));
+}
+
+static inline __m128 tf_hlg_encode_sse2(__m128 nits) {
+    __m128 E = tf_clamp_sse2(_mm_mul_ps(nits, _mm_set1_ps(1.0f / 1000.0f)), 0.0f, 1.0f);
+    __m128 lo = _mm_sqrt_ps(_mm_mul_ps(E, _mm_set1_ps(3.0f)));
+    __m128 arg = _mm_max_ps(_mm_sub_ps(_mm_mul_ps(E, _mm_set1_ps(12.0f)), _mm_set1_ps(TF_HLG_B)), _mm_set1_ps(1e-6f));
+    __m128 hi = _mm_add_ps(_mm_mul_ps(tf_log2_sse2(arg), _mm_set1_ps(TF_HLG_A * 0.69314718f)), _mm_set1_ps(TF_HLG_C));
+
+    return tf_select_sse2(_mm_cmple_ps(E, _mm_set1_ps(1.0f / 12.0f)), lo, hi);
+}
+
+static inline __m128 tf_hlg_decode_sse2(__m128 v) {
+    v = tf_clamp_sse2(v, 0.0f, 1.0f);
+    __m128 lo = _mm_mul_ps(_mm_mul_ps(v, v), _mm_set1_ps(1000.0f / 3.0f));
+    __m128 x = _mm_mul_ps(_mm_sub_ps(v, _mm_set1_ps(TF_HLG_C)), _mm_set1_ps(1.44269504f / TF_HLG_A));
+    __m128 hi = _mm_mul_ps(_mm_add_ps(tf_exp2_sse2(x), _mm_set1_ps(TF_HLG_B)), _mm_set1_ps(1000.0f / 12.0f));
+
+    return tf_select_sse2(_mm_cmple_ps(v, _mm_set1_ps(0.5f)), lo, hi);
+}
+
+static inline __m128 tf_srgb_encode_sse2(__m128 x) {
+    x = tf_clamp_sse2(x, 0.0f, 1.0f);
+    __m128 lo = _mm_mul_ps(x, _mm_set1_ps(12.92f));
+    __m128 hi = _mm_sub_ps(_mm_mul_ps(tf_pow_sse2(x, 1.0f / 2.4f), _mm_set1_ps(1.055f)), _mm_set1_ps(0.055f));
+
+    return tf_select_sse2(_mm_cmple_ps(x, _mm_set1_ps(0.0031308f)), lo, hi);
+}
+
+static inline __m128 tf_srgb_decode_sse2(__m128 v) {
+    v = tf_clamp_sse2(v, 0.0f, 1.0f);
+    __m128 lo = _mm_mul_ps(v, _mm_set1_ps(1.0f / 12.92f));
+    __m128 hi = tf_pow_sse2(_mm_mul_ps(_mm_add_ps(v, _mm_set1_ps(0.055f)), _mm_set1_ps(1.0f / 1.055f)), 2.4f);
+
+    return tf_select_sse2(_mm_cmple_ps(v, _mm_set1_ps(0.04045f)), lo, hi);
+}
+
+#define TF_SSE2_KERNEL(name, vfn, fn)                               \
+    static void name(const float *in, float *out, size_t n) {       \
+        size_t i = 0;                                               \
+        for (; i + 4 <= n; i += 4)                                  \
+            _mm_storeu_ps(out + i, vfn(_mm_loadu_ps(in + i)));      \
+        for (; i < n; i++)                                          \
+            out[i] = fn(in[i]);                                     \
+    }
+
+TF_SSE2_KERNEL(tf_pq_encode_sse2_kernel, tf_pq_encode_sse2, tf_pq_encode_ref)
+TF_SSE2_KERNEL(tf_pq_decode_sse2_kernel, tf_pq_decode_sse2, tf_pq_decode_ref)
+TF_SSE2_KERNEL(tf_hlg_encode_sse2_kernel, tf_hlg_encode_sse2, tf_hlg_encode_ref)
+TF_SSE2_KERNEL(tf_hlg_decode_sse2_kernel, tf_hlg_decode_sse2, tf_hlg_decode_ref)
+TF_SSE2_KERNEL(tf_srgb_encode_sse2_kernel, tf_srgb_encode_sse2, tf_srgb_encode_ref)
+TF_SSE2_KERNEL(tf_srgb_decode_sse2_kernel, tf_srgb_decode_sse2, tf_srgb_decode_ref)
+
+// AVX2 + FMA variants, 8 floats at a time, same math as SSE2:
+
+TF_TARGET("avx2,fma") static inline __m256 tf_log2_avx2(__m256 x) {
+    const __m256 one = _mm256_set1_ps(1.0f);
+    __m256i bits = _mm256_castps_si256(x);
+    __m256 e = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(127)));
+    __m256 m = _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x7fffff)),
+                                                   _mm256_set1_epi32(0x3f800000)));
+
+    __m256 big = _mm256_cmp_ps(m, _mm256_set1_ps(1.41421356f), _CMP_GT_OQ);
+    m = _mm256_blendv_ps(m, _mm256_mul_ps(m, _mm256_set1_ps(0.5f)), big);
+    e = _mm256_add_ps(e, _mm256_and_ps(big, one));
+
+    __m256 t = _mm256_div_ps(_mm256_sub_ps(m, one), _mm256_add_ps(m, one));
+    __m256 t2 = _mm256_mul_ps(t, t);
+    __m256 p = _mm256_set1_ps(1.0f / 9.0f);
+    p = _mm256_fmadd_ps(p, t2, _mm256_set1_ps(1.0f / 7.0f));
+    p = _mm256_fmadd_ps(p, t2, _mm256_set1_ps(1.0f / 5.0f));
+    p = _mm256_fmadd_ps(p, t2, _mm256_set1_ps(1.0f / 3.0f));
+    p = _mm256_fmadd_ps(p, t2, one);
+
+    return _mm256_fmadd_ps(_mm256_mul_ps(p, t), _mm256_set1_ps(2.88539008f), e);
+}
+
+TF_TARGET("avx2,fma") static inline __m256 tf_exp2_avx2(__m256 x) {
+    x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(-126.0f)), _mm256_set1_ps(127.0f));
+
+    __m256 r = _mm256_round_ps(x, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256i i = _mm256_cvtps_epi32(r);
+    __m256 f = _mm256_mul_ps(_mm256_sub_ps(x, r), _mm256_set1_ps(0.69314718f));
+
+    __m256 p = _mm256_set1_ps(1.0f / 5040.0f);
+    p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(1.0f / 720.0f));
+    p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(1.0f / 120.0f));
+    p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(1.0f / 24.0f));
+    p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(1.0f / 6.0f));
+    p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(0.5f));
+    p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(1.0f));
+    p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(1.0f));
+
+    return _mm256_mul_ps(p, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(i, _mm256_set1_epi32(127)), 23)));
+}
+
+TF_TARGET("avx2,fma") static inline __m256 tf_pow_avx2(__m256 x, float y) {
+    __m256 r = tf_exp2_avx2(_mm256_mul_ps(tf_log2_avx2(x), _mm256_set1_ps(y)));
+
+    return _mm256_and_ps(r, _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_GT_OQ));
+}
+
+TF_TARGET("avx2,fma") static inline __m256 tf_clamp_avx2(__m256 x, float lo, float hi) {
+    return _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(lo)), _mm256_set1_ps(hi));
+}
+
+TF_TARGET("avx2,fma") static inline __m256 tf_pq_encode_avx2(__m256 nits) {
+    __m256 Lp = tf_pow_avx2(tf_clamp_avx2(_mm256_mul_ps(nits, _mm256_set1_ps(1.0f / 10000.0f)), 0.0f, 1.0f), TF_PQ_M1);
+    __m256 f = _mm256_div_ps(_mm256_fmadd_ps(_mm256_set1_ps(TF_PQ_C2), Lp, _mm256_set1_ps(TF_PQ_C1)),
+                             _mm256_fmadd_ps(_mm256_set1_ps(TF_PQ_C3), Lp, _mm256_set1_ps(1.0f)));
+
+    return tf_pow_avx2(f, TF_PQ_M2);
+}
+
+TF_TARGET("avx2,fma") static inline __m256 tf_pq_decode_avx2(__m256 v) {
+    __m256 Vp = tf_pow_avx2(tf_clamp_avx2(v, 0.0f, 1.0f), 1.0f / TF_PQ_M2);
+    __m256 L = _mm256_div_ps(_mm256_max_ps(_mm256_sub_ps(Vp, _mm256_set1_ps(TF_PQ_C1)), _mm256_setzero_ps()),
+                             _mm256_fnmadd_ps(_mm256_set1_ps(TF_PQ_C3), Vp, _mm256_set1_ps(TF_PQ_C2)));
+
+    return _mm256_mul_ps(tf_pow_avx2(L, 1.0f / TF_PQ_M1), _mm256_set1_ps(10000.0f));
+}
+
+TF_TARGET("avx2,fma") static inline __m256 tf_hlg_encode_avx2(__m256 nits) {
+    __m256 E = tf_clamp_avx2(_mm256_mul_ps(nits, _mm256_set1_ps(1.0f / 1000.0f)), 0.0f, 1.0f);
+    __m256 lo = _mm256_sqrt_ps(_mm256_mul_ps(E, _mm256_set1_ps(3.0f)));
+    __m256 arg = _mm256_max_ps(_mm256_fmsub_ps(E, _mm256_set1_ps(12.0f), _mm256_set1_ps(TF_HLG_B)), _mm256_set1_ps(1e-6f));
+    __m256 hi = _mm256_fmadd_ps(tf_log2_avx2(arg), _mm256_set1_ps(TF_HLG_A * 0.69314718f), _mm256_set1_ps(TF_HLG_C));
+
+    return _mm256_blendv_ps(hi, lo, _mm256_cmp_ps(E, _mm256_set1_ps(1.0f / 12.0f), _CMP_LE_OQ));
+}
+
+TF_TARGET("avx2,fma") static inline __m256 tf_hlg_decode_avx2(__m256 v) {
+    v = tf_clamp_avx2(v, 0.0f, 1.0f);
+    __m256 lo = _mm256_mul_ps(_mm256_mul_ps(v, v), _mm256_set1_ps(1000.0f / 3.0f));
+    __m256 x = _mm256_mul_ps(_mm256_sub_ps(v, _mm256_set1_ps(TF_HLG_C)), _mm256_set1_ps(1.44269504f / TF_HLG_A));
+    __m256 hi = _mm256_mul_ps(_mm256_add_ps(tf_exp2_avx2(x), _mm256_set1_ps(TF_HLG_B)), _mm256_set1_ps(1000.0f / 12.0f));
+
+    return _mm256_blendv_ps(hi, lo, _mm256_cmp_ps(v, _mm256_set1_ps(0.5f), _CMP_LE_OQ));
+}
+
+TF_TARGET("avx2,fma") static inline __m256 tf_srgb_encode_avx2(__m256 x) {
+    x = tf_clamp_avx2(x, 0.0f, 1.0f);
+    __m256 lo = _mm256_mul_ps(x, _mm256_set1_ps(12.92f));
+    __m256 hi = _mm256_fmsub_ps(tf_pow_avx2(x, 1.0f / 2.4f), _mm256_set1_ps(1.055f), _mm256_set1_ps(0.055f));
+
+    return _mm256_blendv_ps(hi, lo, _mm256_cmp_ps(x, _mm256_set1_ps(0.0031308f), _CMP_LE_OQ));
+}
+
+TF_TARGET("avx2,fma") static inline __m256 tf_srgb_decode_avx2(__m256 v) {
+    v = tf_clamp_avx2(v, 0.0f, 1.0f);
+    __m256 lo = _mm256_mul_ps(v, _mm256_set1_ps(1.0f / 12.92f));
+    __m256 hi = tf_pow_avx2(_mm256_mul_ps(_mm256_add_ps(v, _mm256_set1_ps(0.055f)), _mm256_set1_ps(1.0f / 1.055f)), 2.4f);
+
+    return _mm256_blendv_ps(hi, lo, _mm256_cmp_ps(v, _mm256_set1_ps(0.04045f), _CMP_LE_OQ));
+}
+
+#define TF_AVX2_KERNEL(name, vfn, fn)                                           \
+    TF_TARGET("avx2,fma") static void name(const float *in, float *out, size_t n) { \
+        size_t i = 0;                                                           \
+        for (; i + 8 <= n; i += 8)                                              \
+            _mm256_storeu_ps(out + i, vfn(_mm256_loadu_ps(in + i)));            \
+        for (; i < n; i++)                                                      \
+            out[i] = fn(in[i]);                                                 \
+    }
+
+TF_AVX2_KERNEL(tf_pq_encode_avx2_kernel, tf_pq_encode_avx2, tf_pq_encode_ref)
+TF_AVX2_KERNEL(tf_pq_decode_avx2_kernel, tf_pq_decode_avx2, tf_pq_decode_ref)
+TF_AVX2_KERNEL(tf_hlg_encode_avx2_kernel, tf_hlg_encode_avx2, tf_hlg_encode_ref)
+TF_AVX2_KERNEL(tf_hlg_decode_avx2_kernel, tf_hlg_decode_avx2, tf_hlg_decode_ref)
+TF_AVX2_KERNEL(tf_srgb_encode_avx2_kernel, tf_srgb_encode_avx2, tf_srgb_encode_ref)
+TF_AVX2_KERNEL(tf_srgb_decode_avx2_kernel, tf_srgb_decode_avx2, tf_srgb_decode_ref)
+
+// F16C half conversion, hardware round to nearest even:
+
+TF_TARGET("avx,f16c") static void tf_float_to_half_f16c(const float *in, uint16_t *out, size_t n) {
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8)
+        _mm_storeu_si128((__m128i *) (out + i), _mm256_cvtps_ph(_mm256_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT));
+    for (; i < n; i++)
+        out[i] = tf_float_to_half_ref(in[i]);
+}
+
+TF_TARGET("avx,f16c") static void tf_half_to_float_f16c(const uint16_t *in, float *out, size_t n) {
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(out + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *) (in + i))));
+    for (; i < n; i++)
+        out[i] = tf_half_to_float_ref(in[i]);
+}
+#endif
+
+// Kernel variants by level: 0 = scalar reference, 1 = SSE2, 2 = AVX2 + FMA.
+// Half conversion uses F16C whenever the cpu has it, except for the scalar reference.
+static inline struct tf_kernels tf_get_kernels_level(int level) {
+    struct tf_kernels k = {
+        "scalar",
+        tf_pq_encode_scalar, tf_pq_decode_scalar,
+        tf_hlg_encode_scalar, tf_hlg_decode_scalar,
+        tf_srgb_encode_scalar, tf_srgb_decode_scalar,
+        tf_float_to_half_scalar, tf_half_to_float_scalar,
+    };
+
+#ifdef TF_X86
+    __builtin_cpu_init();
+
+    if (level >= 1 && __builtin_cpu_supports("sse2")) {
+        k.name = "SSE2";
+        k.pq_encode = tf_pq_encode_sse2_kernel;
+        k.pq_decode = tf_pq_decode_sse2_kernel;
+        k.hlg_encode = tf_hlg_encode_sse2_kernel;
+        k.hlg_decode = tf_hlg_decode_sse2_kernel;
+        k.srgb_encode = tf_srgb_encode_sse2_kernel;
+        k.srgb_decode = tf_srgb_decode_sse2_kernel;
+    }
+
+    if (level >= 2 && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        k.name = "AVX2+FMA";
+        k.pq_encode = tf_pq_encode_avx2_kernel;
+        k.pq_decode = tf_pq_decode_avx2_kernel;
+        k.hlg_encode = tf_hlg_encode_avx2_kernel;
+        k.hlg_decode = tf_hlg_decode_avx2_kernel;
+        k.srgb_encode = tf_srgb_encode_avx2_kernel;
+        k.srgb_decode = tf_srgb_decode_avx2_kernel;
+    }
+
+    if (level >= 1 && __builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c")) {
+        k.float_to_half = tf_float_to_half_f16c;
+        k.half_to_float = tf_half_to_float_f16c;
+    }
+#else
+    (void) level;
+#endif
+
+    return k;
+}
+
+// Fastest kernels for this cpu:
+static inline struct tf_kernels tf_get_kernels(void) {
+    return tf_get_kernels_level(2);
+}
+
+#endif // HDRTRANSFER_H
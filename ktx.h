@@ -0,0 +1,618 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Loader for KTX2 textures with block compressed stimuli: BC7 for LDR, BC6H for HDR,
+ * and ASTC 4x4 for mobile gpus. All of them use 16 byte blocks of 4x4 texels.
+ *
+ * ktx_open() memory maps the file via ppm_map() and validates the header and the mip
+ * level index, so the blocks of each level can be copied straight from the mapping
+ * into a staging buffer for a compressed VkImage. For gpus without support for the
+ * format, ktx_decode_level() decodes BC7 to RGBA8 and BC6H to RGBA16F on the cpu.
+ * There is no cpu decoder for ASTC.
+ *
+ * Only plain 2D textures are supported, no arrays, cube maps or supercompression.
+ */
+
+#ifndef KTX_H
+#define KTX_H
+
+#include "ppm.h"
+
+// VkFormat values of the supported formats, so this header doesn't need vulkan.h:
+#define KTX_FORMAT_BC6H_UFLOAT      143
+#define KTX_FORMAT_BC6H_SFLOAT      144
+#define KTX_FORMAT_BC7_UNORM        145
+#define KTX_FORMAT_BC7_SRGB         146
+#define KTX_FORMAT_ASTC_4x4_UNORM   157
+#define KTX_FORMAT_ASTC_4x4_SRGB    158
+
+// One more than log2(PPM_MAX_DIM):
+#define KTX_MAX_LEVELS 17
+
+struct ktx_level {
+    uint32_t width;
+    uint32_t height;
+    const uint8_t *data;
+    size_t size;
+};
+
+struct ktx_texture {
+    uint32_t vk_format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t level_count;
+    struct ktx_level levels[KTX_MAX_LEVELS];
+
+    // The whole file:
+    struct ppm_image map;
+};
+
+static uint32_t ktx_read32(const uint8_t *p)
+{
+    return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static uint64_t ktx_read64(const uint8_t *p)
+{
+    return (uint64_t) ktx_read32(p) | ((uint64_t) ktx_read32(p + 4) << 32);
+}
+
+// Size in bytes of the blocks of a width x height level:
+static size_t ktx_level_size(uint32_t width, uint32_t height)
+{
+    return (size_t) ((width + 3) / 4) * ((height + 3) / 4) * 16;
+}
+
+static bool ktx_is_srgb(const struct ktx_texture *tex)
+{
+    return tex->vk_format == KTX_FORMAT_BC7_SRGB || tex->vk_format == KTX_FORMAT_ASTC_4x4_SRGB;
+}
+
+static bool ktx_is_hdr(const struct ktx_texture *tex)
+{
+    return tex->vk_format == KTX_FORMAT_BC6H_UFLOAT || tex->vk_format == KTX_FORMAT_BC6H_SFLOAT;
+}
+
+// Bytes per texel ktx_decode_level() writes, RGBA8 or RGBA16F, or 0 if there is no cpu decoder:
+static size_t ktx_decoded_texel_size(const struct ktx_texture *tex)
+{
+    switch (tex->vk_format) {
+        case KTX_FORMAT_BC7_UNORM:
+        case KTX_FORMAT_BC7_SRGB:
+            return 4;
+
+        case KTX_FORMAT_BC6H_UFLOAT:
+        case KTX_FORMAT_BC6H_SFLOAT:
+            return 8;
+
+        default:
+            return 0;
+    }
+}
+
+static void ktx_close(struct ktx_texture *tex)
+{
+    ppm_close(&tex->map);
+    memset(tex, 0, sizeof(*tex));
+#if defined(_WIN32)
+    tex->map.file = INVALID_HANDLE_VALUE;
+#endif
+}
+
+static bool ktx_open(const char *path, struct ktx_texture *tex)
+{
+    static const uint8_t identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+    const uint8_t *data;
+    size_t size;
+    uint32_t depth, layers, faces, scheme, i;
+
+    memset(tex, 0, sizeof(*tex));
+
+    if (!ppm_map(path, &tex->map, true))
+        return false;
+
+    data = tex->map.data;
+    size = tex->map.size;
+
+    // Identifier, 9 header fields, the 32 byte index and at least one level index entry:
+    if (size < 104 || memcmp(data, identifier, sizeof(identifier)))
+        goto fail;
+
+    tex->vk_format = ktx_read32(data + 12);
+    tex->width = ktx_read32(data + 20);
+    tex->height = ktx_read32(data + 24);
+    depth = ktx_read32(data + 28);
+    layers = ktx_read32(data + 32);
+    faces = ktx_read32(data + 36);
+    tex->level_count = ktx_read32(data + 40);
+    scheme = ktx_read32(data + 44);
+
+    switch (tex->vk_format) {
+        case KTX_FORMAT_BC6H_UFLOAT:
+        case KTX_FORMAT_BC6H_SFLOAT:
+        case KTX_FORMAT_BC7_UNORM:
+        case KTX_FORMAT_BC7_SRGB:
+        case KTX_FORMAT_ASTC_4x4_UNORM:
+        case KTX_FORMAT_ASTC_4x4_SRGB:
+            break;
+
+        default:
+            printf("KTX2 %s: Unsupported vkFormat %u. Only BC6H, BC7 and ASTC 4x4 are supported.\n", path, tex->vk_format);
+            goto fail;
+    }
+
+    if (tex->width < 1 || tex->width > PPM_MAX_DIM || tex->height < 1 || tex->height > PPM_MAX_DIM ||
+        depth > 0 || layers > 1 || faces != 1 || scheme != 0) {
+        printf("KTX2 %s: Only 2D textures up to %d x %d without arrays, cube faces or supercompression are supported.\n",
+               path, PPM_MAX_DIM, PPM_MAX_DIM);
+        goto fail;
+    }
+
+    // 0 means the loader should generate the mip chain, which we don't do, so use only the base level:
+    if (tex->level_count == 0)
+        tex->level_count = 1;
+
+    if (tex->level_count > KTX_MAX_LEVELS || (size - 80) / 24 < tex->level_count)
+        goto fail;
+
+    for (i = 0; i < tex->level_count; i++) {
+        const uint8_t *entry = data + 80 + 24 * i;
+        uint64_t offset = ktx_read64(entry);
+        uint64_t length = ktx_read64(entry + 8);
+        struct ktx_level *level = &tex->levels[i];
+
+        level->width = (tex->width >> i) ? (tex->width >> i) : 1;
+        level->height = (tex->height >> i) ? (tex->height >> i) : 1;
+        level->size = ktx_level_size(level->width, level->height);
+
+        if (offset > size || length != level->size || size - offset < length) {
+            printf("KTX2 %s: Level %u is truncated or has the wrong size.\n", path, i);
+            goto fail;
+        }
+
+        level->data = data + offset;
+
+        // A full chain ends at 1 x 1:
+        if (level->width == 1 && level->height == 1 && i + 1 < tex->level_count)
+            goto fail;
+    }
+
+    return true;
+
+fail:
+    ktx_close(tex);
+    return false;
+}
+
+// Reads the bits of a 128 bit block, least significant bit of byte 0 first:
+struct ktx_bits {
+    const uint8_t *block;
+    int pos;
+};
+
+static uint32_t ktx_bits_get(struct ktx_bits *bits, int count)
+{
+    uint32_t value = 0;
+    int i;
+
+    for (i = 0; i < count; i++, bits->pos++)
+        value |= (uint32_t) ((bits->block[bits->pos >> 3] >> (bits->pos & 7)) & 1) << i;
+
+    return value;
+}
+
+// Interpolation weights for 2, 3 and 4 bit indices, shared by BC6H and BC7:
+static const uint8_t ktx_weights2[4] = { 0, 21, 43, 64 };
+static const uint8_t ktx_weights3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+static const uint8_t ktx_weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+static const uint8_t *ktx_weights(int bits)
+{
+    return (bits == 2) ? ktx_weights2 : (bits == 3) ? ktx_weights3 : ktx_weights4;
+}
+
+// Partitions of 2 subsets, bit i is the subset of texel i. BC6H uses the first 32:
+static const uint16_t ktx_partitions2[64] = {
+    0xcccc, 0x8888, 0xeeee, 0xecc8, 0xc880, 0xfeec, 0xfec8, 0xec80,
+    0xc800, 0xffec, 0xfe80, 0xe800, 0xffe8, 0xff00, 0xfff0, 0xf000,
+    0xf710, 0x008e, 0x7100, 0x08ce, 0x008c, 0x7310, 0x3100, 0x8cce,
+    0x088c, 0x3110, 0x6666, 0x366c, 0x17e8, 0x0ff0, 0x718e, 0x399c,
+    0xaaaa, 0xf0f0, 0x5a5a, 0x33cc, 0x3c3c, 0x55aa, 0x9696, 0xa55a,
+    0x73ce, 0x13c8, 0x324c, 0x3bdc, 0x6996, 0xc33c, 0x9966, 0x0660,
+    0x0272, 0x04e4, 0x4e40, 0x2720, 0xc936, 0x936c, 0x39c6, 0x639c,
+    0x9336, 0x9cc6, 0x817e, 0xe718, 0xccf0, 0x0fcc, 0x7744, 0xee22,
+};
+
+// Partitions of 3 subsets, bits 2i and 2i + 1 are the subset of texel i:
+static const uint32_t ktx_partitions3[64] = {
+    0xaa685050, 0x6a5a5040, 0x5a5a4200, 0x5450a0a8, 0xa5a50000, 0xa0a05050, 0x5555a0a0, 0x5a5a5050,
+    0xaa550000, 0xaa555500, 0xaaaa5500, 0x90909090, 0x94949494, 0xa4a4a4a4, 0xa9a59450, 0x2a0a4250,
+    0xa5945040, 0x0a425054, 0xa5a5a500, 0x55a0a0a0, 0xa8a85454, 0x6a6a4040, 0xa4a45000, 0x1a1a0500,
+    0x0050a4a4, 0xaaa59090, 0x14696914, 0x69691400, 0xa08585a0, 0xaa821414, 0x50a4a450, 0x6a5a0200,
+    0xa9a58000, 0x5090a0a8, 0xa8a09050, 0x24242424, 0x00aa5500, 0x24924924, 0x24499224, 0x50a50a50,
+    0x500aa550, 0xaaaa4444, 0x66660000, 0xa5a0a5a0, 0x50a050a0, 0x69286928, 0x44aaaa44, 0x66666600,
+    0xaa444444, 0x54a854a8, 0x95809580, 0x96969600, 0xa85454a8, 0x80959580, 0xaa141414, 0x96960000,
+    0xaaaa1414, 0xa05050a0, 0xa0a5a5a0, 0x96000000, 0x40804080, 0xa9a8a9a8, 0xaaaaaa44, 0x2a4a5254,
+};
+
+// Texels of the second subset whose index is stored with one bit less, the first texel is
+// always the anchor of the first subset:
+static const uint8_t ktx_anchors2[64] = {
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+    15,  2,  8,  2,  2,  8,  8, 15,  2,  8,  2,  2,  8,  8,  2,  2,
+    15, 15,  6,  8,  2,  8, 15, 15,  2,  8,  2,  2,  2, 15, 15,  6,
+     6,  2,  6,  8, 15, 15,  2,  2, 15, 15, 15, 15, 15,  2,  2, 15,
+};
+
+// Anchors of the second and third subset of 3 subset partitions:
+static const uint8_t ktx_anchors3[2][64] = {
+    {
+         3,  3, 15, 15,  8,  3, 15, 15,  8,  8,  6,  6,  6,  5,  3,  3,
+         3,  3,  8, 15,  3,  3,  6, 10,  5,  8,  8,  6,  8,  5, 15, 15,
+         8, 15,  3,  5,  6, 10,  8, 15, 15,  3, 15,  5, 15, 15, 15, 15,
+         3, 15,  5,  5,  5,  8,  5, 10,  5, 10,  8, 13, 15, 12,  3,  3,
+    },
+    {
+        15,  8,  8,  3, 15, 15,  3,  8, 15, 15, 15, 15, 15, 15, 15,  8,
+        15,  8, 15,  3, 15,  8, 15,  8,  3, 15,  6, 10, 15, 15, 10,  8,
+        15,  3, 15, 10, 10,  8,  9, 10,  6, 15,  8, 15,  3,  6,  6,  8,
+        15,  3, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,  3, 15, 15,  8,
+    },
+};
+
+static int ktx_subset(int subsets, int partition, int texel)
+{
+    if (subsets == 2)
+        return (ktx_partitions2[partition] >> texel) & 1;
+
+    if (subsets == 3)
+        return (ktx_partitions3[partition] >> (2 * texel)) & 3;
+
+    return 0;
+}
+
+static bool ktx_is_anchor(int subsets, int partition, int texel)
+{
+    return texel == 0 ||
+           (subsets == 2 && texel == ktx_anchors2[partition]) ||
+           (subsets == 3 && (texel == ktx_anchors3[0][partition] || texel == ktx_anchors3[1][partition]));
+}
+
+// Read 16 indices of the given bit count, anchors of the partition have one bit less:
+static void ktx_read_indices(struct ktx_bits *bits, int count, int subsets, int partition, uint8_t indices[16])
+{
+    int i;
+
+    for (i = 0; i < 16; i++)
+        indices[i] = (uint8_t) ktx_bits_get(bits, ktx_is_anchor(subsets, partition, i) ? count - 1 : count);
+}
+
+// Decode one BC7 block into 4x4 RGBA8 texels:
+static void ktx_decode_bc7_block(const uint8_t *block, uint8_t texels[16][4])
+{
+    // Per mode: subsets, partition bits, rotation bits, index selection bits, color bits, alpha bits,
+    // per endpoint p-bits, shared per subset p-bits, index bits, second index bits:
+    static const uint8_t modes[8][10] = {
+        { 3, 4, 0, 0, 4, 0, 1, 0, 3, 0 },
+        { 2, 6, 0, 0, 6, 0, 0, 1, 3, 0 },
+        { 3, 6, 0, 0, 5, 0, 0, 0, 2, 0 },
+        { 2, 6, 0, 0, 7, 0, 1, 0, 2, 0 },
+        { 1, 0, 2, 1, 5, 6, 0, 0, 2, 3 },
+        { 1, 0, 2, 0, 7, 8, 0, 0, 2, 2 },
+        { 1, 0, 0, 0, 7, 7, 1, 0, 4, 0 },
+        { 2, 6, 0, 0, 5, 5, 1, 0, 2, 0 },
+    };
+    struct ktx_bits bits = { block, 0 };
+    uint8_t endpoints[6][4], pbits[6];
+    uint8_t indices[16], indices2[16];
+    const uint8_t *m;
+    int mode, subsets, partition, rotation, selection, i, c;
+
+    for (mode = 0; mode < 8 && !(block[0] & (1 << mode)); mode++);
+
+    // Reserved mode, decodes to transparent black:
+    if (mode == 8) {
+        memset(texels, 0, 16 * 4);
+        return;
+    }
+
+    m = modes[mode];
+    subsets = m[0];
+    bits.pos = mode + 1;
+    partition = ktx_bits_get(&bits, m[1]);
+    rotation = ktx_bits_get(&bits, m[2]);
+    selection = ktx_bits_get(&bits, m[3]);
+
+    // All reds of all endpoints, then all greens, blues and alphas:
+    for (c = 0; c < 4; c++)
+        for (i = 0; i < 2 * subsets; i++)
+            endpoints[i][c] = (uint8_t) ((c < 3) ? ktx_bits_get(&bits, m[4]) : (m[5] ? ktx_bits_get(&bits, m[5]) : 255));
+
+    // P-bits, either one per endpoint or one shared by both endpoints of a subset:
+    for (i = 0; i < 2 * subsets; i++) {
+        if (m[6] || (m[7] && (i & 1) == 0))
+            pbits[i] = (uint8_t) ktx_bits_get(&bits, 1);
+        else if (m[7])
+            pbits[i] = pbits[i - 1];
+        else
+            pbits[i] = 0;
+    }
+
+    // Append the p-bits and expand to 8 bits by replicating the top bits:
+    for (i = 0; i < 2 * subsets; i++) {
+        for (c = 0; c < 4; c++) {
+            int n = (c < 3) ? m[4] : m[5];
+            int v = endpoints[i][c];
+
+            if (n == 0)
+                continue;
+
+            if (m[6] || m[7]) {
+                v = (v << 1) | pbits[i];
+                n++;
+            }
+
+            endpoints[i][c] = (uint8_t) ((v << (8 - n)) | (v >> (2 * n - 8)));
+        }
+    }
+
+    ktx_read_indices(&bits, m[8], subsets, partition, indices);
+    if (m[9])
+        ktx_read_indices(&bits, m[9], 1, 0, indices2);
+
+    for (i = 0; i < 16; i++) {
+        const uint8_t *e0 = endpoints[2 * ktx_subset(subsets, partition, i)];
+        const uint8_t *e1 = e0 + 4;
+        const uint8_t *wc, *wa;
+        int ic, ia, t;
+
+        // Mode 4 and 5 have separate color and alpha indices, mode 4 can swap them:
+        if (m[9] && selection) {
+            wc = ktx_weights(m[9]);
+            ic = indices2[i];
+            wa = ktx_weights(m[8]);
+            ia = indices[i];
+        }
+        else {
+            wc = ktx_weights(m[8]);
+            ic = indices[i];
+            wa = m[9] ? ktx_weights(m[9]) : wc;
+            ia = m[9] ? indices2[i] : ic;
+        }
+
+        for (c = 0; c < 3; c++)
+            texels[i][c] = (uint8_t) ((e0[c] * (64 - wc[ic]) + e1[c] * wc[ic] + 32) >> 6);
+        texels[i][3] = (uint8_t) ((e0[3] * (64 - wa[ia]) + e1[3] * wa[ia] + 32) >> 6);
+
+        if (rotation) {
+            t = texels[i][3];
+            texels[i][3] = texels[i][rotation - 1];
+            texels[i][rotation - 1] = (uint8_t) t;
+        }
+    }
+}
+
+static int32_t ktx_sign_extend(uint32_t v, int bits)
+{
+    return (int32_t) (v << (32 - bits)) >> (32 - bits);
+}
+
+// BC6H endpoint fields, ordered as in the bit layout tables of the spec. W is the first
+// endpoint, X, Y and Z the other three, as deltas from W in transformed modes:
+enum { KTX_RW, KTX_RX, KTX_RY, KTX_RZ, KTX_GW, KTX_GX, KTX_GY, KTX_GZ, KTX_BW, KTX_BX, KTX_BY, KTX_BZ };
+
+// One run of bits of a field in the bit layout: field, lowest bit, bit count, negative count
+// for bit reversed runs:
+struct ktx_bc6h_run {
+    uint8_t field;
+    uint8_t shift;
+    int8_t count;
+};
+
+// Decode one BC6H block into 4x4 RGBA16F texels, with opaque alpha:
+static void ktx_decode_bc6h_block(const uint8_t *block, bool is_signed, uint16_t texels[16][4])
+{
+#define R(f, hi, lo) { KTX_##f, lo, (hi) - (lo) + 1 }
+#define REV(f, lo, hi) { KTX_##f, lo, -((hi) - (lo) + 1) }
+    // Bit layouts after the mode bits, from the BC6H tables of the D3D11 and Khronos data format specs:
+    static const struct ktx_bc6h_run layouts[14][24] = {
+        { R(GY,4,4), R(BY,4,4), R(BZ,4,4), R(RW,9,0), R(GW,9,0), R(BW,9,0), R(RX,4,0), R(GZ,4,4), R(GY,3,0), R(GX,4,0),
+          R(BZ,0,0), R(GZ,3,0), R(BX,4,0), R(BZ,1,1), R(BY,3,0), R(RY,4,0), R(BZ,2,2), R(RZ,4,0), R(BZ,3,3) },
+        { R(GY,5,5), R(GZ,4,4), R(GZ,5,5), R(RW,6,0), R(BZ,0,0), R(BZ,1,1), R(BY,4,4), R(GW,6,0), R(BY,5,5), R(BZ,2,2),
+          R(GY,4,4), R(BW,6,0), R(BZ,3,3), R(BZ,5,5), R(BZ,4,4), R(RX,5,0), R(GY,3,0), R(GX,5,0), R(GZ,3,0), R(BX,5,0),
+          R(BY,3,0), R(RY,5,0), R(RZ,5,0) },
+        { R(RW,9,0), R(GW,9,0), R(BW,9,0), R(RX,4,0), R(RW,10,10), R(GY,3,0), R(GX,3,0), R(GW,10,10), R(BZ,0,0), R(GZ,3,0),
+          R(BX,3,0), R(BW,10,10), R(BZ,1,1), R(BY,3,0), R(RY,4,0), R(BZ,2,2), R(RZ,4,0), R(BZ,3,3) },
+        { R(RW,9,0), R(GW,9,0), R(BW,9,0), R(RX,3,0), R(RW,10,10), R(GZ,4,4), R(GY,3,0), R(GX,4,0), R(GW,10,10), R(GZ,3,0),
+          R(BX,3,0), R(BW,10,10), R(BZ,1,1), R(BY,3,0), R(RY,3,0), R(BZ,0,0), R(BZ,2,2), R(RZ,3,0), R(GY,4,4), R(BZ,3,3) },
+        { R(RW,9,0), R(GW,9,0), R(BW,9,0), R(RX,3,0), R(RW,10,10), R(BY,4,4), R(GY,3,0), R(GX,3,0), R(GW,10,10), R(BZ,0,0),
+          R(GZ,3,0), R(BX,4,0), R(BW,10,10), R(BY,3,0), R(RY,3,0), R(BZ,1,1), R(BZ,2,2), R(RZ,3,0), R(BZ,4,4), R(BZ,3,3) },
+        { R(RW,8,0), R(BY,4,4), R(GW,8,0), R(GY,4,4), R(BW,8,0), R(BZ,4,4), R(RX,4,0), R(GZ,4,4), R(GY,3,0), R(GX,4,0),
+          R(BZ,0,0), R(GZ,3,0), R(BX,4,0), R(BZ,1,1), R(BY,3,0), R(RY,4,0), R(BZ,2,2), R(RZ,4,0), R(BZ,3,3) },
+        { R(RW,7,0), R(GZ,4,4), R(BY,4,4), R(GW,7,0), R(BZ,2,2), R(GY,4,4), R(BW,7,0), R(BZ,3,3), R(BZ,4,4), R(RX,5,0),
+          R(GY,3,0), R(GX,4,0), R(BZ,0,0), R(GZ,3,0), R(BX,4,0), R(BZ,1,1), R(BY,3,0), R(RY,5,0), R(RZ,5,0) },
+        { R(RW,7,0), R(BZ,0,0), R(BY,4,4), R(GW,7,0), R(GY,5,5), R(GY,4,4), R(BW,7,0), R(GZ,5,5), R(BZ,4,4), R(RX,4,0),
+          R(GZ,4,4), R(GY,3,0), R(GX,5,0), R(GZ,3,0), R(BX,4,0), R(BZ,1,1), R(BY,3,0), R(RY,4,0), R(BZ,2,2), R(RZ,4,0),
+          R(BZ,3,3) },
+        { R(RW,7,0), R(BZ,1,1), R(BY,4,4), R(GW,7,0), R(BY,5,5), R(GY,4,4), R(BW,7,0), R(BZ,5,5), R(BZ,4,4), R(RX,4,0),
+          R(GZ,4,4), R(GY,3,0), R(GX,4,0), R(BZ,0,0), R(GZ,3,0), R(BX,5,0), R(BY,3,0), R(RY,4,0), R(BZ,2,2), R(RZ,4,0),
+          R(BZ,3,3) },
+        { R(RW,5,0), R(GZ,4,4), R(BZ,0,0), R(BZ,1,1), R(BY,4,4), R(GW,5,0), R(GY,5,5), R(BY,5,5), R(BZ,2,2), R(GY,4,4),
+          R(BW,5,0), R(GZ,5,5), R(BZ,3,3), R(BZ,5,5), R(BZ,4,4), R(RX,5,0), R(GY,3,0), R(GX,5,0), R(GZ,3,0), R(BX,5,0),
+          R(BY,3,0), R(RY,5,0), R(RZ,5,0) },
+        { R(RW,9,0), R(GW,9,0), R(BW,9,0), R(RX,9,0), R(GX,9,0), R(BX,9,0) },
+        { R(RW,9,0), R(GW,9,0), R(BW,9,0), R(RX,8,0), R(RW,10,10), R(GX,8,0), R(GW,10,10), R(BX,8,0), R(BW,10,10) },
+        { R(RW,9,0), R(GW,9,0), R(BW,9,0), R(RX,7,0), REV(RW,10,11), R(GX,7,0), REV(GW,10,11), R(BX,7,0), REV(BW,10,11) },
+        { R(RW,9,0), R(GW,9,0), R(BW,9,0), R(RX,3,0), REV(RW,10,15), R(GX,3,0), REV(GW,10,15), R(BX,3,0), REV(BW,10,15) },
+    };
+#undef R
+#undef REV
+    // Per mode: 5 bit mode value (2 bit for the first two), endpoint bits, delta bits of R, G and B,
+    // transformed endpoints:
+    static const uint8_t modes[14][6] = {
+        { 0x00, 10, 5, 5, 5, 1 }, { 0x01,  7, 6, 6, 6, 1 }, { 0x02, 11, 5, 4, 4, 1 }, { 0x06, 11, 4, 5, 4, 1 },
+        { 0x0a, 11, 4, 4, 5, 1 }, { 0x0e,  9, 5, 5, 5, 1 }, { 0x12,  8, 6, 5, 5, 1 }, { 0x16,  8, 5, 6, 5, 1 },
+        { 0x1a,  8, 5, 5, 6, 1 }, { 0x1e,  6, 6, 6, 6, 0 }, { 0x03, 10, 10, 10, 10, 0 }, { 0x07, 11, 9, 9, 9, 1 },
+        { 0x0b, 12, 8, 8, 8, 1 }, { 0x0f, 16, 4, 4, 4, 1 },
+    };
+    struct ktx_bits bits = { block, 0 };
+    uint32_t fields[12] = { 0 };
+    int32_t endpoints[4][3];
+    uint8_t indices[16];
+    const uint8_t *m;
+    const uint8_t *weights;
+    int mode, subsets, partition = 0, i, c, r;
+
+    mode = ktx_bits_get(&bits, 2);
+    if (mode < 2) {
+        m = modes[mode];
+    }
+    else {
+        mode |= ktx_bits_get(&bits, 3) << 2;
+        for (i = 2; i < 14 && modes[i][0] != mode; i++);
+
+        // Reserved modes decode to black:
+        if (i == 14) {
+            for (i = 0; i < 16; i++) {
+                texels[i][0] = texels[i][1] = texels[i][2] = 0;
+                texels[i][3] = 0x3c00;
+            }
+            return;
+        }
+
+        m = modes[i];
+        mode = i;
+    }
+
+    for (r = 0; r < 24 && layouts[mode][r].count; r++) {
+        const struct ktx_bc6h_run *run = &layouts[mode][r];
+
+        if (run->count > 0) {
+            fields[run->field] |= ktx_bits_get(&bits, run->count) << run->shift;
+        }
+        else {
+            // Bit reversed, the first bit read is the highest one:
+            for (i = -run->count - 1; i >= 0; i--)
+                fields[run->field] |= ktx_bits_get(&bits, 1) << (run->shift + i);
+        }
+    }
+
+    subsets = (mode < 10) ? 2 : 1;
+    if (subsets == 2)
+        partition = ktx_bits_get(&bits, 5);
+
+    // Undo the delta encoding and sign extend, then unquantize to 16 bits:
+    for (c = 0; c < 3; c++) {
+        int epb = m[1];
+        int db = m[2 + c];
+
+        for (i = 0; i < 2 * subsets; i++) {
+            uint32_t v = fields[4 * c + i];
+            int32_t e;
+
+            if (i > 0 && m[5]) {
+                e = ((int32_t) fields[4 * c] + ktx_sign_extend(v, db)) & ((1 << epb) - 1);
+                e = is_signed ? ktx_sign_extend((uint32_t) e, epb) : e;
+            }
+            else {
+                e = is_signed ? ktx_sign_extend(v, epb) : (int32_t) v;
+            }
+
+            if (!is_signed) {
+                if (epb >= 15)
+                    ;
+                else if (e == 0)
+                    ;
+                else if (e == (1 << epb) - 1)
+                    e = 0xffff;
+                else
+                    e = ((e << 16) + 0x8000) >> epb;
+            }
+            else if (epb < 16) {
+                int s = e < 0;
+
+                e = s ? -e : e;
+                if (e == 0)
+                    ;
+                else if (e >= (1 << (epb - 1)) - 1)
+                    e = 0x7fff;
+                else
+                    e = ((e << 15) + 0x4000) >> (epb - 1);
+                e = s ? -e : e;
+            }
+
+            endpoints[i][c] = e;
+        }
+    }
+
+    ktx_read_indices(&bits, (subsets == 2) ? 3 : 4, subsets, partition, indices);
+    weights = ktx_weights((subsets == 2) ? 3 : 4);
+
+    // Interpolate and scale to the half float bit pattern:
+    for (i = 0; i < 16; i++) {
+        const int32_t *e0 = endpoints[2 * ktx_subset(subsets, partition, i)];
+        const int32_t *e1 = endpoints[2 * ktx_subset(subsets, partition, i) + 1];
+        int w = weights[indices[i]];
+
+        for (c = 0; c < 3; c++) {
+            int32_t v = (e0[c] * (64 - w) + e1[c] * w + 32) >> 6;
+
+            if (!is_signed)
+                texels[i][c] = (uint16_t) ((v * 31) >> 6);
+            else if (v < 0)
+                texels[i][c] = (uint16_t) (0x8000 | (((-v) * 31) >> 5));
+            else
+                texels[i][c] = (uint16_t) ((v * 31) >> 5);
+        }
+
+        texels[i][3] = 0x3c00;
+    }
+}
+
+// Decode a mip level into RGBA8 or RGBA16F texels, see ktx_decoded_texel_size(), at the given
+// row pitch. Returns false for formats without a cpu decoder:
+static bool ktx_decode_level(const struct ktx_texture *tex, uint32_t level, void *dst, size_t rowPitch)
+{
+    const struct ktx_level *l = &tex->levels[level];
+    size_t texel_size = ktx_decoded_texel_size(tex);
+    const uint8_t *block = l->data;
+    uint32_t bx, by, x, y;
+
+    if (!texel_size || level >= tex->level_count)
+        return false;
+
+    for (by = 0; by < l->height; by += 4) {
+        for (bx = 0; bx < l->width; bx += 4, block += 16) {
+            uint16_t texels16[16][4];
+            uint8_t texels8[16][4];
+            const uint8_t *src = (texel_size == 4) ? &texels8[0][0] : (const uint8_t *) &texels16[0][0];
+
+            if (texel_size == 4)
+                ktx_decode_bc7_block(block, texels8);
+            else
+                ktx_decode_bc6h_block(block, tex->vk_format == KTX_FORMAT_BC6H_SFLOAT, texels16);
+
+            // Clip the blocks at the right and bottom edge:
+            for (y = 0; y < 4 && by + y < l->height; y++) {
+                x = (l->width - bx < 4) ? l->width - bx : 4;
+                memcpy((uint8_t *) dst + (by + y) * rowPitch + bx * texel_size, src + y * 4 * texel_size, x * texel_size);
+            }
+        }
+    }
+
+    return true;
+}
+
+#endif
@@ -0,0 +1,832 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Loader for binary PPM (P6) images, as used for stimuli, and for high bit depth HDR
+ * stimuli in 16 bit PPM, PFM float and a raw half float container:
+ *
+ * ppm_open() memory maps the file via ppm_map(), which other loaders like ktx.h share,
+ * and parses the header once, with comments allowed anywhere the Netpbm spec allows
+ * them. ppm_copy_rgba() then expands the RGB pixels straight from the mapping into
+ * RGBA8 with opaque alpha, at any row pitch, e.g., into a mapped linear Vulkan image.
+ * The expansion has a scalar reference implementation, and SSSE3 and AVX2 variants
+ * which use byte shuffles. ppm_get_kernels() returns the fastest variant the cpu
+ * supports. ppm_copy_rgba16f() decodes any of the formats into RGBA16F instead.
+ *
+ * ppm_cache_get() decodes each file only once into a 64 byte aligned RGBA8 buffer,
+ * keyed by path, modification time and size, and hands out views of it, so Vulkan
+ * and OpenGL uploads of the same image share one decode.
+ */
+
+#ifndef PPM_H
+#define PPM_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "hdrtransfer.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PPM_X86 1
+#include <immintrin.h>
+#define PPM_TARGET(t) __attribute__((target(t)))
+#endif
+
+// Largest width or height accepted, so byte counts can't overflow:
+#define PPM_MAX_DIM 65536
+
+typedef void (*ppm_kernel)(const uint8_t *rgb, uint8_t *rgba, size_t n);
+
+struct ppm_kernels {
+    const char *name;
+    ppm_kernel rgb_to_rgba;
+};
+
+// Pixel formats of the files:
+enum ppm_format {
+    PPM_FORMAT_RGB8,    // P6, maxval 255.
+    PPM_FORMAT_RGB16,   // P6, maxval 256 - 65535, 16 bit big endian samples.
+    PPM_FORMAT_PFM,     // PF (RGB) or Pf (gray) 32 bit float, rows bottom to top.
+    PPM_FORMAT_HALF,    // PH, our raw half float container, see ppm_parse_header().
+};
+
+struct ppm_image {
+    int32_t width;
+    int32_t height;
+    int maxval;
+    enum ppm_format format;
+    int channels;
+    bool little_endian;
+
+    // First pixel, rows of width * channels samples without padding:
+    const uint8_t *pixels;
+
+    // The whole file:
+    const uint8_t *data;
+    size_t size;
+#if defined(_WIN32)
+    HANDLE file, mapping;
+#endif
+};
+
+static bool ppm_isspace(uint8_t c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// Skip whitespace and comments:
+static size_t ppm_skip(const uint8_t *data, size_t len, size_t pos)
+{
+    for (;;) {
+        while (pos < len && ppm_isspace(data[pos]))
+            pos++;
+
+        if (pos >= len || data[pos] != '#')
+            return pos;
+
+        while (pos < len && data[pos] != '\n' && data[pos] != '\r')
+            pos++;
+    }
+}
+
+// Skip whitespace and comments, then parse a decimal number. Returns the offset behind it, or 0:
+static size_t ppm_parse_int(const uint8_t *data, size_t len, size_t pos, int32_t *value)
+{
+    int64_t v = 0;
+    size_t start;
+
+    pos = ppm_skip(data, len, pos);
+
+    for (start = pos; pos < len && data[pos] >= '0' && data[pos] <= '9' && pos - start < 9; pos++)
+        v = v * 10 + (data[pos] - '0');
+
+    if (pos == start || (pos < len && !ppm_isspace(data[pos]) && data[pos] != '#'))
+        return 0;
+
+    *value = (int32_t) v;
+    return pos;
+}
+
+// Same for a floating point number, e.g., the scale of a PFM:
+static size_t ppm_parse_float(const uint8_t *data, size_t len, size_t pos, float *value)
+{
+    char text[32];
+    char *end;
+    size_t n = 0;
+
+    pos = ppm_skip(data, len, pos);
+
+    while (pos + n < len && n < sizeof(text) - 1 && !ppm_isspace(data[pos + n]))
+        n++;
+
+    memcpy(text, data + pos, n);
+    text[n] = 0;
+    *value = strtof(text, &end);
+
+    if (n == 0 || *end)
+        return 0;
+
+    return pos + n;
+}
+
+// Bytes per pixel of a file:
+static size_t ppm_pixel_size(const struct ppm_image *img)
+{
+    switch (img->format) {
+        case PPM_FORMAT_RGB8:
+            return 3;
+        case PPM_FORMAT_RGB16:
+            return 6;
+        case PPM_FORMAT_PFM:
+            return 4 * img->channels;
+        case PPM_FORMAT_HALF:
+        default:
+            return 2 * img->channels;
+    }
+}
+
+// Parse the header. Returns the offset of the first pixel, or 0 if this is no supported file:
+//
+// P6 <width> <height> <maxval>, with 8 bit samples for maxval 255, 16 bit big endian otherwise.
+// PF or Pf <width> <height> <scale>, RGB or gray 32 bit floats, little endian if scale < 0.
+// The magnitude of scale is ignored, rows are bottom to top.
+// PH <width> <height> <channels>, 3 = RGB or 4 = RGBA, 16 bit little endian half floats, rows
+// top to bottom. This is no standard format, but the simplest container for half float images.
+static size_t ppm_parse_header(const uint8_t *data, size_t len, struct ppm_image *img)
+{
+    int32_t maxval = 0, channels = 3;
+    float scale = 1;
+    size_t pos;
+
+    if (len < 3 || data[0] != 'P')
+        return 0;
+
+    switch (data[1]) {
+        case '6':
+            img->format = PPM_FORMAT_RGB8;
+            break;
+        case 'F':
+        case 'f':
+            img->format = PPM_FORMAT_PFM;
+            channels = (data[1] == 'F') ? 3 : 1;
+            break;
+        case 'H':
+            img->format = PPM_FORMAT_HALF;
+            break;
+        default:
+            return 0;
+    }
+
+    if (!(pos = ppm_parse_int(data, len, 2, &img->width)) ||
+        !(pos = ppm_parse_int(data, len, pos, &img->height)))
+        return 0;
+
+    if ((img->format == PPM_FORMAT_RGB8 && !(pos = ppm_parse_int(data, len, pos, &maxval))) ||
+        (img->format == PPM_FORMAT_PFM && !(pos = ppm_parse_float(data, len, pos, &scale))) ||
+        (img->format == PPM_FORMAT_HALF && !(pos = ppm_parse_int(data, len, pos, &channels))))
+        return 0;
+
+    // Exactly one whitespace character separates the header from the pixels:
+    if (pos >= len || !ppm_isspace(data[pos]))
+        return 0;
+    pos++;
+
+    if (img->width <= 0 || img->height <= 0 || img->width > PPM_MAX_DIM || img->height > PPM_MAX_DIM)
+        return 0;
+
+    if (img->format == PPM_FORMAT_RGB8) {
+        if (maxval > 255 && maxval <= 65535)
+            img->format = PPM_FORMAT_RGB16;
+        else if (maxval != 255)
+            return 0;
+    }
+
+    if (img->format == PPM_FORMAT_HALF && channels != 3 && channels != 4)
+        return 0;
+
+    img->maxval = maxval;
+    img->channels = channels;
+    img->little_endian = (img->format == PPM_FORMAT_HALF) || (img->format == PPM_FORMAT_PFM && scale < 0);
+
+    return pos;
+}
+
+static void ppm_close(struct ppm_image *img)
+{
+#if defined(_WIN32)
+    if (img->data)
+        UnmapViewOfFile(img->data);
+    if (img->mapping)
+        CloseHandle(img->mapping);
+    if (img->file != INVALID_HANDLE_VALUE)
+        CloseHandle(img->file);
+#else
+    if (img->data)
+        munmap((void *) img->data, img->size);
+#endif
+
+    memset(img, 0, sizeof(*img));
+#if defined(_WIN32)
+    img->file = INVALID_HANDLE_VALUE;
+#endif
+}
+
+// Map a file read-only into img->data and img->size, without looking at its contents. If all
+// of it will be read, populate the mapping up front, which avoids one page fault per 4 KB page
+// later on:
+static bool ppm_map(const char *path, struct ppm_image *img, bool populate)
+{
+    memset(img, 0, sizeof(*img));
+
+#if defined(_WIN32)
+    LARGE_INTEGER size;
+
+    (void) populate;
+
+    img->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (img->file == INVALID_HANDLE_VALUE)
+        return false;
+
+    if (!GetFileSizeEx(img->file, &size) || size.QuadPart == 0 || (uint64_t) size.QuadPart > SIZE_MAX) {
+        ppm_close(img);
+        return false;
+    }
+    img->size = (size_t) size.QuadPart;
+
+    img->mapping = CreateFileMappingA(img->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (img->mapping)
+        img->data = MapViewOfFile(img->mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+    struct stat st;
+    int flags = MAP_PRIVATE;
+    void *map;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    if (fstat(fd, &st) || st.st_size <= 0) {
+        close(fd);
+        return false;
+    }
+    img->size = (size_t) st.st_size;
+
+#if defined(MAP_POPULATE)
+    if (populate)
+        flags |= MAP_POPULATE;
+#else
+    (void) populate;
+#endif
+
+    // The mapping stays valid after the fd is closed:
+    map = mmap(NULL, img->size, PROT_READ, flags, fd, 0);
+    close(fd);
+
+    if (map != MAP_FAILED) {
+        img->data = map;
+        madvise(map, img->size, MADV_SEQUENTIAL);
+    }
+#endif
+
+    if (!img->data) {
+        ppm_close(img);
+        return false;
+    }
+
+    return true;
+}
+
+// Map a PPM file read-only and parse its header:
+static bool ppm_open(const char *path, struct ppm_image *img, bool populate)
+{
+    size_t offset;
+
+    if (!ppm_map(path, img, populate))
+        return false;
+
+    offset = ppm_parse_header(img->data, img->size, img);
+    if (!offset || img->size - offset < (size_t) img->width * img->height * ppm_pixel_size(img)) {
+        ppm_close(img);
+        return false;
+    }
+
+    img->pixels = img->data + offset;
+
+    return true;
+}
+
+// Advance to the next image of a file with several concatenated images, as Netpbm allows,
+// e.g., the frames of a movie. Returns false after the last one:
+static bool ppm_next(struct ppm_image *img)
+{
+    size_t pos = (size_t) (img->pixels - img->data) + (size_t) img->width * img->height * ppm_pixel_size(img);
+    size_t offset;
+
+    while (pos < img->size && ppm_isspace(img->data[pos]))
+        pos++;
+
+    if (pos >= img->size)
+        return false;
+
+    offset = ppm_parse_header(img->data + pos, img->size - pos, img);
+    if (!offset || img->size - pos - offset < (size_t) img->width * img->height * ppm_pixel_size(img))
+        return false;
+
+    img->pixels = img->data + pos + offset;
+
+    return true;
+}
+
+// Restart at the first image:
+static bool ppm_rewind(struct ppm_image *img)
+{
+    size_t offset = ppm_parse_header(img->data, img->size, img);
+
+    if (!offset)
+        return false;
+
+    img->pixels = img->data + offset;
+
+    return true;
+}
+
+// Scalar reference, one pixel at a time:
+static void ppm_rgb_to_rgba_scalar(const uint8_t *rgb, uint8_t *rgba, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        rgba[4 * i + 0] = rgb[3 * i + 0];
+        rgba[4 * i + 1] = rgb[3 * i + 1];
+        rgba[4 * i + 2] = rgb[3 * i + 2];
+        rgba[4 * i + 3] = 255;
+    }
+}
+
+#ifdef PPM_X86
+// SSSE3: 16 pixels from three 16 byte loads, realigned with palignr, then each group of
+// 4 pixels spread out to 4 bytes per pixel with pshufb, zero in alpha, which gets or'ed in:
+PPM_TARGET("ssse3") static void ppm_rgb_to_rgba_ssse3(const uint8_t *rgb, uint8_t *rgba, size_t n)
+{
+    const __m128i shuf = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i alpha = _mm_set1_epi32((int) 0xff000000);
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        const uint8_t *s = rgb + 3 * i;
+        __m128i *d = (__m128i *) (rgba + 4 * i);
+        __m128i a = _mm_loadu_si128((const __m128i *) s);
+        __m128i b = _mm_loadu_si128((const __m128i *) (s + 16));
+        __m128i c = _mm_loadu_si128((const __m128i *) (s + 32));
+
+        _mm_storeu_si128(d + 0, _mm_or_si128(_mm_shuffle_epi8(a, shuf), alpha));
+        _mm_storeu_si128(d + 1, _mm_or_si128(_mm_shuffle_epi8(_mm_alignr_epi8(b, a, 12), shuf), alpha));
+        _mm_storeu_si128(d + 2, _mm_or_si128(_mm_shuffle_epi8(_mm_alignr_epi8(c, b, 8), shuf), alpha));
+        _mm_storeu_si128(d + 3, _mm_or_si128(_mm_shuffle_epi8(_mm_srli_si128(c, 4), shuf), alpha));
+    }
+
+    // 4 pixels from one 16 byte load, as long as that doesn't read beyond the last pixel:
+    for (; i + 6 <= n; i += 4)
+        _mm_storeu_si128((__m128i *) (rgba + 4 * i),
+                         _mm_or_si128(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (rgb + 3 * i)), shuf), alpha));
+
+    ppm_rgb_to_rgba_scalar(rgb + 3 * i, rgba + 4 * i, n - i);
+}
+
+// AVX2: 8 pixels from one 32 byte load. vpermd moves bytes 0 - 15 into the low and bytes
+// 12 - 27 into the high 128 bit lane, so the in-lane vpshufb can use the SSSE3 shuffle:
+PPM_TARGET("avx2") static void ppm_rgb_to_rgba_avx2(const uint8_t *rgb, uint8_t *rgba, size_t n)
+{
+    const __m256i perm = _mm256_setr_epi32(0, 1, 2, 3, 3, 4, 5, 6);
+    const __m256i shuf = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+                                          0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m256i alpha = _mm256_set1_epi32((int) 0xff000000);
+    size_t i = 0;
+
+    // Each load reads 8 bytes beyond its 8 pixels, so the last 3 pixels are left to the tail:
+    for (; i + 11 <= n; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (rgb + 3 * i));
+
+        v = _mm256_permutevar8x32_epi32(v, perm);
+        _mm256_storeu_si256((__m256i *) (rgba + 4 * i), _mm256_or_si256(_mm256_shuffle_epi8(v, shuf), alpha));
+    }
+
+    ppm_rgb_to_rgba_ssse3(rgb + 3 * i, rgba + 4 * i, n - i);
+}
+#endif
+
+// Kernel variants by level: 0 = scalar reference, 1 = SSSE3, 2 = AVX2.
+static inline struct ppm_kernels ppm_get_kernels_level(int level)
+{
+    struct ppm_kernels k = { "scalar", ppm_rgb_to_rgba_scalar };
+
+#ifdef PPM_X86
+    __builtin_cpu_init();
+
+    if (level >= 1 && __builtin_cpu_supports("ssse3")) {
+        k.name = "SSSE3";
+        k.rgb_to_rgba = ppm_rgb_to_rgba_ssse3;
+    }
+
+    if (level >= 2 && __builtin_cpu_supports("avx2")) {
+        k.name = "AVX2";
+        k.rgb_to_rgba = ppm_rgb_to_rgba_avx2;
+    }
+#else
+    (void) level;
+#endif
+
+    return k;
+}
+
+// Fastest kernels for this cpu:
+static inline struct ppm_kernels ppm_get_kernels(void)
+{
+    return ppm_get_kernels_level(2);
+}
+
+// Expand all pixels of an 8 bpc image to RGBA8 into dst, with rows rowPitch bytes apart. Tightly packed
+// destinations are expanded in one go, otherwise row by row:
+static void ppm_copy_rgba(const struct ppm_image *img, uint8_t *dst, size_t rowPitch, ppm_kernel kernel)
+{
+    size_t w = (size_t) img->width;
+    int32_t y;
+
+    if (rowPitch == 4 * w) {
+        kernel(img->pixels, dst, w * img->height);
+        return;
+    }
+
+    for (y = 0; y < img->height; y++)
+        kernel(img->pixels + y * 3 * w, dst + y * rowPitch, w);
+}
+
+// Decode all pixels of an 8 or 16 bpc image into A2B10G10R10, ie. red in the lowest bits, with
+// opaque alpha and rows rowPitch bytes apart. Samples are rounded to the nearest 10 bit value
+// via tables, so no per sample division is needed. 8 bpc tables are per channel and pre-shifted:
+static bool ppm_copy_rgb10a2(const struct ppm_image *img, uint32_t *dst, size_t rowPitch)
+{
+    const size_t w = (size_t) img->width;
+    const size_t srcPitch = w * ppm_pixel_size(img);
+    const uint32_t maxval = (img->format == PPM_FORMAT_RGB8) ? 255 : (uint32_t) img->maxval;
+    uint32_t lut8[3][256];
+    uint16_t *lut16 = NULL;
+    uint32_t s;
+    int32_t y;
+    size_t x;
+
+    if (img->format == PPM_FORMAT_RGB8) {
+        for (s = 0; s < 256; s++) {
+            const uint32_t v = (s * 1023 + 127) / 255;
+
+            lut8[0][s] = 3u << 30 | v;
+            lut8[1][s] = v << 10;
+            lut8[2][s] = v << 20;
+        }
+    }
+    else if (img->format == PPM_FORMAT_RGB16) {
+        // Samples can exceed maxval in malformed files, so cover all of them:
+        lut16 = malloc(65536 * sizeof(uint16_t));
+        if (!lut16)
+            return false;
+
+        for (s = 0; s < 65536; s++)
+            lut16[s] = (uint16_t) ((s > maxval) ? 1023 : (s * 1023 + maxval / 2) / maxval);
+    }
+    else {
+        return false;
+    }
+
+    for (y = 0; y < img->height; y++) {
+        const uint8_t *src = img->pixels + y * srcPitch;
+        uint32_t *out = (uint32_t *) ((uint8_t *) dst + y * rowPitch);
+
+        if (lut16) {
+            for (x = 0; x < w; x++)
+                out[x] = 3u << 30 | (uint32_t) lut16[src[6 * x + 4] << 8 | src[6 * x + 5]] << 20 |
+                         (uint32_t) lut16[src[6 * x + 2] << 8 | src[6 * x + 3]] << 10 |
+                         lut16[src[6 * x] << 8 | src[6 * x + 1]];
+        }
+        else {
+            for (x = 0; x < w; x++)
+                out[x] = lut8[0][src[3 * x]] | lut8[1][src[3 * x + 1]] | lut8[2][src[3 * x + 2]];
+        }
+    }
+
+    free(lut16);
+
+    return true;
+}
+
+static uint32_t ppm_load32(const uint8_t *p, bool little_endian)
+{
+    return little_endian ? (uint32_t) p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24 :
+                           (uint32_t) p[3] | (uint32_t) p[2] << 8 | (uint32_t) p[1] << 16 | (uint32_t) p[0] << 24;
+}
+
+// Decode all pixels of any format into RGBA16F with opaque alpha, rows top to bottom and
+// rowPitch bytes apart, e.g., into a mapped pixel buffer object. Integer samples are normalized
+// to 0 - 1, float samples are taken as is. Each row is converted to floats in a scratch row, then
+// to half with the fastest kernel of hdrtransfer.h, or copied as is for RGBA half files. Returns
+// the maximum and the average of max(R, G, B) over all pixels, as needed for MaxCLL and MaxFALL:
+static bool ppm_copy_rgba16f(const struct ppm_image *img, uint16_t *dst, size_t rowPitch,
+                             float *maxrgb, float *avgrgb)
+{
+    static const uint16_t one = 1;
+    const bool host_little_endian = *(const uint8_t *) &one == 1;
+    const struct tf_kernels k = tf_get_kernels();
+    const size_t w = (size_t) img->width;
+    const size_t srcPitch = w * ppm_pixel_size(img);
+    float *row = malloc(w * 4 * sizeof(float));
+    double sum = 0;
+    float max = 0;
+    int32_t y;
+    size_t x;
+    int c;
+
+    if (!row)
+        return false;
+
+    for (y = 0; y < img->height; y++) {
+        // PFM rows are stored bottom to top:
+        const uint8_t *src = img->pixels + srcPitch * ((img->format == PPM_FORMAT_PFM) ? img->height - 1 - y : y);
+        uint16_t *out = (uint16_t *) ((uint8_t *) dst + y * rowPitch);
+        bool direct = false;
+
+        switch (img->format) {
+            case PPM_FORMAT_RGB8:
+                for (x = 0; x < w; x++) {
+                    for (c = 0; c < 3; c++)
+                        row[4 * x + c] = src[3 * x + c] * (1.0f / 255.0f);
+                    row[4 * x + 3] = 1;
+                }
+                break;
+
+            case PPM_FORMAT_RGB16: {
+                const float scale = 1.0f / img->maxval;
+
+                for (x = 0; x < w; x++) {
+                    for (c = 0; c < 3; c++)
+                        row[4 * x + c] = ((src[6 * x + 2 * c] << 8) | src[6 * x + 2 * c + 1]) * scale;
+                    row[4 * x + 3] = 1;
+                }
+                break;
+            }
+
+            case PPM_FORMAT_PFM:
+                for (x = 0; x < w; x++) {
+                    for (c = 0; c < 3; c++) {
+                        uint32_t bits = ppm_load32(src + 4 * (x * img->channels + ((img->channels == 3) ? c : 0)),
+                                                   img->little_endian);
+                        memcpy(&row[4 * x + c], &bits, sizeof(float));
+                    }
+                    row[4 * x + 3] = 1;
+                }
+                break;
+
+            case PPM_FORMAT_HALF:
+                if (img->channels == 4 && host_little_endian) {
+                    // Already RGBA16F, only the statistics need floats:
+                    memcpy(out, src, w * 8);
+                    direct = true;
+                    if (maxrgb || avgrgb)
+                        k.half_to_float(out, row, w * 4);
+                }
+                else {
+                    for (x = 0; x < w; x++) {
+                        for (c = 0; c < img->channels; c++) {
+                            const uint8_t *p = src + 2 * (x * img->channels + c);
+                            uint16_t h = (uint16_t) (p[0] | p[1] << 8);
+                            row[4 * x + c] = tf_half_to_float_ref(h);
+                        }
+                        if (img->channels == 3)
+                            row[4 * x + 3] = 1;
+                    }
+                }
+                break;
+        }
+
+        if (maxrgb || avgrgb) {
+            for (x = 0; x < w; x++) {
+                float m = row[4 * x];
+
+                if (row[4 * x + 1] > m)
+                    m = row[4 * x + 1];
+                if (row[4 * x + 2] > m)
+                    m = row[4 * x + 2];
+                // NaN's and negatives don't count:
+                if (!(m > 0))
+                    continue;
+                if (m > max)
+                    max = m;
+                sum += m;
+            }
+        }
+
+        if (!direct)
+            k.float_to_half(row, out, w * 4);
+    }
+
+    free(row);
+
+    if (maxrgb)
+        *maxrgb = max;
+    if (avgrgb)
+        *avgrgb = (float) (sum / ((double) w * img->height));
+
+    return true;
+}
+
+// Read-only view of a decoded image in the cache, RGBA8, rows rowPitch bytes apart:
+struct ppm_view {
+    const uint8_t *pixels;
+    int32_t width;
+    int32_t height;
+    size_t rowPitch;
+};
+
+struct ppm_cache_entry {
+    char *path;
+    uint64_t mtime;
+    uint64_t size;
+    bool stale;
+    struct ppm_view view;
+};
+
+// The cache. Stale entries, whose file changed, are kept until ppm_cache_flush(), so all
+// views stay valid until then. Not thread safe:
+static struct {
+    struct ppm_cache_entry *entries;
+    int count;
+    int decodes;
+    int hits;
+} ppm_cache;
+
+// Modification time in nanoseconds (Linux) or 100 nanosecond units (Windows) and size of a file:
+static bool ppm_file_stamp(const char *path, uint64_t *mtime, uint64_t *size)
+{
+#if defined(_WIN32)
+    WIN32_FILE_ATTRIBUTE_DATA attr;
+
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &attr))
+        return false;
+
+    *mtime = ((uint64_t) attr.ftLastWriteTime.dwHighDateTime << 32) | attr.ftLastWriteTime.dwLowDateTime;
+    *size = ((uint64_t) attr.nFileSizeHigh << 32) | attr.nFileSizeLow;
+#else
+    struct stat st;
+
+    if (stat(path, &st))
+        return false;
+
+#if defined(__linux__)
+    *mtime = (uint64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#else
+    *mtime = (uint64_t) st.st_mtime * 1000000000;
+#endif
+    *size = (uint64_t) st.st_size;
+#endif
+
+    return true;
+}
+
+static void *ppm_aligned_alloc(size_t size)
+{
+#if defined(_WIN32)
+    return _aligned_malloc(size, 64);
+#else
+    void *p;
+
+    return posix_memalign(&p, 64, size) ? NULL : p;
+#endif
+}
+
+static void ppm_aligned_free(void *p)
+{
+#if defined(_WIN32)
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+// Get a view of the decoded image, decoding the file only if it isn't cached yet, or if it
+// changed since it was decoded:
+static bool ppm_cache_get(const char *path, struct ppm_view *view)
+{
+    struct ppm_cache_entry *entry, *entries;
+    struct ppm_image img;
+    uint64_t mtime, size;
+    uint8_t *pixels;
+    int i;
+
+    if (!ppm_file_stamp(path, &mtime, &size))
+        return false;
+
+    for (i = 0; i < ppm_cache.count; i++) {
+        entry = &ppm_cache.entries[i];
+        if (entry->stale || strcmp(entry->path, path))
+            continue;
+
+        if (entry->mtime == mtime && entry->size == size) {
+            ppm_cache.hits++;
+            *view = entry->view;
+            return true;
+        }
+
+        entry->stale = true;
+    }
+
+    if (!ppm_open(path, &img, true))
+        return false;
+
+    if (img.format != PPM_FORMAT_RGB8) {
+        ppm_close(&img);
+        return false;
+    }
+
+    entries = realloc(ppm_cache.entries, (ppm_cache.count + 1) * sizeof(*entries));
+    pixels = ppm_aligned_alloc((size_t) img.width * img.height * 4);
+    if (!entries || !pixels) {
+        if (entries)
+            ppm_cache.entries = entries;
+        ppm_aligned_free(pixels);
+        ppm_close(&img);
+        return false;
+    }
+    ppm_cache.entries = entries;
+
+    ppm_copy_rgba(&img, pixels, (size_t) img.width * 4, ppm_get_kernels().rgb_to_rgba);
+
+    entry = &ppm_cache.entries[ppm_cache.count++];
+    entry->path = strdup(path);
+    entry->mtime = mtime;
+    entry->size = size;
+    entry->stale = false;
+    entry->view.pixels = pixels;
+    entry->view.width = img.width;
+    entry->view.height = img.height;
+    entry->view.rowPitch = (size_t) img.width * 4;
+    ppm_cache.decodes++;
+
+    ppm_close(&img);
+
+    *view = entry->view;
+    return true;
+}
+
+// Copy a view into dst, with rows rowPitch bytes apart:
+static void ppm_view_copy(const struct ppm_view *view, uint8_t *dst, size_t rowPitch)
+{
+    int32_t y;
+
+    if (rowPitch == view->rowPitch) {
+        memcpy(dst, view->pixels, view->rowPitch * view->height);
+        return;
+    }
+
+    for (y = 0; y < view->height; y++)
+        memcpy(dst + y * rowPitch, view->pixels + y * view->rowPitch, (size_t) view->width * 4);
+}
+
+// Free all decoded images. Invalidates all views:
+static void ppm_cache_flush(void)
+{
+    int i;
+
+    for (i = 0; i < ppm_cache.count; i++) {
+        ppm_aligned_free((void *) ppm_cache.entries[i].view.pixels);
+        free(ppm_cache.entries[i].path);
+    }
+
+    free(ppm_cache.entries);
+    memset(&ppm_cache, 0, sizeof(ppm_cache));
+}
+
+#endif // PPM_H